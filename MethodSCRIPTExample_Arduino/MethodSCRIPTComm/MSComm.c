@@ -33,11 +33,206 @@
 #include "MSComm.h"
 
 
-/// Offset value for MethodSCRIPT parameters (see the MethodSCRIPT documentation paragraph 'Measurement data package variables')
-#define MSCR_PARAM_OFFSET_VALUE 0x8000000
+// Powers of 1000 that are exact in double precision
+static const double POWERS_OF_1000[7] = { 1, 1e3, 1e6, 1e9, 1e12, 1e15, 1e18 };
 
-/// The size of the serial read buffer in bytes. This is also the maximum length of a package
-#define READ_BUFFER_LENGTH 1000
+// The descriptions of all variable types, indexed by the `MSCR_STR_TO_VT` value.
+// Entries that are not given are all zero and describe an undefined variable type.
+// The names are used in the CSV header, so they should not be changed.
+static const MscrVarTypeInfo VAR_TYPE_INFO[MSCR_VT_CNT] =
+{
+	//                              name                   label         unit   format    category             digits
+	[MSCR_VT_UNKNOWN]            = { "MSCR_VT_UNKNOWN",    NULL,         "",    "%16.3f", MSCR_VTC_UNDEFINED,  3 },
+
+	[MSCR_VT_POTENTIAL]          = { "Potential",          "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_CE]       = { "Potential_CE",       "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_SE]       = { "Potential_SE",       "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_RE]       = { "Potential_RE",       "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_WE_VS_CE] = { "Potential_WE_vs_CE", "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN0]     = { "Potential_AIN0",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN1]     = { "Potential_AIN1",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN2]     = { "Potential_AIN2",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN3]     = { "Potential_AIN3",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN4]     = { "Potential_AIN4",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN5]     = { "Potential_AIN5",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN6]     = { "Potential_AIN6",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_AIN7]     = { "Potential_AIN7",     NULL,         "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+
+	[MSCR_VT_CURRENT]            = { "Current",            "I[A]",       "A",   "%11.3E", MSCR_VTC_CURRENT,    3 },
+
+	[MSCR_VT_PHASE]              = { "Phase",              NULL,         "deg", "%16.3f", MSCR_VTC_IMPEDANCE,  3 },
+	[MSCR_VT_IMP]                = { "Imp",                NULL,         "Ohm", "%16.3f", MSCR_VTC_IMPEDANCE,  3 },
+	[MSCR_VT_ZREAL]              = { "Zreal",              "Zreal[Ohm]", "Ohm", "%16.3f", MSCR_VTC_IMPEDANCE,  3 },
+	[MSCR_VT_ZIMAG]              = { "Zimag",              "Zimag[Ohm]", "Ohm", "%16.3f", MSCR_VTC_IMPEDANCE,  3 },
+
+	[MSCR_VT_CELL_SET_POTENTIAL] = { "Cell_set_potential", "E set[V]",   "V",   "%6.3f",  MSCR_VTC_APPLIED,    3 },
+	[MSCR_VT_CELL_SET_CURRENT]   = { "Cell_set_current",   "I set[A]",   "A",   "%11.3E", MSCR_VTC_APPLIED,    3 },
+	[MSCR_VT_CELL_SET_FREQUENCY] = { "Cell_set_frequency", "F set[Hz]",  "Hz",  "%6.3E",  MSCR_VTC_APPLIED,    3 },
+	[MSCR_VT_CELL_SET_AMPLITUDE] = { "Cell_set_amplitude", "A set[V]",   "V",   "%6.3f",  MSCR_VTC_APPLIED,    2 },
+
+	[MSCR_VT_CHANNEL]            = { "Channel",            NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+	[MSCR_VT_TIME]               = { "Time",               NULL,         "s",   "%16.3f", MSCR_VTC_OTHER,      3 },
+	[MSCR_VT_PIN_MSK]            = { "Pin_msk",            NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+
+	[MSCR_VT_DEV_ADC_OFFSET]     = { "Dev_adc_offset",     NULL,         "",    "%16.3f", MSCR_VTC_DEVICE,     3 },
+	[MSCR_VT_DEV_HS_EX]          = { "Dev_hs_ex",          NULL,         "",    "%16.3f", MSCR_VTC_DEVICE,     3 },
+
+	[MSCR_VT_CURRENT_GENERIC1]   = { "Current_generic1",   "I[A]",       "A",   "%11.3E", MSCR_VTC_CURRENT,    3 },
+	[MSCR_VT_CURRENT_GENERIC2]   = { "Current_generic2",   "I[A]",       "A",   "%11.3E", MSCR_VTC_CURRENT,    3 },
+	[MSCR_VT_CURRENT_GENERIC3]   = { "Current_generic3",   "I[A]",       "A",   "%11.3E", MSCR_VTC_CURRENT,    3 },
+	[MSCR_VT_CURRENT_GENERIC4]   = { "Current_generic4",   "I[A]",       "A",   "%11.3E", MSCR_VTC_CURRENT,    3 },
+	[MSCR_VT_POTENTIAL_GENERIC1] = { "Potential_generic1", "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_GENERIC2] = { "Potential_generic2", "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_GENERIC3] = { "Potential_generic3", "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_POTENTIAL_GENERIC4] = { "Potential_generic4", "E[V]",       "V",   "%6.3f",  MSCR_VTC_POTENTIAL,  3 },
+	[MSCR_VT_MISC_GENERIC1]      = { "Misc_generic1",      NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+	[MSCR_VT_MISC_GENERIC2]      = { "Misc_generic2",      NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+	[MSCR_VT_MISC_GENERIC3]      = { "Misc_generic3",      NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+	[MSCR_VT_MISC_GENERIC4]      = { "Misc_generic4",      NULL,         "",    "%16.3f", MSCR_VTC_OTHER,      3 },
+
+	[MSCR_VT_NONE]               = { "None",               NULL,         "",    "%16.3f", MSCR_VTC_UNDEFINED,  3 },
+};
+
+// Returned by `GetVarTypeInfo()` for variable types that are not in `VAR_TYPE_INFO`
+static const MscrVarTypeInfo VAR_TYPE_UNDEFINED = { "Undefined variable type", NULL, "", "%16.3f", MSCR_VTC_UNDEFINED, 3 };
+
+// The current range names, indexed by the current range value
+static const char *const CURRENT_RANGES[] =
+{
+	"100nA", "2uA", "4uA", "8uA", "16uA", "32uA", "63uA", "125uA", "250uA", "500uA", "1mA", "15mA",
+};
+
+// The current range names of the high speed mode, indexed by the current range value - 128
+static const char *const CURRENT_RANGES_HIGH_SPEED[] =
+{
+	"100nA (High speed)", "1uA (High speed)", "6uA (High speed)", "13uA (High speed)", "25uA (High speed)",
+	"50uA (High speed)", "100uA (High speed)", "200uA (High speed)", "1mA (High speed)", "5mA (High speed)",
+};
+
+#if MSCR_HAS_EXACT_VALUES
+
+// The SI unit prefixes, the index of a prefix is its exponent (power of 1000) + 6
+static const char UNIT_PREFIXES[] = "afpnum kMGTPE";
+
+//
+// Returns the power of 1000 of an SI unit prefix, or MSCR_EXPONENT_INVALID if `charPrefix` is not a prefix
+//
+static inline int PrefixToExponent(char charPrefix)
+{
+	switch (charPrefix)
+	{
+		case 'a': return -6;
+		case 'f': return -5;
+		case 'p': return -4;
+		case 'n': return -3;
+		case 'u': return -2;
+		case 'm': return -1;
+		case ' ': return 0;
+		case 'k': return 1;
+		case 'M': return 2;
+		case 'G': return 3;
+		case 'T': return 4;
+		case 'P': return 5;
+		case 'E': return 6;
+	}
+	return MSCR_EXPONENT_INVALID;
+}
+
+//
+// Returns the prefix character of an exponent, as used by `GetUnitPrefixValue`
+//
+static inline char ExponentToPrefix(int exponent)
+{
+	return (exponent >= -6 && exponent <= 6) ? UNIT_PREFIXES[exponent + 6] : '\0';
+}
+
+#endif
+
+#if MSCR_PACKED_SUBPACKAGES
+
+//
+// Stores a value field of 7 hexadecimal digits (`rawValue`) and its SI unit prefix in a subpackage
+//
+static inline void SetSubpackageValue(MscrSubPackage *subpackage, int rawValue, char charPrefix)
+{
+	int exponent = PrefixToExponent(charPrefix);
+	subpackage->raw_value = rawValue;
+	subpackage->prefix = (exponent == MSCR_EXPONENT_INVALID) ? 15 : exponent + 6;
+}
+
+static inline void SetSubpackageStatus(MscrSubPackage *subpackage, int status)
+{
+	subpackage->status = status;
+	subpackage->flags |= MSCR_HAS_STATUS;
+}
+
+static inline void SetSubpackageCurrentRange(MscrSubPackage *subpackage, int current_range)
+{
+	subpackage->current_range = current_range;
+	subpackage->flags |= MSCR_HAS_CURRENT_RANGE;
+}
+
+static inline void ClearSubpackageMetadata(MscrSubPackage *subpackage)
+{
+	subpackage->flags = 0;
+}
+
+#elif MSCR_EXACT_VALUES
+
+//
+// Stores a value field of 7 hexadecimal digits (`rawValue`) and its SI unit prefix in a subpackage
+//
+static inline void SetSubpackageValue(MscrSubPackage *subpackage, int rawValue, char charPrefix)
+{
+	subpackage->mantissa = rawValue - MSCR_PARAM_OFFSET_VALUE;
+	subpackage->exponent = PrefixToExponent(charPrefix);
+}
+
+static inline void SetSubpackageStatus(MscrSubPackage *subpackage, int status)
+{
+	subpackage->metadata.status = status;
+}
+
+static inline void SetSubpackageCurrentRange(MscrSubPackage *subpackage, int current_range)
+{
+	subpackage->metadata.current_range = current_range;
+}
+
+static inline void ClearSubpackageMetadata(MscrSubPackage *subpackage)
+{
+	subpackage->metadata.status        = -1;
+	subpackage->metadata.current_range = -1;
+}
+
+#else
+
+//
+// Stores a value field of 7 hexadecimal digits (`rawValue`) and its SI unit prefix in a subpackage
+//
+static inline void SetSubpackageValue(MscrSubPackage *subpackage, int rawValue, char charPrefix)
+{
+	// Identical arithmetic to `GetParameterValue` so all parsers give bit-exact results
+	float parameterValue = rawValue - MSCR_PARAM_OFFSET_VALUE;
+	subpackage->value = parameterValue * GetUnitPrefixValue(charPrefix);
+}
+
+static inline void SetSubpackageStatus(MscrSubPackage *subpackage, int status)
+{
+	subpackage->metadata.status = status;
+}
+
+static inline void SetSubpackageCurrentRange(MscrSubPackage *subpackage, int current_range)
+{
+	subpackage->metadata.current_range = current_range;
+}
+
+static inline void ClearSubpackageMetadata(MscrSubPackage *subpackage)
+{
+	subpackage->metadata.status        = -1;
+	subpackage->metadata.current_range = -1;
+}
+
+#endif
 
 
 //
@@ -45,13 +240,11 @@
 //
 void reset_mscr_subpackage(MscrSubPackage *subpackage)
 {
-	subpackage->value = 0;
+	SetSubpackageValue(subpackage, MSCR_PARAM_OFFSET_VALUE, ' ');
 	subpackage->variable_type = MSCR_STR_TO_VT("aa");
 
 	// Clear metadata
-	subpackage->metadata.status        = -1;
-	subpackage->metadata.current_range = -1;
-
+	ClearSubpackageMetadata(subpackage);
 }
 
 //
@@ -68,13 +261,66 @@ void reset_mscr_package(MscrPackage *package)
 }
 
 
+//
+// Shims that call the communication functions without context of a MSComm initialised with `MSCommInit`.
+// The context of these is the MSComm itself.
+//
+static int LegacyWriteChar(void *context, char c)
+{
+	return ((MSComm *)context)->writeCharFunc(c);
+}
+
+static int LegacyWriteBuf(void *context, const MSWriteBlock *blocks, int count)
+{
+	return ((MSComm *)context)->writeBufFunc(blocks, count);
+}
+
+static int LegacyReadChar(void *context)
+{
+	return ((MSComm *)context)->readCharFunc();
+}
+
+static int LegacyReadBuf(void *context, char *buf, int size)
+{
+	return ((MSComm *)context)->readBufFunc(buf, size);
+}
+
+static int LegacyWaitRead(void *context, int *timeout_ms)
+{
+	return ((MSComm *)context)->waitReadFunc(timeout_ms);
+}
+
+
+//
+// Sets all fields of the MSComm to their defaults, without any communication functions
+//
+static void ResetMSComm(MSComm* msComm)
+{
+	memset(&msComm->transport, 0, sizeof(msComm->transport));
+	msComm->writeCharFunc = NULL;
+	msComm->writeBufFunc = NULL;
+	msComm->readCharFunc = NULL;
+	msComm->readBufFunc = NULL;
+	msComm->waitReadFunc = NULL;
+	msComm->readTimeoutMs = -1;
+	msComm->rxPosition = 0;
+	msComm->rxLength = 0;
+	msComm->lastReply = 0;
+	ResetPackageSchema(&msComm->schema);
+}
+
+
 //
 // See documentation in MSComm.h
 //
 RetCode MSCommInit(MSComm* msComm,	WriteCharFunc writeCharFunc, ReadCharFunc readCharFunc)
 {
+	ResetMSComm(msComm);
 	msComm->writeCharFunc = writeCharFunc;			//Initializes the msComm with the function pointer to its write function
 	msComm->readCharFunc = readCharFunc;			//Initializes the msComm with the function pointer to its read function
+	msComm->transport.context = msComm;
+	msComm->transport.write_char = LegacyWriteChar;
+	msComm->transport.read_char = LegacyReadChar;
 
 	if(writeCharFunc == NULL || readCharFunc == NULL)
 	{
@@ -84,11 +330,130 @@ RetCode MSCommInit(MSComm* msComm,	WriteCharFunc writeCharFunc, ReadCharFunc rea
 }
 
 
+//
+// See documentation in MSComm.h
+//
+RetCode MSCommInitBuffered(MSComm* msComm, WriteCharFunc writeCharFunc, ReadBufFunc readBufFunc)
+{
+	ResetMSComm(msComm);
+	msComm->writeCharFunc = writeCharFunc;
+	msComm->readBufFunc = readBufFunc;				//All reads are served from `rxBuffer`, which is filled by this function
+	msComm->transport.context = msComm;
+	msComm->transport.write_char = LegacyWriteChar;
+	msComm->transport.read_buf = LegacyReadBuf;
+
+	if(writeCharFunc == NULL || readBufFunc == NULL)
+	{
+		return CODE_NULL;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+RetCode MSCommInitTransport(MSComm* msComm, const MSTransport* transport)
+{
+	ResetMSComm(msComm);
+	msComm->transport = *transport;
+
+	if(transport->write_char == NULL || (transport->read_char == NULL && transport->read_buf == NULL))
+	{
+		return CODE_NULL;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+void MSCommSetWriteBufFunc(MSComm* msComm, WriteBufFunc writeBufFunc)
+{
+	msComm->writeBufFunc = writeBufFunc;
+	msComm->transport.write_buf = (writeBufFunc != NULL) ? LegacyWriteBuf : NULL;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+void MSCommSetReadTimeout(MSComm* msComm, WaitReadFunc waitReadFunc, int timeoutMs)
+{
+	msComm->waitReadFunc = waitReadFunc;
+	msComm->transport.wait_read = (waitReadFunc != NULL) ? LegacyWaitRead : NULL;
+	msComm->readTimeoutMs = timeoutMs;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+void MSCommSetReadDeadline(MSComm* msComm, int timeoutMs)
+{
+	msComm->readTimeoutMs = timeoutMs;
+}
+
+
+//
+// Waits until the next character can be read.
+// `remainingMs` is the time left until the deadline of the current read call, it is updated by the wait function.
+// Returns CODE_OK if a character might be available, CODE_TIMEOUT if the deadline passed or CODE_ERROR on failure.
+//
+static RetCode WaitForChar(MSComm* msComm, int* remainingMs)
+{
+	if (msComm->rxPosition < msComm->rxLength)
+		return CODE_OK;							//The receive buffer still has characters, so there is nothing to wait for
+	if (msComm->transport.wait_read == NULL)
+		return CODE_OK;							//Nothing to wait with, so keep polling the read function
+
+	int ready = msComm->transport.wait_read(msComm->transport.context, remainingMs);
+	if (ready > 0)
+		return CODE_OK;
+	return (ready == 0) ? CODE_TIMEOUT : CODE_ERROR;
+}
+
+
+//
+// Reads the next character from the receive buffer, refilling it with one call to read_buf when empty.
+// If the transport has no read_buf, read_char is called instead.
+// Returns the value of the byte (0-255), or -1 if no character was available or on failure.
+// -1 is only returned when the receive buffer is empty, so the caller can wait for the transport.
+//
+static int ReadNextChar(MSComm* msComm)
+{
+	if (msComm->transport.read_buf == NULL)
+	{
+		//A ReadCharFunc returns 0 if no character was available, -1 on failure and
+		//the character otherwise, which is negative for bytes >= 0x80 if char is signed
+		int c = msComm->transport.read_char(msComm->transport.context);
+		return (c == 0 || c == -1) ? -1 : (unsigned char)c;
+	}
+
+	if (msComm->rxPosition >= msComm->rxLength)
+	{
+		int n = msComm->transport.read_buf(msComm->transport.context, msComm->rxBuffer, MSCOMM_RX_BUFFER_LENGTH);
+		if (n <= 0)
+			return -1;
+		msComm->rxPosition = 0;
+		msComm->rxLength = n;
+	}
+	return (unsigned char)msComm->rxBuffer[msComm->rxPosition++];
+}
+
+
 //
 // See documentation in MSComm.h
 //
 void WriteStr(MSComm* msComm, const char* buf)
 {
+	if (msComm->transport.write_buf != NULL)
+	{
+		MSWriteBlock block = { buf, (int)strlen(buf) };
+		msComm->transport.write_buf(msComm->transport.context, &block, 1);		//Writes the complete string at once
+		return;
+	}
 	while(*buf != 0)
 	{
 		WriteChar(msComm, *buf);				//Writes the input array of characters to the device
@@ -97,12 +462,102 @@ void WriteStr(MSComm* msComm, const char* buf)
 }
 
 
+//
+// Writes a list of blocks using write_buf, or per character if the transport has none
+// Returns CODE_OK if successful, otherwise CODE_ERROR.
+//
+static RetCode WriteBlocks(MSComm* msComm, const MSWriteBlock* blocks, int count)
+{
+	if (msComm->transport.write_buf != NULL)
+		return (msComm->transport.write_buf(msComm->transport.context, blocks, count) < 0) ? CODE_ERROR : CODE_OK;
+
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < blocks[i].length; j++)
+			WriteChar(msComm, blocks[i].data[j]);
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+RetCode WriteScript(MSComm* msComm, const char* script, size_t length)
+{
+	static const char newline[] = "\n";
+	const char *end = script + length;
+	const char *line;
+	MSWriteBlock blocks[MSCOMM_WRITE_BLOCKS];
+	int nrOfBlocks = 0;
+
+	// Validate the complete script first, so nothing is sent if it would be rejected halfway
+	for (line = script; line < end; )
+	{
+		const char *lineEnd = memchr(line, '\n', end - line);
+		size_t lineLength = (lineEnd != NULL) ? (size_t)(lineEnd - line) : (size_t)(end - line);
+		if (lineLength > 0 && line[lineLength - 1] == '\r')
+			lineLength--;
+		if (lineLength + 1 > MS_MAX_LINECHARS)
+			return CODE_OUT_OF_RANGE;
+		line += (lineEnd != NULL) ? (size_t)(lineEnd + 1 - line) : (size_t)(end - line);
+	}
+
+	// Collect the lines as blocks. Consecutive lines that are sent unmodified are merged into one block.
+	for (line = script; line < end; )
+	{
+		const char *lineEnd = memchr(line, '\n', end - line);
+		const char *next = (lineEnd != NULL) ? lineEnd + 1 : end;
+
+		if (line[0] != '#')
+		{
+			size_t lineLength = (lineEnd != NULL) ? (size_t)(lineEnd - line) : (size_t)(end - line);
+			int hasCR = (lineLength > 0 && line[lineLength - 1] == '\r');
+			MSWriteBlock *last = (nrOfBlocks > 0) ? &blocks[nrOfBlocks - 1] : NULL;
+
+			if (lineEnd != NULL && !hasCR)
+			{
+				// Line including its '\n' can be sent as is
+				if (last != NULL && last->data + last->length == line)
+					last->length += next - line;
+				else
+					blocks[nrOfBlocks++] = (MSWriteBlock){ line, (int)(next - line) };
+			}
+			else
+			{
+				// Leave out the '\r' or add the missing '\n' of the last line
+				if (hasCR)
+					lineLength--;
+				if (last != NULL && last->data + last->length == line)
+					last->length += lineLength;
+				else if (lineLength > 0)
+					blocks[nrOfBlocks++] = (MSWriteBlock){ line, (int)lineLength };
+				blocks[nrOfBlocks++] = (MSWriteBlock){ newline, 1 };
+			}
+		}
+
+		// A line adds at most 2 blocks, so make sure there is room for the next one
+		if (nrOfBlocks >= MSCOMM_WRITE_BLOCKS - 1)
+		{
+			if (WriteBlocks(msComm, blocks, nrOfBlocks) != CODE_OK)
+				return CODE_ERROR;
+			nrOfBlocks = 0;
+		}
+		line = next;
+	}
+
+	if (nrOfBlocks > 0 && WriteBlocks(msComm, blocks, nrOfBlocks) != CODE_OK)
+		return CODE_ERROR;
+	return CODE_OK;
+}
+
+
 //
 // See documentation in MSComm.h
 //
 void WriteChar(MSComm* msComm, char c)
 {
-	msComm->writeCharFunc(c);
+	msComm->transport.write_char(msComm->transport.context, c);
 }
 
 
@@ -112,32 +567,30 @@ void WriteChar(MSComm* msComm, char c)
 RetCode ReadBuf(MSComm* msComm, char* buf)
 {
 	int i = 0;
+	int remainingMs = msComm->readTimeoutMs;	//The deadline applies to the complete line
 	do {
 		int tempChar; 							//Temporary character used for reading
-		tempChar = msComm->readCharFunc(); //Reads a character from the device
-		if(tempChar > 0)
+		tempChar = ReadNextChar(msComm); //Reads a character from the device
+		if(tempChar < 0)
+		{
+			RetCode code = WaitForChar(msComm, &remainingMs);
+			if (code != CODE_OK)
+			{
+				buf[i] = '\0';
+				return code;
+			}
+		}
+		else
 		{
 			buf[i++] = tempChar;			//Stores tempchar into buffer
 
 			if(tempChar == '\n')
 			{
 				buf[i] = '\0';
-				if(buf[0] == REPLY_VERSION_RESPONSE)
-					return CODE_VERSION_RESPONSE;
-				else if((buf[0] == REPLY_MEASURING) || (buf[0] == REPLY_NSCANS_START))
-					return CODE_MEASURING;
-				else if(strcmp(buf, "e\n") == 0)	//Wdg 20-11-2019 added
-					return CODE_RESPONSE_BEGIN;		//..
-				else if((strcmp(buf, "*\n") == 0 || strcmp(buf, "-\n") == 0))
-					return CODE_MEASUREMENT_DONE;
-				else if(strcmp(buf, "\n") == 0)
-					return CODE_RESPONSE_END;
-				else if(buf[0] == REPLY_MEASURE_DP)
-					return CODE_OK;
-				else{
+				RetCode code = ClassifyLine(buf, i);
+				if (code == CODE_NOT_IMPLEMENTED)
 					printf("Unexpected response from ES Pico: \"%s\"\n", buf);
-					return CODE_NOT_IMPLEMENTED;
-				}
+				return code;
 			}
 		}
 	} while (i < READ_BUFFER_LENGTH-1);
@@ -147,6 +600,60 @@ RetCode ReadBuf(MSComm* msComm, char* buf)
 }
 
 
+//
+// See documentation in MSComm.h
+//
+RetCode ReadChar(MSComm* msComm, char* c)
+{
+	int remainingMs = msComm->readTimeoutMs;
+	int tempChar = ReadNextChar(msComm);
+	if (tempChar < 0 && msComm->transport.wait_read != NULL)
+	{
+		RetCode code = WaitForChar(msComm, &remainingMs);
+		if (code != CODE_OK)
+			return code;
+		tempChar = ReadNextChar(msComm);
+	}
+	if (tempChar < 0)
+		return CODE_TIMEOUT;
+	*c = tempChar;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+RetCode ClassifyLine(const char *line, size_t length)
+{
+	if (length == 0)
+		return CODE_NULL;
+
+	switch (line[0])
+	{
+		case REPLY_VERSION_RESPONSE:
+			return CODE_VERSION_RESPONSE;
+		case REPLY_MEASURING:
+		case REPLY_NSCANS_START:
+			return CODE_MEASURING;
+		case REPLY_MEASURE_DP:
+			return CODE_OK;
+		case '\n':
+			return CODE_RESPONSE_END;
+		case REPLY_RESPONSE_BEGIN:
+			if (length == 2 && line[1] == '\n')
+				return CODE_RESPONSE_BEGIN;
+			break;
+		case REPLY_ENDOFMEASLOOP:
+		case REPLY_NSCANS_DONE:
+			if (length == 2 && line[1] == '\n')
+				return CODE_MEASUREMENT_DONE;
+			break;
+	}
+	return CODE_NOT_IMPLEMENTED;
+}
+
+
 //
 // See documentation in MSComm.h
 //
@@ -154,10 +661,12 @@ RetCode ReceivePackage(MSComm* msComm, MscrPackage* retData)
 {
 	char bufferLine[READ_BUFFER_LENGTH];
 	RetCode ret = ReadBuf(msComm, bufferLine); // Reads a line of response from the device
+	msComm->lastReply = bufferLine[0];
+	if (ret == CODE_MEASURING)
+		ResetPackageSchema(&msComm->schema);
 	if (ret != CODE_OK)
 		return ret;
-	ParseResponse(bufferLine, retData);
-	return ret;
+	return ParsePackageLineWithSchema(&msComm->schema, bufferLine, strlen(bufferLine), retData);
 }
 
 
@@ -186,6 +695,340 @@ void ParseResponse(char *responsePackageLine, MscrPackage* retData)
 }
 
 
+//
+// Returns the value of a hexadecimal digit, or -1 if `c` is not a hexadecimal digit
+//
+static inline int HexDigitValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+
+//
+// Returns true if `c` ends a subpackage (or the complete package line)
+//
+static inline int IsSubpackageEnd(char c)
+{
+	return (c == ';' || c == '\n' || c == '\0');
+}
+
+
+//
+// See documentation in MSComm.h
+//
+RetCode ParsePackageLine(const char *line, size_t length, MscrPackage* retData)
+{
+	const char *p = line;
+	const char *end = line + length;
+
+	retData->nr_of_subpackages = 0;
+
+	// Find the beginning of the package
+	while (p < end && *p != REPLY_MEASURE_DP)
+	{
+		if (*p == '\n' || *p == '\0')
+			return CODE_UNEXPECTED_DATA;
+		p++;
+	}
+	if (p == end)
+		return CODE_UNEXPECTED_DATA;
+	p++;
+
+	while (p < end && *p != '\n' && *p != '\0')
+	{
+		// Skip empty subpackages
+		if (*p == ';')
+		{
+			p++;
+			continue;
+		}
+
+		// Every subpackage starts with a 2 character variable type followed by an 8 character value
+		if (end - p < 10)
+			return CODE_UNEXPECTED_DATA;
+		if (retData->nr_of_subpackages >= MSCR_SUBPACKAGES_PER_LINE)
+			return CODE_OUT_OF_RANGE;
+
+		MscrSubPackage *subpackage = &retData->subpackages[retData->nr_of_subpackages++];
+		subpackage->variable_type = VARTYPE_TO_UINT8(p[0], p[1]);
+		ClearSubpackageMetadata(subpackage);
+
+		// The value is 7 hexadecimal digits followed by the SI unit prefix
+		int value = 0;
+		for (int i = 2; i < 9; i++)
+		{
+			int digit = HexDigitValue(p[i]);
+			if (digit < 0)
+				return CODE_UNEXPECTED_DATA;
+			value = (value << 4) | digit;
+		}
+		SetSubpackageValue(subpackage, value, p[9]);
+		p += 10;
+
+		// Skip anything between the value and the first metadata field
+		while (p < end && *p != ',' && !IsSubpackageEnd(*p))
+			p++;
+
+		// Metadata fields are separated by ','
+		while (p < end && *p == ',')
+		{
+			p++;
+			if (p < end && *p == '1')
+			{
+				int status = 0;
+				int digit;
+				for (p++; p < end && (digit = HexDigitValue(*p)) >= 0; p++)
+					status = (status << 4) | digit;
+				SetSubpackageStatus(subpackage, status);
+			}
+			else if (p < end && *p == '2')
+			{
+				int current_range = 0;
+				int digit;
+				const char *crEnd = (end - p > 3) ? p + 3 : end;
+				for (p++; p < crEnd && (digit = HexDigitValue(*p)) >= 0; p++)
+					current_range = (current_range << 4) | digit;
+				SetSubpackageCurrentRange(subpackage, current_range);
+			}
+			// Skip the rest of the field, including unsupported metadata types
+			while (p < end && *p != ',' && !IsSubpackageEnd(*p))
+				p++;
+		}
+	}
+	return CODE_OK;
+}
+
+
+//
+// Adds a character that must be the same in every line to a schema
+// Returns 0 if the schema is full
+//
+static int AddSchemaCheck(MscrPackageSchema *schema, size_t offset, char c)
+{
+	if (schema->checkCount >= MSCR_SCHEMA_MAX_CHECKS)
+		return 0;
+	schema->checkOffsets[schema->checkCount] = offset;
+	schema->checkChars[schema->checkCount] = c;
+	schema->checkCount++;
+	return 1;
+}
+
+
+//
+// Stores the layout of a valid package line in a schema
+// Returns 0 if the layout is not supported, in which case `schema->length` stays 0
+//
+static int LearnSchema(MscrPackageSchema *schema, const char *line, size_t length)
+{
+	size_t p = 1;
+
+	schema->length = 0;
+	schema->count = 0;
+	schema->checkCount = 0;
+	if (length > 255)
+		length = 255;
+	if (length < 1 || line[0] != REPLY_MEASURE_DP)
+		return 0;
+	AddSchemaCheck(schema, 0, REPLY_MEASURE_DP);
+
+	while (p < length && line[p] != '\n')
+	{
+		if (line[p] == ';')
+		{
+			if (!AddSchemaCheck(schema, p++, ';'))
+				return 0;
+			continue;
+		}
+		if (schema->count >= MSCR_SCHEMA_MAX_SUBPACKAGES || length - p < 10)
+			return 0;
+
+		MscrSchemaField *field = &schema->fields[schema->count++];
+		if (!AddSchemaCheck(schema, p, line[p]) || !AddSchemaCheck(schema, p + 1, line[p + 1]))
+			return 0;
+		field->variableType = VARTYPE_TO_UINT8(line[p], line[p + 1]);
+		field->offset = p + 2;
+		field->statusOffset = 0;
+		field->rangeOffset = 0;
+		p += 10;
+
+		// Only the status and current range fields are supported, each at most once
+		while (p < length && line[p] == ',')
+		{
+			char type = (p + 1 < length) ? line[p + 1] : '\0';
+			size_t start = p + 2;
+			if ((type == '1' && field->statusOffset == 0) || (type == '2' && field->rangeOffset == 0))
+			{
+				if (!AddSchemaCheck(schema, p, ',') || !AddSchemaCheck(schema, p + 1, type))
+					return 0;
+			}
+			else
+			{
+				return 0;
+			}
+			for (p = start; p < length && HexDigitValue(line[p]) >= 0; p++)
+				;
+			if (type == '1')
+			{
+				if (p - start > 7)
+					return 0;
+				field->statusOffset = start;
+				field->statusDigits = p - start;
+			}
+			else
+			{
+				// `ParsePackageLine` only uses the first 2 digits of the current range
+				if (p - start > 2)
+					return 0;
+				field->rangeOffset = start;
+				field->rangeDigits = p - start;
+			}
+		}
+		if (p >= length || (line[p] != ';' && line[p] != '\n'))
+			return 0;
+	}
+	if (p >= length || !AddSchemaCheck(schema, p, '\n'))
+		return 0;
+	schema->length = p + 1;
+	return 1;
+}
+
+
+// Hexadecimal digit value of every character with bit 4 set, 0 for characters that are not hexadecimal digits.
+// The digits of a field can be looked up without a branch per digit: the field is only valid if
+// bit 4 is set in all of them.
+static const uint8_t HEX_DIGITS[256] =
+{
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+	['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+};
+
+
+//
+// Decodes the 7 hexadecimal digits of a value field
+// Returns the value or -1 if one of the characters is not a hexadecimal digit
+//
+static inline int DecodeValueDigits(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	unsigned int d0 = HEX_DIGITS[u[0]], d1 = HEX_DIGITS[u[1]], d2 = HEX_DIGITS[u[2]], d3 = HEX_DIGITS[u[3]];
+	unsigned int d4 = HEX_DIGITS[u[4]], d5 = HEX_DIGITS[u[5]], d6 = HEX_DIGITS[u[6]];
+
+	if ((d0 & d1 & d2 & d3 & d4 & d5 & d6 & 0x10) == 0)
+		return -1;
+	return (int)(((d0 & 0xF) << 24) | ((d1 & 0xF) << 20) | ((d2 & 0xF) << 16) | ((d3 & 0xF) << 12) |
+			((d4 & 0xF) << 8) | ((d5 & 0xF) << 4) | (d6 & 0xF));
+}
+
+
+//
+// Decodes `count` hexadecimal digits
+// Returns the value or -1 if one of the characters is not a hexadecimal digit
+//
+static inline int DecodeHexDigits(const char *p, int count)
+{
+	int value = 0;
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int digit = HEX_DIGITS[(unsigned char)p[i]];
+		if (digit == 0)
+			return -1;
+		value = (value << 4) | (digit & 0xF);
+	}
+	return value;
+}
+
+
+//
+// Parses a package line with the layout of a schema
+// Returns 0 if the line does not match the layout
+//
+static int ParseWithSchema(const MscrPackageSchema *schema, const char *line, size_t length, MscrPackage* retData)
+{
+	if (length < schema->length)
+		return 0;
+	for (int i = 0; i < schema->checkCount; i++)
+	{
+		if (line[schema->checkOffsets[i]] != schema->checkChars[i])
+			return 0;
+	}
+
+	for (int i = 0; i < schema->count; i++)
+	{
+		const MscrSchemaField *field = &schema->fields[i];
+		const char *p = &line[field->offset];
+		MscrSubPackage *subpackage = &retData->subpackages[i];
+
+		// Every character that is not checked above must be part of a value, so a line that ends
+		// early or has a different layout never passes
+		int value = DecodeValueDigits(p);
+		if (value < 0 || p[7] == '\n' || p[7] == '\0' || p[7] == ';' || p[7] == ',')
+			return 0;
+		subpackage->variable_type = field->variableType;
+		ClearSubpackageMetadata(subpackage);
+		SetSubpackageValue(subpackage, value, p[7]);
+
+		if (field->statusOffset != 0)
+		{
+			int status = DecodeHexDigits(&line[field->statusOffset], field->statusDigits);
+			if (status < 0)
+				return 0;
+			SetSubpackageStatus(subpackage, status);
+		}
+		if (field->rangeOffset != 0)
+		{
+			int current_range = DecodeHexDigits(&line[field->rangeOffset], field->rangeDigits);
+			if (current_range < 0)
+				return 0;
+			SetSubpackageCurrentRange(subpackage, current_range);
+		}
+	}
+	retData->nr_of_subpackages = schema->count;
+	return 1;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+RetCode ParsePackageLineWithSchema(MscrPackageSchema *schema, const char *line, size_t length, MscrPackage* retData)
+{
+	if (schema->length > 0)
+	{
+		if (ParseWithSchema(schema, line, length, retData))
+			return CODE_OK;
+		schema->length = 0;
+		schema->misses++;
+	}
+
+	RetCode code = ParsePackageLine(line, length, retData);
+	if (code == CODE_OK && schema->misses < MSCR_SCHEMA_MAX_MISSES)
+	{
+		// Give up on layouts that are not supported, instead of trying again for every line
+		if (!LearnSchema(schema, line, length))
+			schema->misses = MSCR_SCHEMA_MAX_MISSES;
+	}
+	return code;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+void ResetPackageSchema(MscrPackageSchema *schema)
+{
+	schema->length = 0;
+	schema->misses = 0;
+}
+
+
 //
 // See documentation in MSComm.h
 //
@@ -221,7 +1064,9 @@ void ParseParam(char* param, MscrSubPackage* retData)
 	paramIdentifier[2] = '\0';
 	strncpy(paramValue, param+ 2, 8);									//Splits the parameter value string
 	paramValue[9]= '\0';
-	retData->value = GetParameterValue(paramValue);				//Retrieves the actual parameter value
+	char charUnitPrefix = paramValue[7];								//Identifies the SI unit prefix from the package at position 8
+	paramValue[7] = '\0';
+	SetSubpackageValue(retData, strtol(paramValue, NULL, 16), charUnitPrefix);	//Stores the actual parameter value
 	retData->variable_type = MSCR_STR_TO_VT(paramIdentifier);
 
 	ParseMetaDataValues(param + 10, retData);							//Rest of the parameter is further parsed to get meta data values
@@ -295,10 +1140,10 @@ void ParseMetaDataValues(char *metaDataParams, MscrSubPackage* retData)
 		switch (metaData[0])
 		{
 			case '1':
-				retData->metadata.status = GetStatusFromPackage(metaData); 	//Retrieves the reading status of the parameter
+				SetSubpackageStatus(retData, GetStatusFromPackage(metaData)); 	//Retrieves the reading status of the parameter
 				break;
 			case '2':
-				retData->metadata.current_range = GetCurrentRangeFromPackage(metaData);		    //Retrieves the current range of the parameter
+				SetSubpackageCurrentRange(retData, GetCurrentRangeFromPackage(metaData));		    //Retrieves the current range of the parameter
 				break;
 		}
 	} while ((metaData = strtokenize(&running, delimiters)) != NULL);
@@ -343,6 +1188,7 @@ int GetCurrentRangeFromPackage(char* metaDataCR)
 {
 	char  crBytePackage[3];
 	strncpy(crBytePackage, metaDataCR + 1, 2);
+	crBytePackage[2] = '\0';
 	return strtol(crBytePackage, NULL, 16);
 }
 
@@ -352,55 +1198,115 @@ int GetCurrentRangeFromPackage(char* metaDataCR)
 //
 const char* current_range_to_string(int current_range)
 {
-	switch (current_range)
-	{
-		case 0:
-			return "100nA";
-		case 1:
-			return "2uA";
-		case 2:
-			return "4uA";
-		case 3:
-			return "8uA";
-		case 4:
-			return "16uA";
-		case 5:
-			return "32uA";
-		case 6:
-			return "63uA";
-		case 7:
-			return "125uA";
-		case 8:
-			return "250uA";
-		case 9:
-			return "500uA";
-		case 10:
-			return "1mA";
-		case 11:
-			return "15mA";
-		case 128:
-			return "100nA (High speed)";
-		case 129:
-			return "1uA (High speed)";
-		case 130:
-			return "6uA (High speed)";
-		case 131:
-			return "13uA (High speed)";
-		case 132:
-			return "25uA (High speed)";
-		case 133:
-			return "50uA (High speed)";
-		case 134:
-			return "100uA (High speed)";
-		case 135:
-			return "200uA (High speed)";
-		case 136:
-			return "1mA (High speed)";
-		case 137:
-			return "5mA (High speed)";
-		default:
-			return "Invalid value";
-	}
+	if ((current_range >= 0) && (current_range < (int)(sizeof(CURRENT_RANGES) / sizeof(CURRENT_RANGES[0]))))
+		return CURRENT_RANGES[current_range];
+	if ((current_range >= 128) && (current_range < 128 + (int)(sizeof(CURRENT_RANGES_HIGH_SPEED) / sizeof(CURRENT_RANGES_HIGH_SPEED[0]))))
+		return CURRENT_RANGES_HIGH_SPEED[current_range - 128];
+	return "Invalid value";
+}
+
+
+//
+// See documentation in MSComm.h
+//
+float GetSubpackageValue(const MscrSubPackage *subpackage)
+{
+#if MSCR_HAS_EXACT_VALUES
+	// Identical arithmetic to `GetParameterValue`, so the float value does not depend on the layout
+	float parameterValue = GetSubpackageMantissa(subpackage);
+	return parameterValue * GetUnitPrefixValue(ExponentToPrefix(GetSubpackageExponent(subpackage)));
+#else
+	return subpackage->value;
+#endif
+}
+
+
+#if MSCR_HAS_EXACT_VALUES
+
+//
+// See documentation in MSComm.h
+//
+int32_t GetSubpackageMantissa(const MscrSubPackage *subpackage)
+{
+#if MSCR_PACKED_SUBPACKAGES
+	return (int32_t)subpackage->raw_value - MSCR_PARAM_OFFSET_VALUE;
+#else
+	return subpackage->mantissa;
+#endif
+}
+
+
+//
+// See documentation in MSComm.h
+//
+int GetSubpackageExponent(const MscrSubPackage *subpackage)
+{
+#if MSCR_PACKED_SUBPACKAGES
+	return (subpackage->prefix < 13) ? (int)subpackage->prefix - 6 : MSCR_EXPONENT_INVALID;
+#else
+	return subpackage->exponent;
+#endif
+}
+
+
+//
+// See documentation in MSComm.h
+//
+double GetSubpackageValueDouble(const MscrSubPackage *subpackage)
+{
+	return ExactValueToDouble(GetSubpackageMantissa(subpackage), GetSubpackageExponent(subpackage));
+}
+
+#endif
+
+
+//
+// See documentation in MSComm.h
+//
+double ExactValueToDouble(int32_t mantissa, int exponent)
+{
+	// The mantissa and the powers of 1000 are exact doubles, so a single multiplication or
+	// division gives the correctly rounded result. Multiplying by 1e-3 etc. would round twice.
+	if (exponent >= 0 && exponent <= 6)
+		return mantissa * POWERS_OF_1000[exponent];
+	if (exponent < 0 && exponent >= -6)
+		return mantissa / POWERS_OF_1000[-exponent];
+	return 0;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+int GetSubpackageVarType(const MscrSubPackage *subpackage)
+{
+	return subpackage->variable_type;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+int GetSubpackageStatus(const MscrSubPackage *subpackage)
+{
+#if MSCR_PACKED_SUBPACKAGES
+	return (subpackage->flags & MSCR_HAS_STATUS) ? subpackage->status : -1;
+#else
+	return subpackage->metadata.status;
+#endif
+}
+
+
+//
+// See documentation in MSComm.h
+//
+int GetSubpackageCurrentRange(const MscrSubPackage *subpackage)
+{
+#if MSCR_PACKED_SUBPACKAGES
+	return (subpackage->flags & MSCR_HAS_CURRENT_RANGE) ? subpackage->current_range : -1;
+#else
+	return subpackage->metadata.current_range;
+#endif
 }
 
 
@@ -409,92 +1315,16 @@ const char* current_range_to_string(int current_range)
 //
 const char *VartypeToString(int variable_type)
 {
-	switch(variable_type)
-	{
-		case MSCR_VT_UNKNOWN:
-			return "MSCR_VT_UNKNOWN";
-
-		case MSCR_VT_POTENTIAL:
-			return "Potential";
-		case MSCR_VT_POTENTIAL_CE:
-			return "Potential_CE";
-		case MSCR_VT_POTENTIAL_SE:
-			return "Potential_SE";
-		case MSCR_VT_POTENTIAL_RE:
-			return "Potential_RE";
-		case MSCR_VT_POTENTIAL_WE_VS_CE:
-			return "Potential_WE_vs_CE";
-		case MSCR_VT_POTENTIAL_AIN0:
-			return "Potential_AIN0";
-		case MSCR_VT_POTENTIAL_AIN1:
-			return "Potential_AIN1";
-		case MSCR_VT_POTENTIAL_AIN2:
-			return "Potential_AIN2";
-		case MSCR_VT_POTENTIAL_AIN3:
-			return "Potential_AIN3";
-		case MSCR_VT_POTENTIAL_AIN4:
-			return "Potential_AIN4";
-		case MSCR_VT_POTENTIAL_AIN5:
-			return "Potential_AIN5";
-		case MSCR_VT_POTENTIAL_AIN6:
-			return "Potential_AIN6";
-		case MSCR_VT_POTENTIAL_AIN7:
-			return "Potential_AIN7";
-		case MSCR_VT_CURRENT:
-			return "Current";
-		case MSCR_VT_PHASE:
-			return "Phase";
-		case MSCR_VT_IMP:
-			return "Imp";
-		case MSCR_VT_ZREAL:
-			return "Zreal";
-		case MSCR_VT_ZIMAG:
-			return "Zimag";
-		case MSCR_VT_CELL_SET_POTENTIAL:
-			return "Cell_set_potential";
-		case MSCR_VT_CELL_SET_CURRENT:
-			return "Cell_set_current";
-		case MSCR_VT_CELL_SET_FREQUENCY:
-			return "Cell_set_frequency";
-		case MSCR_VT_CELL_SET_AMPLITUDE:
-			return "Cell_set_amplitude";
-		case MSCR_VT_CHANNEL:
-			return "Channel";
-		case MSCR_VT_TIME:
-			return "Time";
-		case MSCR_VT_PIN_MSK:
-			return "Pin_msk";
-		case MSCR_VT_DEV_ADC_OFFSET:
-			return "Dev_adc_offset";
-		case MSCR_VT_DEV_HS_EX:
-			return "Dev_hs_ex";
-		case MSCR_VT_CURRENT_GENERIC1:
-			return "Current_generic1";
-		case MSCR_VT_CURRENT_GENERIC2:
-			return "Current_generic2";
-		case MSCR_VT_CURRENT_GENERIC3:
-			return "Current_generic3";
-		case MSCR_VT_CURRENT_GENERIC4:
-			return "Current_generic4";
-		case MSCR_VT_POTENTIAL_GENERIC1:
-			return "Potential_generic1";
-		case MSCR_VT_POTENTIAL_GENERIC2:
-			return "Potential_generic2";
-		case MSCR_VT_POTENTIAL_GENERIC3:
-			return "Potential_generic3";
-		case MSCR_VT_POTENTIAL_GENERIC4:
-			return "Potential_generic4";
-		case MSCR_VT_MISC_GENERIC1:
-			return "Misc_generic1";
-		case MSCR_VT_MISC_GENERIC2:
-			return "Misc_generic2";
-		case MSCR_VT_MISC_GENERIC3:
-			return "Misc_generic3";
-		case MSCR_VT_MISC_GENERIC4:
-			return "Misc_generic4";
-		case MSCR_VT_NONE:
-			return "None";
-		default:
-			return "Undefined variable type";
-	}
+	return GetVarTypeInfo(variable_type)->name;
+}
+
+
+//
+// See documentation in MSComm.h
+//
+const MscrVarTypeInfo *GetVarTypeInfo(int variable_type)
+{
+	if ((variable_type < 0) || (variable_type >= MSCR_VT_CNT) || (VAR_TYPE_INFO[variable_type].name == NULL))
+		return &VAR_TYPE_UNDEFINED;
+	return &VAR_TYPE_INFO[variable_type];
 }
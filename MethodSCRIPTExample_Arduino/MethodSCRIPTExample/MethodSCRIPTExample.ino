@@ -219,62 +219,29 @@ void SendScriptToDevice(const char* scriptText)
 /// parameters:
 ///   subpackage The subpackage to process
 ///
-void PrintSubpackage(const MscrSubPackage subpackage)
+void PrintSubpackage(const MscrSubPackage *subpackage)
 {
-	// Format and print the subpackage value
-	// This is a bit bulky, but does nothing more than call printf with a format that is
+	// Format and print the subpackage value, with the label and number of digits that are
 	// sensible for the `variable type` of the subpackage.
 
-	switch(subpackage.variable_type) {
-		case MSCR_VT_POTENTIAL:
-		case MSCR_VT_POTENTIAL_CE:
-		case MSCR_VT_POTENTIAL_SE:
-		case MSCR_VT_POTENTIAL_RE:
-		case MSCR_VT_POTENTIAL_GENERIC1:
-		case MSCR_VT_POTENTIAL_GENERIC2:
-		case MSCR_VT_POTENTIAL_GENERIC3:
-		case MSCR_VT_POTENTIAL_GENERIC4:
-		case MSCR_VT_POTENTIAL_WE_VS_CE:
-			Serial.print("\tE[V]: ");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_CURRENT:
-		case MSCR_VT_CURRENT_GENERIC1:
-		case MSCR_VT_CURRENT_GENERIC2:
-		case MSCR_VT_CURRENT_GENERIC3:
-		case MSCR_VT_CURRENT_GENERIC4:
-			Serial.print("\tI[A]: ");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_ZREAL:
-			Serial.print("\tZreal[Ohm]:");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_ZIMAG:
-			Serial.print("\tZimag[Ohm]");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_CELL_SET_POTENTIAL:
-			Serial.print("\tE set[V]: ");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_CELL_SET_CURRENT:
-			Serial.print("\tI set[A]: ");
-				Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_CELL_SET_FREQUENCY:
-			Serial.print("\tF set[Hz]: ");
-			Serial.print(sci(subpackage.value, 3));
-			break;
-		case MSCR_VT_CELL_SET_AMPLITUDE:
-			Serial.print("\tA set[V]: ");
-			Serial.print(sci(subpackage.value, 2));
-			break;
-		case MSCR_VT_UNKNOWN:
-		default:
-			char formatted_srt[64];
-			snprintf(formatted_srt, 64, "\t?%d?[?] %16.3f ", subpackage.variable_type, subpackage.value);
-			Serial.print(formatted_srt);
+	// Use the accessor functions, the SDK stores subpackages in a packed layout on Arduino
+	const float value = GetSubpackageValue(subpackage);
+	const int status = GetSubpackageStatus(subpackage);
+	const int current_range = GetSubpackageCurrentRange(subpackage);
+	const MscrVarTypeInfo *info = GetVarTypeInfo(GetSubpackageVarType(subpackage));
+
+	if (info->label != NULL)
+	{
+		Serial.print("\t");
+		Serial.print(info->label);
+		Serial.print(": ");
+		Serial.print(sci(value, info->digits));
+	}
+	else
+	{
+		char formatted_srt[64];
+		snprintf(formatted_srt, 64, "\t?%d?[?] %16.3f ", GetSubpackageVarType(subpackage), value);
+		Serial.print(formatted_srt);
 	}
 
 
@@ -282,10 +249,10 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 	// Note a value of <0 indicates it was provided in the MethodSCRIPT output
 
 	// `Status` field metadata
-	if (subpackage.metadata.status >= 0)
+	if (status >= 0)
 	{
 		const	char *status_str;
-		if (subpackage.metadata.status == 0)
+		if (status == 0)
 		{
 			status_str = StatusToString((Status)0);
 		}
@@ -295,7 +262,7 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 			// Only print the first flag that was set to keep the output readable.
 			for (int i = 0; i < 31; i++)
 			{
-				if ((subpackage.metadata.status & (1 << i)) != 0)
+				if ((status & (1 << i)) != 0)
 				{
 					status_str = StatusToString((Status)(1 << i));
 					break;
@@ -309,9 +276,9 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 	}
 
 	// `current range` metadata
-	if (subpackage.metadata.current_range >= 0)
+	if (current_range >= 0)
 	{
-		const char *current_range_str = current_range_to_string(subpackage.metadata.current_range);
+		const char *current_range_str = current_range_to_string(current_range);
 
 		char formatted_srt[64];
 		snprintf(formatted_srt, 64, "CR: %-20s \t", current_range_str);
@@ -390,7 +357,7 @@ void loop()
 
 				// Print all subpackages in
 				for (int i = 0; i < package.nr_of_subpackages; i++)
-					PrintSubpackage(package.subpackages[i]);
+					PrintSubpackage(&package.subpackages[i]);
 
 				Serial.println();
        
@@ -47,21 +47,28 @@
 
 #include "MethodSCRIPTExample.h"
 #include "SerialPort.h"
+#include "MethodSCRIPTcomm/MSRing.h"
+#ifdef RESULT_BINARY_FILEPATHNAME
+	#include "MethodSCRIPTcomm/MSResultFile.h"
+#endif
+#ifdef RECORD_LOG_FILEPATHNAME
+	#include "MethodSCRIPTcomm/MSRecordLog.h"
+#endif
+#ifdef SEGMENT_FILEPATHNAME
+	#include "MethodSCRIPTcomm/MSSegmentWriter.h"
+#endif
+#ifdef CAPTURE_FILEPATHNAME
+	#include "MethodSCRIPTcomm/MSCapture.h"
+#endif
 
 //
 // Function prototypes from output_formatter.c
 //
-void PrintSubpackage(const MscrSubPackage subpackage);
-void DisplayResults(const RetCode code, const MscrPackage package, const int package_nr);
-void OpenCSVFile(const char *pFilename, FILE **fp);
-void WriteHeaderToCSVFile(FILE *fp, MscrPackage first_package);
-void WriteDataToCSVFile(FILE *fp, const MscrPackage package, int package_nr);
-void ResultsToCsv(const RetCode code, const MscrPackage package, const int package_nr);
-void close_csv_file();
-
-
-// MethodScript communication interface
-MSComm msComm;
+void PrintSubpackage(const MscrSubPackage *subpackage);
+void DisplayResults(const RetCode code, const MscrPackage *package, const int package_nr);
+void OpenCSVFile(CsvOutput *csv);
+void ResultsToCsv(CsvOutput *csv, const RetCode code, const MscrPackage *package, const int package_nr);
+void close_csv_file(CsvOutput *csv);
 
 
 // Script select
@@ -104,24 +111,29 @@ MSComm msComm;
 //
 // Check if the the connected device is an EmStat Pico.
 //
+// parameters:
+//    msComm      The MethodSCRIPT communication interface of the device
+//
 // return:
 //    true    The other side of the serial port is an EmStat Pico
 //    false   The connected device is not supported by this example.
 //
-bool VerifyEmStatPico()
+bool VerifyEmStatPico(MSComm *msComm)
 {
 	char versionString[30];
 	RetCode code;
-	WriteStr(&msComm, CMD_VERSION_STRING);
+	WriteStr(msComm, CMD_VERSION_STRING);
 
-	code = ReadBuf(&msComm, versionString);
+	code = ReadBuf(msComm, versionString);
 
 	// Verifies if the device is EmStat Pico by looking for "espico" in the version response
 	if(code == CODE_VERSION_RESPONSE && strstr(versionString, "espico") != NULL)
 	{
 		while(strstr(versionString, "*") == NULL)
 		{
-			ReadBuf(&msComm, versionString); // Skip line containing *.
+			code = ReadBuf(msComm, versionString); // Skip line containing *.
+			if (code != CODE_VERSION_RESPONSE && code != CODE_OK)
+				return false;						// Timeout, hang-up or a read error
 		}
 		return true;
 	}
@@ -134,28 +146,44 @@ bool VerifyEmStatPico()
 // Send a script file line by line to the EmStat
 //
 // parameters:
+//    msComm      The MethodSCRIPT communication interface of the device
 //    filename    The filename/path of the file to send to the EmStat
 //
 // return:
 //    The status of the operation - `CODE_OK` if successful
 //
-int SendScriptFile(const char *fileName)
+int SendScriptFile(MSComm *msComm, const char *fileName)
 {
 	FILE *fp;
-	char str[MS_MAX_LINECHARS + 1];	// Plus the string termination character (0)
+	char *script;
+	long length;
+	RetCode code;
 
-	fp = fopen(fileName, "r");
+	fp = fopen(fileName, "rb");
 	if (fp == NULL) {
 		printf("Could not open file %s", fileName);
 		return CODE_ERROR;
 	}
-	// Reads a single line from the script file and sends it to the device.
-	while (fgets(str, MS_MAX_LINECHARS, fp) != NULL)
+
+	// Read the complete script, so it can be validated and sent in one go.
+	fseek(fp, 0, SEEK_END);
+	length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	script = malloc(length > 0 ? length : 1);
+	if (script == NULL || fread(script, 1, length, fp) != (size_t)length)
 	{
-		WriteStr(&msComm, str);
+		printf("Could not read file %s", fileName);
+		free(script);
+		fclose(fp);
+		return CODE_ERROR;
 	}
 	fclose(fp);
-	return CODE_OK;
+
+	code = WriteScript(msComm, script, length);
+	if (code == CODE_OUT_OF_RANGE)
+		printf("Script %s contains a line longer than %d characters\n", fileName, MS_MAX_LINECHARS - 1);
+	free(script);
+	return code;
 }
 
 
@@ -163,86 +191,214 @@ int SendScriptFile(const char *fileName)
 ///
 /// Receive and process MethodSCRIPT output from the EmStat.
 /// The results are stored in a CSV file and displayed on the terminal.
-/// This function will loop until the end-of-script is received or an error occurred.
+/// The packages are received by a separate thread, so displaying and storing them does not delay
+/// the reading. This function will loop until the end-of-script is received or an error occurred.
 ///
-void process_emstat_response()
+/// parameters:
+///    msComm      The MethodSCRIPT communication interface of the device
+///    csv         The CSV file to store the results in
+///
+void process_emstat_response(MSComm *msComm, CsvOutput *csv)
 {
-	MscrPackage data;	// The processed package
-	RetCode status_code; // Status of the current operation/measurement
+	MSPackagePool pool;		// The packages that are received into, so no memory is allocated while measuring
+	MSRing ring;			// Received packages that have not been processed yet
+	MSRingReader reader;	// The thread that receives the packages
+	const MSRingEntry *entry;
+	RetCode status_code;	// Status of the current operation/measurement
 	// The number of packages received inside the current measure-loop. Used in CSV and display.
 	int loop_package_nr = 0;
 
-	do
+	if (MSPackagePoolInit(&pool, PACKAGE_POOL_SIZE) != CODE_OK)
+	{
+		printf("Could not allocate memory for the received packages\n");
+		return;
+	}
+	if (MSRingInit(&ring, PACKAGE_RING_SIZE) != CODE_OK)
+	{
+		printf("Could not allocate memory for the received packages\n");
+		MSPackagePoolFree(&pool);
+		return;
+	}
+	if (MSRingStartReader(&reader, msComm, &ring, &pool) != CODE_OK)
+	{
+		printf("Could not start receiving packages from EmStat\n");
+		MSRingFree(&ring);
+		MSPackagePoolFree(&pool);
+		return;
+	}
+#ifdef RESULT_BINARY_FILEPATHNAME
+	// Like the CSV file, the result file is written on a background thread
+	MSAsyncWriter results_file;
+	MSResultWriter results;
+	FILE *results_fp = fopen(RESULT_BINARY_FILEPATHNAME, "wb");
+	bool results_open = (results_fp != NULL && MSAsyncWriterOpen(&results_file, results_fp, 0, 0) == CODE_OK);
+	if (results_open && MSResultWriterOpenAsync(&results, &results_file, 0) != CODE_OK)
+	{
+		MSAsyncWriterClose(&results_file);		// Also closes results_fp
+		results_open = false;
+		results_fp = NULL;
+	}
+	if (!results_open)
+	{
+		if (results_fp != NULL)
+			fclose(results_fp);
+		printf("ERROR: Could not create result file [%s].\n", RESULT_BINARY_FILEPATHNAME);
+	}
+#endif
+#ifdef RECORD_LOG_FILEPATHNAME
+	MSRecordLog record_log;
+	bool record_log_open = (MSRecordLogOpen(&record_log, RECORD_LOG_FILEPATHNAME, MSRECORDLOG_DEFAULT_LATENCY_MS, 0) == CODE_OK);
+	if (!record_log_open)
+		printf("ERROR: Could not open record log [%s].\n", RECORD_LOG_FILEPATHNAME);
+#endif
+#ifdef SEGMENT_FILEPATHNAME
+	MSSegmentWriter segments;
+	MSSegmentLimits segment_limits = { SEGMENT_MAX_BYTES, SEGMENT_MAX_SECONDS, 0 };
+	bool segments_open = (MSSegmentWriterOpen(&segments, SEGMENT_FILEPATHNAME, MSSEGMENT_CSV, &segment_limits) == CODE_OK);
+	if (!segments_open)
+		printf("ERROR: Could not create segment files [%s].\n", SEGMENT_FILEPATHNAME);
+#endif
+
+	// Sleeps until the reader stores a package, and stops once the reader is done and everything it received
+	// has been processed
+	while ((entry = MSRingWaitRead(&ring)) != NULL)
 	{
-		// Receives one package and stores the parsed values in the struct 'data'
-		status_code = ReceivePackage(&msComm, &data);
-		if(status_code < 0)
+		// Processes one package, the parsed values are in `entry->package`.
+		// Both outputs use the same package, it is only released to the pool by `MSRingEndRead`.
+		status_code = entry->code;
+#ifdef RECORD_LOG_FILEPATHNAME
+		if (record_log_open)
+			MSRecordLogAdd(&record_log, status_code, entry->reply, entry->package);
+#endif
+		if (status_code < 0)
 		{
 			printf("Error while receiving packages from EmStat (code %d)\n", status_code);
-			return;
 		}
-
-		// Start of a new loop received, begin counting from the start.
-		if(status_code == CODE_MEASURING)
+		else
 		{
-			loop_package_nr = 0;
-		}
+			// Start of a new loop received, begin counting from the start.
+			if (status_code == CODE_MEASURING)
+			{
+				loop_package_nr = 0;
+			}
+
+			ResultsToCsv(csv, status_code, entry->package, loop_package_nr);	// Write result data-point to a CSV file
+			DisplayResults(status_code, entry->package, loop_package_nr);	// Displays the data-point on the console
+#ifdef RESULT_BINARY_FILEPATHNAME
+			if (results_open)
+				MSResultWriterAddEvent(&results, status_code, &entry->reply, 1, entry->package);
+#endif
+#ifdef SEGMENT_FILEPATHNAME
+			if (segments_open)
+				MSSegmentWriterAddEvent(&segments, status_code, &entry->reply, 1, entry->package);
+#endif
 
-		ResultsToCsv(status_code, data, loop_package_nr);		// Write result data-point to a CSV file
-		DisplayResults(status_code, data, loop_package_nr);	// Displays the data-point on the console
+			if (status_code == CODE_OK)
+				loop_package_nr++;
+		}
+		MSRingEndRead(&ring);
+	}
 
-		if (status_code == CODE_OK)
-			loop_package_nr++;
-	} while((status_code != CODE_RESPONSE_END) && (status_code >= 0));
+	MSRingJoinReader(&reader);
+#ifdef RESULT_BINARY_FILEPATHNAME
+	if (results_open)
+	{
+		RetCode results_code = MSResultWriterClose(&results);
+		if (MSAsyncWriterClose(&results_file) != CODE_OK || results_code != CODE_OK)
+			printf("ERROR: Could not write result file [%s].\n", RESULT_BINARY_FILEPATHNAME);
+	}
+#endif
+#ifdef RECORD_LOG_FILEPATHNAME
+	if (record_log_open && MSRecordLogClose(&record_log) != CODE_OK)
+		printf("ERROR: Could not write record log [%s].\n", RECORD_LOG_FILEPATHNAME);
+#endif
+#ifdef SEGMENT_FILEPATHNAME
+	if (segments_open && MSSegmentWriterClose(&segments) != CODE_OK)
+		printf("ERROR: Could not write segment files [%s].\n", SEGMENT_FILEPATHNAME);
+#endif
+	if (MSRingGetOverflows(&ring) > 0)
+		printf("\n%lu packages were lost because processing could not keep up (highest number of waiting packages %u)\n",
+				MSRingGetOverflows(&ring), MSRingGetHighWaterMark(&ring));
+	if (MSRingGetBadLines(&ring) > 0)
+		printf("%lu package lines could not be read and were skipped\n", MSRingGetBadLines(&ring));
+	MSRingFree(&ring);
+	MSPackagePoolFree(&pool);
 }
 
 
 //
 // The main loop of the application.
-// In this example the main loop is responsible for setting up the serial communication using `MSCommInit`and
+// In this example the main loop is responsible for setting up the serial communication using `MSCommInitTransport` and
 // sending the MethodSCRIPT file to the device. At that point it will call the `process_emstat_response`
 // function which processes the response from the EmStat, displays and stores the results.
 // After the MethodSCRIPT execution completes on the device, the main function will clean up and exit.
 //
 int main(int argc, char *argv[])
 {
-	RetCode status_code = MSCommInit(&msComm, &WriteToDevice, &ReadFromDevice);
+	SerialPort serialPort;					// The serial port the EmStat Pico is connected to
+	MSTransport transport;					// Functions to communicate over the serial port
+	MSComm msComm;							// MethodScript communication interface
+	CsvOutput csv = { .filename = RESULT_FILEPATHNAME, .isOpen = false };
+
+	SerialPortGetTransport(&serialPort, &transport);
+#ifdef CAPTURE_FILEPATHNAME
+	// Put the recorder between MSComm and the serial port
+	MSCapture capture;
+	if (MSCaptureOpen(&capture, CAPTURE_FILEPATHNAME, &transport) != CODE_OK)
+	{
+		printf("ERROR: Could not create capture file [%s].\n", CAPTURE_FILEPATHNAME);
+		return -1;
+	}
+	MSCaptureGetTransport(&capture, &transport);
+#endif
+	RetCode status_code = MSCommInitTransport(&msComm, &transport);
 
 	if (status_code == CODE_OK)
 	{
-		int isOpen = OpenSerialPort(SERIAL_PORT_NAME, BAUD_RATE);
+		int isOpen = SerialPortOpen(&serialPort, SERIAL_PORT_NAME, BAUD_RATE);
 
 		if(isOpen)
 		{
+			char discard;
 			printf("Connecting to EmStat Pico...\n");
 			// Flush any previous communication (required for Bluetooth on older dev-boards)
+			// A deadline of 0 makes ReadChar return as soon as no more data is available.
+			MSCommSetReadDeadline(&msComm, 0);
 			for (int i = 0 ; i < 3; i++)
 			{
 				WriteStr(&msComm, "\n");
 				Sleep(100); // Wait 100ms
-				while(ReadFromDevice() > 0);
+				while(ReadChar(&msComm, &discard) == CODE_OK);
 			}
 
+			// From now on, wait for data and give up if the EmStat Pico stops responding
+			MSCommSetReadDeadline(&msComm, READ_TIMEOUT_MS);
+
 			// To make sure we have the right serial port open we will check if the device on the other end is
 			// actually an EmStat.
-			int fSuccess = VerifyEmStatPico();
+			int fSuccess = VerifyEmStatPico(&msComm);
 			if(fSuccess)
 			{
 				printf("Serial port successfully connected to EmStat Pico.\n");
 			} else {
 				printf("Connected device is not EmStat Pico.\n");
+				SerialPortClose(&serialPort);
 				return -1;
 			}
 			// Everything is set up at this point, so time to send the script and process the response.
-			if(SendScriptFile(METHODSCRIPT_FILEPATHNAME) == CODE_OK)
+			if(SendScriptFile(&msComm, METHODSCRIPT_FILEPATHNAME) == CODE_OK)
 			{
 				printf("\nMethodSCRIPT sent to EmStat Pico.\n");
-				process_emstat_response();
+				process_emstat_response(&msComm, &csv);
 			}
 
-			close_csv_file();
+			close_csv_file(&csv);
 
-			CloseSerialPort();
+			SerialPortClose(&serialPort);
+#ifdef CAPTURE_FILEPATHNAME
+			if (MSCaptureClose(&capture) != CODE_OK)
+				printf("ERROR: Could not write the capture file [%s].\n", CAPTURE_FILEPATHNAME);
+#endif
 		} else {
 			printf("ERROR: Could not open serial port [%s].\n", SERIAL_PORT_NAME);
 		}
@@ -34,6 +34,7 @@
 #ifndef ESPICOCODEEXAMPLE_H
 #define ESPICOCODEEXAMPLE_H
 
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
@@ -42,6 +43,8 @@
 
 #include "MethodSCRIPTcomm/MSComm.h"
 #include "MethodSCRIPTcomm/MSCommon.h"
+#include "MethodSCRIPTcomm/MSAsyncWriter.h"
+#include "MethodSCRIPTcomm/MSCsvWriter.h"
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -61,8 +64,45 @@
 #endif
 #define BAUD_RATE 230400										   // The baud rate for EmStat Pico
 
-// Maximum number of characters that the EmStat Pico can receive in one line
-#define MS_MAX_LINECHARS	128
+// Maximum time to wait for one line of response from the EmStat Pico, in milliseconds.
+// Increase this for scripts that contain long `wait` commands or slow measurements.
+#define READ_TIMEOUT_MS		30000
+
+// Number of received packages that can wait to be displayed and stored, must be a power of 2.
+// If displaying or storing is slower than the measurement for longer than this, packages are lost.
+#define PACKAGE_RING_SIZE	1024
+// Number of packages to receive into: one for every entry of the ring and a few that are being received or processed
+#define PACKAGE_POOL_SIZE	(PACKAGE_RING_SIZE + 4)
+
+// Uncomment to record all communication with the EmStat Pico in a capture file (see MSCapture.h).
+// The capture can be replayed later, e.g. with Tools/ReplayCapture.c, to process the measurement again.
+//#define CAPTURE_FILEPATHNAME	"./Results/MSExample.mscap"
+
+// Uncomment to also store the results in a binary result file (see MSResultFile.h), which analysis tools
+// can read much faster than the CSV file, e.g. with `ReplayCapture -r`.
+//#define RESULT_BINARY_FILEPATHNAME	"./Results/MSExample.msres"
+
+// Uncomment to also store every response in a record log (see MSRecordLog.h). If the computer fails, the log
+// is intact up to the last `MSRECORDLOG_DEFAULT_LATENCY_MS`. It can be converted to a CSV or result file
+// with `ReplayCapture -l`. An existing log is appended to.
+//#define RECORD_LOG_FILEPATHNAME	"./Results/MSExample.msrlog"
+
+// Uncomment to also store the results in a series of CSV files of bounded size (see MSSegmentWriter.h), for
+// measurements that run for days. A new file is started after SEGMENT_MAX_BYTES or SEGMENT_MAX_SECONDS, and
+// finished files are listed in "./Results/MSExample_manifest.csv", so they can be moved while measuring.
+//#define SEGMENT_FILEPATHNAME	"./Results/MSExample"
+#define SEGMENT_MAX_BYTES	(64 * 1024 * 1024)
+#define SEGMENT_MAX_SECONDS	3600
+
+
+// A CSV file that the results of a measurement are stored in
+typedef struct _CsvOutput
+{
+	const char *filename;	// Path of the CSV file, created when the response begins
+	bool isOpen;			// Set from the begin until the end of the response
+	MSAsyncWriter file;		// Writes the file on a background thread, so a slow disk does not hold up the measurement
+	MSCsvWriter writer;		// Formats the results into the buffers of `file`
+} CsvOutput;
 
 
 //
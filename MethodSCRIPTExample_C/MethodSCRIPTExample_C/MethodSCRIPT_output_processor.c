@@ -40,12 +40,6 @@
 
 #include "MethodSCRIPTExample.h"
 
-// CSV File pointer
-FILE *pFCsv;
-
-// Path to the CSF file to create
-extern const char* RESULT_FILEPATHNAME;
-
 
 ///
 /// Print one MethodSCRIPT output subpackage on the console.
@@ -53,52 +47,25 @@ extern const char* RESULT_FILEPATHNAME;
 /// parameters:
 ///   subpackage The subpackage to process
 ///
-void PrintSubpackage(const MscrSubPackage subpackage)
+void PrintSubpackage(const MscrSubPackage *subpackage)
 {
-	// Format and print the subpackage value
-	// This is a bit bulky, but does nothing more than call printf with a format that is
+	// Format and print the subpackage value, with the label and format that are
 	// sensible for the `variable type` of the subpackage.
 
-	switch(subpackage.variable_type) {
-		case MSCR_VT_POTENTIAL:
-		case MSCR_VT_POTENTIAL_CE:
-		case MSCR_VT_POTENTIAL_SE:
-		case MSCR_VT_POTENTIAL_RE:
-		case MSCR_VT_POTENTIAL_GENERIC1:
-		case MSCR_VT_POTENTIAL_GENERIC2:
-		case MSCR_VT_POTENTIAL_GENERIC3:
-		case MSCR_VT_POTENTIAL_GENERIC4:
-		case MSCR_VT_POTENTIAL_WE_VS_CE:
-			printf("E[V]: %6.3f \t", subpackage.value);
-			break;
-		case MSCR_VT_CURRENT:
-		case MSCR_VT_CURRENT_GENERIC1:
-		case MSCR_VT_CURRENT_GENERIC2:
-		case MSCR_VT_CURRENT_GENERIC3:
-		case MSCR_VT_CURRENT_GENERIC4:
-			printf("I[A]: %11.3E \t", subpackage.value);
-			break;
-		case MSCR_VT_ZREAL:
-			printf("Zreal[Ohm]: %16.3f \t", subpackage.value);
-			break;
-		case MSCR_VT_ZIMAG:
-			printf("Zimag[Ohm]: %16.3f \t", subpackage.value);
-			break;
-		case MSCR_VT_CELL_SET_POTENTIAL:
-			printf("E set[V]: %6.3f \t", subpackage.value);
-			break;
-		case MSCR_VT_CELL_SET_CURRENT:
-			printf("I set[A]: %11.3E \t", subpackage.value);
-			break;
-		case MSCR_VT_CELL_SET_FREQUENCY:
-			printf("F set[Hz]: %6.3E \t", subpackage.value);
-			break;
-		case MSCR_VT_CELL_SET_AMPLITUDE:
-			printf("A set[V]: %6.3f \t", subpackage.value);
-			break;
-		case MSCR_VT_UNKNOWN:
-		default:
-			printf("?%d?[?] %16.3f ", subpackage.variable_type, subpackage.value);
+	const float value = GetSubpackageValue(subpackage);
+	const int status = GetSubpackageStatus(subpackage);
+	const int current_range = GetSubpackageCurrentRange(subpackage);
+	const MscrVarTypeInfo *info = GetVarTypeInfo(GetSubpackageVarType(subpackage));
+
+	if (info->label != NULL)
+	{
+		printf("%s: ", info->label);
+		printf(info->format, value);
+		printf(" \t");
+	}
+	else
+	{
+		printf("?%d?[?] %16.3f ", GetSubpackageVarType(subpackage), value);
 	}
 
 
@@ -106,10 +73,10 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 	// Note a value of <0 indicates it was provided in the MethodSCRIPT output
 
 	// `Status` field metadata
-	if (subpackage.metadata.status >= 0)
+	if (status >= 0)
 	{
 		const	char *status_str;
-		if (subpackage.metadata.status == 0)
+		if (status == 0)
 		{
 			status_str = StatusToString(0);
 		}
@@ -119,7 +86,7 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 			// Only print the first flag that was set to keep the output readable.
 			for (int i = 0; i < 31; i++)
 			{
-				if ((subpackage.metadata.status & (1 << i)) != 0)
+				if ((status & (1 << i)) != 0)
 				{
 					status_str = StatusToString(1 << i);
 					break;
@@ -131,9 +98,9 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 	}
 
 	// `current range` metadata
-	if (subpackage.metadata.current_range >= 0)
+	if (current_range >= 0)
 	{
-		const char *current_range_str = current_range_to_string(subpackage.metadata.current_range);
+		const char *current_range_str = current_range_to_string(current_range);
 
 		printf("CR: %-20s \t", current_range_str);
 	}
@@ -145,10 +112,10 @@ void PrintSubpackage(const MscrSubPackage subpackage)
 //
 // parameters:
 //    code        The status code from the received package
-//    package     The processed MethodSCRIPT package
+//    package     The processed MethodSCRIPT package, only used if `code` is CODE_OK
 //    package_nr  The package number within the current measurement-loop (starts at 0)
 //
-void DisplayResults(const RetCode code, const MscrPackage package, const int package_nr)
+void DisplayResults(const RetCode code, const MscrPackage *package, const int package_nr)
 {
 	switch(code)
 	{
@@ -165,8 +132,8 @@ void DisplayResults(const RetCode code, const MscrPackage package, const int pac
 			printf(" %d \t", package_nr + 1);
 
 			// Print all subpackages in
-			for (int i = 0; i < package.nr_of_subpackages; i++)
-				PrintSubpackage(package.subpackages[i]);
+			for (int i = 0; i < package->nr_of_subpackages; i++)
+				PrintSubpackage(&package->subpackages[i]);
 
 			printf("\n");
 		 	fflush(stdout);
@@ -188,124 +155,52 @@ void DisplayResults(const RetCode code, const MscrPackage package, const int pac
 // Open a new CSV file for writing. Overwrite if it already exists.
 //
 // parameters:
-//    pFilename    The filename/path for the new CSV file
-//    fp           The pointer to store the created file pointer in.
+//    csv          The CSV output, `filename` is the filename/path for the new CSV file
 //
-void OpenCSVFile(const char *pFilename, FILE **fp)
+void OpenCSVFile(CsvOutput *csv)
 {
-	*fp = fopen(pFilename, "w");		//Open file for writing (overwrite existing)
-	if (*fp == NULL)
-	{
-		printf("Could not open CSV file %s (hint: make sure the directory exists)", pFilename);
-	}
-
-	// Add an extra line to tell Microsoft Excel that we use "," as separator
-	if (SET_SEPARATOR_FOR_MS_EXCEL == 1)
+	FILE *fp = fopen(csv->filename, "w");		//Open file for writing (overwrite existing)
+	if (fp == NULL)
 	{
-		fprintf(*fp, "\"sep=,\"\n");
+		printf("Could not open CSV file %s (hint: make sure the directory exists)", csv->filename);
+		return;
 	}
-}
-
-
-//
-// Write a CSV header to the file. The fields in the header are determined by the `variable types`
-// in the provided package.
-//
-// parameters:
-//    fp               File pointer of the opened CSV file
-//    first_package    The first package in the measurement loop, used to determine the header fields
-//
-//
-void WriteHeaderToCSVFile(FILE *fp, MscrPackage first_package)
-{
-	if (fp == NULL)
+	if (MSAsyncWriterOpen(&csv->file, fp, 0, 0) != CODE_OK)
 	{
-		printf("Unable to write header to CSV file\n");
-		fflush(stdout);
+		printf("Not enough memory to write CSV file %s\n", csv->filename);
+		fclose(fp);
 		return;
 	}
+	MSCsvWriterInitAsync(&csv->writer, &csv->file);
+	csv->isOpen = true;
 
-	// The first field is always the package index
-	fprintf(fp, "\"Index\"");
-
-	// Loop through package to find Variable types
-	for (int i = 0; i < first_package.nr_of_subpackages; i++)
+	// Add an extra line to tell Microsoft Excel that we use "," as separator
+	if (SET_SEPARATOR_FOR_MS_EXCEL == 1)
 	{
-		const char *variable_typename_str = VartypeToString(first_package.subpackages[i].variable_type);
-		fprintf(fp, ",\"%s\"", variable_typename_str);
-
-		if(first_package.subpackages[i].metadata.status >= 0)
-			fprintf(fp, ",\"Status\"");
-		if(first_package.subpackages[i].metadata.current_range >= 0)
-			fprintf(fp, ",\"Current Range\"");
-
+		MSCsvWriteText(&csv->writer, "\"sep=,\"\n");
 	}
-
-	// Terminate the line
-	fprintf(fp, "\n");
 }
 
 
 //
-// Write one data package to the CSV file
+// Write the remaining results and close the CSV file on the operating system.
 //
-// parameters:
-//    fp          File pointer of the opened CSV file
-//    package     The processed MethodSCRIPT package
-//    package_nr  The package number within the current measurement-loop (starts at 0)
-//
-void WriteDataToCSVFile(FILE *fp, const MscrPackage package, int package_nr)
+void close_csv_file(CsvOutput *csv)
 {
-	if (fp == NULL)
-	{
-		printf("Unable to write to CSV file\n");
-		fflush(stdout);
-		return;
-	}
-
-	// Start the CSV line with a package index
-	fprintf(fp, "%d", package_nr + 1);
-
-	// Loop through package and add values to the CSV cells
-	for (int i = 0; i < package.nr_of_subpackages; i++)
-	{
-		fprintf(fp, ",\"%.15f\"", package.subpackages[i].value);
-
-		// Also print metadata if available
-
-		if (package.subpackages[i].metadata.status >= 0)
-		{
-			const	char *status_str;
-			if (package.subpackages[i].metadata.status == 0)
-			{
-				status_str = StatusToString(0);
-			}
-			else
-			{
-				// Find the first status flag that is set.
-				for (int bit = 0; bit < 31; bit++)
-				{
-					if ((package.subpackages[i].metadata.status & (1 << bit)) != 0)
-					{
-						status_str = StatusToString(1 << bit);
-						break;
-					}
-				}
-			}
-			fprintf(fp, ",\"%s\"", status_str);
-		}
-
-		// Print current range if available
-		if (package.subpackages[i].metadata.current_range >= 0)
-		{
-			const char *current_range_str = current_range_to_string(package.subpackages[i].metadata.current_range);
-
-			fprintf(fp, ",\"%s\"", current_range_str);
-		}
-	}
+	MSAsyncWriterStats stats;
 
-	// Terminate the line
-	fprintf(fp, "\n");
+	if (!csv->isOpen)
+		return;
+	MSCsvWriterFree(&csv->writer);
+	MSAsyncWriterGetStats(&csv->file, &stats);
+	if (MSAsyncWriterClose(&csv->file) != CODE_OK)
+		printf("ERROR: Could not write CSV file %s\n", csv->filename);
+	// Waiting means that the disk was slower than the measurement for longer than one buffer
+	if (stats.waits > 0)
+		printf("Writing the CSV file held up processing %llu times, %llu ms in total (longest write %llu ms)\n",
+				(unsigned long long)stats.waits, (unsigned long long)(stats.waitTimeUs / 1000),
+				(unsigned long long)(stats.maxWriteUs / 1000));
+	csv->isOpen = false;
 }
 
 
@@ -316,42 +211,38 @@ void WriteDataToCSVFile(FILE *fp, const MscrPackage package, int package_nr)
 // and may in that case not match the header.
 //
 // parameters:
+//    csv         The CSV file to write to, opened when the response begins
 //    code        The status code from the received package
-//    package     The processed MethodSCRIPT package
+//    package     The processed MethodSCRIPT package, only used if `code` is CODE_OK
 //    package_nr  The package number within the current measurement-loop (starts at 0)
 //
-void ResultsToCsv(const RetCode code, const MscrPackage package, const int package_nr)
+void ResultsToCsv(CsvOutput *csv, const RetCode code, const MscrPackage *package, const int package_nr)
 {
 	switch(code)
 	{
 	case CODE_RESPONSE_BEGIN:					// Measurement response begins
-		OpenCSVFile(RESULT_FILEPATHNAME, &pFCsv);
+		OpenCSVFile(csv);
 		break;
 	case CODE_MEASURING:
 		break;
 	case CODE_OK:								// Received valid package, print it.
+		if (!csv->isOpen)
+			break;
 		if(package_nr == 0)
 		{
-			WriteHeaderToCSVFile(pFCsv, package);
+			// The fields in the header are determined by the `variable types` in the first package
+			MSCsvWriteHeader(&csv->writer, package);
 		}
-		WriteDataToCSVFile(pFCsv, package, package_nr);
+		MSCsvWritePackage(&csv->writer, package, package_nr + 1);
 		break;
 	case CODE_MEASUREMENT_DONE:         // Measurement loop complete
-		fprintf(pFCsv, "\n");            // Add a empty line to create a new section
+		if (csv->isOpen)
+			MSCsvWriteText(&csv->writer, "\n");		// Add a empty line to create a new section
+		break;
+	case CODE_RESPONSE_END:             // Measurement response end, write the remaining results
+		close_csv_file(csv);
 		break;
-	case CODE_RESPONSE_END:             // Measurement response end
-	    break;
 	default:                            // Failed to parse or identify package.
 		break;
 	}
 }
-
-
-//
-// Close the CSV file on the operating system.
-//
-void close_csv_file()
-{
-	if (pFCsv != NULL)
-		fclose(pFCsv);
-}
@@ -0,0 +1,108 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSArena.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "MSArena.h"
+
+
+// The size of the block header, rounded up so the memory after it starts aligned
+#define BLOCK_HEADER_SIZE	((sizeof(MSArenaBlock) + MSARENA_ALIGNMENT - 1) & ~(size_t)(MSARENA_ALIGNMENT - 1))
+
+
+//
+// See documentation in MSArena.h
+//
+void MSArenaInit(MSArena *arena, size_t blockSize)
+{
+	arena->blocks = NULL;
+	arena->blockSize = (blockSize > 0) ? blockSize : MSARENA_DEFAULT_BLOCK_SIZE;
+	arena->allocated = 0;
+}
+
+
+//
+// See documentation in MSArena.h
+//
+void* MSArenaAlloc(MSArena *arena, size_t size)
+{
+	MSArenaBlock *block = arena->blocks;
+
+	size = (size + MSARENA_ALIGNMENT - 1) & ~(size_t)(MSARENA_ALIGNMENT - 1);
+	if (block == NULL || block->size - block->used < size)
+	{
+		size_t blockSize = (size > arena->blockSize) ? size : arena->blockSize;
+
+		// Allocate one extra alignment, malloc only guarantees the alignment of the largest basic type
+		char *memory = malloc(BLOCK_HEADER_SIZE + blockSize + MSARENA_ALIGNMENT);
+		if (memory == NULL)
+			return NULL;
+		block = (MSArenaBlock *)memory;
+		block->size = blockSize;
+		block->used = (-(uintptr_t)(memory + BLOCK_HEADER_SIZE)) & (MSARENA_ALIGNMENT - 1);
+		block->size += block->used;
+
+		// A block for one large allocation is put behind the current block, so the remainder of the
+		// current block can still be used for the next small allocations
+		if (size > arena->blockSize && arena->blocks != NULL)
+		{
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		}
+		else
+		{
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		arena->allocated += blockSize;
+	}
+
+	void *result = (char *)block + BLOCK_HEADER_SIZE + block->used;
+	block->used += size;
+	return result;
+}
+
+
+//
+// See documentation in MSArena.h
+//
+void MSArenaFree(MSArena *arena)
+{
+	while (arena->blocks != NULL)
+	{
+		MSArenaBlock *next = arena->blocks->next;
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+	arena->allocated = 0;
+}
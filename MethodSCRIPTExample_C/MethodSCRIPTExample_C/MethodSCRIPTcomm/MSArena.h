@@ -0,0 +1,126 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSArena.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSArena is a simple region allocator for data that is freed all at once, such as a measurement dataset.
+ *	Memory is taken from large blocks by incrementing an offset, so an allocation costs a few instructions
+ *	and the data ends up contiguous in memory. Allocations larger than a block get a block of their own.
+ *	There is no way to free a single allocation: all memory of an arena is freed by `MSArenaFree()`.
+ *
+ *	Every allocation is aligned to `MSARENA_ALIGNMENT` bytes, so arrays can be processed with aligned
+ *	SIMD loads and different arrays never share a cache line.
+ *
+ *	An arena must not be used by more than one thread at a time.
+ *
+ ============================================================================
+ */
+
+#ifndef MSARENA_H
+#define MSARENA_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and macros
+//////////////////////////////////////////////////////////////////////////////
+
+/// The alignment of every allocation in bytes (the cache line size)
+#define MSARENA_ALIGNMENT	64
+
+/// The default size of the blocks in which an arena grows
+#define MSARENA_DEFAULT_BLOCK_SIZE	(1024 * 1024)
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// One block of memory of an arena, followed by the memory itself
+///
+typedef struct _MSArenaBlock
+{
+	struct _MSArenaBlock *next;		// The previously allocated block
+	size_t size;					// The number of bytes of memory after the header
+	size_t used;					// The number of bytes that have been handed out
+} MSArenaBlock;
+
+///
+/// A region allocator
+///
+typedef struct _MSArena
+{
+	MSArenaBlock *blocks;			// The most recently allocated block, from which memory is taken
+	size_t blockSize;				// The size of new blocks
+	size_t allocated;				// The total size of all blocks
+} MSArena;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Initialises an empty arena. No memory is allocated until the first call to `MSArenaAlloc()`.
+///
+/// parameters:
+///   arena      - The arena to initialise
+///   blockSize  - The size of the blocks in bytes, 0 for `MSARENA_DEFAULT_BLOCK_SIZE`
+///
+void MSArenaInit(MSArena *arena, size_t blockSize);
+
+
+///
+/// Allocates memory from an arena. The memory is not cleared.
+///
+/// parameters:
+///   arena  - The arena
+///   size   - The number of bytes to allocate
+///
+/// Returns:
+///   Memory aligned to `MSARENA_ALIGNMENT` bytes, or NULL if out of memory
+///
+void* MSArenaAlloc(MSArena *arena, size_t size);
+
+
+///
+/// Frees all memory of an arena. The arena is empty afterwards and can be used again.
+///
+void MSArenaFree(MSArena *arena);
+
+
+#endif //MSARENA_H
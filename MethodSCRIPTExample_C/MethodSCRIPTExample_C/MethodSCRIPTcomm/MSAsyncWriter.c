@@ -0,0 +1,323 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSAsyncWriter.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __WIN32
+	#include <windows.h>
+	#include <io.h>
+#else
+	#include <time.h>
+	#include <unistd.h>
+#endif
+
+#include "MSAsyncWriter.h"
+
+
+//
+// Returns the time of a monotonic clock in microseconds
+//
+static uint64_t NowUs(void)
+{
+#ifdef __WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000
+			+ (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+
+//
+// Writes the data of the file to the disk
+//
+static int SyncFile(FILE *fp)
+{
+#ifdef __WIN32
+	return _commit(_fileno(fp));
+#else
+	return fdatasync(fileno(fp));
+#endif
+}
+
+
+//
+// The thread that writes the buffers handed to it
+//
+static void* RunWriter(void *context)
+{
+	MSAsyncWriter *writer = context;
+
+	pthread_mutex_lock(&writer->mutex);
+	for (;;)
+	{
+		while (writer->pending == NULL && !writer->stop)
+			pthread_cond_wait(&writer->submitted, &writer->mutex);
+		if (writer->pending == NULL)
+			break;
+
+		const char *data = writer->pending;
+		size_t length = writer->pendingLength;
+		FILE *fp = writer->pendingFile;
+		int sync = writer->pendingSync;
+		int close = writer->pendingClose;
+		pthread_mutex_unlock(&writer->mutex);
+
+		// Write without holding the lock, the producer keeps filling the other buffer
+		uint64_t start = NowUs();
+		int failed = (length > 0 && fwrite(data, 1, length, fp) != length);
+		failed |= (fflush(fp) != 0);
+		if (sync)
+			failed |= (SyncFile(fp) != 0);
+		if (close)
+			failed |= (fclose(fp) != 0);
+		uint64_t duration = NowUs() - start;
+
+		pthread_mutex_lock(&writer->mutex);
+		if (failed && writer->error == CODE_OK)
+			writer->error = CODE_ERROR;
+		writer->stats.bytesWritten += length;
+		writer->stats.buffersWritten++;
+		writer->stats.syncs += (sync != 0);
+		writer->stats.filesClosed += (close != 0);
+		if (duration > writer->stats.maxWriteUs)
+			writer->stats.maxWriteUs = duration;
+		writer->pending = NULL;
+		pthread_cond_broadcast(&writer->written);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+	return NULL;
+}
+
+
+//
+// Hands the buffer being filled to the thread and continues with the other buffer.
+// Waits first if the thread is still writing the other buffer. If `close` is set, the thread
+// closes the file after writing the buffer.
+//
+static void Submit(MSAsyncWriter *writer, int sync, int close)
+{
+	pthread_mutex_lock(&writer->mutex);
+	if (writer->pending != NULL)
+	{
+		uint64_t start = NowUs();
+		while (writer->pending != NULL)
+			pthread_cond_wait(&writer->written, &writer->mutex);
+		uint64_t duration = NowUs() - start;
+
+		writer->stats.waits++;
+		writer->stats.waitTimeUs += duration;
+		if (duration > writer->stats.maxWaitUs)
+			writer->stats.maxWaitUs = duration;
+	}
+	writer->pending = writer->fill;
+	writer->pendingLength = writer->fillLength;
+	writer->pendingFile = writer->fp;
+	writer->pendingSync = sync;
+	writer->pendingClose = close;
+	pthread_cond_signal(&writer->submitted);
+	pthread_mutex_unlock(&writer->mutex);
+
+	writer->fill = (writer->fill == writer->buffers[0]) ? writer->buffers[1] : writer->buffers[0];
+	writer->fillLength = 0;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+RetCode MSAsyncWriterOpen(MSAsyncWriter *writer, FILE *fp, size_t bufferSize, int flags)
+{
+	if (writer == NULL || fp == NULL)
+		return CODE_NULL;
+	if (bufferSize == 0)
+		bufferSize = MSASYNC_DEFAULT_BUFFER_SIZE;
+	if (bufferSize < MSASYNC_MIN_BUFFER_SIZE)
+		bufferSize = MSASYNC_MIN_BUFFER_SIZE;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->fp = fp;
+	writer->flags = flags;
+	writer->bufferSize = bufferSize;
+	writer->error = CODE_OK;
+	writer->buffers[0] = malloc(bufferSize);
+	writer->buffers[1] = malloc(bufferSize);
+	if (writer->buffers[0] == NULL || writer->buffers[1] == NULL)
+	{
+		free(writer->buffers[0]);
+		free(writer->buffers[1]);
+		return CODE_ERROR;
+	}
+	writer->fill = writer->buffers[0];
+	// The buffers are written in large blocks, so the file does not need a buffer of its own
+	setvbuf(fp, NULL, _IONBF, 0);
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->submitted, NULL);
+	pthread_cond_init(&writer->written, NULL);
+	if (pthread_create(&writer->thread, NULL, RunWriter, writer) != 0)
+	{
+		pthread_cond_destroy(&writer->written);
+		pthread_cond_destroy(&writer->submitted);
+		pthread_mutex_destroy(&writer->mutex);
+		free(writer->buffers[0]);
+		free(writer->buffers[1]);
+		return CODE_ERROR;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+RetCode MSAsyncWriterClose(MSAsyncWriter *writer)
+{
+	MSAsyncWriterFlush(writer, writer->flags & MSASYNC_SYNC);
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->stop = 1;
+	pthread_cond_signal(&writer->submitted);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	if (fclose(writer->fp) != 0 && writer->error == CODE_OK)
+		writer->error = CODE_ERROR;
+	pthread_cond_destroy(&writer->written);
+	pthread_cond_destroy(&writer->submitted);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer->buffers[0]);
+	free(writer->buffers[1]);
+	writer->fp = NULL;
+	writer->buffers[0] = NULL;
+	writer->buffers[1] = NULL;
+	writer->fill = NULL;
+	return writer->error;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+RetCode MSAsyncWrite(MSAsyncWriter *writer, const void *data, size_t length)
+{
+	const char *bytes = data;
+
+	while (length > 0)
+	{
+		if (writer->fillLength == writer->bufferSize)
+			Submit(writer, writer->flags & MSASYNC_SYNC, 0);
+
+		size_t part = writer->bufferSize - writer->fillLength;
+		if (part > length)
+			part = length;
+		memcpy(writer->fill + writer->fillLength, bytes, part);
+		writer->fillLength += part;
+		bytes += part;
+		length -= part;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	RetCode error = writer->error;
+	pthread_mutex_unlock(&writer->mutex);
+	return error;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+char* MSAsyncWriterReserve(MSAsyncWriter *writer, size_t minimum, size_t *available)
+{
+	if (writer->bufferSize - writer->fillLength < minimum)
+		Submit(writer, writer->flags & MSASYNC_SYNC, 0);
+	*available = writer->bufferSize - writer->fillLength;
+	return writer->fill + writer->fillLength;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+void MSAsyncWriterCommit(MSAsyncWriter *writer, size_t length)
+{
+	writer->fillLength += length;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+RetCode MSAsyncWriterFlush(MSAsyncWriter *writer, int sync)
+{
+	if (writer->fillLength > 0 || sync)
+		Submit(writer, sync || (writer->flags & MSASYNC_SYNC), 0);
+
+	pthread_mutex_lock(&writer->mutex);
+	while (writer->pending != NULL)
+		pthread_cond_wait(&writer->written, &writer->mutex);
+	RetCode error = writer->error;
+	pthread_mutex_unlock(&writer->mutex);
+	return error;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+RetCode MSAsyncWriterSwitchFile(MSAsyncWriter *writer, FILE *fp)
+{
+	Submit(writer, writer->flags & MSASYNC_SYNC, 1);
+	writer->fp = fp;
+	setvbuf(fp, NULL, _IONBF, 0);
+
+	pthread_mutex_lock(&writer->mutex);
+	RetCode error = writer->error;
+	pthread_mutex_unlock(&writer->mutex);
+	return error;
+}
+
+
+//
+// See documentation in MSAsyncWriter.h
+//
+void MSAsyncWriterGetStats(MSAsyncWriter *writer, MSAsyncWriterStats *stats)
+{
+	pthread_mutex_lock(&writer->mutex);
+	*stats = writer->stats;
+	pthread_mutex_unlock(&writer->mutex);
+}
@@ -0,0 +1,225 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSAsyncWriter.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSAsyncWriter writes a file on a background thread, so a slow disk does not hold up the thread
+ *	that produces the data. The producer fills one buffer while the thread writes (and optionally syncs)
+ *	the other one. When both buffers are full, the producer waits until the thread has written one:
+ *	the memory used is bounded and the waits are counted, so a disk that cannot keep up shows in the
+ *	statistics instead of going unnoticed.
+ *
+ *	Sinks such as MSCsvWriter and MSResultWriter can write into an MSAsyncWriter instead of a file.
+ *	Data can be added by copying it with `MSAsyncWrite()`, or formatted directly into the buffer with
+ *	`MSAsyncWriterReserve()` and `MSAsyncWriterCommit()`. `MSAsyncWriterSwitchFile()` continues in another
+ *	file without waiting, the thread closes the previous file when it has written it.
+ *
+ *	All functions except `MSAsyncWriterGetStats()` must be called from the same (producer) thread.
+ *
+ ============================================================================
+ */
+
+#ifndef MSASYNCWRITER_H
+#define MSASYNCWRITER_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "MSCommon.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The default size of each of the two buffers of a writer
+#define MSASYNC_DEFAULT_BUFFER_SIZE	(1024 * 1024)
+
+/// The smallest size of a buffer
+#define MSASYNC_MIN_BUFFER_SIZE		(64 * 1024)
+
+/// Flag: write the data to the disk (`fdatasync`) after every buffer and when the file is closed,
+/// so at most two buffers are lost if the computer fails.
+#define MSASYNC_SYNC				0x01
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Statistics of a writer
+///
+typedef struct _MSAsyncWriterStats
+{
+	uint64_t bytesWritten;
+	uint64_t buffersWritten;
+	uint64_t syncs;					// Number of times the data was written to the disk
+	uint64_t filesClosed;			// Number of files that were switched away from and have been closed
+	uint64_t waits;					// Number of times the producer had to wait because both buffers were full
+	uint64_t waitTimeUs;			// Total time the producer waited, in microseconds
+	uint64_t maxWaitUs;				// Longest time the producer waited
+	uint64_t maxWriteUs;			// Longest time to write (and sync) one buffer
+} MSAsyncWriterStats;
+
+///
+/// A file that is written on a background thread
+///
+typedef struct _MSAsyncWriter
+{
+	FILE *fp;						// The file that new data goes to
+	int flags;
+	size_t bufferSize;				// The size of each buffer
+	char *buffers[2];
+
+	// Used by the producer only
+	char *fill;						// The buffer being filled
+	size_t fillLength;				// The number of bytes in `fill`
+
+	// Shared with the thread, protected by `mutex`
+	pthread_mutex_t mutex;
+	pthread_cond_t submitted;		// Signalled when a buffer is handed to the thread or the thread must stop
+	pthread_cond_t written;			// Signalled when the thread has written a buffer
+	const char *pending;			// The buffer handed to the thread, NULL if the thread is idle
+	size_t pendingLength;
+	FILE *pendingFile;				// The file to write `pending` to
+	int pendingSync;				// Set if the thread must sync after writing `pending`
+	int pendingClose;				// Set if the thread must close `pendingFile` after writing `pending`
+	int stop;						// Set if the thread must stop when it is idle
+	RetCode error;					// The first error that occurred, CODE_OK if none
+	MSAsyncWriterStats stats;
+
+	pthread_t thread;
+} MSAsyncWriter;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Allocates the buffers of a writer and starts its thread
+///
+/// parameters:
+///   writer      - The writer to initialise
+///   fp          - The opened file to write to. The writer takes it over and closes it in `MSAsyncWriterClose()`.
+///                 The file should not be used by anything else while the writer is open.
+///   bufferSize  - The size of each of the two buffers in bytes, 0 for `MSASYNC_DEFAULT_BUFFER_SIZE`
+///   flags       - 0 or MSASYNC_SYNC
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if `fp` is NULL or CODE_ERROR if out of memory or the thread could not
+///   be started. The file is not closed if the writer could not be opened.
+///
+RetCode MSAsyncWriterOpen(MSAsyncWriter *writer, FILE *fp, size_t bufferSize, int flags);
+
+
+///
+/// Writes all data, stops the thread, closes the file and frees the buffers.
+///
+/// Returns:
+///   CODE_OK if all data was written or CODE_ERROR if writing failed at any time.
+///
+RetCode MSAsyncWriterClose(MSAsyncWriter *writer);
+
+
+///
+/// Copies data into the buffers. If both buffers are full, this waits until the thread has written one.
+///
+/// Returns:
+///   CODE_OK or CODE_ERROR if writing failed at any time before.
+///
+RetCode MSAsyncWrite(MSAsyncWriter *writer, const void *data, size_t length);
+
+
+///
+/// Gets room in the buffer to format data into directly. If the buffer being filled has less than `minimum`
+/// bytes left, it is handed to the thread first, which waits if the thread is still writing the other buffer.
+/// The data is added by `MSAsyncWriterCommit()`.
+///
+/// parameters:
+///   writer     - The writer
+///   minimum    - The number of bytes needed, at most the buffer size
+///   available  - Receives the number of bytes that can be written at the returned address
+///
+/// Returns:
+///   The address to write to, it is valid until the next call to a function of the writer
+///
+char* MSAsyncWriterReserve(MSAsyncWriter *writer, size_t minimum, size_t *available);
+
+
+///
+/// Adds `length` bytes written at the address returned by `MSAsyncWriterReserve()`
+///
+void MSAsyncWriterCommit(MSAsyncWriter *writer, size_t length);
+
+
+///
+/// Hands all data to the thread and waits until it is written, e.g. at the end of a measurement.
+///
+/// parameters:
+///   writer  - The writer
+///   sync    - Non-zero to also write the data to the disk (`fdatasync`)
+///
+/// Returns:
+///   CODE_OK if all data was written or CODE_ERROR if writing failed at any time.
+///
+RetCode MSAsyncWriterFlush(MSAsyncWriter *writer, int sync);
+
+
+///
+/// Continues in another file. The data added before is written to the previous file, which is then closed by the
+/// thread, so this only waits if the thread is still writing the other buffer.
+/// Use `MSAsyncWriterGetStats()` to find out when the previous file has been closed.
+///
+/// parameters:
+///   writer  - The writer
+///   fp      - The opened file to write to from now on. The writer takes it over.
+///
+/// Returns:
+///   CODE_OK or CODE_ERROR if writing failed at any time before.
+///
+RetCode MSAsyncWriterSwitchFile(MSAsyncWriter *writer, FILE *fp);
+
+
+///
+/// Gets the statistics of a writer. Can be called from any thread while the writer is open.
+///
+void MSAsyncWriterGetStats(MSAsyncWriter *writer, MSAsyncWriterStats *stats);
+
+
+#endif //MSASYNCWRITER_H
@@ -0,0 +1,787 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSBatch.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifndef __WIN32
+	#include <unistd.h>
+#endif
+
+#include "MSBatch.h"
+#include "MSCapture.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Work stealing thread pool
+//////////////////////////////////////////////////////////////////////////////
+
+// Function that executes one task of the pool
+typedef void (*TaskFunc)(void *context, int worker, int task);
+
+// A thread of the pool with the range of tasks it still has to execute
+typedef struct _Worker
+{
+	struct _Pool *pool;
+	int index;
+	pthread_t thread;
+	pthread_mutex_t lock;			// Protects `next` and `end`
+	int next;						// The next task to execute
+	int end;						// The end of the range of tasks
+} Worker;
+
+typedef struct _Pool
+{
+	TaskFunc taskFunc;
+	void *context;
+	int count;						// The number of workers
+	Worker *workers;
+} Pool;
+
+
+//
+// Takes the next task from the range of the worker
+// Returns the task or -1 if the range is empty
+//
+static int TakeTask(Worker *worker)
+{
+	int task = -1;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->next < worker->end)
+		task = worker->next++;
+	pthread_mutex_unlock(&worker->lock);
+	return task;
+}
+
+
+//
+// Moves the second half of the remaining tasks of another worker to an idle worker
+// Returns 1 if tasks were stolen or 0 if all other workers are out of work as well
+//
+static int StealTasks(Worker *thief)
+{
+	Pool *pool = thief->pool;
+
+	for (int i = 1; i < pool->count; i++)
+	{
+		Worker *victim = &pool->workers[(thief->index + i) % pool->count];
+		int begin, end;
+
+		pthread_mutex_lock(&victim->lock);
+		begin = victim->next + (victim->end - victim->next) / 2;
+		end = victim->end;
+		victim->end = begin;
+		pthread_mutex_unlock(&victim->lock);
+
+		if (begin < end)
+		{
+			pthread_mutex_lock(&thief->lock);
+			thief->next = begin;
+			thief->end = end;
+			pthread_mutex_unlock(&thief->lock);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Executes tasks until there are none left in the pool
+//
+static void *RunWorker(void *argument)
+{
+	Worker *worker = argument;
+	int task;
+
+	do
+	{
+		while ((task = TakeTask(worker)) >= 0)
+			worker->pool->taskFunc(worker->pool->context, worker->index, task);
+	} while (StealTasks(worker));
+	return NULL;
+}
+
+
+//
+// Executes tasks 0 up to `count` on `threads` threads, including the calling thread, and waits until they are done.
+// The tasks are divided evenly at the start, workers that run out of tasks steal from the others.
+// If a thread cannot be started, its tasks are stolen by the others.
+//
+static void RunTasks(int count, int threads, TaskFunc taskFunc, void *context)
+{
+	Pool pool = { taskFunc, context, threads, NULL };
+	Worker single;
+	int started[MSBATCH_MAX_THREADS];
+
+	pool.workers = (threads > 1) ? calloc(threads, sizeof(Worker)) : &single;
+	if (pool.workers == NULL)
+	{
+		pool.workers = &single;
+		pool.count = threads = 1;
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		Worker *worker = &pool.workers[i];
+		worker->pool = &pool;
+		worker->index = i;
+		worker->next = (int)((long long)count * i / threads);
+		worker->end = (int)((long long)count * (i + 1) / threads);
+		pthread_mutex_init(&worker->lock, NULL);
+	}
+	for (int i = 1; i < threads; i++)
+		started[i] = (pthread_create(&pool.workers[i].thread, NULL, RunWorker, &pool.workers[i]) == 0);
+
+	RunWorker(&pool.workers[0]);
+
+	for (int i = 1; i < threads; i++)
+	{
+		if (started[i])
+			pthread_join(pool.workers[i].thread, NULL);
+	}
+	for (int i = 0; i < threads; i++)
+		pthread_mutex_destroy(&pool.workers[i].lock);
+	if (pool.workers != &single)
+		free(pool.workers);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Parsing
+//////////////////////////////////////////////////////////////////////////////
+
+// The parsing state of one file or chunk
+typedef struct _ParseState
+{
+	MSBatchEventFunc eventFunc;
+	void *context;
+	int worker;
+	MSBatchPosition position;		// The position of the next line
+} ParseState;
+
+
+//
+// Updates the position for a line from a MSParser and passes the line on, `context` is the ParseState
+//
+static void OnLine(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	ParseState *state = context;
+
+	if (line[0] == REPLY_MEASURING || line[0] == REPLY_NSCANS_START)
+	{
+		state->position.loop++;
+		state->position.index = 0;
+	}
+	state->eventFunc(state->context, state->worker, &state->position, event, line, length, package);
+	if (line[0] == REPLY_MEASURE_DP)
+	{
+		state->position.index++;
+		state->position.package++;
+	}
+}
+
+
+//
+// Returns the number of threads to use for a requested number
+//
+static int ThreadCount(int threads)
+{
+	if (threads <= 0)
+		threads = MSBatchDefaultThreads();
+	return (threads > MSBATCH_MAX_THREADS) ? MSBATCH_MAX_THREADS : threads;
+}
+
+
+//
+// See documentation in MSBatch.h
+//
+int MSBatchDefaultThreads(void)
+{
+#ifdef __WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Many files
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct _FileBatch
+{
+	const char *const *filenames;
+	MSBatchEventFunc eventFunc;
+	void *context;
+	atomic_int failed;				// Set if a file could not be processed, by any of the threads
+} FileBatch;
+
+
+//
+// Processes one file of a FileBatch, `context` is the FileBatch
+//
+static void ParseOneFile(void *context, int worker, int task)
+{
+	FileBatch *batch = context;
+	ParseState state = { batch->eventFunc, batch->context, worker, { task, -1, 0, 0 } };
+	MSLogFile log;
+	MSParser parser;
+
+	if (MSLogFileOpen(&log, batch->filenames[task]) != CODE_OK)
+	{
+		atomic_store_explicit(&batch->failed, 1, memory_order_relaxed);
+		batch->eventFunc(batch->context, worker, &state.position, CODE_ERROR, NULL, 0, NULL);
+		return;
+	}
+	MSParserInit(&parser, OnLine, &state);
+	if (MSLogFileParse(&log, &parser) != CODE_OK)
+	{
+		atomic_store_explicit(&batch->failed, 1, memory_order_relaxed);
+		batch->eventFunc(batch->context, worker, &state.position, CODE_ERROR, NULL, 0, NULL);
+	}
+	MSLogFileClose(&log);
+}
+
+
+//
+// See documentation in MSBatch.h
+//
+RetCode MSBatchParseFiles(const char *const *filenames, int count, int threads, MSBatchEventFunc eventFunc, void *context)
+{
+	FileBatch batch = { filenames, eventFunc, context, 0 };
+
+	if (filenames == NULL || eventFunc == NULL)
+		return CODE_NULL;
+	if (count <= 0)
+		return CODE_OK;
+
+	threads = ThreadCount(threads);
+	RunTasks(count, (threads < count) ? threads : count, ParseOneFile, &batch);
+	// The worker threads are joined, so their stores are visible
+	return atomic_load_explicit(&batch.failed, memory_order_relaxed) ? CODE_ERROR : CODE_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// One file in chunks
+//////////////////////////////////////////////////////////////////////////////
+
+// A part of the received data in the mapped file. For a raw log this is the whole file.
+typedef struct _Segment
+{
+	const char *data;
+	size_t length;
+	size_t offset;					// The position of `data` in the received data
+} Segment;
+
+// A range of complete lines of the received data
+typedef struct _Chunk
+{
+	size_t begin;
+	size_t end;
+	long loops;						// Number of lines that start a loop or scan
+	long packages;					// Number of data packages
+	long trailingPackages;			// Number of data packages after the last line that starts a loop or scan
+	MSBatchPosition start;			// The position at the start of the chunk
+} Chunk;
+
+typedef struct _ChunkBatch
+{
+	Segment *segments;
+	int segmentCount;
+	size_t size;					// Total length of the received data
+	Chunk *chunks;
+	int chunkCount;
+	MSBatchEventFunc eventFunc;
+	void *context;
+} ChunkBatch;
+
+
+//
+// Collects the received data of a log file as segments
+// Returns CODE_OK if successful, CODE_UNEXPECTED_DATA if a capture file is incomplete or CODE_ERROR if out of memory.
+//
+static RetCode CollectSegments(const MSLogFile *log, ChunkBatch *batch)
+{
+	size_t position = MSCAPTURE_MAGIC_LENGTH;
+	int capacity = 0;
+
+	batch->segments = NULL;
+	batch->segmentCount = 0;
+	batch->size = 0;
+	if (log->format == LOG_FORMAT_RAW)
+	{
+		batch->segments = malloc(sizeof(Segment));
+		if (batch->segments == NULL)
+			return CODE_ERROR;
+		batch->segments[0] = (Segment) { log->data, log->size, 0 };
+		batch->segmentCount = 1;
+		batch->size = log->size;
+		return CODE_OK;
+	}
+
+	while (position < log->size)
+	{
+		MSCaptureRecord record;
+		size_t length = MSCaptureDecodeRecord(log->data + position, log->size - position, &record);
+		if (length == 0)
+			return CODE_UNEXPECTED_DATA;
+		position += length;
+		if (record.direction != CAPTURE_RECEIVED || record.length == 0)
+			continue;
+
+		if (batch->segmentCount == capacity)
+		{
+			capacity = (capacity > 0) ? capacity * 2 : 1024;
+			Segment *segments = realloc(batch->segments, capacity * sizeof(Segment));
+			if (segments == NULL)
+				return CODE_ERROR;
+			batch->segments = segments;
+		}
+		batch->segments[batch->segmentCount++] = (Segment) { record.data, record.length, batch->size };
+		batch->size += record.length;
+	}
+	return CODE_OK;
+}
+
+
+//
+// Returns the index of the segment that contains the given position of the received data
+//
+static int FindSegment(const ChunkBatch *batch, size_t position)
+{
+	int low = 0, high = batch->segmentCount - 1;
+
+	while (low < high)
+	{
+		int middle = (low + high + 1) / 2;
+		if (batch->segments[middle].offset <= position)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return low;
+}
+
+
+//
+// Returns the position after the first line end at or after `position`, or the end of the data
+//
+static size_t NextLineStart(const ChunkBatch *batch, size_t position)
+{
+	if (position >= batch->size)
+		return batch->size;
+
+	for (int i = FindSegment(batch, position); i < batch->segmentCount; i++)
+	{
+		const Segment *segment = &batch->segments[i];
+		size_t start = (position > segment->offset) ? position - segment->offset : 0;
+		const char *newline = memchr(segment->data + start, '\n', segment->length - start);
+		if (newline != NULL)
+			return segment->offset + (newline + 1 - segment->data);
+	}
+	return batch->size;
+}
+
+
+//
+// Counts the lines that start a loop or scan and the data packages of a chunk, `context` is the ChunkBatch
+//
+static void CountChunk(void *context, int worker, int task)
+{
+	ChunkBatch *batch = context;
+	Chunk *chunk = &batch->chunks[task];
+	int lineStart = 1;
+	(void)worker;
+
+	for (int i = FindSegment(batch, chunk->begin); i < batch->segmentCount; i++)
+	{
+		const Segment *segment = &batch->segments[i];
+		if (segment->offset >= chunk->end)
+			break;
+		const char *data = segment->data + ((chunk->begin > segment->offset) ? chunk->begin - segment->offset : 0);
+		const char *end = segment->data + ((chunk->end < segment->offset + segment->length) ? chunk->end - segment->offset : segment->length);
+
+		while (data < end)
+		{
+			if (lineStart)
+			{
+				if (*data == REPLY_MEASURE_DP)
+				{
+					chunk->packages++;
+					chunk->trailingPackages++;
+				}
+				else if (*data == REPLY_MEASURING || *data == REPLY_NSCANS_START)
+				{
+					chunk->loops++;
+					chunk->trailingPackages = 0;
+				}
+			}
+			const char *newline = memchr(data, '\n', end - data);
+			lineStart = (newline != NULL);
+			data = (newline != NULL) ? newline + 1 : end;
+		}
+	}
+}
+
+
+//
+// Feeds the received data of a chunk to a parser
+//
+static void FeedChunk(const ChunkBatch *batch, const Chunk *chunk, MSParser *parser)
+{
+	for (int i = FindSegment(batch, chunk->begin); i < batch->segmentCount; i++)
+	{
+		const Segment *segment = &batch->segments[i];
+		if (segment->offset >= chunk->end)
+			break;
+		size_t begin = (chunk->begin > segment->offset) ? chunk->begin - segment->offset : 0;
+		size_t end = (chunk->end < segment->offset + segment->length) ? chunk->end - segment->offset : segment->length;
+		MSParserFeed(parser, segment->data + begin, end - begin);
+	}
+}
+
+
+//
+// Parses the lines of a chunk, `context` is the ChunkBatch
+//
+static void ParseChunk(void *context, int worker, int task)
+{
+	ChunkBatch *batch = context;
+	Chunk *chunk = &batch->chunks[task];
+	ParseState state = { batch->eventFunc, batch->context, worker, chunk->start };
+	MSParser parser;
+
+	MSParserInit(&parser, OnLine, &state);
+	FeedChunk(batch, chunk, &parser);
+}
+
+
+//
+// Opens a file and splits its received data into chunks that start at a line, enough for `threads` threads
+// Returns CODE_OK if successful, CODE_UNEXPECTED_DATA if a capture file is incomplete, in which case the
+// chunks contain its complete records, or CODE_ERROR if the file could not be opened or out of memory.
+// Unless CODE_ERROR is returned, the file must be closed with `CloseChunks()`.
+//
+static RetCode OpenChunks(const char *filename, int threads, MSLogFile *log, ChunkBatch *batch)
+{
+	RetCode code;
+	int count;
+
+	if (MSLogFileOpen(log, filename) != CODE_OK)
+		return CODE_ERROR;
+
+	code = CollectSegments(log, batch);
+	count = threads * MSBATCH_CHUNKS_PER_THREAD;
+	if ((size_t)count > batch->size / MSBATCH_MIN_CHUNK_SIZE)
+		count = (int)(batch->size / MSBATCH_MIN_CHUNK_SIZE);
+	if (count < 1)
+		count = 1;
+	batch->chunks = (code != CODE_ERROR) ? calloc(count, sizeof(Chunk)) : NULL;
+	if (batch->chunks == NULL)
+	{
+		free(batch->segments);
+		MSLogFileClose(log);
+		return CODE_ERROR;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		batch->chunks[i].begin = (i > 0) ? batch->chunks[i - 1].end : 0;
+		batch->chunks[i].end = (i < count - 1) ? NextLineStart(batch, batch->size / count * (i + 1)) : batch->size;
+		if (batch->chunks[i].end < batch->chunks[i].begin)
+			batch->chunks[i].end = batch->chunks[i].begin;
+	}
+	batch->chunkCount = count;
+	return code;
+}
+
+
+//
+// Frees the chunks and closes the file of `OpenChunks()`
+//
+static void CloseChunks(MSLogFile *log, ChunkBatch *batch)
+{
+	free(batch->chunks);
+	free(batch->segments);
+	MSLogFileClose(log);
+}
+
+
+//
+// See documentation in MSBatch.h
+//
+RetCode MSBatchParseFile(const char *filename, int threads, MSBatchEventFunc eventFunc, void *context)
+{
+	ChunkBatch batch = { NULL, 0, 0, NULL, 0, eventFunc, context };
+	MSLogFile log;
+	RetCode code;
+	int count;
+
+	if (filename == NULL || eventFunc == NULL)
+		return CODE_NULL;
+	threads = ThreadCount(threads);
+	code = OpenChunks(filename, threads, &log, &batch);
+	if (code == CODE_ERROR)
+		return CODE_ERROR;
+	count = batch.chunkCount;
+
+	// Determine where every chunk is in the measurement, then parse all chunks
+	RunTasks(count, (threads < count) ? threads : count, CountChunk, &batch);
+	batch.chunks[0].start = (MSBatchPosition) { 0, -1, 0, 0 };
+	for (int i = 1; i < count; i++)
+	{
+		const Chunk *previous = &batch.chunks[i - 1];
+		MSBatchPosition *start = &batch.chunks[i].start;
+		start->file = 0;
+		start->loop = previous->start.loop + previous->loops;
+		start->index = (previous->loops > 0) ? previous->trailingPackages : previous->start.index + previous->packages;
+		start->package = previous->start.package + previous->packages;
+	}
+	RunTasks(count, (threads < count) ? threads : count, ParseChunk, &batch);
+
+	CloseChunks(&log, &batch);
+	return (code == CODE_OK) ? CODE_OK : CODE_ERROR;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// One file in chunks, in order
+//////////////////////////////////////////////////////////////////////////////
+
+// A line reported by the parser of a chunk
+typedef struct _BufferedEvent
+{
+	RetCode event;
+	int subpackages;				// The number of subpackages of the package of a CODE_OK event
+	size_t offset;					// The position of the line in the text of the chunk
+	size_t length;
+} BufferedEvent;
+
+// The events of a chunk, kept until the events of all chunks before it are reported
+typedef struct _ChunkEvents
+{
+	BufferedEvent *events;
+	size_t count;
+	size_t capacity;
+	MscrSubPackage *subpackages;	// The subpackages of the packages of all CODE_OK events, one after the other
+	size_t subpackageCount;
+	size_t subpackageCapacity;
+	char *text;						// The lines of the events, one after the other
+	size_t textLength;
+	size_t textCapacity;
+	int failed;						// Set if out of memory
+	int parsed;						// Set when all lines are buffered, protected by the lock of the OrderedBatch
+} ChunkEvents;
+
+typedef struct _OrderedBatch
+{
+	ChunkBatch *batch;
+	ChunkEvents *chunks;			// The events of every chunk of `batch`
+	MSParserEventFunc eventFunc;
+	void *context;
+	MscrPackage package;			// The package that is reported, only used by the reporting thread
+	atomic_int nextChunk;			// The next chunk to parse
+	pthread_mutex_t lock;			// Protects `parsed` of the chunks, `reported` and `reporting`
+	int reported;					// The number of chunks whose events have been reported
+	int reporting;					// Set while a thread reports events
+	int failed;						// Set if the events of a chunk were lost, only used by the reporting thread
+} OrderedBatch;
+
+
+//
+// Makes room for `count` items in an array that grows by doubling
+// Returns 0 if successful or -1 if out of memory
+//
+static int Reserve(void **items, size_t *capacity, size_t count, size_t itemSize)
+{
+	if (count <= *capacity)
+		return 0;
+
+	size_t newCapacity = (*capacity > 0) ? *capacity * 2 : 256;
+	while (newCapacity < count)
+		newCapacity *= 2;
+	void *grown = realloc(*items, newCapacity * itemSize);
+	if (grown == NULL)
+		return -1;
+	*items = grown;
+	*capacity = newCapacity;
+	return 0;
+}
+
+
+//
+// Stores a line from the MSParser of a chunk, `context` is the ChunkEvents of the chunk
+//
+static void OnBufferedLine(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	ChunkEvents *chunk = context;
+	const int subpackages = (package != NULL) ? package->nr_of_subpackages : 0;
+
+	// Only the subpackages that are used are kept, a MscrPackage has room for many more
+	if (chunk->failed
+			|| Reserve((void **)&chunk->events, &chunk->capacity, chunk->count + 1, sizeof(BufferedEvent)) != 0
+			|| Reserve((void **)&chunk->text, &chunk->textCapacity, chunk->textLength + length, 1) != 0
+			|| Reserve((void **)&chunk->subpackages, &chunk->subpackageCapacity,
+					chunk->subpackageCount + subpackages, sizeof(MscrSubPackage)) != 0)
+	{
+		chunk->failed = 1;
+		return;
+	}
+	chunk->events[chunk->count++] = (BufferedEvent) { event, subpackages, chunk->textLength, length };
+	memcpy(chunk->text + chunk->textLength, line, length);
+	chunk->textLength += length;
+	if (subpackages > 0)
+	{
+		memcpy(&chunk->subpackages[chunk->subpackageCount], package->subpackages, subpackages * sizeof(MscrSubPackage));
+		chunk->subpackageCount += subpackages;
+	}
+}
+
+
+//
+// Reports the buffered events of a chunk and frees them.
+// Once the events of a chunk are lost, no events of later chunks are reported either.
+//
+static void ReportChunk(OrderedBatch *ordered, ChunkEvents *chunk)
+{
+	const MscrSubPackage *subpackages = chunk->subpackages;
+
+	ordered->failed |= chunk->failed;
+	for (size_t i = 0; i < chunk->count && !ordered->failed; i++)
+	{
+		const BufferedEvent *event = &chunk->events[i];
+		if (event->event == CODE_OK)
+		{
+			ordered->package.nr_of_subpackages = event->subpackages;
+			memcpy(ordered->package.subpackages, subpackages, event->subpackages * sizeof(MscrSubPackage));
+			subpackages += event->subpackages;
+		}
+		ordered->eventFunc(ordered->context, event->event, chunk->text + event->offset, event->length,
+				(event->event == CODE_OK) ? &ordered->package : NULL);
+	}
+	free(chunk->events);
+	free(chunk->subpackages);
+	free(chunk->text);
+	chunk->events = NULL;
+	chunk->subpackages = NULL;
+	chunk->text = NULL;
+}
+
+
+//
+// Marks a chunk as parsed and reports the events of all parsed chunks that are next in line.
+// Only one thread reports at a time, the others leave their chunks to it.
+//
+static void ReportParsedChunks(OrderedBatch *ordered, int index)
+{
+	pthread_mutex_lock(&ordered->lock);
+	ordered->chunks[index].parsed = 1;
+	if (!ordered->reporting)
+	{
+		ordered->reporting = 1;
+		while (ordered->reported < ordered->batch->chunkCount && ordered->chunks[ordered->reported].parsed)
+		{
+			ChunkEvents *chunk = &ordered->chunks[ordered->reported];
+			pthread_mutex_unlock(&ordered->lock);
+			ReportChunk(ordered, chunk);
+			pthread_mutex_lock(&ordered->lock);
+			ordered->reported++;
+		}
+		ordered->reporting = 0;
+	}
+	pthread_mutex_unlock(&ordered->lock);
+}
+
+
+//
+// Parses chunks in the order of the file until all are taken, `context` is the OrderedBatch.
+// Taking the chunks in order keeps the number of chunks that wait to be reported low.
+//
+static void ParseChunksInOrder(void *context, int worker, int task)
+{
+	OrderedBatch *ordered = context;
+	int index;
+	(void)worker;
+	(void)task;
+
+	while ((index = atomic_fetch_add(&ordered->nextChunk, 1)) < ordered->batch->chunkCount)
+	{
+		MSParser parser;
+		MSParserInit(&parser, OnBufferedLine, &ordered->chunks[index]);
+		FeedChunk(ordered->batch, &ordered->batch->chunks[index], &parser);
+		ReportParsedChunks(ordered, index);
+	}
+}
+
+
+//
+// See documentation in MSBatch.h
+//
+RetCode MSBatchParseFileInOrder(const char *filename, int threads, MSParserEventFunc eventFunc, void *context)
+{
+	ChunkBatch batch = { NULL, 0, 0, NULL, 0, NULL, NULL };
+	OrderedBatch ordered = { 0 };
+	MSLogFile log;
+	RetCode code;
+
+	if (filename == NULL || eventFunc == NULL)
+		return CODE_NULL;
+	threads = ThreadCount(threads);
+	code = OpenChunks(filename, threads, &log, &batch);
+	if (code == CODE_ERROR)
+		return CODE_ERROR;
+	ordered.chunks = calloc(batch.chunkCount, sizeof(ChunkEvents));
+	if (ordered.chunks == NULL)
+	{
+		CloseChunks(&log, &batch);
+		return CODE_ERROR;
+	}
+	ordered.batch = &batch;
+	ordered.eventFunc = eventFunc;
+	ordered.context = context;
+	pthread_mutex_init(&ordered.lock, NULL);
+
+	threads = (threads < batch.chunkCount) ? threads : batch.chunkCount;
+	RunTasks(threads, threads, ParseChunksInOrder, &ordered);
+
+	pthread_mutex_destroy(&ordered.lock);
+	free(ordered.chunks);
+	CloseChunks(&log, &batch);
+	return (code == CODE_OK && !ordered.failed) ? CODE_OK : CODE_ERROR;
+}
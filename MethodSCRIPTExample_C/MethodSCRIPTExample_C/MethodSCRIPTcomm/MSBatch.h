@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSBatch.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSBatch processes recorded EmStat Pico output (see MSLogFile.h) on all processor cores.
+ *	There are two ways to divide the work:
+ *	  - `MSBatchParseFiles()` processes many files, each file by one thread. The files are divided
+ *	    over a pool of threads that steal work from each other when they run out, so a few large
+ *	    files among many small ones do not leave the other threads idle.
+ *	  - `MSBatchParseFile()` splits one large file into chunks at line boundaries and parses the
+ *	    chunks in parallel. A first pass over the chunks only counts the lines that start a loop or
+ *	    scan and the data packages, from which the position of every chunk in the measurement is
+ *	    determined. The second pass parses the lines.
+ *
+ *	In both cases every line is reported to an event function together with its position in the
+ *	file, which is the same as if the file was processed from start to end by one thread. The event
+ *	function is called from several threads at the same time. The lines of a file or chunk are
+ *	reported in order, but the files and chunks are processed in any order, so the events are NOT
+ *	reported in the order of the file.
+ *
+ *	An event function that needs the order of the file, such as one that writes a CSV or result file
+ *	or fills an MSDataset, can use `MSBatchParseFileInOrder()`. It parses the chunks of one file in
+ *	parallel like `MSBatchParseFile()`, but keeps the events of every chunk until all chunks before
+ *	it are reported. The events are then reported in the order of the file, one at a time, to an
+ *	MSParserEventFunc, so e.g. `MSDatasetOnEvent()` and `MSResultWriterOnEvent()` can be passed to
+ *	it directly.
+ *
+ ============================================================================
+ */
+
+#ifndef MSBATCH_H
+#define MSBATCH_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include "MSLogFile.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The number of chunks per thread a file is split into, more chunks balance the load better
+#define MSBATCH_CHUNKS_PER_THREAD	8
+
+/// The minimum size of a chunk, smaller files are split into fewer chunks
+#define MSBATCH_MIN_CHUNK_SIZE		(1024 * 1024)
+
+/// The maximum number of threads
+#define MSBATCH_MAX_THREADS			256
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The position of a line in a file
+///
+typedef struct _MSBatchPosition
+{
+	int file;						// Index of the file in the list of files, 0 for `MSBatchParseFile()`
+	long loop;						// Number of the measurement loop or scan, counting from 0. -1 before the first one.
+	long index;						// Number of the data package in the current loop or scan, counting from 0
+	long package;					// Number of the data package in the file, counting from 0
+} MSBatchPosition;
+
+///
+/// Function that is called for every line of the processed files.
+/// It is called from several threads at the same time, use `worker` to keep data per thread.
+///
+/// parameters:
+///   context   - The context pointer given to the parse function
+///   worker    - The index of the calling thread, from 0 up to the number of threads
+///   position  - The position of the line. For a data package, `index` and `package` are its own numbers.
+///   event     - The type of the line as reported by MSParser, or CODE_ERROR if the file could not be read
+///   line      - The line, including the terminating '\n'. Only valid during the call, NULL for CODE_ERROR.
+///   length    - The number of characters in `line`
+///   package   - The parsed package if `event` is CODE_OK, otherwise NULL. Only valid during the call.
+///
+typedef void (*MSBatchEventFunc)(void *context, int worker, const MSBatchPosition *position, RetCode event,
+		const char *line, size_t length, const MscrPackage *package);
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Processes many files in parallel, each file by one thread.
+///
+/// parameters:
+///   filenames  - The files to process, capture files or raw logs
+///   count      - The number of files
+///   threads    - The number of threads to use, 0 to use one per processor core
+///   eventFunc  - The function that is called for every line
+///   context    - Pointer that is passed to `eventFunc`
+///
+/// Returns:
+///   CODE_OK if all files were processed completely, CODE_NULL if a parameter is NULL,
+///   CODE_ERROR if a file could not be opened or a capture file is incomplete.
+///
+RetCode MSBatchParseFiles(const char *const *filenames, int count, int threads, MSBatchEventFunc eventFunc, void *context);
+
+
+///
+/// Processes one file in parallel, by splitting it into chunks.
+/// The chunks are parsed at the same time, so the events of a later chunk can be reported before
+/// those of an earlier one. Use `position` to put the results in the order of the file.
+///
+/// parameters:
+///   filename   - The file to process, a capture file or raw log
+///   threads    - The number of threads to use, 0 to use one per processor core
+///   eventFunc  - The function that is called for every line
+///   context    - Pointer that is passed to `eventFunc`
+///
+/// Returns:
+///   CODE_OK if the file was processed completely, CODE_NULL if a parameter is NULL,
+///   CODE_ERROR if the file could not be opened or a capture file is incomplete.
+///
+RetCode MSBatchParseFile(const char *filename, int threads, MSBatchEventFunc eventFunc, void *context);
+
+
+///
+/// Processes one file in parallel, by splitting it into chunks, and reports the events in the order of the file.
+/// The events are the same as if the file was parsed by one MSParser. The event function is called by one
+/// thread at a time, but not always by the same thread. The events of the chunks that are parsed but not
+/// yet reported are kept in memory, which is usually about one chunk per thread.
+///
+/// parameters:
+///   filename   - The file to process, a capture file or raw log
+///   threads    - The number of threads to use, 0 to use one per processor core
+///   eventFunc  - The function that is called for every line, e.g. `MSDatasetOnEvent()`
+///   context    - Pointer that is passed to `eventFunc`
+///
+/// Returns:
+///   CODE_OK if the file was processed completely, CODE_NULL if a parameter is NULL,
+///   CODE_ERROR if the file could not be opened, a capture file is incomplete or out of memory.
+///   If out of memory, the events up to the first chunk that could not be kept are reported.
+///
+RetCode MSBatchParseFileInOrder(const char *filename, int threads, MSParserEventFunc eventFunc, void *context);
+
+
+///
+/// Returns the number of threads that is used when 0 threads are requested, one per processor core.
+///
+int MSBatchDefaultThreads(void);
+
+
+#endif //MSBATCH_H
@@ -0,0 +1,466 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSCapture.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#ifdef __WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+#include "MSCapture.h"
+
+// A variable length integer of 64 bits takes at most 10 bytes
+#define VARINT_MAX_LENGTH	10
+
+
+//
+// Returns the time of a monotonic clock in microseconds
+//
+static uint64_t NowUs(void)
+{
+#ifdef __WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000
+			+ (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+
+//
+// Sleeps for the given number of microseconds
+//
+static void SleepUs(uint64_t us)
+{
+#ifdef __WIN32
+	Sleep((DWORD)((us + 999) / 1000));
+#else
+	struct timespec duration = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+	while (nanosleep(&duration, &duration) != 0)
+		;
+#endif
+}
+
+
+//
+// Stores a variable length integer in `buf`
+// Returns the number of bytes used
+//
+static int EncodeVarint(uint64_t value, unsigned char *buf)
+{
+	int length = 0;
+
+	while (value >= 0x80)
+	{
+		buf[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	buf[length++] = (unsigned char)value;
+	return length;
+}
+
+
+//
+// Reads a variable length integer from the file
+// Returns 1 if successful or 0 at the end of the file
+//
+static int ReadVarint(FILE *fp, uint64_t *value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 7 * VARINT_MAX_LENGTH; shift += 7)
+	{
+		int c = getc(fp);
+		if (c == EOF)
+			return 0;
+		*value |= (uint64_t)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+
+//
+// Decodes a variable length integer from memory
+// Returns the number of bytes used or 0 if the integer is incomplete
+//
+static size_t DecodeVarint(const unsigned char *data, size_t length, uint64_t *value)
+{
+	*value = 0;
+	for (size_t i = 0; i < length && i < VARINT_MAX_LENGTH; i++)
+	{
+		*value |= (uint64_t)(data[i] & 0x7F) << (7 * i);
+		if ((data[i] & 0x80) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+
+//
+// Writes one record to the capture file
+//
+static void Record(MSCapture *capture, MSCaptureDirection direction, const char *data, size_t length)
+{
+	unsigned char header[2 * VARINT_MAX_LENGTH];
+	uint64_t now = NowUs();
+	int headerLength;
+
+	headerLength = EncodeVarint(now - capture->lastTimeUs, header);
+	headerLength += EncodeVarint((uint64_t)length << 1 | direction, &header[headerLength]);
+	capture->lastTimeUs = now;
+
+	if (fwrite(header, 1, headerLength, capture->fp) != (size_t)headerLength
+			|| fwrite(data, 1, length, capture->fp) != length)
+		capture->failed = 1;
+}
+
+
+//
+// Recording versions of the transport functions, which pass the call on to the device transport
+//
+
+static int CaptureWriteChar(void *context, char c)
+{
+	MSCapture *capture = context;
+	int result = capture->device.write_char(capture->device.context, c);
+
+	if (result > 0)
+		Record(capture, CAPTURE_SENT, &c, 1);
+	return result;
+}
+
+static int CaptureWriteBuf(void *context, const MSWriteBlock *blocks, int count)
+{
+	MSCapture *capture = context;
+	int result = capture->device.write_buf(capture->device.context, blocks, count);
+
+	// The blocks are recorded separately, they are usually written at once anyway
+	for (int i = 0; i < count && result > 0; i++)
+		Record(capture, CAPTURE_SENT, blocks[i].data, blocks[i].length);
+	return result;
+}
+
+static int CaptureReadChar(void *context)
+{
+	MSCapture *capture = context;
+	int c = capture->device.read_char(capture->device.context);
+
+	if (c > 0)
+	{
+		char data = (char)c;
+		Record(capture, CAPTURE_RECEIVED, &data, 1);
+	}
+	return c;
+}
+
+static int CaptureReadBuf(void *context, char *buf, int size)
+{
+	MSCapture *capture = context;
+	int n = capture->device.read_buf(capture->device.context, buf, size);
+
+	if (n > 0)
+		Record(capture, CAPTURE_RECEIVED, buf, n);
+	return n;
+}
+
+static int CaptureWaitRead(void *context, int *timeout_ms)
+{
+	MSCapture *capture = context;
+	return capture->device.wait_read(capture->device.context, timeout_ms);
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+RetCode MSCaptureOpen(MSCapture *capture, const char *filename, const MSTransport *device)
+{
+	if (capture == NULL || filename == NULL || device == NULL)
+		return CODE_NULL;
+
+	capture->device = *device;
+	capture->failed = 0;
+	capture->fp = fopen(filename, "wb");
+	if (capture->fp == NULL)
+		return CODE_ERROR;
+	setvbuf(capture->fp, NULL, _IOFBF, MSCAPTURE_FILE_BUFFER_SIZE);
+
+	if (fwrite(MSCAPTURE_MAGIC, 1, MSCAPTURE_MAGIC_LENGTH, capture->fp) != MSCAPTURE_MAGIC_LENGTH)
+		capture->failed = 1;
+	capture->lastTimeUs = NowUs();
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+void MSCaptureGetTransport(MSCapture *capture, MSTransport *transport)
+{
+	transport->context = capture;
+	transport->write_char = CaptureWriteChar;
+	transport->write_buf = (capture->device.write_buf != NULL) ? CaptureWriteBuf : NULL;
+	transport->read_char = (capture->device.read_char != NULL) ? CaptureReadChar : NULL;
+	transport->read_buf = (capture->device.read_buf != NULL) ? CaptureReadBuf : NULL;
+	transport->wait_read = (capture->device.wait_read != NULL) ? CaptureWaitRead : NULL;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+RetCode MSCaptureClose(MSCapture *capture)
+{
+	if (capture->fp == NULL)
+		return CODE_ERROR;
+	if (fclose(capture->fp) != 0)
+		capture->failed = 1;
+	capture->fp = NULL;
+	return capture->failed ? CODE_ERROR : CODE_OK;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+size_t MSCaptureDecodeRecord(const char *data, size_t length, MSCaptureRecord *record)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	uint64_t header;
+	size_t used, n;
+
+	if ((used = DecodeVarint(bytes, length, &record->deltaUs)) == 0)
+		return 0;
+	if ((n = DecodeVarint(bytes + used, length - used, &header)) == 0)
+		return 0;
+	used += n;
+	if ((header >> 1) > length - used)
+		return 0;
+
+	record->direction = (MSCaptureDirection)(header & 1);
+	record->data = data + used;
+	record->length = (size_t)(header >> 1);
+	return used + record->length;
+}
+
+
+//
+// Moves to the next chunk that was received from the device.
+// Recorded sends are skipped, they realign the clocks so the time the host spent before sending is not replayed.
+// Returns 1 if a chunk is available or 0 at the end of the capture.
+//
+static int NextReceivedChunk(MSReplay *replay)
+{
+	uint64_t delta, header;
+
+	while (replay->remaining == 0 && !replay->ended)
+	{
+		if (!ReadVarint(replay->fp, &delta) || !ReadVarint(replay->fp, &header))
+		{
+			replay->ended = 1;
+			break;
+		}
+		replay->captureTimeUs += delta;
+		if (!replay->started || (header & 1) == CAPTURE_SENT)
+		{
+			replay->offsetUs = (int64_t)(NowUs() - replay->captureTimeUs);
+			replay->started = 1;
+		}
+
+		if ((header & 1) == CAPTURE_SENT)
+		{
+			if (fseek(replay->fp, (long)(header >> 1), SEEK_CUR) != 0)
+				replay->ended = 1;
+		}
+		else
+		{
+			replay->remaining = (int)(header >> 1);
+		}
+	}
+	return !replay->ended;
+}
+
+
+//
+// Returns the number of microseconds until the current chunk is due, 0 if it is available now
+//
+static uint64_t TimeUntilDue(const MSReplay *replay)
+{
+	int64_t due;
+
+	if (replay->speed == REPLAY_MAX_SPEED)
+		return 0;
+	due = (int64_t)replay->captureTimeUs + replay->offsetUs - (int64_t)NowUs();
+	return (due > 0) ? (uint64_t)due : 0;
+}
+
+
+//
+// Replay versions of the transport functions
+//
+
+static int ReplayWriteChar(void *context, char c)
+{
+	(void)context;
+	(void)c;
+	return 1;
+}
+
+static int ReplayWriteBuf(void *context, const MSWriteBlock *blocks, int count)
+{
+	int total = 0;
+	(void)context;
+
+	for (int i = 0; i < count; i++)
+		total += blocks[i].length;
+	return total;
+}
+
+static int ReplayReadBuf(void *context, char *buf, int size)
+{
+	MSReplay *replay = context;
+	size_t n;
+
+	if (!NextReceivedChunk(replay))
+		return -1;
+	if (TimeUntilDue(replay) > 0)
+		return 0;
+
+	n = fread(buf, 1, (replay->remaining < size) ? replay->remaining : size, replay->fp);
+	if (n == 0)
+	{
+		replay->ended = 1;
+		return -1;
+	}
+	replay->remaining -= (int)n;
+	return (int)n;
+}
+
+static int ReplayReadChar(void *context)
+{
+	char c;
+	int n = ReplayReadBuf(context, &c, 1);
+
+	return (n > 0) ? c : n;
+}
+
+static int ReplayWaitRead(void *context, int *timeout_ms)
+{
+	MSReplay *replay = context;
+	uint64_t waitUs;
+
+	if (!NextReceivedChunk(replay))
+		return -1;
+
+	waitUs = TimeUntilDue(replay);
+	if (waitUs == 0)
+		return 1;
+	if (*timeout_ms >= 0 && waitUs > (uint64_t)*timeout_ms * 1000)
+	{
+		SleepUs((uint64_t)*timeout_ms * 1000);
+		*timeout_ms = 0;
+		return 0;
+	}
+
+	SleepUs(waitUs);
+	if (*timeout_ms >= 0)
+		*timeout_ms -= (int)(waitUs / 1000);
+	return 1;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+RetCode MSReplayOpen(MSReplay *replay, const char *filename, MSReplaySpeed speed)
+{
+	char magic[MSCAPTURE_MAGIC_LENGTH];
+
+	if (replay == NULL || filename == NULL)
+		return CODE_NULL;
+
+	memset(replay, 0, sizeof(*replay));
+	replay->speed = speed;
+	replay->fp = fopen(filename, "rb");
+	if (replay->fp == NULL)
+		return CODE_ERROR;
+	setvbuf(replay->fp, NULL, _IOFBF, MSCAPTURE_FILE_BUFFER_SIZE);
+
+	if (fread(magic, 1, MSCAPTURE_MAGIC_LENGTH, replay->fp) != MSCAPTURE_MAGIC_LENGTH
+			|| memcmp(magic, MSCAPTURE_MAGIC, MSCAPTURE_MAGIC_LENGTH) != 0)
+	{
+		MSReplayClose(replay);
+		return CODE_ERROR;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+void MSReplayGetTransport(MSReplay *replay, MSTransport *transport)
+{
+	transport->context = replay;
+	transport->write_char = ReplayWriteChar;
+	transport->write_buf = ReplayWriteBuf;
+	transport->read_char = ReplayReadChar;
+	transport->read_buf = ReplayReadBuf;
+	transport->wait_read = ReplayWaitRead;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+int MSReplayAtEnd(const MSReplay *replay)
+{
+	return replay->ended;
+}
+
+
+//
+// See documentation in MSCapture.h
+//
+void MSReplayClose(MSReplay *replay)
+{
+	if (replay->fp != NULL)
+		fclose(replay->fp);
+	replay->fp = NULL;
+}
@@ -0,0 +1,245 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSCapture.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSCapture records the communication with an EmStat Pico in a capture file and replays it later.
+ *	The recorder is a transport that sits between a MSComm and the transport of the device. Every
+ *	chunk of data that the device transport returns or is given is written to the capture file,
+ *	together with a monotonic timestamp of the host.
+ *
+ *	The replay transport reads a capture file and returns the received data to a MSComm as if it
+ *	came from the device, either with the original timing or as fast as possible. This allows the
+ *	parsing and processing of archived measurements to be repeated, and the throughput of the
+ *	processing to be measured independent of the baud rate.
+ *
+ *	The capture file starts with the 8 characters "MSCAP01\n", followed by one record per chunk:
+ *	  - The time since the previous record in microseconds, as variable length integer
+ *	  - The chunk length * 2 + direction (0 = received from device, 1 = sent to device), as variable length integer
+ *	  - The data of the chunk
+ *	Variable length integers store 7 bits per byte, least significant first, with the highest bit set
+ *	in all bytes except the last one.
+ *
+ ============================================================================
+ */
+
+#ifndef MSCAPTURE_H
+#define MSCAPTURE_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "MSComm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The first characters of every capture file
+#define MSCAPTURE_MAGIC				"MSCAP01\n"
+#define MSCAPTURE_MAGIC_LENGTH		8
+
+/// Size of the file buffers of the recorder and replay, so the file is not accessed for every chunk
+#define MSCAPTURE_FILE_BUFFER_SIZE	65536
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The direction of a recorded chunk
+///
+typedef enum _MSCaptureDirection
+{
+	CAPTURE_RECEIVED = 0,			// Received from the device
+	CAPTURE_SENT     = 1,			// Sent to the device
+} MSCaptureDirection;
+
+///
+/// The speed at which a capture is replayed
+///
+typedef enum _MSReplaySpeed
+{
+	REPLAY_ORIGINAL_TIMING,			// Every chunk becomes available at the time it was received originally
+	REPLAY_MAX_SPEED,				// All data is available immediately
+} MSReplaySpeed;
+
+///
+/// One record of a capture file, see the description at the top of this file
+///
+typedef struct _MSCaptureRecord
+{
+	uint64_t deltaUs;				// Time since the previous record in microseconds
+	MSCaptureDirection direction;
+	const char *data;				// The data of the chunk, points into the decoded buffer
+	size_t length;					// Number of bytes in `data`
+} MSCaptureRecord;
+
+///
+/// Recorder for the communication with one device
+///
+typedef struct _MSCapture
+{
+	MSTransport device;				// The transport of the device that is recorded
+	FILE *fp;						// The capture file
+	uint64_t lastTimeUs;			// Host time of the previous record
+	int failed;						// Set if writing to the capture file failed
+} MSCapture;
+
+///
+/// Replay of one capture file
+///
+typedef struct _MSReplay
+{
+	FILE *fp;						// The capture file
+	MSReplaySpeed speed;
+	uint64_t captureTimeUs;			// Capture time of the current record
+	int64_t offsetUs;				// Host time minus capture time
+	int started;					// Set once the first record was read and the clocks are aligned
+	int remaining;					// Number of bytes of the current received chunk that were not returned yet
+	int ended;						// Set when the end of the capture was reached
+} MSReplay;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Creates a capture file and starts recording the communication over a device transport.
+/// Use `MSCaptureGetTransport()` to get the transport that a MSComm should use instead of `device`.
+///
+/// parameters:
+///   capture   - The recorder to initialise
+///   filename  - The capture file to create, an existing file is overwritten
+///   device    - The transport of the device, it is copied
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL or CODE_ERROR if the file could not be created.
+///
+RetCode MSCaptureOpen(MSCapture *capture, const char *filename, const MSTransport *device);
+
+
+///
+/// Fills in the transport that passes all communication to the device and records it.
+/// The transport only has the optional functions that the device transport has.
+///
+/// parameters:
+///   capture    - The opened recorder
+///   transport  - Receives the recording transport
+///
+void MSCaptureGetTransport(MSCapture *capture, MSTransport *transport);
+
+
+///
+/// Stops recording and closes the capture file. The device transport is not closed.
+///
+/// parameters:
+///   capture  - The recorder
+///
+/// Returns:
+///   CODE_OK if the complete communication was recorded, CODE_ERROR if writing the file failed.
+///
+RetCode MSCaptureClose(MSCapture *capture);
+
+
+///
+/// Decodes one record of a capture file that is in memory, e.g. a memory mapped file.
+///
+/// parameters:
+///   data    - The start of the record, after the header of the file or after the previous record
+///   length  - The number of bytes available from `data` on
+///   record  - Receives the record, its data points into `data`
+///
+/// Returns:
+///   The number of bytes of the record, or 0 if `data` does not contain a complete record.
+///
+size_t MSCaptureDecodeRecord(const char *data, size_t length, MSCaptureRecord *record);
+
+
+///
+/// Opens a capture file for replaying.
+/// Use `MSReplayGetTransport()` to get the transport that a MSComm can use to read the received data.
+///
+/// parameters:
+///   replay    - The replay to initialise
+///   filename  - The capture file
+///   speed     - Replay with the original timing or as fast as possible
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL or CODE_ERROR if the file could not be opened
+///   or is not a capture file.
+///
+RetCode MSReplayOpen(MSReplay *replay, const char *filename, MSReplaySpeed speed);
+
+
+///
+/// Fills in the transport that returns the data that was received in the capture.
+/// Data that is written to the transport is discarded. Sending data is not replayed, instead the
+/// next received chunk is timed relative to the moment the replay reaches the recorded send.
+/// At the end of the capture the wait function fails, so `ReceivePackage()` returns CODE_ERROR,
+/// like when a device is disconnected. Use `MSReplayAtEnd()` to tell both apart.
+///
+/// parameters:
+///   replay     - The opened replay
+///   transport  - Receives the replay transport
+///
+void MSReplayGetTransport(MSReplay *replay, MSTransport *transport);
+
+
+///
+/// Checks if all received data of the capture was returned.
+///
+/// parameters:
+///   replay  - The replay
+///
+/// Returns:
+///   1 if the end of the capture was reached, 0 if not. A truncated capture file also counts as the end.
+///
+int MSReplayAtEnd(const MSReplay *replay);
+
+
+///
+/// Closes the capture file of a replay
+///
+/// parameters:
+///   replay  - The replay
+///
+void MSReplayClose(MSReplay *replay);
+
+
+#endif //MSCAPTURE_H
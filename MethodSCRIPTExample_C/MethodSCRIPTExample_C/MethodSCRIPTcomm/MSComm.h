@@ -44,6 +44,8 @@
  *
  *	This library support MethodSCRIPT output packages with a fixed maximum number of subpackages.
  *	The maximum number is defined by `MSCR_SUBPACKAGES_PER_LINE` and statically allocated in the struct `MscrPackage`.
+ *	On memory constrained hosts the subpackages can be stored in a packed layout of half the size,
+ *	see `MSCR_PACKED_SUBPACKAGES`.
  *
  ============================================================================
  */
@@ -72,7 +74,66 @@
 
 #define VERSION_STR_LENGTH	28
 
+/// The maximum number of subpackages in one package (line). Every `MscrPackage` reserves room for this many,
+/// so hosts with little RAM can lower it to the number of variables their scripts output.
+#ifndef MSCR_SUBPACKAGES_PER_LINE
 #define MSCR_SUBPACKAGES_PER_LINE	100
+#endif
+
+/// Set to 1 to store every `MscrSubPackage` in 8 instead of 16 bytes. The value is then kept as received
+/// and only converted to a float when it is read, so use the `GetSubpackage...` functions to read subpackages.
+/// This is the default on Arduino, where a package of 100 subpackages would otherwise take 1.6 KB of RAM.
+#ifndef MSCR_PACKED_SUBPACKAGES
+#if defined(ARDUINO)
+#define MSCR_PACKED_SUBPACKAGES	1
+#else
+#define MSCR_PACKED_SUBPACKAGES	0
+#endif
+#endif
+
+/// Set to 1 to store the value of a (not packed) `MscrSubPackage` exactly, as an integer mantissa and
+/// a power of 1000 exponent instead of a float. Packed subpackages always store the value exactly.
+/// The exact value can be read with `GetSubpackageMantissa()` and `GetSubpackageExponent()`.
+#ifndef MSCR_EXACT_VALUES
+#define MSCR_EXACT_VALUES	0
+#endif
+
+/// Whether the subpackages store exact values, see `MSCR_EXACT_VALUES`
+#define MSCR_HAS_EXACT_VALUES	(MSCR_PACKED_SUBPACKAGES || MSCR_EXACT_VALUES)
+
+/// The exponent of a value with an invalid SI unit prefix. The value of such a subpackage is 0.
+#define MSCR_EXPONENT_INVALID	127
+
+/// The maximum number of subpackages of a package layout that can be learned by `ParsePackageLineWithSchema`.
+/// Packages with more subpackages are always parsed with `ParsePackageLine`.
+#ifndef MSCR_SCHEMA_MAX_SUBPACKAGES
+#define MSCR_SCHEMA_MAX_SUBPACKAGES	8
+#endif
+
+/// The maximum number of fixed characters in a package layout: 'P', '\n', and per subpackage the variable type,
+/// the separator and two characters for each of the status and current range fields
+#define MSCR_SCHEMA_MAX_CHECKS	(MSCR_SCHEMA_MAX_SUBPACKAGES * 7 + 2)
+
+/// The number of packages in a measurement loop that may not match the learned layout before
+/// `ParsePackageLineWithSchema` stops learning layouts until the next loop
+#define MSCR_SCHEMA_MAX_MISSES	8
+
+/// Maximum number of characters that the EmStat Pico can receive in one line (including the '\n')
+#define MS_MAX_LINECHARS	128
+
+/// The maximum number of blocks that `WriteScript` passes to the write_buf_func in one call
+#define MSCOMM_WRITE_BLOCKS	64
+
+/// The size of the serial read buffer in bytes. This is also the maximum length of a package
+#define READ_BUFFER_LENGTH 1000
+
+/// The size of the receive buffer of a MSComm that reads blocks of data (see `MSCommInitBuffered`)
+#ifndef MSCOMM_RX_BUFFER_LENGTH
+#define MSCOMM_RX_BUFFER_LENGTH 128
+#endif
+
+/// Offset value for MethodSCRIPT parameters (see the MethodSCRIPT documentation paragraph 'Measurement data package variables')
+#define MSCR_PARAM_OFFSET_VALUE 0x8000000
 
 
 #define VARTYPE_TO_UINT8(ch1, ch2) (((ch1)-'a') * 26 + (ch2 - 'a'))
@@ -145,6 +206,35 @@ typedef enum _VarType
 } VarType;
 
 
+///
+/// The physical quantity of a `variable type`
+///
+typedef enum _VarTypeCategory
+{
+	MSCR_VTC_UNDEFINED = 0,		// Not a known variable type
+	MSCR_VTC_POTENTIAL,
+	MSCR_VTC_CURRENT,
+	MSCR_VTC_IMPEDANCE,			// Impedance and phase
+	MSCR_VTC_APPLIED,			// Values applied to the cell, e.g. the set potential or frequency
+	MSCR_VTC_OTHER,				// Time, channel, pin mask and other variables
+	MSCR_VTC_DEVICE,			// Device specific diagnostic values
+} VarTypeCategory;
+
+
+///
+/// Description of one `variable type`, see `GetVarTypeInfo()`
+///
+typedef struct _MscrVarTypeInfo
+{
+	const char *name;			// Name as used in the CSV header, e.g. "Potential"
+	const char *label;			// Label for console output, e.g. "E[V]", NULL if the value has no preferred display
+	const char *unit;			// SI unit of the value, e.g. "V", or "" if the value has no unit
+	const char *format;			// printf format for the value on the console, e.g. "%6.3f"
+	uint8_t category;			// The `VarTypeCategory`
+	uint8_t digits;				// Number of digits for displays without printf floating point support (e.g. Arduino)
+} MscrVarTypeInfo;
+
+
 ///
 /// Whether the cell should be on or off.
 ///
@@ -178,6 +268,7 @@ typedef enum _Status
 typedef enum _Reply
 {
 	REPLY_VERSION_RESPONSE 	= 't',
+	REPLY_RESPONSE_BEGIN	= 'e',
 	REPLY_MEASURING 		= 'M',
 	REPLY_MEASURE_DP		= 'P',
 	REPLY_NSCANS_START		= 'C',
@@ -186,6 +277,37 @@ typedef enum _Reply
 } Reply;
 
 
+///
+/// The position of one subpackage in a package line with a fixed layout
+///
+typedef struct _MscrSchemaField
+{
+	uint8_t offset;					// Offset of the 7 value digits, followed by the SI unit prefix
+	uint8_t statusOffset;			// Offset of the status digits, 0 if the subpackage has no status
+	uint8_t statusDigits;
+	uint8_t rangeOffset;			// Offset of the current range digits, 0 if the subpackage has no current range
+	uint8_t rangeDigits;
+	int16_t variableType;
+} MscrSchemaField;
+
+
+///
+/// The layout of the package lines of one measurement loop, as learned by `ParsePackageLineWithSchema`.
+/// Within a loop, every package contains the same variables with the same metadata fields,
+/// so every field is at the same offset in every line.
+///
+typedef struct _MscrPackageSchema
+{
+	uint8_t length;					// The length of a line including the '\n', 0 if no layout has been learned
+	uint8_t count;					// The number of subpackages
+	uint8_t checkCount;				// The number of fixed characters
+	uint8_t misses;					// The number of lines that did not match the layout
+	uint8_t checkOffsets[MSCR_SCHEMA_MAX_CHECKS];	// The offsets of the characters that are the same in every line
+	char checkChars[MSCR_SCHEMA_MAX_CHECKS];
+	MscrSchemaField fields[MSCR_SCHEMA_MAX_SUBPACKAGES];
+} MscrPackageSchema;
+
+
 ///
 /// The communication object for one EmStat Pico
 /// You can instantiate multiple MSComms if you have multiple EmStat Picos,
@@ -193,8 +315,20 @@ typedef enum _Reply
 ///
 typedef struct _MSComm
 {
+	MSTransport transport;						// The functions used to communicate with the device
+	// Functions without context, called through `transport` if the MSComm was initialised with `MSCommInit`
 	WriteCharFunc writeCharFunc;
+	WriteBufFunc writeBufFunc;					// Optional, see `MSCommSetWriteBufFunc`
 	ReadCharFunc readCharFunc;
+	ReadBufFunc readBufFunc;					// Only used if the MSComm was initialised with `MSCommInitBuffered`
+	WaitReadFunc waitReadFunc;					// Optional, see `MSCommSetReadTimeout`
+	int readTimeoutMs;							// Maximum duration of one read call in ms, < 0 to wait forever
+	int rxPosition;								// Index of the next unread character in `rxBuffer`
+	int rxLength;								// Number of characters in `rxBuffer`
+	char rxBuffer[MSCOMM_RX_BUFFER_LENGTH];
+	MscrPackageSchema schema;					// The package layout of the current measurement loop
+	char lastReply;								// The first character of the last line read by `ReceivePackage()`,
+												// e.g. to tell the nscans lines ('C' and '-') from the loop lines
 } MSComm;
 
 
@@ -209,6 +343,40 @@ typedef struct _MscrMetadata {
 } MscrMetadata;
 
 
+#if MSCR_PACKED_SUBPACKAGES
+
+/// Flags of a packed `MscrSubPackage` that tell which metadata fields were given
+#define MSCR_HAS_STATUS			0x01
+#define MSCR_HAS_CURRENT_RANGE	0x02
+
+///
+/// Structure to store one MethodSCRIPT sub-package in 8 bytes.
+/// The fields should be read with `GetSubpackageValue()`, `GetSubpackageVarType()`,
+/// `GetSubpackageStatus()` and `GetSubpackageCurrentRange()`.
+///
+typedef struct _MscrSubPackage {
+	uint32_t raw_value : 28;	// The 7 hexadecimal digits of the value, including the `MSCR_PARAM_OFFSET_VALUE`
+	uint32_t prefix    : 4;		// Index of the SI unit prefix in "afpnum kMGTPE" (the exponent + 6), 15 if the prefix is invalid
+	uint8_t variable_type;		// As converted by `MSCR_STR_TO_VT`
+	uint8_t flags;				// Combination of `MSCR_HAS_STATUS` and `MSCR_HAS_CURRENT_RANGE`
+	uint8_t status;				// The lowest 8 bits of the status, only valid if `MSCR_HAS_STATUS` is set
+	uint8_t current_range;		// Only valid if `MSCR_HAS_CURRENT_RANGE` is set
+} MscrSubPackage;
+
+#elif MSCR_EXACT_VALUES
+
+///
+/// Structure to store one MethodSCRIPT sub-package with an exact value: `mantissa` * 1000^`exponent`.
+///
+typedef struct _MscrSubPackage {
+	int32_t      mantissa;		 // The value without the SI unit prefix, i.e. the 7 hexadecimal digits - `MSCR_PARAM_OFFSET_VALUE`
+	int16_t      variable_type; // As converted by `MSCR_STR_TO_VT`
+	int8_t       exponent;		 // The SI unit prefix as a power of 1000 (-6 for 'a' to 6 for 'E') or `MSCR_EXPONENT_INVALID`
+	MscrMetadata metadata;		 // The meta-data parsed from the sub-package string
+} MscrSubPackage;
+
+#else
+
 ///
 /// Structure to store one MethodSCRIPT sub-package
 ///
@@ -218,6 +386,8 @@ typedef struct _MscrSubPackage {
 	MscrMetadata metadata;		 // The meta-data parsed from the sub-package string
 } MscrSubPackage;
 
+#endif
+
 
 ///
 /// Structure to store one MethodScript package (line).
@@ -249,6 +419,94 @@ typedef struct _MscrPackage {
 RetCode MSCommInit(MSComm* MSComm,	WriteCharFunc write_char_func, ReadCharFunc read_char_func);
 
 
+///
+/// Initialises the MSComm object to read blocks of data instead of single characters.
+/// This reduces the number of calls to the read function (e.g. system calls) to a fraction of
+/// the number of calls that are required when using `MSCommInit`.
+///
+/// parameters:
+///   MSComm           - The MSComm data struct
+///   write_char_func  - Function pointer to the write function this MSComm should use
+///   read_buf_func    - Function pointer to the block read function this MSComm should use
+///
+/// Returns:
+///   CODE_OK if successful, otherwise CODE_NULL.
+///
+RetCode MSCommInitBuffered(MSComm* MSComm, WriteCharFunc write_char_func, ReadBufFunc read_buf_func);
+
+
+///
+/// Initialises the MSComm object with communication functions that take a context pointer.
+/// Unlike `MSCommInit`, this does not need global state per device, so any number of MSComms
+/// can share the same functions, each with the port object of its own device as context.
+///
+/// parameters:
+///   MSComm      - The MSComm data struct
+///   transport   - The communication functions and their context, copied into the MSComm
+///
+/// Returns:
+///   CODE_OK if successful, otherwise CODE_NULL.
+///
+RetCode MSCommInitTransport(MSComm* MSComm, const MSTransport* transport);
+
+
+///
+/// Sets the maximum duration of a read call, for a MSComm that has a wait_read function.
+/// See `MSCommSetReadTimeout` for details.
+///
+/// parameters:
+///   MSComm      - The MSComm data struct
+///   timeout_ms  - The deadline for one read call in milliseconds, < 0 to wait forever,
+///                 0 to only read data that is already available
+///
+void MSCommSetReadDeadline(MSComm* MSComm, int timeout_ms);
+
+
+///
+/// Sets a function that writes blocks of data, which is used instead of the write_char_func to
+/// write strings and scripts with as few calls (e.g. system calls) as possible.
+/// Only for a MSComm initialised with `MSCommInit` or `MSCommInitBuffered`.
+///
+/// parameters:
+///   MSComm           - The MSComm data struct
+///   write_buf_func   - Function pointer to the block write function, NULL to write per character
+///
+void MSCommSetWriteBufFunc(MSComm* MSComm, WriteBufFunc write_buf_func);
+
+
+///
+/// Sets the function that is used to wait for data and the maximum duration of a read call.
+/// Without a wait function the MSComm keeps calling the read function until data is received,
+/// which keeps the processor busy if the read function does not block. With a wait function the
+/// MSComm sleeps until data arrives, and `ReadBuf`, `ReadChar` and `ReceivePackage` return
+/// CODE_TIMEOUT if they could not complete within `timeout_ms`.
+/// Only for a MSComm initialised with `MSCommInit` or `MSCommInitBuffered`.
+///
+/// parameters:
+///   MSComm           - The MSComm data struct
+///   wait_read_func   - Function that waits until data is available, NULL to disable waiting
+///   timeout_ms       - The deadline for one read call in milliseconds, < 0 to wait forever
+///
+void MSCommSetReadTimeout(MSComm* MSComm, WaitReadFunc wait_read_func, int timeout_ms);
+
+
+///
+/// Validates a MethodSCRIPT and sends it to the EmStat Pico.
+/// The script is checked before anything is sent: every line must fit in `MS_MAX_LINECHARS`.
+/// Comment lines (starting with '#') and carriage returns are left out. The remaining text is
+/// passed to the write_buf_func as a list of blocks pointing into `script`, without copying.
+///
+/// parameters:
+///   MSComm   - The MSComm data struct
+///   script   - The MethodSCRIPT text, does not need to be 0 terminated
+///   length   - The number of characters in `script`
+///
+/// Returns:
+///   CODE_OK if successful, CODE_OUT_OF_RANGE if a line is too long or CODE_ERROR if writing failed.
+///
+RetCode WriteScript(MSComm* MSComm, const char* script, size_t length);
+
+
 ///
 /// Receives a package and parses it
 /// Currents are expressed in the Ampere, potentials are expressed in Volts
@@ -273,6 +531,52 @@ RetCode ReceivePackage(MSComm* MSComm, MscrPackage* retData);
 void ParseResponse(char *responseLine, MscrPackage* retData);
 
 
+///
+/// Parses one MethodSCRIPT data package line in a single pass.
+/// The line is decoded in place: it is not modified or copied and every character is visited only once.
+/// This produces the same output as `ParseResponse`, but is considerably faster and should be preferred.
+/// Note that only the first `nr_of_subpackages` subpackages of `retData` are written.
+///
+/// parameters:
+///   line     - The package line to parse. Parsing starts at the first 'P' and ends at '\n', '\0' or `length`
+///   length   - The maximum number of characters to read from `line`
+///   retData  - The struct in which the parsed values are stored
+///
+/// Returns:
+///   CODE_OK if successful, CODE_UNEXPECTED_DATA if the line is not a valid package or
+///   CODE_OUT_OF_RANGE if the line contains more than `MSCR_SUBPACKAGES_PER_LINE` subpackages.
+///
+RetCode ParsePackageLine(const char *line, size_t length, MscrPackage* retData);
+
+
+///
+/// Parses one MethodSCRIPT data package line using the layout of the previous packages.
+/// The first package that is parsed after `ResetPackageSchema()` is parsed with `ParsePackageLine`
+/// and its layout is stored in `schema`. The next packages are checked against this layout:
+/// only the characters that should be the same in every line are compared and the values
+/// are decoded at their known offsets, without searching for separators.
+/// A line that does not match is parsed with `ParsePackageLine` and its layout replaces the old one.
+/// The result is always the same as that of `ParsePackageLine`.
+///
+/// parameters:
+///   schema   - The layout of the previous packages, updated by this function
+///   line     - The package line to parse, ending at '\n' or '\0'
+///   length   - The maximum number of characters to read from `line`
+///   retData  - The struct in which the parsed values are stored
+///
+/// Returns:
+///   The same as `ParsePackageLine`
+///
+RetCode ParsePackageLineWithSchema(MscrPackageSchema *schema, const char *line, size_t length, MscrPackage* retData);
+
+
+///
+/// Forgets the learned package layout, e.g. at the start of a new measurement loop.
+/// `ReceivePackage()` does this for every measurement loop.
+///
+void ResetPackageSchema(MscrPackageSchema *schema);
+
+
 ///
 /// Splits the input string in to tokens based on the delimiters set (delim) and stores the pointer to the successive token in *stringp
 /// This has to be performed repeatedly until end of string or until no further tokens are found
@@ -377,6 +681,69 @@ const double GetUnitPrefixValue(char charPrefix);
 const char* current_range_to_string(int current_range);
 
 
+///
+/// Returns the value of a subpackage, including its SI unit prefix.
+/// This works for both the normal and the packed (`MSCR_PACKED_SUBPACKAGES`) subpackage layout.
+///
+float GetSubpackageValue(const MscrSubPackage *subpackage);
+
+
+#if MSCR_HAS_EXACT_VALUES
+
+///
+/// Returns the mantissa of the exact value of a subpackage: the value without its SI unit prefix.
+/// The value is `mantissa` * 1000^`exponent`, see `GetSubpackageExponent()`.
+/// Only available if the subpackages store exact values (`MSCR_EXACT_VALUES` or `MSCR_PACKED_SUBPACKAGES`).
+///
+int32_t GetSubpackageMantissa(const MscrSubPackage *subpackage);
+
+
+///
+/// Returns the SI unit prefix of a subpackage as a power of 1000, e.g. -2 for 'u' and 1 for 'k',
+/// or `MSCR_EXPONENT_INVALID` if the prefix is not valid.
+///
+int GetSubpackageExponent(const MscrSubPackage *subpackage);
+
+
+///
+/// Returns the value of a subpackage in double precision, see `ExactValueToDouble()`.
+///
+double GetSubpackageValueDouble(const MscrSubPackage *subpackage);
+
+#endif
+
+
+///
+/// Converts an exact value (`mantissa` * 1000^`exponent`) to the nearest double.
+///
+/// parameters:
+///   mantissa - The value without its SI unit prefix
+///   exponent - The SI unit prefix as a power of 1000, from -6 to 6
+///
+/// return:
+///   The value, or 0 if the exponent is out of range (such as `MSCR_EXPONENT_INVALID`)
+///
+double ExactValueToDouble(int32_t mantissa, int exponent);
+
+
+///
+/// Returns the `variable type` of a subpackage, as converted by `MSCR_STR_TO_VT`.
+///
+int GetSubpackageVarType(const MscrSubPackage *subpackage);
+
+
+///
+/// Returns the status metadata of a subpackage (see `Status`), or -1 if the subpackage has no status.
+///
+int GetSubpackageStatus(const MscrSubPackage *subpackage);
+
+
+///
+/// Returns the current range metadata of a subpackage, or -1 if the subpackage has no current range.
+///
+int GetSubpackageCurrentRange(const MscrSubPackage *subpackage);
+
+
 ///
 /// Look up function to convert a MethodSCRIPT `variable type` value to a string
 ///
@@ -389,6 +756,21 @@ const char* current_range_to_string(int current_range);
 const char *VartypeToString(int variable_type);
 
 
+///
+/// Look up the description of a MethodSCRIPT `variable type`.
+/// All descriptions are in one constant table indexed by the `MSCR_STR_TO_VT` value,
+/// so this is a single table read.
+///
+/// parameters:
+///   variable_type The `variable type` as converted by `MSCR_STR_TO_VT`
+///
+/// return:
+///   The description, with category MSCR_VTC_UNDEFINED and name "Undefined variable type"
+///   if the variable type is not known. Never NULL.
+///
+const MscrVarTypeInfo *GetVarTypeInfo(int variable_type);
+
+
 
 //////////////////////////////////////////////////////////////////////////////
 // Internal Communication Functions
@@ -406,13 +788,27 @@ const char *VartypeToString(int variable_type);
 ///   buf     - The buffer in which the response is stored
 ///
 /// Returns
-///   CODE_OK if successful, otherwise CODE_NULL.
+///   The type of the line as classified by `ClassifyLine`, CODE_TIMEOUT if no complete line was received
+///   before the read deadline (the partial line is discarded) or CODE_NULL if the line was too long.
 ///
 RetCode ReadBuf(MSComm* MSComm, char* buf);
 
 
 ///
-/// Reads a character using the supplied read_char_func
+/// Determines the type of a line received from the EmStat Pico
+///
+/// parameters:
+///   line    - The received line, including the terminating '\n'
+///   length  - The number of characters in `line`, including the terminating '\n'
+///
+/// Returns
+///   The code that `ReadBuf` returns for this line, CODE_NOT_IMPLEMENTED for unexpected lines.
+///
+RetCode ClassifyLine(const char *line, size_t length);
+
+
+///
+/// Reads a character using the supplied read_char_func or read_buf_func
 ///
 /// parameters:
 ///   MSComm - The MSComm data struct
@@ -40,12 +40,47 @@
 // Types
 //////////////////////////////////////////////////////////////////////////////
 
+///
+/// One block of data for a WriteBufFunc. A list of blocks is written as one continuous stream.
+///
+typedef struct _MSWriteBlock
+{
+	const char *data;
+	int length;
+} MSWriteBlock;
+
 //Templates for communication functions
 
 //Function in the form of "int function(char c);"
 typedef int (*WriteCharFunc)(char c);
 //Function in the form of "int function();"
 typedef int (*ReadCharFunc)();
+//Function in the form of "int function(char *buf, int size);"
+//Reads up to `size` bytes into `buf`, returns the number of bytes read, 0 if no data was available or < 0 on failure
+typedef int (*ReadBufFunc)(char *buf, int size);
+//Function in the form of "int function(const MSWriteBlock *blocks, int count);"
+//Writes all blocks in the given order, returns the total number of bytes written or < 0 on failure
+typedef int (*WriteBufFunc)(const MSWriteBlock *blocks, int count);
+//Function in the form of "int function(int *timeout_ms);"
+//Waits until data can be read or `*timeout_ms` milliseconds have passed (forever if `*timeout_ms` < 0).
+//Decreases `*timeout_ms` by the time spent waiting. Returns > 0 if data is available, 0 on timeout or < 0 on failure
+typedef int (*WaitReadFunc)(int *timeout_ms);
+
+///
+/// Communication functions of one device, with a context pointer that is passed to every call.
+/// The context is typically the port object of the device, so one set of functions can serve
+/// any number of devices. The functions behave like the templates above.
+/// Only the write_char and either read_char or read_buf are required, the others may be NULL.
+///
+typedef struct _MSTransport
+{
+	void *context;
+	int (*write_char)(void *context, char c);
+	int (*write_buf)(void *context, const MSWriteBlock *blocks, int count);
+	int (*read_char)(void *context);
+	int (*read_buf)(void *context, char *buf, int size);
+	int (*wait_read)(void *context, int *timeout_ms);
+} MSTransport;
 
 ///
 /// Function return codes.
@@ -0,0 +1,575 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSCsvWriter.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MSCsvWriter.h"
+
+
+// Powers of 10 that are exact in double precision
+static const double POWERS_OF_10[23] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Negative powers of 10, to divide by multiplying
+static const double INVERSE_POWERS_OF_10[9] = { 1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8 };
+
+// The decimal text of all numbers from 0 to 99
+static const char DIGIT_PAIRS[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Finds the index of the only bit that is set in a 32 bit value, see `StatusCellIndex()`
+static const uint8_t DE_BRUIJN_BIT_INDEX[32] =
+{
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+};
+
+
+//
+// Returns `value` * 10^`n`, with a relative error of at most a few double precision roundings
+//
+static double ScaleByPowerOf10(double value, int n)
+{
+	while (n > 22)
+	{
+		value *= 1e22;
+		n -= 22;
+	}
+	while (n < -22)
+	{
+		value /= 1e22;
+		n += 22;
+	}
+	return (n >= 0) ? value * POWERS_OF_10[n] : value / POWERS_OF_10[-n];
+}
+
+
+//
+// Returns 2^`n` for -1022 <= `n` <= 1023
+//
+static inline double PowerOf2(int n)
+{
+	uint64_t bits = (uint64_t)(n + 1023) << 52;
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+//
+// Writes the digits of `value` and returns the number of characters written
+//
+static int FormatUnsigned(char *text, uint32_t value)
+{
+	char digits[10];
+	char *p = digits + sizeof(digits);
+
+	// Two digits at a time
+	while (value >= 100)
+	{
+		const uint32_t pair = value % 100;
+		value /= 100;
+		p -= 2;
+		memcpy(p, &DIGIT_PAIRS[2 * pair], 2);
+	}
+	if (value >= 10)
+	{
+		p -= 2;
+		memcpy(p, &DIGIT_PAIRS[2 * value], 2);
+	}
+	else
+	{
+		*--p = (char)('0' + value);
+	}
+
+	const int count = (int)(digits + sizeof(digits) - p);
+	memcpy(text, p, count);
+	return count;
+}
+
+
+//
+// Writes `digits` * 10^`exponent` as decimal text and returns the number of characters written.
+// Values from 1e-5 up to 1e15 are written without exponent, all others in scientific notation (e.g. 1.5E-09).
+//
+static int FormatDecimal(char *text, int negative, uint32_t digits, int exponent)
+{
+	char buffer[10];
+	char *p = text;
+	int count;
+
+	if (digits == 0)
+	{
+		*p = '0';
+		return 1;
+	}
+	while (digits % 10 == 0)
+	{
+		digits /= 10;
+		exponent++;
+	}
+	count = FormatUnsigned(buffer, digits);
+
+	if (negative)
+		*p++ = '-';
+
+	// The power of 10 of the first digit
+	const int power = exponent + count - 1;
+
+	if (power < -5 || power >= 15)
+	{
+		*p++ = buffer[0];
+		if (count > 1)
+		{
+			*p++ = '.';
+			memcpy(p, buffer + 1, count - 1);
+			p += count - 1;
+		}
+		*p++ = 'E';
+		*p++ = (power < 0) ? '-' : '+';
+		if (abs(power) < 10)
+			*p++ = '0';
+		p += FormatUnsigned(p, abs(power));
+	}
+	else if (exponent >= 0)
+	{
+		memcpy(p, buffer, count);
+		p += count;
+		memset(p, '0', exponent);
+		p += exponent;
+	}
+	else if (power >= 0)
+	{
+		memcpy(p, buffer, power + 1);
+		p += power + 1;
+		*p++ = '.';
+		memcpy(p, buffer + power + 1, count - power - 1);
+		p += count - power - 1;
+	}
+	else
+	{
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -power - 1);
+		p += -power - 1;
+		memcpy(p, buffer, count);
+		p += count;
+	}
+	return (int)(p - text);
+}
+
+
+//
+// Returns the index in `statusCells` of a status value
+//
+static inline int StatusCellIndex(int status)
+{
+	if (status == 0)
+		return 0;
+
+	// Only the first flag that is set is written, as the lowest bit that is set
+	uint32_t lowestBit = (uint32_t)status & (0u - (uint32_t)status);
+	return 1 + DE_BRUIJN_BIT_INDEX[(uint32_t)(lowestBit * 0x077CB531u) >> 27];
+}
+
+
+//
+// Prepares a quoted cell with a separator, such as `,"OK"`
+//
+static void PrepareCell(MSCsvCell *cell, const char *text)
+{
+	int length = snprintf(cell->text, sizeof(cell->text), ",\"%s\"", text);
+	cell->length = (length < (int)sizeof(cell->text)) ? (uint8_t)length : (uint8_t)(sizeof(cell->text) - 1);
+}
+
+
+//
+// Writes the buffered text to the file, or hands it to the MSAsyncWriter and gets room for at least
+// `minimum` more characters
+//
+static void WriteBuffer(MSCsvWriter *writer, size_t minimum)
+{
+	writer->written += writer->length;
+	if (writer->async != NULL)
+	{
+		MSAsyncWriterCommit(writer->async, writer->length);
+		writer->buffer = MSAsyncWriterReserve(writer->async, minimum, &writer->capacity);
+	}
+	else if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->fp) != writer->length)
+		writer->error = 1;
+	writer->length = 0;
+}
+
+
+//
+// Makes sure that at least `length` characters can be added to the buffer
+//
+static inline void Reserve(MSCsvWriter *writer, size_t length)
+{
+	if (writer->capacity - writer->length < length)
+		WriteBuffer(writer, length);
+}
+
+
+//
+// Prepares the status and current range cells
+//
+static void PrepareCells(MSCsvWriter *writer)
+{
+	PrepareCell(&writer->statusCells[0], StatusToString(STATUS_OK));
+	for (int bit = 0; bit < 32; bit++)
+		PrepareCell(&writer->statusCells[1 + bit], StatusToString((Status)(1u << bit)));
+	for (int range = 0; range < 256; range++)
+		PrepareCell(&writer->rangeCells[range], current_range_to_string(range));
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+RetCode MSCsvWriterInit(MSCsvWriter *writer, FILE *fp, size_t bufferSize)
+{
+	if (bufferSize == 0)
+		bufferSize = MSCSV_DEFAULT_BUFFER_SIZE;
+	if (bufferSize < MSCSV_MAX_LINE_LENGTH(MSCR_SUBPACKAGES_PER_LINE))
+		bufferSize = MSCSV_MAX_LINE_LENGTH(MSCR_SUBPACKAGES_PER_LINE);
+
+	writer->fp = fp;
+	writer->async = NULL;
+	writer->written = 0;
+	writer->length = 0;
+	writer->error = 0;
+	writer->buffer = malloc(bufferSize);
+	writer->capacity = (writer->buffer != NULL) ? bufferSize : 0;
+	if (writer->buffer == NULL)
+		return CODE_ERROR;
+
+	PrepareCells(writer);
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+RetCode MSCsvWriterInitAsync(MSCsvWriter *writer, MSAsyncWriter *async)
+{
+	if (async->bufferSize < MSCSV_MAX_LINE_LENGTH(MSCR_SUBPACKAGES_PER_LINE))
+		return CODE_OUT_OF_RANGE;
+
+	writer->fp = NULL;
+	writer->async = async;
+	writer->written = 0;
+	writer->length = 0;
+	writer->error = 0;
+	writer->buffer = MSAsyncWriterReserve(async, 0, &writer->capacity);
+
+	PrepareCells(writer);
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+RetCode MSCsvWriterFree(MSCsvWriter *writer)
+{
+	RetCode code = CODE_OK;
+
+	if (writer->buffer != NULL)
+	{
+		code = MSCsvFlush(writer);
+		if (writer->async == NULL)
+			free(writer->buffer);
+	}
+	writer->buffer = NULL;
+	writer->capacity = 0;
+	return code;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+RetCode MSCsvFlush(MSCsvWriter *writer)
+{
+	if (writer->async != NULL)
+	{
+		MSAsyncWriterCommit(writer->async, writer->length);
+		writer->written += writer->length;
+		writer->length = 0;
+		if (MSAsyncWriterFlush(writer->async, 0) != CODE_OK)
+			writer->error = 1;
+		writer->buffer = MSAsyncWriterReserve(writer->async, 0, &writer->capacity);
+		return writer->error ? CODE_ERROR : CODE_OK;
+	}
+	WriteBuffer(writer, 0);
+	if (fflush(writer->fp) != 0)
+		writer->error = 1;
+	return writer->error ? CODE_ERROR : CODE_OK;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+void MSCsvFlushBuffer(MSCsvWriter *writer)
+{
+	WriteBuffer(writer, 0);
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+void MSCsvWriteText(MSCsvWriter *writer, const char *text)
+{
+	size_t length = strlen(text);
+
+	if (length > writer->capacity)
+	{
+		WriteBuffer(writer, 0);
+		writer->written += length;
+		if (writer->async != NULL)
+		{
+			if (MSAsyncWrite(writer->async, text, length) != CODE_OK)
+				writer->error = 1;
+			writer->buffer = MSAsyncWriterReserve(writer->async, 0, &writer->capacity);
+		}
+		else if (fwrite(text, 1, length, writer->fp) != length)
+			writer->error = 1;
+		return;
+	}
+	Reserve(writer, length);
+	memcpy(writer->buffer + writer->length, text, length);
+	writer->length += length;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+void MSCsvWriteHeader(MSCsvWriter *writer, const MscrPackage *package)
+{
+	// The first field is always the package index
+	MSCsvWriteText(writer, "\"Index\"");
+
+	for (int i = 0; i < package->nr_of_subpackages; i++)
+	{
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+
+		MSCsvWriteText(writer, ",\"");
+		MSCsvWriteText(writer, VartypeToString(GetSubpackageVarType(subpackage)));
+		MSCsvWriteText(writer, "\"");
+		if (GetSubpackageStatus(subpackage) >= 0)
+			MSCsvWriteText(writer, ",\"Status\"");
+		if (GetSubpackageCurrentRange(subpackage) >= 0)
+			MSCsvWriteText(writer, ",\"Current Range\"");
+	}
+	MSCsvWriteText(writer, "\n");
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+void MSCsvWritePackage(MSCsvWriter *writer, const MscrPackage *package, int index)
+{
+	Reserve(writer, MSCSV_MAX_LINE_LENGTH(package->nr_of_subpackages));
+
+	char *p = writer->buffer + writer->length;
+
+	if (index < 0)
+		*p++ = '-';
+	p += FormatUnsigned(p, (index < 0) ? 0u - (uint32_t)index : (uint32_t)index);
+
+	for (int i = 0; i < package->nr_of_subpackages; i++)
+	{
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+		const int status = GetSubpackageStatus(subpackage);
+		const int currentRange = GetSubpackageCurrentRange(subpackage);
+
+		*p++ = ',';
+		*p++ = '"';
+#if MSCR_HAS_EXACT_VALUES
+		p += MSCsvFormatExact(p, GetSubpackageMantissa(subpackage), GetSubpackageExponent(subpackage));
+#else
+		p += MSCsvFormatFloat(p, GetSubpackageValue(subpackage));
+#endif
+		*p++ = '"';
+
+		// The whole cell is copied, which is faster than copying a variable length.
+		// The space for it is included in `MSCSV_MAX_LINE_LENGTH`.
+		if (status >= 0)
+		{
+			const MSCsvCell *cell = &writer->statusCells[StatusCellIndex(status)];
+			memcpy(p, cell->text, MSCSV_MAX_CELL_LENGTH);
+			p += cell->length;
+		}
+		if (currentRange >= 0)
+		{
+			MSCsvCell cell;
+			const MSCsvCell *rangeCell = &writer->rangeCells[currentRange & 0xFF];
+			if (currentRange > 0xFF)
+			{
+				PrepareCell(&cell, current_range_to_string(currentRange));
+				rangeCell = &cell;
+			}
+			memcpy(p, rangeCell->text, MSCSV_MAX_CELL_LENGTH);
+			p += rangeCell->length;
+		}
+	}
+	*p++ = '\n';
+	writer->length = (size_t)(p - writer->buffer);
+}
+
+
+//
+// Checks if `digits` * 10^`exponent` converts back to the float `x`, which is positive.
+// `difference` is the distance of the decimal to `x`, and `above` and `below` the distances of the midpoints
+// between `x` and its neighbours, all in the scale of `scaled`. These are only exact to within `margin`,
+// so a decimal that is that close to a midpoint is converted with strtof() to be sure.
+//
+static int ConvertsBack(double difference, double above, double below, double margin,
+		uint32_t digits, int exponent, float x)
+{
+	if (difference < above - margin && -difference < below - margin)
+		return 1;
+	if (difference > above + margin || -difference > below + margin)
+		return 0;
+
+	char text[24];
+	const int length = FormatUnsigned(text, digits);
+	text[length] = 'e';
+	snprintf(text + length + 1, sizeof(text) - length - 1, "%d", exponent);
+	return strtof(text, NULL) == x;
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+int MSCsvFormatFloat(char *text, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const int negative = (int)(bits >> 31);
+	const int biasedExponent = (int)((bits >> 23) & 0xFF);
+	const uint32_t significand = bits & 0x7FFFFF;
+
+	if (biasedExponent == 0xFF)
+	{
+		const char *special = (significand != 0) ? "NaN" : (negative ? "-Inf" : "Inf");
+		memcpy(text, special, strlen(special));
+		return (int)strlen(special);
+	}
+	if (biasedExponent == 0 && significand == 0)
+		return FormatDecimal(text, 0, 0, 0);
+
+	// Scale the value to 9 digits before the decimal point, enough to tell all floats apart.
+	// `power` is the power of 10 of the first digit, estimated from the binary exponent
+	// as floor(exponent * log10(2)), and corrected if needed.
+	const double x = fabs((double)value);
+	const int binaryExponent = (biasedExponent > 0) ? biasedExponent - 127 : -127;
+	int power = (binaryExponent * 78913) >> 18;
+	double scaled = ScaleByPowerOf10(x, 8 - power);
+	while (scaled >= 1e9)
+	{
+		power++;
+		scaled /= 10;
+	}
+	while (scaled < 1e8)
+	{
+		power--;
+		scaled *= 10;
+	}
+
+	// The distance to the midpoints between `value` and the neighbouring floats, in the same scale.
+	// A decimal between those midpoints converts back to `value`. The scaling has a tiny rounding
+	// error, which is the margin within which `ConvertsBack()` checks a decimal with strtof().
+	// The float below a power of 2 is closer than the float above it, except for the smallest normal float.
+	const int ulpExponent = (biasedExponent > 0) ? biasedExponent - 150 : -149;
+	const double margin = scaled * 0x1p-47;
+	const double above = scaled / x * PowerOf2(ulpExponent - 1);
+	const double below = (significand == 0 && biasedExponent > 1) ? above / 2 : above;
+
+	// Find the fewest digits that are within the midpoints. With 9 digits this is always the case,
+	// and if a number of digits is enough, more digits are too, so a binary search is used.
+	// The nearest decimal with a number of digits is tried first. If it is below `value`, the next one
+	// can still be within the midpoints when the float below is closer than the float above.
+	int fewest = 1, most = 9;
+	uint32_t digits = (uint32_t)(scaled + 0.5);
+	while (fewest < most)
+	{
+		const int count = (fewest + most) / 2;
+		const int exponent = power + 1 - count;
+		const double unit = POWERS_OF_10[9 - count];
+		uint32_t candidate = (uint32_t)(scaled * INVERSE_POWERS_OF_10[9 - count] + 0.5);
+		double difference = candidate * unit - scaled;
+		int found = ConvertsBack(difference, above, below, margin, candidate, exponent, (float)x);
+		if (!found && difference < 0)
+		{
+			candidate++;
+			difference += unit;
+			found = ConvertsBack(difference, above, below, margin, candidate, exponent, (float)x);
+		}
+		if (found)
+		{
+			most = count;
+			digits = candidate;
+		}
+		else
+		{
+			fewest = count + 1;
+		}
+	}
+	return FormatDecimal(text, negative, digits, power + 1 - most);
+}
+
+
+//
+// See documentation in MSCsvWriter.h
+//
+int MSCsvFormatExact(char *text, int32_t mantissa, int exponent)
+{
+	if (exponent < -6 || exponent > 6)
+		return FormatDecimal(text, 0, 0, 0);
+	return FormatDecimal(text, mantissa < 0, (mantissa < 0) ? 0u - (uint32_t)mantissa : (uint32_t)mantissa, 3 * exponent);
+}
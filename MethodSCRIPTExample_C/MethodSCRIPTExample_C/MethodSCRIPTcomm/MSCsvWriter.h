@@ -0,0 +1,220 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSCsvWriter.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSCsvWriter stores MethodSCRIPT packages in a CSV file.
+ *	Lines are formatted into a large buffer that is written to the file in big blocks, so writing a
+ *	package costs no `fprintf()` calls. Values are written with the shortest text that reads back as
+ *	the same value: the exact decimal value if the subpackages store exact values (`MSCR_HAS_EXACT_VALUES`),
+ *	otherwise the shortest decimal that converts back to the same float. The quoted status and current
+ *	range texts are prepared once when the writer is initialised.
+ *	A writer can also format directly into the buffers of an MSAsyncWriter, so the file is written on
+ *	a background thread.
+ *
+ *	Each file has its own writer. A writer must not be used by more than one thread at a time.
+ *
+ ============================================================================
+ */
+
+#ifndef MSCSVWRITER_H
+#define MSCSVWRITER_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "MSAsyncWriter.h"
+#include "MSComm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and macros
+//////////////////////////////////////////////////////////////////////////////
+
+/// The default size of the buffer of a writer
+#define MSCSV_DEFAULT_BUFFER_SIZE	(256 * 1024)
+
+/// The maximum length of a value written by `MSCsvFormatFloat()` or `MSCsvFormatExact()`
+#define MSCSV_MAX_VALUE_LENGTH		24
+
+/// The maximum length of a prepared cell, including the separator and quotes
+#define MSCSV_MAX_CELL_LENGTH		32
+
+/// The maximum length of one CSV line of a package with `nrOfSubpackages` subpackages
+#define MSCSV_MAX_LINE_LENGTH(nrOfSubpackages)	(16 + (nrOfSubpackages) * (MSCSV_MAX_VALUE_LENGTH + 3 + 2 * MSCSV_MAX_CELL_LENGTH))
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// A prepared CSV cell, e.g. `,"Overload"`
+///
+typedef struct _MSCsvCell
+{
+	uint8_t length;
+	char text[MSCSV_MAX_CELL_LENGTH];
+} MSCsvCell;
+
+///
+/// A CSV writer
+///
+typedef struct _MSCsvWriter
+{
+	FILE *fp;						// The file that is written to, NULL if `async` is used
+	MSAsyncWriter *async;			// The asynchronous writer that is written to, NULL if `fp` is used
+	char *buffer;					// The text that has not been written to the file yet, owned by `async` if used
+	uint64_t written;				// The number of characters passed on to the file, without those in `buffer`
+	size_t length;					// The number of characters in `buffer`
+	size_t capacity;				// The size of `buffer`
+	int error;						// Non-zero if writing to the file failed
+	MSCsvCell statusCells[33];		// The status cells: [0] for status OK, [1 + n] if bit n is the first bit that is set
+	MSCsvCell rangeCells[256];		// The current range cells, indexed by the current range
+} MSCsvWriter;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Initialises a writer for an opened file
+///
+/// parameters:
+///   writer      - The writer to initialise
+///   fp          - The file to write to. The writer does not close it.
+///   bufferSize  - The size of the buffer in bytes, 0 for `MSCSV_DEFAULT_BUFFER_SIZE`
+///
+/// Returns:
+///   CODE_OK if successful or CODE_ERROR if out of memory.
+///
+RetCode MSCsvWriterInit(MSCsvWriter *writer, FILE *fp, size_t bufferSize);
+
+
+///
+/// Initialises a writer that formats directly into the buffers of an asynchronous writer
+///
+/// parameters:
+///   writer  - The writer to initialise
+///   async   - The opened asynchronous writer. The writer does not close it.
+///
+/// Returns:
+///   CODE_OK if successful or CODE_OUT_OF_RANGE if the buffers of `async` cannot hold the longest line.
+///
+RetCode MSCsvWriterInitAsync(MSCsvWriter *writer, MSAsyncWriter *async);
+
+
+///
+/// Writes all buffered text to the file and frees the buffer. The file is flushed, but not closed.
+/// With an asynchronous writer, this waits until the thread has written all text.
+///
+/// Returns:
+///   CODE_OK if all text was written or CODE_ERROR if writing failed at any time.
+///
+RetCode MSCsvWriterFree(MSCsvWriter *writer);
+
+
+///
+/// Writes all buffered text to the file and flushes the file
+///
+/// Returns:
+///   CODE_OK if all text was written or CODE_ERROR if writing failed at any time.
+///
+RetCode MSCsvFlush(MSCsvWriter *writer);
+
+
+///
+/// Passes the buffered text on to the file or the asynchronous writer, without flushing the file or waiting
+/// for the asynchronous writer. E.g. before `MSAsyncWriterSwitchFile()`, to keep the text in the previous file;
+/// call it once more after the switch to continue in the buffer of the new file.
+///
+void MSCsvFlushBuffer(MSCsvWriter *writer);
+
+
+///
+/// Adds text as it is, e.g. an empty line between measurement loops.
+///
+void MSCsvWriteText(MSCsvWriter *writer, const char *text);
+
+
+///
+/// Adds a header line. The fields in the header are determined by the `variable types`
+/// and metadata of the subpackages of `package`.
+///
+void MSCsvWriteHeader(MSCsvWriter *writer, const MscrPackage *package);
+
+
+///
+/// Adds one line with the index and the values and metadata of a package
+///
+/// parameters:
+///   writer   - The writer
+///   package  - The package
+///   index    - The index written in the first column
+///
+void MSCsvWritePackage(MSCsvWriter *writer, const MscrPackage *package, int index);
+
+
+///
+/// Formats the shortest decimal text that converts back to the same float, e.g. "-0.495" or "1.23E-09".
+///
+/// parameters:
+///   text   - Receives the text, at least `MSCSV_MAX_VALUE_LENGTH` characters. It is not terminated.
+///   value  - The value
+///
+/// Returns:
+///   The number of characters written
+///
+int MSCsvFormatFloat(char *text, float value);
+
+
+///
+/// Formats an exact value (`mantissa` * 1000^`exponent`) as decimal text without rounding.
+/// An invalid exponent (such as `MSCR_EXPONENT_INVALID`) is written as 0, like `ExactValueToDouble()`.
+///
+/// parameters:
+///   text      - Receives the text, at least `MSCSV_MAX_VALUE_LENGTH` characters. It is not terminated.
+///   mantissa  - The value without its SI unit prefix
+///   exponent  - The SI unit prefix as a power of 1000
+///
+/// Returns:
+///   The number of characters written
+///
+int MSCsvFormatExact(char *text, int32_t mantissa, int exponent);
+
+
+#endif //MSCSVWRITER_H
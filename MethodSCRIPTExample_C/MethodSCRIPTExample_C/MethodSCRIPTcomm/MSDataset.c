@@ -0,0 +1,412 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSDataset.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "MSDataset.h"
+#include "MSValueDecoder.h"
+
+
+// The number of columns and scans that is allocated at first
+#define INITIAL_COLUMNS	8
+#define INITIAL_SCANS	8
+#define INITIAL_LOOPS	8
+
+// `lastRow` of a column that has not been written yet
+#define NO_ROW	SIZE_MAX
+
+
+//
+// Moves the first `count` elements of an array to a new array of `capacity` elements from the arena.
+// The old array stays in the arena until the arena is freed.
+// Returns the new array or NULL if out of memory
+//
+static void* GrowArray(MSArena *arena, const void *array, size_t count, size_t capacity, size_t elementSize)
+{
+	void *result = MSArenaAlloc(arena, capacity * elementSize);
+	if (result != NULL && count > 0)
+		memcpy(result, array, count * elementSize);
+	return result;
+}
+
+
+//
+// Allocates a metadata column of the loop in which the first `rows` rows are -1
+//
+static int16_t* NewMetadataColumn(MSArena *arena, const MSDatasetLoop *loop, size_t rows)
+{
+	int16_t *column = MSArenaAlloc(arena, loop->rowCapacity * sizeof(int16_t));
+	if (column != NULL)
+	{
+		for (size_t row = 0; row < rows; row++)
+			column[row] = -1;
+	}
+	return column;
+}
+
+
+//
+// Doubles the number of rows of every column of a loop
+//
+static RetCode GrowRows(MSArena *arena, MSDatasetLoop *loop)
+{
+	size_t capacity = (loop->rowCapacity > 0) ? loop->rowCapacity * 2 : MSDATASET_INITIAL_ROWS;
+
+	for (int i = 0; i < loop->columnCount; i++)
+	{
+		MSDatasetColumn *column = &loop->columns[i];
+		double *values = GrowArray(arena, column->values, loop->rowCount, capacity, sizeof(double));
+		if (values == NULL)
+			return CODE_ERROR;
+		column->values = values;
+		if (column->status != NULL)
+		{
+			int16_t *status = GrowArray(arena, column->status, loop->rowCount, capacity, sizeof(int16_t));
+			if (status == NULL)
+				return CODE_ERROR;
+			column->status = status;
+		}
+		if (column->currentRange != NULL)
+		{
+			int16_t *currentRange = GrowArray(arena, column->currentRange, loop->rowCount, capacity, sizeof(int16_t));
+			if (currentRange == NULL)
+				return CODE_ERROR;
+			column->currentRange = currentRange;
+		}
+	}
+	loop->rowCapacity = capacity;
+	return CODE_OK;
+}
+
+
+//
+// Adds a column to a loop, the existing rows are NAN
+// Returns the column or NULL if out of memory
+//
+static MSDatasetColumn* AddColumn(MSArena *arena, MSDatasetLoop *loop, int variable_type)
+{
+	if (loop->columnCount == loop->columnCapacity)
+	{
+		int capacity = (loop->columnCapacity > 0) ? loop->columnCapacity * 2 : INITIAL_COLUMNS;
+		MSDatasetColumn *columns = GrowArray(arena, loop->columns, loop->columnCount, capacity, sizeof(MSDatasetColumn));
+		if (columns == NULL)
+			return NULL;
+		loop->columns = columns;
+		loop->columnCapacity = capacity;
+	}
+
+	MSDatasetColumn *column = &loop->columns[loop->columnCount];
+	column->values = MSArenaAlloc(arena, loop->rowCapacity * sizeof(double));
+	if (column->values == NULL)
+		return NULL;
+	for (size_t row = 0; row < loop->rowCount; row++)
+		column->values[row] = NAN;
+	column->variableType = variable_type;
+	column->status = NULL;
+	column->currentRange = NULL;
+	column->lastRow = NO_ROW;
+	loop->columnCount++;
+	return column;
+}
+
+
+//
+// Finds the column for a subpackage: the first column of its variable type that has no value in `row` yet
+//
+static MSDatasetColumn* FindFreeColumn(MSDatasetLoop *loop, int variable_type, size_t row)
+{
+	for (int i = 0; i < loop->columnCount; i++)
+	{
+		if (loop->columns[i].variableType == variable_type && loop->columns[i].lastRow != row)
+			return &loop->columns[i];
+	}
+	return NULL;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+void MSDatasetInit(MSDataset *dataset, size_t blockSize)
+{
+	MSArenaInit(&dataset->arena, blockSize);
+	dataset->loopCount = 0;
+	dataset->loopCapacity = 0;
+	dataset->loops = NULL;
+	dataset->inLoop = 0;
+	dataset->error = CODE_OK;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+void MSDatasetFree(MSDataset *dataset)
+{
+	MSArenaFree(&dataset->arena);
+	MSDatasetInit(dataset, dataset->arena.blockSize);
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+RetCode MSDatasetBeginLoop(MSDataset *dataset)
+{
+	MSDatasetEndLoop(dataset);
+	if (dataset->loopCount == dataset->loopCapacity)
+	{
+		size_t capacity = (dataset->loopCapacity > 0) ? dataset->loopCapacity * 2 : INITIAL_LOOPS;
+		MSDatasetLoop *loops = GrowArray(&dataset->arena, dataset->loops, dataset->loopCount, capacity, sizeof(MSDatasetLoop));
+		if (loops == NULL)
+			return CODE_ERROR;
+		dataset->loops = loops;
+		dataset->loopCapacity = capacity;
+	}
+
+	memset(&dataset->loops[dataset->loopCount], 0, sizeof(MSDatasetLoop));
+	dataset->loopCount++;
+	dataset->inLoop = 1;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+void MSDatasetEndLoop(MSDataset *dataset)
+{
+	if (!dataset->inLoop)
+		return;
+	dataset->loops[dataset->loopCount - 1].inScan = 0;
+	dataset->loops[dataset->loopCount - 1].complete = 1;
+	dataset->inLoop = 0;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+RetCode MSDatasetBeginScan(MSDataset *dataset)
+{
+	if (!dataset->inLoop && MSDatasetBeginLoop(dataset) != CODE_OK)
+		return CODE_ERROR;
+
+	MSDatasetLoop *loop = &dataset->loops[dataset->loopCount - 1];
+	if (loop->scanCount == loop->scanCapacity)
+	{
+		size_t capacity = (loop->scanCapacity > 0) ? loop->scanCapacity * 2 : INITIAL_SCANS;
+		MSDatasetScan *scans = GrowArray(&dataset->arena, loop->scans, loop->scanCount, capacity, sizeof(MSDatasetScan));
+		if (scans == NULL)
+			return CODE_ERROR;
+		loop->scans = scans;
+		loop->scanCapacity = capacity;
+	}
+
+	loop->scans[loop->scanCount].firstRow = loop->rowCount;
+	loop->scans[loop->scanCount].rowCount = 0;
+	loop->scanCount++;
+	loop->inScan = 1;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+void MSDatasetEndScan(MSDataset *dataset)
+{
+	if (dataset->inLoop)
+		dataset->loops[dataset->loopCount - 1].inScan = 0;
+}
+
+
+//
+// Adds one row for a package. If `values` is not NULL it holds the values of all subpackages,
+// otherwise the values are taken from the subpackages.
+//
+static RetCode AddRow(MSDataset *dataset, const MscrPackage *package, const double *values)
+{
+	MSArena *arena = &dataset->arena;
+
+	if (!dataset->inLoop && MSDatasetBeginLoop(dataset) != CODE_OK)
+		return CODE_ERROR;
+
+	MSDatasetLoop *loop = &dataset->loops[dataset->loopCount - 1];
+	if (loop->rowCount == loop->rowCapacity && GrowRows(arena, loop) != CODE_OK)
+		return CODE_ERROR;
+
+	size_t row = loop->rowCount;
+	int filled = 0;
+	for (int i = 0; i < package->nr_of_subpackages; i++)
+	{
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+		int variable_type = GetSubpackageVarType(subpackage);
+
+		// Usually every subpackage goes to the column with the same index
+		MSDatasetColumn *column = (i < loop->columnCount) ? &loop->columns[i] : NULL;
+		if (column == NULL || column->variableType != variable_type || column->lastRow == row)
+		{
+			column = FindFreeColumn(loop, variable_type, row);
+			if (column == NULL && (column = AddColumn(arena, loop, variable_type)) == NULL)
+				return CODE_ERROR;
+		}
+
+#if MSCR_HAS_EXACT_VALUES
+		column->values[row] = (values != NULL) ? values[i] : GetSubpackageValueDouble(subpackage);
+#else
+		column->values[row] = (values != NULL) ? values[i] : GetSubpackageValue(subpackage);
+#endif
+		int status = GetSubpackageStatus(subpackage);
+		if (status >= 0 && column->status == NULL && (column->status = NewMetadataColumn(arena, loop, row)) == NULL)
+			return CODE_ERROR;
+		if (column->status != NULL)
+			column->status[row] = status;
+		int currentRange = GetSubpackageCurrentRange(subpackage);
+		if (currentRange >= 0 && column->currentRange == NULL && (column->currentRange = NewMetadataColumn(arena, loop, row)) == NULL)
+			return CODE_ERROR;
+		if (column->currentRange != NULL)
+			column->currentRange[row] = currentRange;
+		column->lastRow = row;
+		filled++;
+	}
+
+	// Fill the columns of variables that are not in this package
+	if (filled < loop->columnCount)
+	{
+		for (int i = 0; i < loop->columnCount; i++)
+		{
+			MSDatasetColumn *column = &loop->columns[i];
+			if (column->lastRow == row)
+				continue;
+			column->values[row] = NAN;
+			if (column->status != NULL)
+				column->status[row] = -1;
+			if (column->currentRange != NULL)
+				column->currentRange[row] = -1;
+			column->lastRow = row;
+		}
+	}
+
+	loop->rowCount++;
+	if (loop->inScan)
+		loop->scans[loop->scanCount - 1].rowCount++;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+RetCode MSDatasetAddPackage(MSDataset *dataset, const MscrPackage *package)
+{
+	return AddRow(dataset, package, NULL);
+}
+
+
+#if !MSCR_HAS_EXACT_VALUES
+
+//
+// Adds a package with the values decoded in double precision from its line.
+// Falls back to the `float` values of the package if the line does not match it.
+//
+static RetCode AddPackageLine(MSDataset *dataset, const char *line, size_t length, const MscrPackage *package)
+{
+	const char *fields[MSCR_SUBPACKAGES_PER_LINE];
+	double values[MSCR_SUBPACKAGES_PER_LINE];
+
+	int count = FindValueFields(line, length, fields, MSCR_SUBPACKAGES_PER_LINE);
+	if (count != package->nr_of_subpackages)
+		return AddRow(dataset, package, NULL);
+	DecodeValueFields(fields, count, values);
+	return AddRow(dataset, package, values);
+}
+
+#endif
+
+
+//
+// See documentation in MSDataset.h
+//
+RetCode MSDatasetAddEvent(MSDataset *dataset, RetCode code, const char *line, size_t length, const MscrPackage *package)
+{
+	int nscans = (line != NULL && length > 0 && (line[0] == REPLY_NSCANS_START || line[0] == REPLY_NSCANS_DONE));
+
+	switch (code)
+	{
+		case CODE_OK:
+#if !MSCR_HAS_EXACT_VALUES
+			if (line != NULL)
+				return AddPackageLine(dataset, line, length, package);
+#endif
+			return MSDatasetAddPackage(dataset, package);
+		case CODE_MEASURING:
+			return nscans ? MSDatasetBeginScan(dataset) : MSDatasetBeginLoop(dataset);
+		case CODE_MEASUREMENT_DONE:
+			if (nscans)
+				MSDatasetEndScan(dataset);
+			else
+				MSDatasetEndLoop(dataset);
+			return CODE_OK;
+		default:
+			return CODE_OK;
+	}
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+void MSDatasetOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	MSDataset *dataset = context;
+	RetCode code = MSDatasetAddEvent(dataset, event, line, length, package);
+
+	if (code != CODE_OK && dataset->error == CODE_OK)
+		dataset->error = code;
+}
+
+
+//
+// See documentation in MSDataset.h
+//
+const MSDatasetColumn* MSDatasetFindColumn(const MSDatasetLoop *loop, int variable_type)
+{
+	for (int i = 0; i < loop->columnCount; i++)
+	{
+		if (loop->columns[i].variableType == variable_type)
+			return &loop->columns[i];
+	}
+	return NULL;
+}
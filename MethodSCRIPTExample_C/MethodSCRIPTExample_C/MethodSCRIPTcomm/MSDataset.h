@@ -0,0 +1,234 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSDataset.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSDataset collects received packages in columns, one array per variable, so analysis code can
+ *	work on contiguous arrays instead of on one MscrPackage at a time.
+ *
+ *	The packages are grouped in measurement loops, which start with a CODE_MEASURING response ('M')
+ *	and end with CODE_MEASUREMENT_DONE ('*'). Every loop has its own columns: one for every variable type
+ *	in its packages, in the order in which they first appear. If a package contains the same variable type
+ *	more than once, the second occurrence gets a second column with that type. All columns of a loop have
+ *	one row per package; rows of packages that did not contain the variable are NAN.
+ *	The nscans loops within a measurement loop (from 'C' to '-') are kept as ranges of rows.
+ *
+ *	The columns are allocated from an MSArena and grow by doubling, so appending a package costs no
+ *	allocation most of the time. All arrays are aligned to `MSARENA_ALIGNMENT` bytes.
+ *	Pointers to loops and columns are only valid until the next package or loop is added.
+ *
+ *	Typical use is to pass `MSDatasetOnEvent` as event function to `MSParserInit()`, or to call
+ *	`MSDatasetAddEvent()` with the result of every `ReceivePackage()`.
+ *
+ ============================================================================
+ */
+
+#ifndef MSDATASET_H
+#define MSDATASET_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MSComm.h"
+#include "MSArena.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and macros
+//////////////////////////////////////////////////////////////////////////////
+
+/// The number of rows that is allocated for the first package of a loop
+#define MSDATASET_INITIAL_ROWS	256
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The values of one variable in a measurement loop
+///
+typedef struct _MSDatasetColumn
+{
+	int variableType;				// As converted by `MSCR_STR_TO_VT`
+	double *values;					// The value of every row, NAN if the package did not contain the variable
+	int16_t *status;				// The status of every row or -1, NULL if no package had a status for the variable
+	int16_t *currentRange;			// The current range of every row or -1, NULL if no package had a current range
+	size_t lastRow;					// The last row that was written, for internal use
+} MSDatasetColumn;
+
+///
+/// The rows of one nscans loop
+///
+typedef struct _MSDatasetScan
+{
+	size_t firstRow;
+	size_t rowCount;
+} MSDatasetScan;
+
+///
+/// One measurement loop
+///
+typedef struct _MSDatasetLoop
+{
+	size_t rowCount;				// The number of packages
+	size_t rowCapacity;				// The number of rows allocated for every column
+	int columnCount;
+	int columnCapacity;
+	MSDatasetColumn *columns;
+	size_t scanCount;
+	size_t scanCapacity;
+	MSDatasetScan *scans;
+	int inScan;						// Set between the begin and end of an nscans loop
+	int complete;					// Set if the loop ended with CODE_MEASUREMENT_DONE
+} MSDatasetLoop;
+
+///
+/// A dataset of measurement loops
+///
+typedef struct _MSDataset
+{
+	MSArena arena;
+	size_t loopCount;
+	size_t loopCapacity;
+	MSDatasetLoop *loops;
+	int inLoop;						// Set if packages are added to the last loop
+	RetCode error;					// The first error of `MSDatasetOnEvent`, CODE_OK if none
+} MSDataset;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Initialises an empty dataset
+///
+/// parameters:
+///   dataset    - The dataset to initialise
+///   blockSize  - The size of the memory blocks in which the dataset grows, 0 for `MSARENA_DEFAULT_BLOCK_SIZE`
+///
+void MSDatasetInit(MSDataset *dataset, size_t blockSize);
+
+
+///
+/// Frees all memory of a dataset. The dataset is empty afterwards and can be used again.
+///
+void MSDatasetFree(MSDataset *dataset);
+
+
+///
+/// Starts a new measurement loop
+///
+/// Returns:
+///   CODE_OK if successful or CODE_ERROR if out of memory
+///
+RetCode MSDatasetBeginLoop(MSDataset *dataset);
+
+
+///
+/// Ends the current measurement loop. Packages that are added after this start a new loop.
+///
+void MSDatasetEndLoop(MSDataset *dataset);
+
+
+///
+/// Starts a new nscans loop in the current measurement loop
+///
+/// Returns:
+///   CODE_OK if successful or CODE_ERROR if out of memory
+///
+RetCode MSDatasetBeginScan(MSDataset *dataset);
+
+
+///
+/// Ends the current nscans loop
+///
+void MSDatasetEndScan(MSDataset *dataset);
+
+
+///
+/// Adds a package to the current measurement loop, a new loop is started if there is none.
+///
+/// parameters:
+///   dataset  - The dataset
+///   package  - The package to add
+///
+/// Returns:
+///   CODE_OK if successful or CODE_ERROR if out of memory
+///
+RetCode MSDatasetAddPackage(MSDataset *dataset, const MscrPackage *package);
+
+
+///
+/// Adds a response of the EmStat Pico: a package for CODE_OK, or the begin or end of a loop.
+/// Other responses are ignored.
+///
+/// parameters:
+///   dataset  - The dataset
+///   code     - The return value of `ReceivePackage()` or the event of a MSParser
+///   line     - The received line, used to tell nscans loops from measurement loops. May be NULL if there are no nscans loops.
+///              If this is the whole package line, its values are decoded in double precision with `DecodeValueFields()`
+///              instead of taking the `float` values of `package`.
+///   length   - The number of characters in `line`
+///   package  - The parsed package if `code` is CODE_OK
+///
+/// Returns:
+///   CODE_OK if successful or CODE_ERROR if out of memory
+///
+RetCode MSDatasetAddEvent(MSDataset *dataset, RetCode code, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// MSParserEventFunc that adds every line to a dataset with `MSDatasetAddEvent()`.
+/// `context` must be the MSDataset. The first error is stored in `dataset->error`.
+///
+void MSDatasetOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// Finds the first column of a variable type in a measurement loop
+///
+/// parameters:
+///   loop           - The measurement loop
+///   variable_type  - The variable type, e.g. MSCR_VT_CURRENT
+///
+/// Returns:
+///   The column or NULL if the loop has no values of this type
+///
+const MSDatasetColumn* MSDatasetFindColumn(const MSDatasetLoop *loop, int variable_type);
+
+
+#endif //MSDATASET_H
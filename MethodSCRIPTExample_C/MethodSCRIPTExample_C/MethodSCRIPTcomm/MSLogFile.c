@@ -0,0 +1,192 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSLogFile.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#ifndef __WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#include "MSLogFile.h"
+#include "MSCapture.h"
+
+
+//
+// Maps the opened file, `log->size` must be set
+// Returns CODE_OK if successful, otherwise CODE_ERROR.
+//
+static RetCode MapFile(MSLogFile *log)
+{
+#ifdef __WIN32
+	log->mapping = CreateFileMapping(log->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (log->mapping == NULL)
+		return CODE_ERROR;
+	log->data = MapViewOfFile(log->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	void *data = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+	if (data == MAP_FAILED)
+		return CODE_ERROR;
+	// The file is read from start to end once, so read ahead aggressively
+	madvise(data, log->size, MADV_SEQUENTIAL);
+	log->data = data;
+#endif
+	return (log->data != NULL) ? CODE_OK : CODE_ERROR;
+}
+
+
+//
+// Releases the pages of the mapping between `*released` and `end`, which have been processed.
+// They would be dropped under memory pressure anyway, but releasing them keeps the memory use of the process low.
+// On Windows the pages are left to the memory manager.
+//
+static void ReleaseProcessed(MSLogFile *log, size_t *released, size_t end)
+{
+	if (end - *released < MSLOGFILE_RELEASE_SIZE)
+		return;
+#ifndef __WIN32
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	end -= end % pageSize;
+	madvise((void *)(log->data + *released), end - *released, MADV_DONTNEED);
+#endif
+	*released = end;
+}
+
+
+//
+// See documentation in MSLogFile.h
+//
+RetCode MSLogFileOpen(MSLogFile *log, const char *filename)
+{
+	if (log == NULL || filename == NULL)
+		return CODE_NULL;
+
+	memset(log, 0, sizeof(*log));
+#ifdef __WIN32
+	LARGE_INTEGER size;
+	log->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (log->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(log->file, &size))
+	{
+		MSLogFileClose(log);
+		return CODE_ERROR;
+	}
+	log->size = (size_t)size.QuadPart;
+#else
+	struct stat info;
+	log->fd = open(filename, O_RDONLY);
+	if (log->fd < 0 || fstat(log->fd, &info) < 0)
+	{
+		MSLogFileClose(log);
+		return CODE_ERROR;
+	}
+	log->size = (size_t)info.st_size;
+#endif
+
+	// An empty file cannot be mapped, it is a raw log without data
+	if (log->size > 0 && MapFile(log) != CODE_OK)
+	{
+		MSLogFileClose(log);
+		return CODE_ERROR;
+	}
+
+	if (log->size >= MSCAPTURE_MAGIC_LENGTH && memcmp(log->data, MSCAPTURE_MAGIC, MSCAPTURE_MAGIC_LENGTH) == 0)
+		log->format = LOG_FORMAT_CAPTURE;
+	else
+		log->format = LOG_FORMAT_RAW;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSLogFile.h
+//
+RetCode MSLogFileParse(MSLogFile *log, MSParser *parser)
+{
+	size_t released = 0;
+
+	if (log->format == LOG_FORMAT_RAW)
+	{
+		// Feed the file in parts, so the processed parts can be released in between
+		for (size_t position = 0; position < log->size; )
+		{
+			size_t length = log->size - position;
+			if (length > MSLOGFILE_RELEASE_SIZE)
+				length = MSLOGFILE_RELEASE_SIZE;
+			MSParserFeed(parser, log->data + position, length);
+			position += length;
+			ReleaseProcessed(log, &released, position);
+		}
+		return CODE_OK;
+	}
+
+	size_t position = MSCAPTURE_MAGIC_LENGTH;
+	while (position < log->size)
+	{
+		MSCaptureRecord record;
+		size_t length = MSCaptureDecodeRecord(log->data + position, log->size - position, &record);
+		if (length == 0)
+			return CODE_UNEXPECTED_DATA;
+
+		if (record.direction == CAPTURE_RECEIVED)
+			MSParserFeed(parser, record.data, record.length);
+		position += length;
+		ReleaseProcessed(log, &released, position);
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSLogFile.h
+//
+void MSLogFileClose(MSLogFile *log)
+{
+#ifdef __WIN32
+	if (log->data != NULL)
+		UnmapViewOfFile(log->data);
+	if (log->mapping != NULL)
+		CloseHandle(log->mapping);
+	if (log->file != NULL && log->file != INVALID_HANDLE_VALUE)
+		CloseHandle(log->file);
+	log->mapping = NULL;
+	log->file = NULL;
+#else
+	if (log->data != NULL)
+		munmap((void *)log->data, log->size);
+	if (log->fd >= 0)
+		close(log->fd);
+	log->fd = -1;
+#endif
+	log->data = NULL;
+}
@@ -0,0 +1,142 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSLogFile.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSLogFile reads recorded output of an EmStat Pico from a file for offline processing.
+ *	Two formats are supported, which are detected automatically:
+ *	  - Capture files recorded with MSCapture (see MSCapture.h), of which the received data is used
+ *	  - Raw logs, which contain the output of the EmStat Pico as received
+ *
+ *	The file is memory mapped instead of read, and the received data is passed to a MSParser
+ *	directly from the mapping. The parser handles complete lines in place, so the data is not
+ *	copied, except for the few lines that are split over two capture records.
+ *	The operating system is told that the file is read sequentially, so it reads ahead, and the
+ *	pages that were processed are released again. Files larger than the RAM can be processed,
+ *	as long as they fit in the address space, which is no limitation on 64 bit hosts.
+ *
+ ============================================================================
+ */
+
+#ifndef MSLOGFILE_H
+#define MSLOGFILE_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#ifdef __WIN32
+	#include <windows.h>
+#endif
+
+#include "MSParser.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The amount of data after which processed pages of the file are released
+#define MSLOGFILE_RELEASE_SIZE	(64 * 1024 * 1024)
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The format of a log file
+///
+typedef enum _MSLogFormat
+{
+	LOG_FORMAT_RAW,					// The output of the EmStat Pico as received
+	LOG_FORMAT_CAPTURE,				// A capture file recorded with MSCapture
+} MSLogFormat;
+
+///
+/// An opened log file
+///
+typedef struct _MSLogFile
+{
+	const char *data;				// The mapped file
+	size_t size;					// The size of the file
+	MSLogFormat format;
+#ifdef __WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+} MSLogFile;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Opens and maps a log file and detects its format
+///
+/// parameters:
+///   log       - The log file to initialise
+///   filename  - The file to open
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL or CODE_ERROR if the file could not be mapped.
+///
+RetCode MSLogFileOpen(MSLogFile *log, const char *filename);
+
+
+///
+/// Passes all data that was received from the EmStat Pico to a parser, from the start of the file to the end.
+/// The event function of the parser is called for every line, the line points into the mapped file.
+///
+/// parameters:
+///   log     - The opened log file
+///   parser  - The parser to feed, it is not reset first
+///
+/// Returns:
+///   CODE_OK if the complete file was processed, CODE_UNEXPECTED_DATA if a capture file ends with an incomplete record.
+///
+RetCode MSLogFileParse(MSLogFile *log, MSParser *parser);
+
+
+///
+/// Unmaps and closes a log file
+///
+/// parameters:
+///   log  - The log file
+///
+void MSLogFileClose(MSLogFile *log);
+
+
+#endif //MSLOGFILE_H
@@ -0,0 +1,134 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSPackagePool.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+
+#include "MSPackagePool.h"
+
+
+//
+// Adds a package to the list of free packages
+//
+static void PushFree(MSPackagePool *pool, unsigned int index)
+{
+	unsigned long long head = atomic_load_explicit(&pool->freeList, memory_order_relaxed);
+	unsigned long long newHead;
+
+	do
+	{
+		atomic_store_explicit(&pool->packages[index].next, (unsigned int)head, memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | (index + 1);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->freeList, &head, newHead,
+			memory_order_release, memory_order_relaxed));
+}
+
+
+//
+// See documentation in MSPackagePool.h
+//
+RetCode MSPackagePoolInit(MSPackagePool *pool, unsigned int count)
+{
+	if (count == 0)
+		return CODE_OUT_OF_RANGE;
+
+	pool->packages = malloc(count * sizeof(MSPooledPackage));
+	if (pool->packages == NULL)
+		return CODE_ERROR;
+	pool->count = count;
+	atomic_init(&pool->freeList, 0);
+	for (unsigned int i = count; i-- > 0; )
+	{
+		pool->packages[i].pool = pool;
+		atomic_init(&pool->packages[i].refCount, 0);
+		atomic_init(&pool->packages[i].next, 0);
+		PushFree(pool, i);
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSPackagePool.h
+//
+void MSPackagePoolFree(MSPackagePool *pool)
+{
+	free(pool->packages);
+	pool->packages = NULL;
+	pool->count = 0;
+}
+
+
+//
+// See documentation in MSPackagePool.h
+//
+MscrPackage* MSPackageAcquire(MSPackagePool *pool)
+{
+	unsigned long long head = atomic_load_explicit(&pool->freeList, memory_order_acquire);
+	unsigned long long newHead;
+	unsigned int index;
+
+	do
+	{
+		index = (unsigned int)head;
+		if (index == 0)
+			return NULL;
+		newHead = (((head >> 32) + 1) << 32)
+				| atomic_load_explicit(&pool->packages[index - 1].next, memory_order_relaxed);
+	} while (!atomic_compare_exchange_weak_explicit(&pool->freeList, &head, newHead,
+			memory_order_acquire, memory_order_acquire));
+
+	atomic_store_explicit(&pool->packages[index - 1].refCount, 1, memory_order_relaxed);
+	return &pool->packages[index - 1].package;
+}
+
+
+//
+// See documentation in MSPackagePool.h
+//
+void MSPackageRetain(MscrPackage *package)
+{
+	MSPooledPackage *pooled = (MSPooledPackage *)package;
+	atomic_fetch_add_explicit(&pooled->refCount, 1, memory_order_relaxed);
+}
+
+
+//
+// See documentation in MSPackagePool.h
+//
+void MSPackageRelease(MscrPackage *package)
+{
+	MSPooledPackage *pooled = (MSPooledPackage *)package;
+
+	// The last user returns it to the pool, after all writes of the other users are done
+	if (atomic_fetch_sub_explicit(&pooled->refCount, 1, memory_order_acq_rel) == 1)
+		PushFree(pooled->pool, (unsigned int)(pooled - pooled->pool->packages));
+}
@@ -0,0 +1,136 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSPackagePool.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSPackagePool provides reusable MscrPackage objects with a reference count.
+ *	All packages of a pool are allocated once, so receiving packages does not allocate memory.
+ *	A package is taken from the pool with a reference count of 1. Every consumer that needs the package
+ *	after the current call, e.g. for display, CSV output and analysis on different threads, takes a
+ *	reference with `MSPackageRetain()` and gives it back with `MSPackageRelease()`. The package is
+ *	returned to the pool when the last reference is released, so one package can be shared without
+ *	copying it.
+ *
+ *	All functions may be called from any thread. Taking and returning packages is lock-free.
+ *
+ ============================================================================
+ */
+
+#ifndef MSPACKAGEPOOL_H
+#define MSPACKAGEPOOL_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdatomic.h>
+
+#include "MSComm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// A package of a pool. The package is the first member, so a MscrPackage pointer from the pool
+/// can be converted back.
+///
+typedef struct _MSPooledPackage
+{
+	MscrPackage package;
+	atomic_uint refCount;
+	atomic_uint next;				// Index + 1 of the next free package, while this one is free
+	struct _MSPackagePool *pool;
+} MSPooledPackage;
+
+///
+/// A pool of packages
+///
+typedef struct _MSPackagePool
+{
+	MSPooledPackage *packages;
+	unsigned int count;
+	// The free packages as a linked list: the index + 1 of the first free package in the lower 32 bits and
+	// a counter in the upper 32 bits that changes on every update, so a list that was changed and changed
+	// back in between is not mistaken for an unchanged list.
+	atomic_ullong freeList;
+} MSPackagePool;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Allocates the packages of a pool
+///
+/// parameters:
+///   pool   - The pool to initialise
+///   count  - The number of packages
+///
+/// Returns:
+///   CODE_OK if successful, CODE_OUT_OF_RANGE if count is 0 or CODE_ERROR if out of memory.
+///
+RetCode MSPackagePoolInit(MSPackagePool *pool, unsigned int count);
+
+
+///
+/// Frees the packages of a pool. All packages must have been released.
+///
+void MSPackagePoolFree(MSPackagePool *pool);
+
+
+///
+/// Takes a package from the pool, with a reference count of 1. The contents are not cleared.
+///
+/// parameters:
+///   pool  - The pool
+///
+/// Returns:
+///   The package or NULL if all packages are in use
+///
+MscrPackage* MSPackageAcquire(MSPackagePool *pool);
+
+
+///
+/// Takes an extra reference to a package of a pool
+///
+void MSPackageRetain(MscrPackage *package);
+
+
+///
+/// Releases a reference to a package of a pool. The package returns to the pool when the last reference is released.
+///
+void MSPackageRelease(MscrPackage *package);
+
+
+#endif //MSPACKAGEPOOL_H
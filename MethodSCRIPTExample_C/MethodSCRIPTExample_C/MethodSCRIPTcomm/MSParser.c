@@ -0,0 +1,142 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSParser.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "MSParser.h"
+
+
+//
+// Classifies and parses one complete line and reports it to the event function
+//
+static void HandleLine(MSParser *parser, const char *line, size_t length)
+{
+	RetCode code = ClassifyLine(line, length);
+	const MscrPackage *package = NULL;
+
+	if (code == CODE_MEASURING)
+	{
+		// Every measurement loop has its own package layout
+		ResetPackageSchema(&parser->schema);
+	}
+	else if (code == CODE_OK)
+	{
+		code = ParsePackageLineWithSchema(&parser->schema, line, length, &parser->package);
+		if (code == CODE_OK)
+			package = &parser->package;
+	}
+	parser->eventFunc(parser->context, code, line, length, package);
+}
+
+
+//
+// Stores (part of) a line that continues in the next chunk
+//
+static void StoreLinePart(MSParser *parser, const char *data, size_t length)
+{
+	if (parser->discardLine)
+		return;
+	if (parser->lineLength + length > sizeof(parser->line))
+	{
+		parser->discardLine = 1;
+		return;
+	}
+	memcpy(&parser->line[parser->lineLength], data, length);
+	parser->lineLength += length;
+}
+
+
+//
+// See documentation in MSParser.h
+//
+RetCode MSParserInit(MSParser *parser, MSParserEventFunc eventFunc, void *context)
+{
+	parser->eventFunc = eventFunc;
+	parser->context = context;
+	MSParserReset(parser);
+
+	if (eventFunc == NULL)
+		return CODE_NULL;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSParser.h
+//
+void MSParserReset(MSParser *parser)
+{
+	parser->lineLength = 0;
+	parser->discardLine = 0;
+	parser->package.nr_of_subpackages = 0;
+	ResetPackageSchema(&parser->schema);
+}
+
+
+//
+// See documentation in MSParser.h
+//
+void MSParserFeed(MSParser *parser, const char *data, size_t length)
+{
+	const char *end = data + length;
+
+	while (data < end)
+	{
+		const char *newline = memchr(data, '\n', end - data);
+		if (newline == NULL)
+		{
+			// Incomplete line, keep it until the next chunk
+			StoreLinePart(parser, data, end - data);
+			return;
+		}
+
+		size_t lineLength = newline + 1 - data;
+		if (parser->lineLength == 0 && !parser->discardLine)
+		{
+			// Complete line within this chunk, parse it in place. It is held to the same length limit as a line
+			// that is stored, so the result does not depend on where the data was split into chunks.
+			if (lineLength > sizeof(parser->line))
+				parser->eventFunc(parser->context, CODE_OUT_OF_RANGE, data, lineLength, NULL);
+			else
+				HandleLine(parser, data, lineLength);
+		}
+		else
+		{
+			StoreLinePart(parser, data, lineLength);
+			if (parser->discardLine)
+				parser->eventFunc(parser->context, CODE_OUT_OF_RANGE, parser->line, parser->lineLength, NULL);
+			else
+				HandleLine(parser, parser->line, parser->lineLength);
+			parser->lineLength = 0;
+			parser->discardLine = 0;
+		}
+		data = newline + 1;
+	}
+}
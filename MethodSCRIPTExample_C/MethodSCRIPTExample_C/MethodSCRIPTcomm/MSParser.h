@@ -0,0 +1,138 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSParser.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSParser is a resumable parser for the output of the EmStat Pico.
+ *	Unlike `ReceivePackage()`, which pulls one character at a time from the read function of a MSComm,
+ *	the parser is pushed chunks of received data of any size, for example whatever a `read()` from a
+ *	serial port, socket or file returned. The chunks are split into lines and every complete line is
+ *	classified and reported to an event function. A line that is split over two chunks is stored in
+ *	the parser until the rest of it is received, all other lines are parsed in place without copying.
+ *
+ *	The events are reported using the same codes that `ReceivePackage()` returns:
+ *	  CODE_VERSION_RESPONSE   Version string received
+ *	  CODE_RESPONSE_BEGIN     Start of the script response
+ *	  CODE_MEASURING          Start of a measurement loop or scan
+ *	  CODE_OK                 Data package received, the parsed package is passed to the event function
+ *	  CODE_MEASUREMENT_DONE   End of a measurement loop or scan
+ *	  CODE_RESPONSE_END       End of the script response
+ *	  < 0                     Error, e.g. unexpected or invalid line
+ *
+ ============================================================================
+ */
+
+#ifndef MSPARSER_H
+#define MSPARSER_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include "MSComm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Function that is called for every line handled by the parser.
+///
+/// parameters:
+///   context  - The context pointer given to `MSParserInit()`
+///   event    - The type of the line, see the description at the top of this file
+///   line     - The received line, including the terminating '\n'. Only valid during the call.
+///   length   - The number of characters in `line`
+///   package  - The parsed package if `event` is CODE_OK, otherwise NULL. Only valid during the call.
+///
+typedef void (*MSParserEventFunc)(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// The parser state for one EmStat Pico.
+/// Use a separate parser for every data stream.
+///
+typedef struct _MSParser
+{
+	MSParserEventFunc eventFunc;
+	void *context;
+	size_t lineLength;				// Number of characters of the incomplete line stored in `line`
+	int discardLine;				// Set if the current line is too long and is being skipped
+	MscrPackage package;			// The last parsed package
+	MscrPackageSchema schema;		// The package layout of the current measurement loop
+	char line[READ_BUFFER_LENGTH];	// Incomplete line from the previous chunk(s)
+} MSParser;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Initialises the parser
+///
+/// parameters:
+///   parser     - The parser to initialise
+///   eventFunc  - The function that is called for every received line
+///   context    - Pointer that is passed to `eventFunc`, e.g. to identify the EmStat Pico
+///
+/// Returns:
+///   CODE_OK if successful, otherwise CODE_NULL.
+///
+RetCode MSParserInit(MSParser *parser, MSParserEventFunc eventFunc, void *context);
+
+
+///
+/// Discards any incomplete line, e.g. after reconnecting to the EmStat Pico.
+///
+/// parameters:
+///   parser  - The parser to reset
+///
+void MSParserReset(MSParser *parser);
+
+
+///
+/// Feeds a chunk of received data to the parser.
+/// The event function is called for every line that is completed by this chunk.
+/// Lines longer than `READ_BUFFER_LENGTH` are reported as CODE_OUT_OF_RANGE.
+///
+/// parameters:
+///   parser  - The parser
+///   data    - The received data, does not need to be 0 terminated or to end at a line boundary
+///   length  - The number of characters in `data`
+///
+void MSParserFeed(MSParser *parser, const char *data, size_t length);
+
+
+#endif //MSPARSER_H
@@ -0,0 +1,517 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSRecordLog.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __WIN32
+	#include <io.h>
+#else
+	#include <fcntl.h>
+	#include <libgen.h>
+	#include <unistd.h>
+#endif
+
+#include "MSLogFile.h"
+#include "MSRecordLog.h"
+
+// The largest record: a package with all subpackages
+#define MSRECORD_MAX_SIZE	(sizeof(MSRecordHeader) + sizeof(((MscrPackage *)0)->subpackages))
+
+// Records are read in place, so every record must start at a multiple of 8 bytes
+_Static_assert(sizeof(MSRecordHeader) % 8 == 0 && sizeof(MscrSubPackage) % 8 == 0 && sizeof(MSRecordFileHeader) % 8 == 0,
+		"records must be 8 byte aligned");
+
+// CRC-32C (Castagnoli) of every byte value
+static uint32_t CRC_TABLE[256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+
+//
+// Fills the CRC table
+//
+static void InitCrcTable(void)
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+		CRC_TABLE[i] = crc;
+	}
+}
+
+
+//
+// Continues the CRC-32C `crc` of the preceding data with `length` more bytes
+//
+static uint32_t Crc32c(uint32_t crc, const void *data, size_t length)
+{
+	const uint8_t *bytes = data;
+
+	crc = ~crc;
+	while (length-- > 0)
+		crc = CRC_TABLE[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+
+//
+// Returns the checksum of a record: everything after the checksum field, including the subpackages
+//
+static uint32_t RecordChecksum(const MSRecordHeader *record)
+{
+	const size_t start = offsetof(MSRecordHeader, length);
+	return Crc32c(0, (const char *)record + start, sizeof(*record) - start + record->length);
+}
+
+
+//
+// Returns the time in microseconds since 1970 (UTC). This is also the clock of `pthread_cond_timedwait()`.
+//
+static int64_t NowUs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+//
+// Writes the data of the file to the disk
+//
+static int SyncFile(FILE *fp)
+{
+#ifdef __WIN32
+	return _commit(_fileno(fp));
+#else
+	return fdatasync(fileno(fp));
+#endif
+}
+
+
+//
+// Writes the directory entry of a new file to the disk, so the file itself survives a failure.
+// On Windows, syncing the file is enough.
+//
+static int SyncDirectory(const char *filename)
+{
+#ifdef __WIN32
+	return 0;
+#else
+	char path[1024];
+	// dirname() may change the path, so it works on a copy, which must not be cut off
+	int length = snprintf(path, sizeof(path), "%s", filename);
+	if (length < 0 || (size_t)length >= sizeof(path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int fd = open(dirname(path), O_RDONLY);
+	if (fd < 0)
+		return -1;
+	int result = fsync(fd);
+	close(fd);
+	return result;
+#endif
+}
+
+
+//
+// Sets the size of a file
+//
+static int TruncateFile(FILE *fp, uint64_t size)
+{
+#ifdef __WIN32
+	return _chsize_s(_fileno(fp), (__int64)size);
+#else
+	return ftruncate(fileno(fp), (off_t)size);
+#endif
+}
+
+
+//
+// Passes the valid records of a mapped log to `onEvent` (if not NULL) and fills in `info`
+//
+static RetCode ScanRecords(const MSLogFile *file, MSParserEventFunc onEvent, void *context, MSRecordLogInfo *info)
+{
+	const MSRecordFileHeader *header = (const MSRecordFileHeader *)file->data;
+	MscrPackage package;
+	size_t offset = sizeof(*header);
+
+	info->fileSize = file->size;
+	if (file->size < sizeof(*header) || memcmp(header->magic, MSRECORD_MAGIC, MSRECORD_MAGIC_LENGTH) != 0
+			|| header->byteOrder != MSRECORD_BYTE_ORDER || header->subpackageSize != sizeof(MscrSubPackage)
+			|| header->layout != MSRECORD_LAYOUT)
+		return CODE_UNEXPECTED_DATA;
+
+	for (;;)
+	{
+		info->validSize = offset;
+		if (file->size - offset < sizeof(MSRecordHeader))
+			break;
+
+		const MSRecordHeader *record = (const MSRecordHeader *)(file->data + offset);
+		if (record->length > sizeof(package.subpackages) || record->length % sizeof(MscrSubPackage) != 0
+				|| (record->code != CODE_OK && record->length != 0)
+				|| file->size - offset - sizeof(*record) < record->length
+				|| record->sequence != info->records || record->checksum != RecordChecksum(record))
+			break;
+
+		if (onEvent != NULL)
+		{
+			if (record->code == CODE_OK)
+			{
+				package.nr_of_subpackages = (int)(record->length / sizeof(MscrSubPackage));
+				memcpy(package.subpackages, record + 1, record->length);
+			}
+			onEvent(context, record->code, (record->reply != 0) ? (const char *)&record->reply : NULL, (record->reply != 0),
+					(record->code == CODE_OK) ? &package : NULL);
+		}
+		if (info->records == 0)
+			info->firstTimeUs = record->timeUs;
+		info->lastTimeUs = record->timeUs;
+		info->records++;
+		offset += sizeof(*record) + record->length;
+	}
+	return (info->validSize == file->size) ? CODE_OK : CODE_UNEXPECTED_DATA;
+}
+
+
+//
+// The thread that commits the batches
+//
+static void* RunCommitter(void *context)
+{
+	MSRecordLog *log = context;
+
+	pthread_mutex_lock(&log->mutex);
+	for (;;)
+	{
+		if (log->fillRecords == 0)
+		{
+			if (log->stop)
+				break;
+			pthread_cond_wait(&log->added, &log->mutex);
+			continue;
+		}
+
+		// Wait for more records until the batch must be committed
+		int64_t deadline = log->fillStartUs + (int64_t)log->maxLatencyMs * 1000;
+		if (!log->stop && !log->commitRequested && log->fillRecords < log->maxRecords
+				&& MSRECORDLOG_BUFFER_SIZE - log->fillLength >= MSRECORD_MAX_SIZE && NowUs() < deadline)
+		{
+			struct timespec until = { (time_t)(deadline / 1000000), (long)(deadline % 1000000) * 1000 };
+			pthread_cond_timedwait(&log->added, &log->mutex, &until);
+			continue;
+		}
+
+		// Take the batch, the records that are added from now on go into the other buffer
+		const char *data = log->fill;
+		size_t length = log->fillLength;
+		uint32_t records = log->fillRecords;
+		uint64_t durable = log->nextSequence;
+		log->fill = (log->fill == log->buffers[0]) ? log->buffers[1] : log->buffers[0];
+		log->fillLength = 0;
+		log->fillRecords = 0;
+		log->commitRequested = 0;
+		pthread_cond_broadcast(&log->progress);
+		pthread_mutex_unlock(&log->mutex);
+
+		int64_t start = NowUs();
+		int failed = (fwrite(data, 1, length, log->fp) != length);
+		failed |= (fflush(log->fp) != 0);
+		failed |= (SyncFile(log->fp) != 0);
+		uint64_t duration = (uint64_t)(NowUs() - start);
+
+		pthread_mutex_lock(&log->mutex);
+		if (failed && log->error == CODE_OK)
+			log->error = CODE_ERROR;
+		log->durableRecords = durable;
+		log->stats.commits++;
+		if (records > log->stats.maxCommitRecords)
+			log->stats.maxCommitRecords = records;
+		if (duration > log->stats.maxCommitUs)
+			log->stats.maxCommitUs = duration;
+		pthread_cond_broadcast(&log->progress);
+	}
+	pthread_mutex_unlock(&log->mutex);
+	return NULL;
+}
+
+
+//
+// Creates a new log file with only the header
+//
+static FILE* CreateLogFile(const char *filename)
+{
+	MSRecordFileHeader header = { MSRECORD_MAGIC, MSRECORD_BYTE_ORDER, sizeof(MscrSubPackage), MSRECORD_LAYOUT, 0 };
+	FILE *fp = fopen(filename, "wb");
+
+	if (fp == NULL)
+		return NULL;
+	setvbuf(fp, NULL, _IONBF, 0);
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 || SyncFile(fp) != 0 || SyncDirectory(filename) != 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogOpen(MSRecordLog *log, const char *filename, uint32_t maxLatencyMs, uint32_t maxRecords)
+{
+	MSRecordLogInfo info;
+
+	if (log == NULL || filename == NULL)
+		return CODE_NULL;
+
+	memset(log, 0, sizeof(*log));
+	log->maxLatencyMs = maxLatencyMs;
+	log->maxRecords = (maxRecords > 0) ? maxRecords : MSRECORDLOG_DEFAULT_MAX_RECORDS;
+	log->error = CODE_OK;
+
+	RetCode code = MSRecordLogRecover(filename, &info);
+	if (code == CODE_OK)
+	{
+		log->fp = fopen(filename, "r+b");
+		if (log->fp != NULL)
+		{
+			setvbuf(log->fp, NULL, _IONBF, 0);
+			if (fseek(log->fp, 0, SEEK_END) != 0)
+			{
+				fclose(log->fp);
+				log->fp = NULL;
+			}
+		}
+		log->nextSequence = info.records;
+		log->durableRecords = info.records;
+	}
+	else if (info.fileSize < sizeof(MSRecordFileHeader))
+	{
+		// A new log, or one that failed before its header was written
+		log->fp = CreateLogFile(filename);
+	}
+	else
+	{
+		return code;
+	}
+	if (log->fp == NULL)
+		return CODE_ERROR;
+
+	log->buffers[0] = malloc(MSRECORDLOG_BUFFER_SIZE);
+	log->buffers[1] = malloc(MSRECORDLOG_BUFFER_SIZE);
+	if (log->buffers[0] == NULL || log->buffers[1] == NULL)
+	{
+		free(log->buffers[0]);
+		free(log->buffers[1]);
+		fclose(log->fp);
+		return CODE_ERROR;
+	}
+	log->fill = log->buffers[0];
+
+	pthread_mutex_init(&log->mutex, NULL);
+	pthread_cond_init(&log->added, NULL);
+	pthread_cond_init(&log->progress, NULL);
+	if (pthread_create(&log->thread, NULL, RunCommitter, log) != 0)
+	{
+		pthread_cond_destroy(&log->progress);
+		pthread_cond_destroy(&log->added);
+		pthread_mutex_destroy(&log->mutex);
+		free(log->buffers[0]);
+		free(log->buffers[1]);
+		fclose(log->fp);
+		return CODE_ERROR;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogAdd(MSRecordLog *log, RetCode code, char reply, const MscrPackage *package)
+{
+	uint32_t length = (code == CODE_OK) ? (uint32_t)(package->nr_of_subpackages * sizeof(MscrSubPackage)) : 0;
+	size_t size = sizeof(MSRecordHeader) + length;
+
+	pthread_mutex_lock(&log->mutex);
+	if (MSRECORDLOG_BUFFER_SIZE - log->fillLength < size)
+	{
+		// The batch is full and the thread is still committing the previous one
+		int64_t start = NowUs();
+		pthread_cond_signal(&log->added);
+		while (MSRECORDLOG_BUFFER_SIZE - log->fillLength < size)
+			pthread_cond_wait(&log->progress, &log->mutex);
+		log->stats.waits++;
+		log->stats.waitTimeUs += (uint64_t)(NowUs() - start);
+	}
+
+	MSRecordHeader *record = (MSRecordHeader *)(log->fill + log->fillLength);
+	record->length = length;
+	record->sequence = log->nextSequence++;
+	record->timeUs = NowUs();
+	record->code = code;
+	record->reply = (uint8_t)reply;
+	memset(record->reserved, 0, sizeof(record->reserved));
+	if (length > 0)
+		memcpy(record + 1, package->subpackages, length);
+	record->checksum = RecordChecksum(record);
+
+	log->fillLength += size;
+	if (log->fillRecords++ == 0)
+		log->fillStartUs = record->timeUs;
+	log->stats.records++;
+	// Wake up the thread to start the latency timer, or because the batch is full
+	if (log->fillRecords == 1 || log->fillRecords >= log->maxRecords
+			|| MSRECORDLOG_BUFFER_SIZE - log->fillLength < MSRECORD_MAX_SIZE)
+		pthread_cond_signal(&log->added);
+	RetCode error = log->error;
+	pthread_mutex_unlock(&log->mutex);
+	return error;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+void MSRecordLogOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	MSRecordLogAdd(context, event, (line != NULL && length > 0) ? line[0] : 0, package);
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogCommit(MSRecordLog *log)
+{
+	pthread_mutex_lock(&log->mutex);
+	uint64_t target = log->nextSequence;
+	// Records that are not in the current batch are already being committed
+	if (log->fillRecords > 0)
+	{
+		log->commitRequested = 1;
+		pthread_cond_signal(&log->added);
+	}
+	while (log->durableRecords < target)
+		pthread_cond_wait(&log->progress, &log->mutex);
+	RetCode error = log->error;
+	pthread_mutex_unlock(&log->mutex);
+	return error;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+void MSRecordLogGetStats(MSRecordLog *log, MSRecordLogStats *stats)
+{
+	pthread_mutex_lock(&log->mutex);
+	*stats = log->stats;
+	pthread_mutex_unlock(&log->mutex);
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogClose(MSRecordLog *log)
+{
+	MSRecordLogCommit(log);
+
+	pthread_mutex_lock(&log->mutex);
+	log->stop = 1;
+	pthread_cond_signal(&log->added);
+	pthread_mutex_unlock(&log->mutex);
+	pthread_join(log->thread, NULL);
+
+	if (fclose(log->fp) != 0 && log->error == CODE_OK)
+		log->error = CODE_ERROR;
+	pthread_cond_destroy(&log->progress);
+	pthread_cond_destroy(&log->added);
+	pthread_mutex_destroy(&log->mutex);
+	free(log->buffers[0]);
+	free(log->buffers[1]);
+	log->fp = NULL;
+	log->buffers[0] = NULL;
+	log->buffers[1] = NULL;
+	log->fill = NULL;
+	return log->error;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogRead(const char *filename, MSParserEventFunc onEvent, void *context, MSRecordLogInfo *info)
+{
+	MSLogFile file;
+
+	memset(info, 0, sizeof(*info));
+	pthread_once(&crcTableOnce, InitCrcTable);
+	RetCode code = MSLogFileOpen(&file, filename);
+	if (code != CODE_OK)
+		return code;
+	code = ScanRecords(&file, onEvent, context, info);
+	MSLogFileClose(&file);
+	return code;
+}
+
+
+//
+// See documentation in MSRecordLog.h
+//
+RetCode MSRecordLogRecover(const char *filename, MSRecordLogInfo *info)
+{
+	RetCode code = MSRecordLogRead(filename, NULL, NULL, info);
+
+	if (code != CODE_UNEXPECTED_DATA || info->validSize == 0)
+		return code;
+
+	// Remove the incomplete or damaged data after the last valid record
+	FILE *fp = fopen(filename, "r+b");
+	if (fp == NULL)
+		return CODE_ERROR;
+	code = (TruncateFile(fp, info->validSize) == 0 && SyncFile(fp) == 0) ? CODE_OK : CODE_ERROR;
+	if (fclose(fp) != 0)
+		code = CODE_ERROR;
+	if (code == CODE_OK)
+		info->fileSize = info->validSize;
+	return code;
+}
@@ -0,0 +1,287 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSRecordLog.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSRecordLog stores every response of the EmStat Pico in an append-only file of checksummed records,
+ *	so a measurement that runs for days can be recovered up to a known point if the computer fails.
+ *
+ *	Records are not synced one by one. They are collected in a batch, and a background thread writes the
+ *	batch and syncs it (`fdatasync`) as one group commit. A batch is committed when its oldest record has
+ *	waited `maxLatencyMs`, when it holds `maxRecords` records, or when `MSRecordLogCommit()` is called.
+ *	So at most the last `maxLatencyMs` of data, and at most about `maxRecords` records, is lost in a
+ *	failure, for one sync per batch instead of one per package. Records that are added while a batch is
+ *	synced go into the next batch. If that batch is full too, adding waits: the memory is bounded to
+ *	two batch buffers.
+ *
+ *	The file consists of a `MSRecordFileHeader` followed by records. Every record is a `MSRecordHeader`
+ *	followed by the subpackages of the package as `MscrSubPackage`s, so the file can only be read by a
+ *	program with the same subpackage layout (see `MSCR_PACKED_SUBPACKAGES` and `MSCR_EXACT_VALUES`).
+ *	A record is valid if it is complete, its checksum matches and its number follows the previous one.
+ *	Everything after the first invalid record, e.g. a record that was being written when the computer
+ *	failed, is removed by `MSRecordLogRecover()` and when the log is opened again to append to it.
+ *
+ *	`MSRecordLogRead()` passes the records to an event function like MSParser's, so they can be written
+ *	to a CSV or result file afterwards, e.g. with `ReplayCapture -l`.
+ *
+ ============================================================================
+ */
+
+#ifndef MSRECORDLOG_H
+#define MSRECORDLOG_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "MSComm.h"
+#include "MSParser.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The first characters of every record log
+#define MSRECORD_MAGIC				"MSRLOG1\n"
+#define MSRECORD_MAGIC_LENGTH		8
+
+/// Written as a number in the header, to detect files of the other byte order
+#define MSRECORD_BYTE_ORDER			0x01020304u
+
+/// The subpackage layout of this program, stored in the header
+#if MSCR_PACKED_SUBPACKAGES
+#define MSRECORD_LAYOUT				2
+#elif MSCR_EXACT_VALUES
+#define MSRECORD_LAYOUT				1
+#else
+#define MSRECORD_LAYOUT				0
+#endif
+
+/// The size of each of the two batch buffers
+#define MSRECORDLOG_BUFFER_SIZE		(1024 * 1024)
+
+/// The default maximum time a record waits before it is committed
+#define MSRECORDLOG_DEFAULT_LATENCY_MS	200
+
+/// The default maximum number of records in a batch
+#define MSRECORDLOG_DEFAULT_MAX_RECORDS	10000
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The start of a record log
+///
+typedef struct _MSRecordFileHeader
+{
+	char magic[MSRECORD_MAGIC_LENGTH];	// MSRECORD_MAGIC
+	uint32_t byteOrder;					// MSRECORD_BYTE_ORDER
+	uint16_t subpackageSize;			// sizeof(MscrSubPackage)
+	uint8_t layout;						// MSRECORD_LAYOUT
+	uint8_t reserved;
+} MSRecordFileHeader;
+
+///
+/// The start of every record
+///
+typedef struct _MSRecordHeader
+{
+	uint32_t checksum;					// CRC-32C of the rest of the header and the subpackages
+	uint32_t length;					// The size of the subpackages in bytes, 0 if the record is not a package
+	uint64_t sequence;					// The number of the record, counting from 0
+	int64_t timeUs;						// The time the record was added, in microseconds since 1970 (UTC)
+	int32_t code;						// The response: CODE_OK for a package, otherwise the code of `ReceivePackage()`
+	uint8_t reply;						// The first character of the reply line, 0 if not known
+	uint8_t reserved[3];
+} MSRecordHeader;
+
+///
+/// Statistics of a record log
+///
+typedef struct _MSRecordLogStats
+{
+	uint64_t records;					// Records added since the log was opened
+	uint64_t commits;					// Batches written and synced
+	uint64_t maxCommitRecords;			// The largest number of records in one commit
+	uint64_t maxCommitUs;				// The longest time to write and sync one batch, in microseconds
+	uint64_t waits;						// Number of times adding waited because both batch buffers were full
+	uint64_t waitTimeUs;				// Total time adding waited, in microseconds
+} MSRecordLogStats;
+
+///
+/// A record log that is being written
+///
+typedef struct _MSRecordLog
+{
+	FILE *fp;
+	uint32_t maxLatencyMs;
+	uint32_t maxRecords;
+	char *buffers[2];
+
+	// Shared with the thread, protected by `mutex`
+	pthread_mutex_t mutex;
+	pthread_cond_t added;				// Signalled when the thread may have to commit the batch
+	pthread_cond_t progress;			// Signalled when the thread has taken or committed a batch
+	char *fill;							// The buffer of the batch that records are added to
+	size_t fillLength;
+	uint32_t fillRecords;
+	int64_t fillStartUs;				// The time the first record of the batch was added
+	uint64_t nextSequence;				// The number of the next record
+	uint64_t durableRecords;			// The number of records that have been committed
+	int commitRequested;				// Set by `MSRecordLogCommit()` until the batch is taken
+	int stop;
+	RetCode error;						// The first error that occurred, CODE_OK if none
+	MSRecordLogStats stats;
+
+	pthread_t thread;
+} MSRecordLog;
+
+///
+/// The contents of a record log, as found by `MSRecordLogRead()`
+///
+typedef struct _MSRecordLogInfo
+{
+	uint64_t records;					// The number of valid records
+	uint64_t validSize;					// The size of the file up to the end of the last valid record, 0 if the header is not valid
+	uint64_t fileSize;
+	int64_t firstTimeUs;				// The time of the first record, 0 if there are no records
+	int64_t lastTimeUs;					// The time of the last record
+} MSRecordLogInfo;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Opens a record log to append to and starts the thread that commits the records.
+/// A log that does not exist is created, an existing log is recovered first (see `MSRecordLogRecover()`).
+///
+/// parameters:
+///   log           - The log to initialise
+///   filename      - The file
+///   maxLatencyMs  - The maximum time a record waits before it is committed
+///   maxRecords    - The maximum number of records in a batch, 0 for `MSRECORDLOG_DEFAULT_MAX_RECORDS`
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL, CODE_UNEXPECTED_DATA if the file exists but is not
+///   a record log of this subpackage layout, or CODE_ERROR if the file could not be opened or out of memory.
+///
+RetCode MSRecordLogOpen(MSRecordLog *log, const char *filename, uint32_t maxLatencyMs, uint32_t maxRecords);
+
+
+///
+/// Adds a response to the log, such as the result of `ReceivePackage()` or an MSRingEntry.
+/// The record is committed later. This waits only if both batch buffers are full.
+///
+/// parameters:
+///   log      - The log
+///   code     - The response: CODE_OK for a package, otherwise the code of `ReceivePackage()`
+///   reply    - The first character of the reply line, e.g. `MSRingEntry.reply`, or 0 if not known.
+///              It tells the nscans lines ('C' and '-') from the start and end of a loop when reading the log.
+///   package  - The package if `code` is CODE_OK, otherwise ignored
+///
+/// Returns:
+///   CODE_OK or the first error of the log.
+///
+RetCode MSRecordLogAdd(MSRecordLog *log, RetCode code, char reply, const MscrPackage *package);
+
+
+///
+/// Event function for `MSParserInit()` that calls `MSRecordLogAdd()`, `context` must be the MSRecordLog
+///
+void MSRecordLogOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// Commits all records that were added and waits until they are on the disk, e.g. at the end of a measurement.
+///
+/// Returns:
+///   CODE_OK or the first error of the log.
+///
+RetCode MSRecordLogCommit(MSRecordLog *log);
+
+
+///
+/// Gets the statistics of a log. Can be called from any thread while the log is open.
+///
+void MSRecordLogGetStats(MSRecordLog *log, MSRecordLogStats *stats);
+
+
+///
+/// Commits all records, stops the thread and closes the file
+///
+/// Returns:
+///   CODE_OK if all records were committed, otherwise the first error of the log.
+///
+RetCode MSRecordLogClose(MSRecordLog *log);
+
+
+///
+/// Reads the valid records of a log and passes them to an event function: the `code` of every record as the
+/// event with its package, and its reply character as a line of length 1 (NULL if not known).
+/// Reading stops at the first invalid record.
+///
+/// parameters:
+///   filename  - The file
+///   onEvent   - The function called for every record, may be NULL to only check the file
+///   context   - Passed to `onEvent`
+///   info      - Receives the number and size of the valid records
+///
+/// Returns:
+///   CODE_OK if the file only contains valid records, CODE_UNEXPECTED_DATA if it is not a record log of this
+///   subpackage layout or data follows the last valid record, or CODE_ERROR if the file could not be read.
+///
+RetCode MSRecordLogRead(const char *filename, MSParserEventFunc onEvent, void *context, MSRecordLogInfo *info);
+
+
+///
+/// Removes everything after the last valid record of a log, so records can be appended again
+///
+/// parameters:
+///   filename  - The file
+///   info      - Receives the number and size of the valid records
+///
+/// Returns:
+///   CODE_OK if the file is a valid log now, CODE_UNEXPECTED_DATA if it is not a record log of this subpackage
+///   layout, or CODE_ERROR if the file could not be read or truncated.
+///
+RetCode MSRecordLogRecover(const char *filename, MSRecordLogInfo *info);
+
+
+#endif //MSRECORDLOG_H
@@ -0,0 +1,697 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSResultFile.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MSResultFile.h"
+
+
+// Rounds a size up to a multiple of 8 bytes
+#define PAD8(size)	(((size) + 7) & ~(uint64_t)7)
+
+
+//
+// Returns the size of the data of one column in a chunk with `rowCount` rows
+//
+static uint64_t ColumnDataSize(const MSResultColumn *column, uint64_t rowCount)
+{
+	uint64_t size = rowCount * sizeof(double);
+
+	if (column->hasStatus)
+		size += PAD8(rowCount * sizeof(int16_t));
+	if (column->hasCurrentRange)
+		size += PAD8(rowCount * sizeof(int16_t));
+	return size;
+}
+
+
+//
+// Returns the size of the data of all columns in a chunk with `rowCount` rows
+//
+static uint64_t ChunkDataSize(const MSResultColumn *columns, uint32_t columnCount, uint64_t rowCount)
+{
+	uint64_t size = 0;
+
+	for (uint32_t i = 0; i < columnCount; i++)
+		size += ColumnDataSize(&columns[i], rowCount);
+	return size;
+}
+
+
+//
+// Writes data to the file and keeps track of the size of the file
+//
+static void WriteData(MSResultWriter *writer, const void *data, size_t size)
+{
+	if (writer->async != NULL)
+	{
+		if (MSAsyncWrite(writer->async, data, size) != CODE_OK && writer->error == CODE_OK)
+			writer->error = CODE_ERROR;
+	}
+	else if (size > 0 && fwrite(data, 1, size, writer->fp) != size && writer->error == CODE_OK)
+		writer->error = CODE_ERROR;
+	writer->position += size;
+}
+
+
+//
+// Writes zeros up to the next multiple of 8 bytes
+//
+static void WritePadding(MSResultWriter *writer)
+{
+	static const char zeros[8] = { 0 };
+	WriteData(writer, zeros, PAD8(writer->position) - writer->position);
+}
+
+
+//
+// Writes the header of a block
+//
+static void WriteBlockHeader(MSResultWriter *writer, uint32_t type, uint64_t size)
+{
+	MSResultBlockHeader header = { type, writer->loopCount - 1, size };
+	WriteData(writer, &header, sizeof(header));
+}
+
+
+//
+// Grows an array to hold at least `count` elements of `size` bytes by doubling its capacity.
+// Returns CODE_OK if successful or CODE_ERROR if out of memory.
+//
+static RetCode Reserve(void **array, uint64_t *capacity, uint64_t count, size_t size)
+{
+	if (count <= *capacity)
+		return CODE_OK;
+
+	uint64_t newCapacity = (*capacity > 0) ? *capacity * 2 : 64;
+	while (newCapacity < count)
+		newCapacity *= 2;
+	void *grown = realloc(*array, newCapacity * size);
+	if (grown == NULL)
+		return CODE_ERROR;
+	*array = grown;
+	*capacity = newCapacity;
+	return CODE_OK;
+}
+
+
+//
+// Writes the rows of the chunk buffers as a chunk block and adds the chunk to the index
+//
+static void WriteChunk(MSResultWriter *writer)
+{
+	if (writer->rowCount == 0)
+		return;
+
+	const uint32_t rows = writer->rowCount;
+	const MSResultChunkHeader header = { writer->loopRows, rows, 0 };
+	MSResultIndexLoop *loop = &writer->loops[writer->loopCount - 1];
+
+	if (Reserve((void **)&writer->chunks, &writer->chunkCapacity, writer->chunkCount + 1, sizeof(MSResultChunk)) != CODE_OK)
+	{
+		writer->error = CODE_ERROR;
+		return;
+	}
+
+	WriteBlockHeader(writer, MSRESULT_BLOCK_CHUNK, sizeof(header) + ChunkDataSize(writer->columns, writer->columnCount, rows));
+	WriteData(writer, &header, sizeof(header));
+
+	MSResultChunk *chunk = &writer->chunks[writer->chunkCount++];
+	chunk->offset = writer->position;
+	chunk->firstRow = writer->loopRows;
+	chunk->rowCount = rows;
+	chunk->reserved = 0;
+
+	for (uint32_t i = 0; i < writer->columnCount; i++)
+	{
+		const size_t start = (size_t)i * writer->chunkRows;
+
+		WriteData(writer, &writer->values[start], rows * sizeof(double));
+		if (writer->columns[i].hasStatus)
+		{
+			WriteData(writer, &writer->status[start], rows * sizeof(int16_t));
+			WritePadding(writer);
+		}
+		if (writer->columns[i].hasCurrentRange)
+		{
+			WriteData(writer, &writer->currentRange[start], rows * sizeof(int16_t));
+			WritePadding(writer);
+		}
+	}
+
+	loop->chunkCount++;
+	loop->rowCount += rows;
+	writer->loopRows += rows;
+	writer->rowCount = 0;
+}
+
+
+//
+// Starts a loop with the columns of its first package and writes the loop block.
+// Returns CODE_OK if successful or CODE_ERROR if out of memory.
+//
+static RetCode StartLoop(MSResultWriter *writer, const MscrPackage *package)
+{
+	uint64_t loopCapacity = writer->loopCapacity;
+	uint32_t columnCount = (package->nr_of_subpackages < MSCR_SUBPACKAGES_PER_LINE) ?
+			(uint32_t)package->nr_of_subpackages : MSCR_SUBPACKAGES_PER_LINE;
+
+	if (Reserve((void **)&writer->loops, &loopCapacity, (uint64_t)writer->loopCount + 1, sizeof(MSResultIndexLoop)) != CODE_OK)
+		return CODE_ERROR;
+	writer->loopCapacity = (uint32_t)loopCapacity;
+
+	// The chunk buffers only grow, most measurements have the same columns in every loop
+	if (columnCount > writer->bufferColumns)
+	{
+		const size_t rows = (size_t)columnCount * writer->chunkRows;
+		double *values = realloc(writer->values, rows * sizeof(double));
+		if (values != NULL)
+			writer->values = values;
+		int16_t *status = realloc(writer->status, rows * sizeof(int16_t));
+		if (status != NULL)
+			writer->status = status;
+		int16_t *currentRange = realloc(writer->currentRange, rows * sizeof(int16_t));
+		if (currentRange != NULL)
+			writer->currentRange = currentRange;
+		if (values == NULL || status == NULL || currentRange == NULL)
+			return CODE_ERROR;
+		writer->bufferColumns = columnCount;
+	}
+
+	writer->columnCount = columnCount;
+	for (uint32_t i = 0; i < columnCount; i++)
+	{
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+		writer->columns[i].variableType = (int16_t)GetSubpackageVarType(subpackage);
+		writer->columns[i].hasStatus = GetSubpackageStatus(subpackage) >= 0;
+		writer->columns[i].hasCurrentRange = GetSubpackageCurrentRange(subpackage) >= 0;
+	}
+
+	MSResultIndexLoop *loop = &writer->loops[writer->loopCount++];
+	const MSResultLoopHeader header = { columnCount, 0 };
+
+	WriteBlockHeader(writer, MSRESULT_BLOCK_LOOP, PAD8(sizeof(header) + columnCount * sizeof(MSResultColumn)));
+	loop->offset = writer->position;
+	loop->rowCount = 0;
+	loop->firstChunk = writer->chunkCount;
+	loop->chunkCount = 0;
+	loop->complete = 0;
+	WriteData(writer, &header, sizeof(header));
+	WriteData(writer, writer->columns, columnCount * sizeof(MSResultColumn));
+	WritePadding(writer);
+
+	writer->inLoop = 1;
+	writer->loopStarted = 0;
+	writer->loopRows = 0;
+	writer->rowCount = 0;
+	return CODE_OK;
+}
+
+
+//
+// Writes the last rows of the current loop and marks it as complete if its end was received
+//
+static void FinishLoop(MSResultWriter *writer, int complete)
+{
+	if (!writer->inLoop)
+		return;
+	WriteChunk(writer);
+	writer->loops[writer->loopCount - 1].complete = complete;
+	writer->inLoop = 0;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterOpen(MSResultWriter *writer, const char *filename, uint32_t chunkRows)
+{
+	if (writer == NULL || filename == NULL)
+		return CODE_NULL;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->chunkRows = (chunkRows > 0) ? chunkRows : MSRESULT_DEFAULT_CHUNK_ROWS;
+	writer->error = CODE_OK;
+	writer->fp = fopen(filename, "wb");
+	if (writer->fp == NULL)
+		return CODE_ERROR;
+
+	MSResultFileHeader header = { MSRESULT_MAGIC, MSRESULT_BYTE_ORDER, writer->chunkRows, 0 };
+	WriteData(writer, &header, sizeof(header));
+	return writer->error;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterOpenAsync(MSResultWriter *writer, MSAsyncWriter *async, uint32_t chunkRows)
+{
+	if (writer == NULL || async == NULL)
+		return CODE_NULL;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->chunkRows = (chunkRows > 0) ? chunkRows : MSRESULT_DEFAULT_CHUNK_ROWS;
+	writer->error = CODE_OK;
+	writer->async = async;
+
+	MSResultFileHeader header = { MSRESULT_MAGIC, MSRESULT_BYTE_ORDER, writer->chunkRows, 0 };
+	WriteData(writer, &header, sizeof(header));
+	return writer->error;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+void MSResultWriterBeginLoop(MSResultWriter *writer)
+{
+	FinishLoop(writer, 0);
+	writer->loopStarted = 1;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+void MSResultWriterEndLoop(MSResultWriter *writer)
+{
+	FinishLoop(writer, 1);
+	writer->loopStarted = 0;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterAddPackage(MSResultWriter *writer, const MscrPackage *package)
+{
+	if (writer->error != CODE_OK)
+		return writer->error;
+	if (!writer->inLoop && StartLoop(writer, package) != CODE_OK)
+	{
+		writer->error = CODE_ERROR;
+		return writer->error;
+	}
+
+	const uint32_t row = writer->rowCount;
+	for (uint32_t i = 0; i < writer->columnCount; i++)
+	{
+		const size_t index = (size_t)i * writer->chunkRows + row;
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+
+		if ((int)i < package->nr_of_subpackages && GetSubpackageVarType(subpackage) == writer->columns[i].variableType)
+		{
+#if MSCR_HAS_EXACT_VALUES
+			writer->values[index] = GetSubpackageValueDouble(subpackage);
+#else
+			writer->values[index] = GetSubpackageValue(subpackage);
+#endif
+			writer->status[index] = (int16_t)GetSubpackageStatus(subpackage);
+			writer->currentRange[index] = (int16_t)GetSubpackageCurrentRange(subpackage);
+		}
+		else
+		{
+			writer->values[index] = NAN;
+			writer->status[index] = -1;
+			writer->currentRange[index] = -1;
+		}
+	}
+
+	if (++writer->rowCount == writer->chunkRows)
+		WriteChunk(writer);
+	return writer->error;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterAddEvent(MSResultWriter *writer, RetCode code, const char *line, size_t length, const MscrPackage *package)
+{
+	int nscans = (line != NULL && length > 0 && (line[0] == REPLY_NSCANS_START || line[0] == REPLY_NSCANS_DONE));
+
+	switch (code)
+	{
+		case CODE_OK:
+			return MSResultWriterAddPackage(writer, package);
+		case CODE_MEASURING:
+			if (!nscans)
+				MSResultWriterBeginLoop(writer);
+			break;
+		case CODE_MEASUREMENT_DONE:
+			if (!nscans)
+				MSResultWriterEndLoop(writer);
+			break;
+		default:
+			break;
+	}
+	return writer->error;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+void MSResultWriterOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	MSResultWriterAddEvent(context, event, line, length, package);
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterFlush(MSResultWriter *writer)
+{
+	if (writer->inLoop)
+		WriteChunk(writer);
+	if (writer->async != NULL)
+	{
+		if (MSAsyncWriterFlush(writer->async, 0) != CODE_OK && writer->error == CODE_OK)
+			writer->error = CODE_ERROR;
+	}
+	else if (fflush(writer->fp) != 0 && writer->error == CODE_OK)
+		writer->error = CODE_ERROR;
+	return writer->error;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultWriterClose(MSResultWriter *writer)
+{
+	FinishLoop(writer, 0);
+
+	MSResultTrailer trailer = { writer->position, MSRESULT_TRAILER_MAGIC };
+	MSResultIndexHeader header = { writer->loopCount, 0, writer->chunkCount };
+
+	WriteBlockHeader(writer, MSRESULT_BLOCK_INDEX, sizeof(header) + writer->loopCount * sizeof(MSResultIndexLoop)
+			+ writer->chunkCount * sizeof(MSResultChunk));
+	WriteData(writer, &header, sizeof(header));
+	WriteData(writer, writer->loops, writer->loopCount * sizeof(MSResultIndexLoop));
+	WriteData(writer, writer->chunks, writer->chunkCount * sizeof(MSResultChunk));
+	WriteData(writer, &trailer, sizeof(trailer));
+
+	// The asynchronous writer writes the rest when it is flushed, closed or switched to another file
+	if (writer->async == NULL && fclose(writer->fp) != 0 && writer->error == CODE_OK)
+		writer->error = CODE_ERROR;
+	free(writer->values);
+	free(writer->status);
+	free(writer->currentRange);
+	free(writer->loops);
+	free(writer->chunks);
+	writer->fp = NULL;
+	writer->async = NULL;
+	writer->values = NULL;
+	writer->status = NULL;
+	writer->currentRange = NULL;
+	writer->loops = NULL;
+	writer->chunks = NULL;
+	return writer->error;
+}
+
+
+//
+// Fills in a loop from its loop block at `offset`, the chunks are set by the caller.
+// Returns CODE_OK if the loop block is complete, otherwise CODE_UNEXPECTED_DATA.
+//
+static RetCode ReadLoop(const MSResultFile *file, uint64_t offset, MSResultLoop *loop)
+{
+	const MSLogFile *log = &file->log;
+
+	if (offset % 8 != 0 || offset > log->size || log->size - offset < sizeof(MSResultLoopHeader))
+		return CODE_UNEXPECTED_DATA;
+
+	const MSResultLoopHeader *header = (const MSResultLoopHeader *)(log->data + offset);
+	if ((log->size - offset - sizeof(*header)) / sizeof(MSResultColumn) < header->columnCount)
+		return CODE_UNEXPECTED_DATA;
+
+	memset(loop, 0, sizeof(*loop));
+	loop->columnCount = header->columnCount;
+	loop->columns = (const MSResultColumn *)(header + 1);
+	return CODE_OK;
+}
+
+
+//
+// Checks that the data of a chunk of `loop` is within the file.
+// Returns CODE_OK if it is, otherwise CODE_UNEXPECTED_DATA.
+//
+static RetCode CheckChunk(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk)
+{
+	const uint64_t size = ChunkDataSize(loop->columns, loop->columnCount, chunk->rowCount);
+
+	if (chunk->offset % 8 != 0 || chunk->offset > file->log.size || file->log.size - chunk->offset < size)
+		return CODE_UNEXPECTED_DATA;
+	return CODE_OK;
+}
+
+
+//
+// Reads the loops from the index at the end of a closed file.
+// Returns CODE_OK if successful, CODE_UNEXPECTED_DATA if the file has no valid index or CODE_ERROR if out of memory.
+//
+static RetCode ReadIndex(MSResultFile *file)
+{
+	const MSLogFile *log = &file->log;
+
+	// A closed file consists of 8 byte blocks and ends with the trailer
+	if (log->size < sizeof(MSResultFileHeader) + sizeof(MSResultTrailer) || log->size % 8 != 0)
+		return CODE_UNEXPECTED_DATA;
+
+	const MSResultTrailer *trailer = (const MSResultTrailer *)(log->data + log->size - sizeof(MSResultTrailer));
+	const uint64_t end = log->size - sizeof(MSResultTrailer);
+	if (memcmp(trailer->magic, MSRESULT_TRAILER_MAGIC, MSRESULT_MAGIC_LENGTH) != 0 || trailer->indexOffset % 8 != 0
+			|| trailer->indexOffset > end || end - trailer->indexOffset < sizeof(MSResultBlockHeader) + sizeof(MSResultIndexHeader))
+		return CODE_UNEXPECTED_DATA;
+
+	const MSResultBlockHeader *block = (const MSResultBlockHeader *)(log->data + trailer->indexOffset);
+	const MSResultIndexHeader *header = (const MSResultIndexHeader *)(block + 1);
+	const MSResultIndexLoop *loops = (const MSResultIndexLoop *)(header + 1);
+	const uint64_t available = end - trailer->indexOffset - sizeof(*block) - sizeof(*header);
+	if (block->type != MSRESULT_BLOCK_INDEX || available / sizeof(MSResultIndexLoop) < header->loopCount
+			|| (available - header->loopCount * sizeof(MSResultIndexLoop)) / sizeof(MSResultChunk) < header->chunkCount)
+		return CODE_UNEXPECTED_DATA;
+	const MSResultChunk *chunks = (const MSResultChunk *)(loops + header->loopCount);
+
+	file->loops = calloc(header->loopCount + 1, sizeof(MSResultLoop));
+	if (file->loops == NULL)
+		return CODE_ERROR;
+
+	for (uint32_t i = 0; i < header->loopCount; i++)
+	{
+		MSResultLoop *loop = &file->loops[i];
+
+		if (ReadLoop(file, loops[i].offset, loop) != CODE_OK || loops[i].firstChunk > header->chunkCount
+				|| header->chunkCount - loops[i].firstChunk < loops[i].chunkCount)
+			return CODE_UNEXPECTED_DATA;
+		loop->rowCount = loops[i].rowCount;
+		loop->chunkCount = loops[i].chunkCount;
+		loop->chunks = &chunks[loops[i].firstChunk];
+		loop->complete = loops[i].complete != 0;
+		for (uint32_t c = 0; c < loop->chunkCount; c++)
+		{
+			if (CheckChunk(file, loop, &loop->chunks[c]) != CODE_OK)
+				return CODE_UNEXPECTED_DATA;
+		}
+		file->loopCount++;
+	}
+	return CODE_OK;
+}
+
+
+//
+// Finds the loops and chunks of a file that was not closed by walking through its blocks,
+// up to the last complete block.
+// Returns CODE_OK if successful or CODE_ERROR if out of memory.
+//
+static RetCode RecoverIndex(MSResultFile *file)
+{
+	const MSLogFile *log = &file->log;
+	uint64_t loopCapacity = 0, chunkCapacity = 0, chunkCount = 0, firstChunksCapacity = 0;
+	uint64_t *firstChunks = NULL;		// The index of the first chunk of every loop
+	uint64_t position = sizeof(MSResultFileHeader);
+	RetCode code = CODE_OK;
+
+	file->recovered = 1;
+	while (position <= log->size && log->size - position >= sizeof(MSResultBlockHeader))
+	{
+		const MSResultBlockHeader *block = (const MSResultBlockHeader *)(log->data + position);
+		const uint64_t offset = position + sizeof(*block);
+
+		if (block->size % 8 != 0 || log->size - offset < block->size || block->type == MSRESULT_BLOCK_INDEX)
+			break;
+		position = offset + block->size;
+
+		if (block->type == MSRESULT_BLOCK_LOOP)
+		{
+			MSResultLoop loop;
+			if (ReadLoop(file, offset, &loop) != CODE_OK)
+				break;
+			if (Reserve((void **)&file->loops, &loopCapacity, (uint64_t)file->loopCount + 1, sizeof(MSResultLoop)) != CODE_OK
+					|| Reserve((void **)&firstChunks, &firstChunksCapacity, (uint64_t)file->loopCount + 1, sizeof(uint64_t)) != CODE_OK)
+			{
+				code = CODE_ERROR;
+				break;
+			}
+			firstChunks[file->loopCount] = chunkCount;
+			file->loops[file->loopCount++] = loop;
+		}
+		else if (block->type == MSRESULT_BLOCK_CHUNK && file->loopCount > 0 && block->size >= sizeof(MSResultChunkHeader))
+		{
+			const MSResultChunkHeader *header = (const MSResultChunkHeader *)(log->data + offset);
+			MSResultLoop *loop = &file->loops[file->loopCount - 1];
+			MSResultChunk chunk = { offset + sizeof(*header), header->firstRow, header->rowCount, 0 };
+
+			if (CheckChunk(file, loop, &chunk) != CODE_OK)
+				break;
+			if (Reserve((void **)&file->recoveredChunks, &chunkCapacity, chunkCount + 1, sizeof(MSResultChunk)) != CODE_OK)
+			{
+				code = CODE_ERROR;
+				break;
+			}
+			file->recoveredChunks[chunkCount++] = chunk;
+			loop->chunkCount++;
+			loop->rowCount += chunk.rowCount;
+		}
+	}
+
+	// The chunks array has its final address now
+	for (uint32_t i = 0; i < file->loopCount; i++)
+		file->loops[i].chunks = (file->recoveredChunks != NULL) ? &file->recoveredChunks[firstChunks[i]] : NULL;
+	free(firstChunks);
+	return code;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+RetCode MSResultFileOpen(MSResultFile *file, const char *filename)
+{
+	if (file == NULL || filename == NULL)
+		return CODE_NULL;
+
+	memset(file, 0, sizeof(*file));
+	RetCode code = MSLogFileOpen(&file->log, filename);
+	if (code != CODE_OK)
+		return code;
+
+	const MSResultFileHeader *header = (const MSResultFileHeader *)file->log.data;
+	if (file->log.size < sizeof(*header) || memcmp(header->magic, MSRESULT_MAGIC, MSRESULT_MAGIC_LENGTH) != 0
+			|| header->byteOrder != MSRESULT_BYTE_ORDER)
+	{
+		MSResultFileClose(file);
+		return CODE_UNEXPECTED_DATA;
+	}
+
+	code = ReadIndex(file);
+	if (code == CODE_UNEXPECTED_DATA)
+	{
+		// No valid index, the file was not closed
+		free(file->loops);
+		file->loops = NULL;
+		file->loopCount = 0;
+		code = RecoverIndex(file);
+	}
+	if (code != CODE_OK)
+		MSResultFileClose(file);
+	return code;
+}
+
+
+//
+// Returns the data of a column in a chunk: `part` 0 for the values, 1 for the status and 2 for the current range
+//
+static const char* GetColumnData(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk,
+		uint32_t column, int part)
+{
+	if (column >= loop->columnCount)
+		return NULL;
+
+	const MSResultColumn *info = &loop->columns[column];
+	const char *data = file->log.data + chunk->offset + ChunkDataSize(loop->columns, column, chunk->rowCount);
+
+	if (part == 0)
+		return data;
+	if (!(part == 1 ? info->hasStatus : info->hasCurrentRange))
+		return NULL;
+	data += chunk->rowCount * sizeof(double);
+	if (part == 2 && info->hasStatus)
+		data += PAD8(chunk->rowCount * sizeof(int16_t));
+	return data;
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+const double* MSResultGetValues(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column)
+{
+	return (const double *)GetColumnData(file, loop, chunk, column, 0);
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+const int16_t* MSResultGetStatus(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column)
+{
+	return (const int16_t *)GetColumnData(file, loop, chunk, column, 1);
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+const int16_t* MSResultGetCurrentRange(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column)
+{
+	return (const int16_t *)GetColumnData(file, loop, chunk, column, 2);
+}
+
+
+//
+// See documentation in MSResultFile.h
+//
+void MSResultFileClose(MSResultFile *file)
+{
+	MSLogFileClose(&file->log);
+	free(file->loops);
+	free(file->recoveredChunks);
+	file->loops = NULL;
+	file->recoveredChunks = NULL;
+	file->loopCount = 0;
+}
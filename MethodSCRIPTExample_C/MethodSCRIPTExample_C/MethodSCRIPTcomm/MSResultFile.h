@@ -0,0 +1,382 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSResultFile.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSResultFile stores measurement results in a binary file with one array per variable, and reads
+ *	them back by memory mapping the file, so the arrays can be used in place without parsing.
+ *
+ *	The writer appends the packages during the measurement. The packages of every measurement loop
+ *	are collected in chunks of rows, and every full chunk is written to the file as one block with
+ *	an array per column. When the file is closed, an index of all loops and chunks is added at the end.
+ *	A file that was not closed, e.g. because the program stopped, can still be read: the reader then
+ *	finds the loops and chunks by walking through the blocks, up to the last complete one.
+ *	The writer can also write through an MSAsyncWriter, so the file is written on a background thread.
+ *
+ *	The file consists of 8 byte aligned blocks, all numbers are in the byte order of the host
+ *	(little endian on all supported hosts; the reader refuses files of the other byte order):
+ *	  - `MSResultFileHeader`
+ *	  - Per measurement loop: a MSRESULT_BLOCK_LOOP block with the schema of the loop: a `MSResultLoopHeader`
+ *	    followed by one `MSResultColumn` per column, with the variable type and which metadata is present.
+ *	  - Per chunk of a loop: a MSRESULT_BLOCK_CHUNK block with a `MSResultChunkHeader`, followed by the
+ *	    data of every column: the values as doubles, the status as int16 if present and the current
+ *	    range as int16 if present. Each array is padded to a multiple of 8 bytes.
+ *	  - A MSRESULT_BLOCK_INDEX block with a `MSResultIndexHeader`, a `MSResultIndexLoop` per loop and a
+ *	    `MSResultChunk` per chunk, followed by a `MSResultTrailer` at the very end of the file.
+ *
+ *	The columns of a loop are taken from its first package. Later packages of the loop are matched
+ *	by position: values of subpackages with a different variable type are stored as NAN, metadata that
+ *	is not given as -1, and subpackages beyond the columns of the loop are not stored.
+ *
+ ============================================================================
+ */
+
+#ifndef MSRESULTFILE_H
+#define MSRESULTFILE_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "MSAsyncWriter.h"
+#include "MSComm.h"
+#include "MSLogFile.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The first characters of every result file
+#define MSRESULT_MAGIC				"MSRES01\n"
+/// The last characters of every result file that was closed
+#define MSRESULT_TRAILER_MAGIC		"MSRESEND"
+#define MSRESULT_MAGIC_LENGTH		8
+
+/// Written as a number in the header, to detect files of the other byte order
+#define MSRESULT_BYTE_ORDER			0x01020304u
+
+/// The default number of rows per chunk
+#define MSRESULT_DEFAULT_CHUNK_ROWS	4096
+
+/// The types of blocks
+#define MSRESULT_BLOCK_LOOP			1
+#define MSRESULT_BLOCK_CHUNK		2
+#define MSRESULT_BLOCK_INDEX		3
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The start of a result file
+///
+typedef struct _MSResultFileHeader
+{
+	char magic[MSRESULT_MAGIC_LENGTH];	// MSRESULT_MAGIC
+	uint32_t byteOrder;					// MSRESULT_BYTE_ORDER
+	uint32_t chunkRows;					// The maximum number of rows per chunk
+	uint64_t reserved;
+} MSResultFileHeader;
+
+///
+/// The start of every block
+///
+typedef struct _MSResultBlockHeader
+{
+	uint32_t type;						// MSRESULT_BLOCK_LOOP, MSRESULT_BLOCK_CHUNK or MSRESULT_BLOCK_INDEX
+	uint32_t loop;						// The index of the measurement loop that the block belongs to
+	uint64_t size;						// The number of bytes after this header, a multiple of 8
+} MSResultBlockHeader;
+
+///
+/// The start of a MSRESULT_BLOCK_LOOP block, followed by the columns
+///
+typedef struct _MSResultLoopHeader
+{
+	uint32_t columnCount;
+	uint32_t reserved;
+} MSResultLoopHeader;
+
+///
+/// One column of a measurement loop
+///
+typedef struct _MSResultColumn
+{
+	int16_t variableType;				// As converted by `MSCR_STR_TO_VT`
+	uint8_t hasStatus;					// Whether the column has a status array
+	uint8_t hasCurrentRange;			// Whether the column has a current range array
+} MSResultColumn;
+
+///
+/// The start of a MSRESULT_BLOCK_CHUNK block, followed by the data of the columns
+///
+typedef struct _MSResultChunkHeader
+{
+	uint64_t firstRow;					// The row in the loop of the first row of the chunk
+	uint32_t rowCount;
+	uint32_t reserved;
+} MSResultChunkHeader;
+
+///
+/// The start of the MSRESULT_BLOCK_INDEX block, followed by the loops and the chunks
+///
+typedef struct _MSResultIndexHeader
+{
+	uint32_t loopCount;
+	uint32_t reserved;
+	uint64_t chunkCount;
+} MSResultIndexHeader;
+
+///
+/// One measurement loop in the index
+///
+typedef struct _MSResultIndexLoop
+{
+	uint64_t offset;					// The offset in the file of the `MSResultLoopHeader`
+	uint64_t rowCount;
+	uint64_t firstChunk;				// The index of the first chunk of the loop in the index
+	uint32_t chunkCount;
+	uint32_t complete;					// Non-zero if the end of the measurement loop was received
+} MSResultIndexLoop;
+
+///
+/// One chunk, in the index and as returned by the reader
+///
+typedef struct _MSResultChunk
+{
+	uint64_t offset;					// The offset in the file of the column data of the chunk
+	uint64_t firstRow;					// The row in the loop of the first row of the chunk
+	uint32_t rowCount;
+	uint32_t reserved;
+} MSResultChunk;
+
+///
+/// The end of a result file that was closed
+///
+typedef struct _MSResultTrailer
+{
+	uint64_t indexOffset;				// The offset in the file of the MSRESULT_BLOCK_INDEX block header
+	char magic[MSRESULT_MAGIC_LENGTH];	// MSRESULT_TRAILER_MAGIC
+} MSResultTrailer;
+
+///
+/// Writes a result file
+///
+typedef struct _MSResultWriter
+{
+	FILE *fp;							// The file that is written to, NULL if `async` is used
+	MSAsyncWriter *async;				// The asynchronous writer that is written to, NULL if `fp` is used
+	uint64_t position;					// The current size of the file
+	RetCode error;						// The first error that occurred, CODE_OK if none
+	uint32_t chunkRows;					// The maximum number of rows per chunk
+	// The current measurement loop
+	int inLoop;							// Set between the first package of a loop and its end
+	int loopStarted;					// Set if the next package starts a new loop
+	uint32_t columnCount;
+	MSResultColumn columns[MSCR_SUBPACKAGES_PER_LINE];
+	uint32_t rowCount;					// The number of rows in the chunk buffers
+	uint64_t loopRows;					// The number of rows of the loop that were written
+	uint32_t bufferColumns;				// The number of columns that the chunk buffers have room for
+	double *values;						// The values of the current chunk, `chunkRows` per column
+	int16_t *status;					// The status of the current chunk, `chunkRows` per column
+	int16_t *currentRange;				// The current ranges of the current chunk, `chunkRows` per column
+	// The index
+	MSResultIndexLoop *loops;
+	uint32_t loopCount;
+	uint32_t loopCapacity;
+	MSResultChunk *chunks;
+	uint64_t chunkCount;
+	uint64_t chunkCapacity;
+} MSResultWriter;
+
+///
+/// One measurement loop of an opened result file
+///
+typedef struct _MSResultLoop
+{
+	uint32_t columnCount;
+	const MSResultColumn *columns;		// Points into the mapped file
+	uint64_t rowCount;
+	uint32_t chunkCount;
+	const MSResultChunk *chunks;		// The chunks in the order of their rows
+	int complete;						// Set if the end of the measurement loop was received
+} MSResultLoop;
+
+///
+/// An opened result file
+///
+typedef struct _MSResultFile
+{
+	MSLogFile log;						// The mapped file
+	uint32_t loopCount;
+	MSResultLoop *loops;
+	MSResultChunk *recoveredChunks;		// The chunks found in a file without index, NULL if the file has an index
+	int recovered;						// Set if the file was not closed and the loops were found by walking the blocks
+} MSResultFile;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Creates a result file and writes its header
+///
+/// parameters:
+///   writer     - The writer to initialise
+///   filename   - The file to create, an existing file is overwritten
+///   chunkRows  - The maximum number of rows per chunk, 0 for `MSRESULT_DEFAULT_CHUNK_ROWS`
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL or CODE_ERROR if the file could not be created.
+///
+RetCode MSResultWriterOpen(MSResultWriter *writer, const char *filename, uint32_t chunkRows);
+
+
+///
+/// Starts a result file in an asynchronous writer and writes its header
+///
+/// parameters:
+///   writer     - The writer to initialise
+///   async      - The opened asynchronous writer of an empty file. It is not closed by `MSResultWriterClose()`.
+///   chunkRows  - The maximum number of rows per chunk, 0 for `MSRESULT_DEFAULT_CHUNK_ROWS`
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL or CODE_ERROR if writing failed.
+///
+RetCode MSResultWriterOpenAsync(MSResultWriter *writer, MSAsyncWriter *async, uint32_t chunkRows);
+
+
+///
+/// Starts a new measurement loop. The columns of the loop are taken from its first package.
+/// A loop that was not ended is ended first.
+///
+void MSResultWriterBeginLoop(MSResultWriter *writer);
+
+
+///
+/// Ends the current measurement loop and writes its last rows
+///
+void MSResultWriterEndLoop(MSResultWriter *writer);
+
+
+///
+/// Adds one package to the current measurement loop. If no loop was started, a loop is started first.
+///
+/// Returns:
+///   CODE_OK if successful, or the first error of the writer.
+///
+RetCode MSResultWriterAddPackage(MSResultWriter *writer, const MscrPackage *package);
+
+
+///
+/// Adds the result of `ReceivePackage()` or a line of a MSParser, like `MSDatasetAddEvent()`.
+/// A CODE_MEASURING line starts a new loop and a CODE_MEASUREMENT_DONE line ends it, except for
+/// the nscans lines ('C' and '-'), which are within a loop. `line` may be NULL if it is not known,
+/// then every CODE_MEASURING starts a new loop.
+///
+/// Returns:
+///   CODE_OK if successful, or the first error of the writer.
+///
+RetCode MSResultWriterAddEvent(MSResultWriter *writer, RetCode code, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// Event function for `MSParserInit()` that calls `MSResultWriterAddEvent()`, `context` must be the MSResultWriter
+///
+void MSResultWriterOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// Writes the rows of the current chunk to the file, so they can be read even if the writer is not closed.
+/// This writes a smaller chunk, so it should not be called for every package.
+///
+/// Returns:
+///   CODE_OK if successful, or the first error of the writer.
+///
+RetCode MSResultWriterFlush(MSResultWriter *writer);
+
+
+///
+/// Ends the current loop, writes the index and closes the file.
+/// An asynchronous writer is not closed or waited for: the file is complete once it has been flushed, closed or
+/// switched to another file.
+///
+/// Returns:
+///   CODE_OK if the complete file was written, otherwise the first error of the writer.
+///
+RetCode MSResultWriterClose(MSResultWriter *writer);
+
+
+///
+/// Opens and maps a result file and finds its measurement loops
+///
+/// parameters:
+///   file      - The result file to initialise
+///   filename  - The file to open
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL, CODE_UNEXPECTED_DATA if the file is not
+///   a result file or CODE_ERROR if the file could not be mapped or out of memory.
+///
+RetCode MSResultFileOpen(MSResultFile *file, const char *filename);
+
+
+///
+/// Returns the values of a column in a chunk, `chunk->rowCount` doubles that point into the mapped file
+///
+const double* MSResultGetValues(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column);
+
+
+///
+/// Returns the status of a column in a chunk, `chunk->rowCount` values, or NULL if the column has no status
+///
+const int16_t* MSResultGetStatus(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column);
+
+
+///
+/// Returns the current ranges of a column in a chunk, `chunk->rowCount` values, or NULL if the column has no current range
+///
+const int16_t* MSResultGetCurrentRange(const MSResultFile *file, const MSResultLoop *loop, const MSResultChunk *chunk, uint32_t column);
+
+
+///
+/// Unmaps and closes a result file
+///
+void MSResultFileClose(MSResultFile *file);
+
+
+#endif //MSRESULTFILE_H
@@ -0,0 +1,370 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSRing.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+
+#include "MSRing.h"
+
+
+//
+// See documentation in MSRing.h
+//
+RetCode MSRingInit(MSRing *ring, unsigned int size)
+{
+	if (size == 0 || (size & (size - 1)) != 0)
+		return CODE_OUT_OF_RANGE;
+
+	ring->entries = malloc(size * sizeof(MSRingEntry));
+	if (ring->entries == NULL)
+		return CODE_ERROR;
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->overflows, 0);
+	atomic_init(&ring->badLines, 0);
+	atomic_init(&ring->highWaterMark, 0);
+	ring->cachedHead = 0;
+	ring->cachedTail = 0;
+	atomic_init(&ring->consumerWaiting, 0);
+	atomic_init(&ring->producerWaiting, 0);
+	atomic_init(&ring->closed, 0);
+	if (pthread_mutex_init(&ring->lock, NULL) != 0 || pthread_cond_init(&ring->changed, NULL) != 0)
+	{
+		free(ring->entries);
+		return CODE_ERROR;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSRing.h
+//
+void MSRingFree(MSRing *ring)
+{
+	for (unsigned int i = atomic_load(&ring->tail); i != atomic_load(&ring->head); i++)
+	{
+		if (ring->entries[i & ring->mask].package != NULL)
+			MSPackageRelease(ring->entries[i & ring->mask].package);
+	}
+	free(ring->entries);
+	ring->entries = NULL;
+	pthread_cond_destroy(&ring->changed);
+	pthread_mutex_destroy(&ring->lock);
+}
+
+
+//
+// Wakes the other thread if it sleeps on `waiting`. Called after moving the own index: either the other
+// thread sees the new index before it sleeps, or this thread sees that it sleeps.
+//
+static void WakeIfWaiting(MSRing *ring, atomic_int *waiting)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(waiting, memory_order_relaxed))
+	{
+		pthread_mutex_lock(&ring->lock);
+		pthread_cond_broadcast(&ring->changed);
+		pthread_mutex_unlock(&ring->lock);
+	}
+}
+
+
+//
+// Returns the entry to write next or NULL if the ring is full
+//
+static MSRingEntry* FreeEntry(MSRing *ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if (head - ring->cachedTail > ring->mask)
+	{
+		// Looks full, check where the consumer is now
+		ring->cachedTail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		if (head - ring->cachedTail > ring->mask)
+			return NULL;
+	}
+	return &ring->entries[head & ring->mask];
+}
+
+
+//
+// Increments a counter of the ring that only the producer writes
+//
+static void Count(atomic_ulong *counter)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+
+//
+// Counts an entry that was dropped because the ring was full
+//
+static void CountOverflow(MSRing *ring)
+{
+	Count(&ring->overflows);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+MSRingEntry* MSRingBeginWrite(MSRing *ring)
+{
+	MSRingEntry *entry = FreeEntry(ring);
+
+	if (entry == NULL)
+		CountOverflow(ring);
+	return entry;
+}
+
+
+//
+// See documentation in MSRing.h
+//
+void MSRingCommitWrite(MSRing *ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed) + 1;
+	unsigned int used = head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->head, head, memory_order_release);
+	if (used > atomic_load_explicit(&ring->highWaterMark, memory_order_relaxed))
+		atomic_store_explicit(&ring->highWaterMark, used, memory_order_relaxed);
+	WakeIfWaiting(ring, &ring->consumerWaiting);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+MSRingEntry* MSRingWaitWrite(MSRing *ring)
+{
+	MSRingEntry *entry = FreeEntry(ring);
+
+	if (entry != NULL)
+		return entry;
+	pthread_mutex_lock(&ring->lock);
+	atomic_store(&ring->producerWaiting, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+	while ((entry = FreeEntry(ring)) == NULL)
+		pthread_cond_wait(&ring->changed, &ring->lock);
+	atomic_store(&ring->producerWaiting, 0);
+	pthread_mutex_unlock(&ring->lock);
+	return entry;
+}
+
+
+//
+// See documentation in MSRing.h
+//
+void MSRingClose(MSRing *ring)
+{
+	pthread_mutex_lock(&ring->lock);
+	atomic_store(&ring->closed, 1);
+	pthread_cond_broadcast(&ring->changed);
+	pthread_mutex_unlock(&ring->lock);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+const MSRingEntry* MSRingBeginRead(MSRing *ring)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (tail == ring->cachedHead)
+	{
+		ring->cachedHead = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if (tail == ring->cachedHead)
+			return NULL;
+	}
+	return &ring->entries[tail & ring->mask];
+}
+
+
+//
+// See documentation in MSRing.h
+//
+const MSRingEntry* MSRingWaitRead(MSRing *ring)
+{
+	const MSRingEntry *entry = MSRingBeginRead(ring);
+
+	if (entry != NULL)
+		return entry;
+	pthread_mutex_lock(&ring->lock);
+	atomic_store(&ring->consumerWaiting, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+	while ((entry = MSRingBeginRead(ring)) == NULL && !atomic_load(&ring->closed))
+		pthread_cond_wait(&ring->changed, &ring->lock);
+	atomic_store(&ring->consumerWaiting, 0);
+	pthread_mutex_unlock(&ring->lock);
+	// The last entries are written before the ring is closed
+	return (entry != NULL) ? entry : MSRingBeginRead(ring);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+void MSRingEndRead(MSRing *ring)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	MSRingEntry *entry = &ring->entries[tail & ring->mask];
+
+	if (entry->package != NULL)
+		MSPackageRelease(entry->package);
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	WakeIfWaiting(ring, &ring->producerWaiting);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+unsigned long MSRingGetOverflows(MSRing *ring)
+{
+	return atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+unsigned long MSRingGetBadLines(MSRing *ring)
+{
+	return atomic_load_explicit(&ring->badLines, memory_order_relaxed);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+unsigned int MSRingGetHighWaterMark(MSRing *ring)
+{
+	return atomic_load_explicit(&ring->highWaterMark, memory_order_relaxed);
+}
+
+
+//
+// Receives packages into the ring until the response ends, `argument` is the MSRingReader
+//
+static void *RunReader(void *argument)
+{
+	MSRingReader *reader = argument;
+	RetCode code;
+
+	do
+	{
+		// Receive directly into a package of the pool if one is free
+		MscrPackage *package = MSPackageAcquire(reader->pool);
+		MSRingEntry *entry;
+
+		code = ReceivePackage(reader->msComm, (package != NULL) ? package : &reader->overflow);
+		if (code != CODE_OK && package != NULL)
+		{
+			MSPackageRelease(package);		// Only data packages are passed on
+			package = NULL;
+		}
+
+		if (code == CODE_UNEXPECTED_DATA)
+		{
+			// A damaged package line, the next lines are usually fine again
+			Count(&reader->ring->badLines);
+			continue;
+		}
+		if (code == CODE_OK)
+		{
+			entry = (package != NULL) ? FreeEntry(reader->ring) : NULL;
+			if (entry == NULL)
+			{
+				if (package != NULL)
+					MSPackageRelease(package);
+				CountOverflow(reader->ring);
+				continue;
+			}
+		}
+		else
+		{
+			// Other responses mark the structure of the measurement and are rare, wait until they fit
+			entry = MSRingWaitWrite(reader->ring);
+		}
+		entry->code = code;
+		entry->package = package;
+		entry->reply = reader->msComm->lastReply;
+		MSRingCommitWrite(reader->ring);
+	} while (code != CODE_RESPONSE_END && (code >= 0 || code == CODE_UNEXPECTED_DATA));
+
+	reader->result = code;
+	atomic_store_explicit(&reader->running, 0, memory_order_release);
+	MSRingClose(reader->ring);
+	return NULL;
+}
+
+
+//
+// See documentation in MSRing.h
+//
+RetCode MSRingStartReader(MSRingReader *reader, MSComm *msComm, MSRing *ring, MSPackagePool *pool)
+{
+	reader->msComm = msComm;
+	reader->ring = ring;
+	reader->pool = pool;
+	reader->result = CODE_OK;
+	atomic_init(&reader->running, 1);
+
+	if (pthread_create(&reader->thread, NULL, RunReader, reader) != 0)
+	{
+		atomic_store(&reader->running, 0);
+		return CODE_ERROR;
+	}
+	return CODE_OK;
+}
+
+
+//
+// See documentation in MSRing.h
+//
+int MSRingReaderRunning(MSRingReader *reader)
+{
+	return atomic_load_explicit(&reader->running, memory_order_acquire);
+}
+
+
+//
+// See documentation in MSRing.h
+//
+RetCode MSRingJoinReader(MSRingReader *reader)
+{
+	pthread_join(reader->thread, NULL);
+	return reader->result;
+}
@@ -0,0 +1,277 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSRing.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSRing passes received packages from one thread to another without locking.
+ *	A reader thread receives the packages from an EmStat Pico and stores them in the ring, while a
+ *	processing thread takes them out to display or store them. A slow processing step, such as writing
+ *	a file, then no longer delays the reading, so the receive buffer of the EmStat Pico does not overflow.
+ *
+ *	The ring is a bounded single producer, single consumer queue: exactly one thread may write and
+ *	exactly one other thread may read. The ring only holds pointers to packages of a MSPackagePool
+ *	(see MSPackagePool.h), into which the packages are received, so they are never copied. An entry
+ *	holds a reference to its package, which is released when the entry is read. To use the package
+ *	after that, e.g. on another thread, take a reference with `MSPackageRetain()`.
+ *	When the ring is full, the reader does not wait: the package is dropped and counted as an
+ *	overflow. The overflow count and the highest fill level (high-water mark) can be used to choose
+ *	the size of the ring.
+ *	The consumer can sleep until an entry arrives with `MSRingWaitRead()`. Writing and reading stay
+ *	lock-free: a thread only takes the lock of the ring to sleep, or to wake the other thread while
+ *	it sleeps.
+ *
+ *	`MSRingStartReader()` starts a thread that receives the response of a MSComm into a ring. It only
+ *	drops data packages, also when all packages of the pool are in use. The other responses, such as the
+ *	start and end of a loop, are rare and mark the structure of the measurement, so for those the reader
+ *	waits until the ring has room. A package line that cannot be parsed, e.g. because of a transmission
+ *	error, is counted and skipped, so one damaged line does not end the measurement.
+ *	Use one ring and one reader thread per EmStat Pico. A thread that handles many devices, like the
+ *	SerialReactor, can use a ring per device in the same way.
+ *
+ ============================================================================
+ */
+
+#ifndef MSRING_H
+#define MSRING_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "MSComm.h"
+#include "MSPackagePool.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// Size of a cache line, the indices of the producer and consumer are kept on separate lines
+#define MSRING_CACHE_LINE	64
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// One received response, as returned by `ReceivePackage()`
+///
+typedef struct _MSRingEntry
+{
+	RetCode code;					// The return code of `ReceivePackage()`
+	MscrPackage *package;			// The package of a MSPackagePool if `code` is CODE_OK, otherwise NULL
+	char reply;						// The first character of the line, see `MSComm.lastReply`
+} MSRingEntry;
+
+///
+/// A bounded single producer, single consumer ring of entries
+///
+typedef struct _MSRing
+{
+	MSRingEntry *entries;
+	unsigned int mask;				// The number of entries - 1
+
+	// Written by the producer only
+	_Alignas(MSRING_CACHE_LINE) atomic_uint head;	// Index of the next entry to write
+	unsigned int cachedTail;		// Last known `tail`, so the producer rarely reads the consumer's line
+	atomic_ulong overflows;			// Number of entries dropped because the ring was full
+	atomic_ulong badLines;			// Number of package lines skipped by the reader because they could not be parsed
+	atomic_uint highWaterMark;		// Highest number of entries in the ring
+
+	// Written by the consumer only
+	_Alignas(MSRING_CACHE_LINE) atomic_uint tail;	// Index of the next entry to read
+	unsigned int cachedHead;		// Last known `head`
+
+	// Only used to sleep while the ring is empty or full
+	_Alignas(MSRING_CACHE_LINE) pthread_mutex_t lock;
+	pthread_cond_t changed;			// Signalled when a sleeping thread must check the ring again
+	atomic_int consumerWaiting;		// Set while the consumer sleeps until an entry is written
+	atomic_int producerWaiting;		// Set while the producer sleeps until an entry is read
+	atomic_int closed;				// Set when the producer will not write any more entries
+} MSRing;
+
+///
+/// A thread that receives the response of one EmStat Pico into a ring
+///
+typedef struct _MSRingReader
+{
+	MSComm *msComm;
+	MSRing *ring;
+	MSPackagePool *pool;
+	MscrPackage overflow;			// Receives the packages that are dropped
+	pthread_t thread;
+	atomic_int running;				// Cleared when the thread has stored the last entry
+	RetCode result;					// The last code returned by `ReceivePackage()`, valid when not running
+} MSRingReader;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Allocates the entries of a ring
+///
+/// parameters:
+///   ring  - The ring to initialise
+///   size  - The number of entries, must be a power of 2
+///
+/// Returns:
+///   CODE_OK if successful, CODE_OUT_OF_RANGE if the size is not a power of 2 or CODE_ERROR if out of memory.
+///
+RetCode MSRingInit(MSRing *ring, unsigned int size);
+
+
+///
+/// Frees the entries of a ring. The packages of the entries that were not read are released.
+///
+void MSRingFree(MSRing *ring);
+
+
+///
+/// Producer: gets the entry to write the next response into.
+/// The entry takes over the reference to the package that is stored in it.
+/// If the ring is full, the overflow counter is increased and NULL is returned.
+///
+/// parameters:
+///   ring  - The ring
+///
+/// Returns:
+///   The free entry or NULL if the ring is full
+///
+MSRingEntry* MSRingBeginWrite(MSRing *ring);
+
+
+///
+/// Producer: makes the entry returned by `MSRingBeginWrite()` available to the consumer
+///
+void MSRingCommitWrite(MSRing *ring);
+
+
+///
+/// Consumer: gets the oldest entry, without removing it from the ring
+///
+/// parameters:
+///   ring  - The ring
+///
+/// Returns:
+///   The entry or NULL if the ring is empty
+///
+const MSRingEntry* MSRingBeginRead(MSRing *ring);
+
+
+///
+/// Consumer: gets the oldest entry like `MSRingBeginRead()`, but sleeps until an entry is written if the ring
+/// is empty. Returns NULL once the ring is empty and closed with `MSRingClose()`.
+///
+const MSRingEntry* MSRingWaitRead(MSRing *ring);
+
+
+///
+/// Consumer: removes the entry returned by `MSRingBeginRead()` or `MSRingWaitRead()` from the ring, so it can be reused.
+/// The reference of the entry to its package is released.
+///
+void MSRingEndRead(MSRing *ring);
+
+
+///
+/// Producer: like `MSRingBeginWrite()`, but sleeps until the consumer has read an entry if the ring is full,
+/// instead of dropping the entry. Only for rare entries, as it holds up the producer.
+///
+MSRingEntry* MSRingWaitWrite(MSRing *ring);
+
+
+///
+/// Producer: marks that no more entries will be written, so `MSRingWaitRead()` returns NULL when the ring is empty
+///
+void MSRingClose(MSRing *ring);
+
+
+///
+/// Returns the number of entries that were dropped because the ring was full. Can be called from any thread.
+///
+unsigned long MSRingGetOverflows(MSRing *ring);
+
+
+///
+/// Returns the number of package lines that the reader thread skipped because they could not be parsed.
+/// Can be called from any thread.
+///
+unsigned long MSRingGetBadLines(MSRing *ring);
+
+
+///
+/// Returns the highest number of entries that were in the ring at the same time. Can be called from any thread.
+///
+unsigned int MSRingGetHighWaterMark(MSRing *ring);
+
+
+///
+/// Starts a thread that calls `ReceivePackage()` and stores every result in the ring, until the end of the
+/// response or an error is received, and then closes the ring. The thread is the producer of the ring, no other
+/// thread may write to it.
+///
+/// parameters:
+///   reader   - The reader to start
+///   msComm   - The MSComm to receive from, it may not be used by other threads until the reader is joined
+///   ring     - The ring to store the results in
+///   pool     - The pool to take the packages from
+///
+/// Returns:
+///   CODE_OK if the thread was started, otherwise CODE_ERROR.
+///
+RetCode MSRingStartReader(MSRingReader *reader, MSComm *msComm, MSRing *ring, MSPackagePool *pool);
+
+
+///
+/// Checks if a reader thread is still receiving. When it is no longer running and the ring is empty,
+/// all entries were processed.
+///
+/// Returns:
+///   1 if the reader is running, 0 if it stored its last entry.
+///
+int MSRingReaderRunning(MSRingReader *reader);
+
+
+///
+/// Waits until a reader thread has finished
+///
+/// Returns:
+///   The last code returned by `ReceivePackage()`: CODE_RESPONSE_END or an error.
+///
+RetCode MSRingJoinReader(MSRingReader *reader);
+
+
+#endif //MSRING_H
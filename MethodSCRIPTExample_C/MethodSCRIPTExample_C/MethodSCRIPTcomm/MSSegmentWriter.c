@@ -0,0 +1,337 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSSegmentWriter.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "MSSegmentWriter.h"
+
+
+//
+// Returns the time in microseconds since 1970 (UTC)
+//
+static int64_t NowUs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+//
+// Keeps the first error
+//
+static void SetError(MSSegmentWriter *writer, RetCode code)
+{
+	if (code != CODE_OK && writer->error == CODE_OK)
+		writer->error = code;
+}
+
+
+//
+// Creates the file of a segment
+//
+static FILE* CreateSegmentFile(const MSSegmentWriter *writer, uint32_t number)
+{
+	char path[MSSEGMENT_MAX_PATH + 32];
+
+	snprintf(path, sizeof(path), "%s_%06u%s", writer->basePath, (unsigned int)number,
+			(writer->format == MSSEGMENT_CSV) ? ".csv" : ".msres");
+	return fopen(path, (writer->format == MSSEGMENT_CSV) ? "w" : "wb");
+}
+
+
+//
+// Returns the size of the current segment
+//
+static uint64_t SegmentSize(const MSSegmentWriter *writer)
+{
+	if (writer->format == MSSEGMENT_CSV)
+		return writer->csv.written + writer->csv.length - writer->segmentStart;
+	return writer->results.position;
+}
+
+
+//
+// Starts formatting into the current file of the asynchronous writer
+//
+static void StartFormat(MSSegmentWriter *writer, int first)
+{
+	if (writer->format == MSSEGMENT_RESULT)
+		SetError(writer, MSResultWriterOpenAsync(&writer->results, &writer->file, 0));
+	else if (first)
+		SetError(writer, MSCsvWriterInitAsync(&writer->csv, &writer->file));
+	else
+		MSCsvFlushBuffer(&writer->csv);		// Continue in the buffer of the new file
+}
+
+
+//
+// Passes everything of the current segment on to the asynchronous writer
+//
+static void FinishFormat(MSSegmentWriter *writer)
+{
+	if (writer->format == MSSEGMENT_RESULT)
+		SetError(writer, MSResultWriterClose(&writer->results));
+	else
+		MSCsvFlushBuffer(&writer->csv);
+}
+
+
+//
+// Adds a line for a segment to the manifest
+//
+static void ListSegment(MSSegmentWriter *writer, const MSSegmentInfo *segment)
+{
+	// The files are in the same directory as the manifest, so only their names are listed
+	const char *name = writer->basePath;
+	for (const char *c = writer->basePath; *c != '\0'; c++)
+	{
+		if (*c == '/' || *c == '\\')
+			name = c + 1;
+	}
+
+	fprintf(writer->manifest, "%u,%s_%06u%s,%.3f,%.3f,%llu,%llu,%llu,%llu\n", (unsigned int)segment->number,
+			name, (unsigned int)segment->number, (writer->format == MSSEGMENT_CSV) ? ".csv" : ".msres",
+			segment->startUs / 1e6, segment->endUs / 1e6, (unsigned long long)segment->firstLoop,
+			(unsigned long long)segment->lastLoop, (unsigned long long)segment->packages,
+			(unsigned long long)segment->bytes);
+	if (fflush(writer->manifest) != 0)
+		SetError(writer, CODE_ERROR);
+}
+
+
+//
+// Lists the previous segment in the manifest once the thread has closed its file.
+// If `wait` is set, this waits until the thread has written everything.
+//
+static void ListPrevious(MSSegmentWriter *writer, int wait)
+{
+	MSAsyncWriterStats stats;
+
+	if (!writer->previousPending)
+		return;
+	if (wait)
+		SetError(writer, MSAsyncWriterFlush(&writer->file, 0));
+	MSAsyncWriterGetStats(&writer->file, &stats);
+	// Every segment before the current one has been switched away from, in order
+	if (stats.filesClosed >= writer->previous.number)
+	{
+		ListSegment(writer, &writer->previous);
+		writer->previousPending = 0;
+	}
+}
+
+
+//
+// Returns whether a new segment must be started before the response `code`
+//
+static int LimitReached(const MSSegmentWriter *writer, int64_t now, RetCode code, int nscans)
+{
+	const MSSegmentLimits *limits = &writer->limits;
+
+	// Only split before a package or a new loop, so the end of a loop stays with its packages.
+	// A segment without data is never ended.
+	if ((code != CODE_OK && code != CODE_MEASURING) || (writer->segment.packages == 0 && writer->segmentLoops == 0))
+		return 0;
+	if (code == CODE_MEASURING && !nscans && limits->maxLoops > 0 && writer->segmentLoops >= limits->maxLoops)
+		return 1;
+	if (limits->maxBytes > 0 && SegmentSize(writer) >= limits->maxBytes)
+		return 1;
+	if (limits->maxSeconds > 0 && now - writer->segment.startUs >= (int64_t)limits->maxSeconds * 1000000)
+		return 1;
+	return 0;
+}
+
+
+//
+// Ends the current segment and starts the next one
+//
+static void NewSegment(MSSegmentWriter *writer, int64_t now)
+{
+	FILE *fp = CreateSegmentFile(writer, writer->segment.number + 1);
+	if (fp == NULL)
+	{
+		// Continue in the current segment
+		SetError(writer, CODE_ERROR);
+		memset(&writer->limits, 0, sizeof(writer->limits));
+		return;
+	}
+
+	FinishFormat(writer);
+	writer->segment.bytes = SegmentSize(writer);
+	// At most one segment waits to be listed, which is only a wait if segments are very small
+	ListPrevious(writer, 1);
+	SetError(writer, MSAsyncWriterSwitchFile(&writer->file, fp));
+
+	writer->previous = writer->segment;
+	writer->previousPending = 1;
+	memset(&writer->segment, 0, sizeof(writer->segment));
+	writer->segment.number = writer->previous.number + 1;
+	writer->segment.startUs = now;
+	writer->segment.endUs = now;
+	if (writer->inLoop)
+	{
+		// The loop continues in the new segment
+		writer->segment.firstLoop = writer->loop;
+		writer->segment.lastLoop = writer->loop;
+	}
+	writer->segmentLoops = 0;
+	writer->segmentStart = writer->csv.written + writer->csv.length;
+	writer->needHeader = 1;
+	StartFormat(writer, 0);
+}
+
+
+//
+// See documentation in MSSegmentWriter.h
+//
+RetCode MSSegmentWriterOpen(MSSegmentWriter *writer, const char *basePath, MSSegmentFormat format,
+		const MSSegmentLimits *limits)
+{
+	char path[MSSEGMENT_MAX_PATH + 32];
+
+	if (writer == NULL || basePath == NULL || limits == NULL)
+		return CODE_NULL;
+	if (strlen(basePath) >= MSSEGMENT_MAX_PATH)
+		return CODE_OUT_OF_RANGE;
+
+	memset(writer, 0, sizeof(*writer));
+	strcpy(writer->basePath, basePath);
+	writer->format = format;
+	writer->limits = *limits;
+	writer->error = CODE_OK;
+
+	snprintf(path, sizeof(path), "%s_manifest.csv", basePath);
+	writer->manifest = fopen(path, "w");
+	if (writer->manifest == NULL)
+		return CODE_ERROR;
+	fprintf(writer->manifest, "segment,file,start_time,end_time,first_loop,last_loop,packages,bytes\n");
+
+	FILE *fp = CreateSegmentFile(writer, 1);
+	if (fp == NULL || MSAsyncWriterOpen(&writer->file, fp, 0, 0) != CODE_OK)
+	{
+		if (fp != NULL)
+			fclose(fp);
+		fclose(writer->manifest);
+		return CODE_ERROR;
+	}
+	writer->segment.number = 1;
+	writer->segment.startUs = NowUs();
+	writer->segment.endUs = writer->segment.startUs;
+	StartFormat(writer, 1);
+	return writer->error;
+}
+
+
+//
+// See documentation in MSSegmentWriter.h
+//
+RetCode MSSegmentWriterAddEvent(MSSegmentWriter *writer, RetCode code, const char *line, size_t length,
+		const MscrPackage *package)
+{
+	int nscans = (line != NULL && length > 0 && (line[0] == REPLY_NSCANS_START || line[0] == REPLY_NSCANS_DONE));
+	int64_t now = NowUs();
+
+	if (writer->previousPending)
+		ListPrevious(writer, 0);
+	if (LimitReached(writer, now, code, nscans))
+		NewSegment(writer, now);
+
+	switch (code)
+	{
+	case CODE_MEASURING:
+		// The CSV starts a new block for the nscans lines as well, like the other CSV output
+		writer->loopPackages = 0;
+		if (nscans)
+			break;
+		writer->loop++;
+		writer->inLoop = 1;
+		writer->segmentLoops++;
+		if (writer->segment.firstLoop == 0)
+			writer->segment.firstLoop = writer->loop;
+		writer->segment.lastLoop = writer->loop;
+		break;
+	case CODE_OK:
+		if (writer->format == MSSEGMENT_CSV)
+		{
+			// The fields in the header are determined by the first package of the loop in this segment
+			if (writer->loopPackages == 0 || writer->needHeader)
+				MSCsvWriteHeader(&writer->csv, package);
+			MSCsvWritePackage(&writer->csv, package, writer->loopPackages + 1);
+		}
+		writer->needHeader = 0;
+		writer->loopPackages++;
+		writer->segment.packages++;
+		break;
+	case CODE_MEASUREMENT_DONE:
+		if (writer->format == MSSEGMENT_CSV)
+			MSCsvWriteText(&writer->csv, "\n");
+		if (!nscans)
+			writer->inLoop = 0;
+		break;
+	default:
+		break;
+	}
+	if (writer->format == MSSEGMENT_RESULT)
+		SetError(writer, MSResultWriterAddEvent(&writer->results, code, line, length, package));
+	writer->segment.endUs = now;
+	return writer->error;
+}
+
+
+//
+// See documentation in MSSegmentWriter.h
+//
+void MSSegmentWriterOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	MSSegmentWriterAddEvent(context, event, line, length, package);
+}
+
+
+//
+// See documentation in MSSegmentWriter.h
+//
+RetCode MSSegmentWriterClose(MSSegmentWriter *writer)
+{
+	FinishFormat(writer);
+	writer->segment.bytes = SegmentSize(writer);
+	SetError(writer, MSAsyncWriterClose(&writer->file));
+
+	if (writer->previousPending)
+		ListSegment(writer, &writer->previous);
+	ListSegment(writer, &writer->segment);
+	if (fclose(writer->manifest) != 0)
+		SetError(writer, CODE_ERROR);
+	writer->manifest = NULL;
+	return writer->error;
+}
@@ -0,0 +1,196 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSSegmentWriter.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSSegmentWriter stores the results of a measurement that runs for a long time in a series of files
+ *	(segments) of bounded size, instead of one file that keeps growing. A new segment is started when the
+ *	current one reaches a size, a duration or a number of measurement loops. Segments are CSV files in the
+ *	format of MSCsvWriter or result files of MSResultWriter, and are written on a background thread with
+ *	an MSAsyncWriter, so starting a new segment does not hold up the measurement.
+ *
+ *	A manifest lists every finished segment with its time range, the measurement loops it contains and
+ *	its size, so a reader can find the segment it needs without opening the others. A segment is added to
+ *	the manifest once its file has been written and closed: listed segments do not change any more and
+ *	can be compressed or moved while the measurement continues.
+ *
+ *	For the base path "Results/Run", the segments are "Results/Run_000001.csv" (or ".msres"), "Results/Run_000002.csv"
+ *	and so on, and the manifest is "Results/Run_manifest.csv", a CSV file with one line per segment:
+ *	  segment,file,start_time,end_time,first_loop,last_loop,packages,bytes
+ *	The times are in seconds since 1970 (UTC). Loops are numbered from 1 over all segments; a loop that
+ *	is split over two segments is listed in both, and 0 means that the segment contains no loop.
+ *
+ *	A writer must not be used by more than one thread at a time.
+ *
+ ============================================================================
+ */
+
+#ifndef MSSEGMENTWRITER_H
+#define MSSEGMENTWRITER_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "MSAsyncWriter.h"
+#include "MSComm.h"
+#include "MSCsvWriter.h"
+#include "MSResultFile.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+/// The maximum length of the base path of the segments
+#define MSSEGMENT_MAX_PATH	512
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// The file format of the segments
+///
+typedef enum _MSSegmentFormat
+{
+	MSSEGMENT_CSV,						// CSV files, see MSCsvWriter.h
+	MSSEGMENT_RESULT,					// Binary result files, see MSResultFile.h
+} MSSegmentFormat;
+
+///
+/// When to start a new segment. A limit of 0 is not used.
+///
+typedef struct _MSSegmentLimits
+{
+	uint64_t maxBytes;					// The size of a segment
+	uint32_t maxSeconds;				// The time since the start of a segment
+	uint32_t maxLoops;					// The number of measurement loops that start in a segment
+} MSSegmentLimits;
+
+///
+/// One segment, as listed in the manifest
+///
+typedef struct _MSSegmentInfo
+{
+	uint32_t number;					// Counting from 1
+	int64_t startUs;					// The time the segment was started, in microseconds since 1970 (UTC)
+	int64_t endUs;						// The time of the last response
+	uint64_t firstLoop;					// The first measurement loop, 0 if none
+	uint64_t lastLoop;
+	uint64_t packages;
+	uint64_t bytes;						// The size of the file
+} MSSegmentInfo;
+
+///
+/// Writes a series of segments
+///
+typedef struct _MSSegmentWriter
+{
+	char basePath[MSSEGMENT_MAX_PATH];
+	MSSegmentFormat format;
+	MSSegmentLimits limits;
+	FILE *manifest;
+	RetCode error;						// The first error that occurred, CODE_OK if none
+
+	MSAsyncWriter file;					// Writes the current segment, and finishes the previous one
+	MSCsvWriter csv;					// Formats the current segment if the format is MSSEGMENT_CSV
+	MSResultWriter results;				// Formats the current segment if the format is MSSEGMENT_RESULT
+
+	MSSegmentInfo segment;				// The current segment
+	uint64_t segmentStart;				// The value of `csv.written` when the current segment started
+	uint32_t segmentLoops;				// The number of loops that started in the current segment
+	MSSegmentInfo previous;				// The previous segment, until it is closed and listed in the manifest
+	int previousPending;				// Set if `previous` has not been listed yet
+
+	uint64_t loop;						// The number of the current measurement loop, 0 before the first loop
+	int inLoop;							// Set between the start and the end of a measurement loop
+	int loopPackages;					// The number of packages of the current loop, for the index column of the CSV
+	int needHeader;						// Set if the CSV header must be written before the next package
+} MSSegmentWriter;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Creates the manifest and the first segment. Existing segments and manifest with the same base path are overwritten.
+///
+/// parameters:
+///   writer    - The writer to initialise
+///   basePath  - The path of the files without segment number and extension, e.g. "./Results/Run"
+///   format    - The file format of the segments
+///   limits    - When to start a new segment
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if a parameter is NULL, CODE_OUT_OF_RANGE if the base path is too long
+///   or CODE_ERROR if a file could not be created or out of memory.
+///
+RetCode MSSegmentWriterOpen(MSSegmentWriter *writer, const char *basePath, MSSegmentFormat format,
+		const MSSegmentLimits *limits);
+
+
+///
+/// Adds the result of `ReceivePackage()` or a line of a MSParser, like `MSResultWriterAddEvent()`:
+/// a package is added to the current segment, CODE_MEASURING starts a measurement loop and
+/// CODE_MEASUREMENT_DONE ends it, except for the nscans lines ('C' and '-'). `line` may be NULL if it
+/// is not known. If the current segment has reached a limit, a new segment is started first. This is
+/// only done before a package or a new loop, and the size of a result file segment is only checked
+/// when its buffered rows are written.
+///
+/// Returns:
+///   CODE_OK if successful, or the first error of the writer.
+///
+RetCode MSSegmentWriterAddEvent(MSSegmentWriter *writer, RetCode code, const char *line, size_t length,
+		const MscrPackage *package);
+
+
+///
+/// Event function for `MSParserInit()` that calls `MSSegmentWriterAddEvent()`, `context` must be the MSSegmentWriter
+///
+void MSSegmentWriterOnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package);
+
+
+///
+/// Writes and closes the last segment and completes the manifest
+///
+/// Returns:
+///   CODE_OK if all segments were written, otherwise the first error of the writer.
+///
+RetCode MSSegmentWriterClose(MSSegmentWriter *writer);
+
+
+#endif //MSSEGMENTWRITER_H
@@ -0,0 +1,331 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : MSValueDecoder.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "MSValueDecoder.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define MSCR_VALUE_DECODER_X86	1
+	#include <immintrin.h>
+#else
+	#define MSCR_VALUE_DECODER_X86	0
+#endif
+
+
+/// Function type of the different decoder implementations
+typedef void (*DecodeValueFieldsFunc)(const char * const *fields, size_t count, double *values);
+
+/// Look up tables from SI unit prefix character to the power of 1000 the value is multiplied by
+/// (NAN for invalid prefixes) and the power of 1000 it is divided by. One of the two is always 1.
+/// Dividing by 1e3 instead of multiplying by 1e-3 rounds once, so the values equal those of `ExactValueToDouble()`.
+static double s_prefixMultipliers[256];
+static double s_prefixDivisors[256];
+
+/// Look up table from character to hexadecimal digit value (-1 for non hexadecimal characters)
+static signed char s_hexDigits[256];
+
+/// The decoder implementation selected for this processor, set by `InitValueDecoder()`
+static DecodeValueFieldsFunc s_decodeFunc = NULL;
+static const char *s_decoderName = NULL;
+static pthread_once_t s_decoderOnce = PTHREAD_ONCE_INIT;
+
+
+//
+// Decodes a single value field. Also used for the remaining fields and invalid fields of the vector implementations.
+//
+static double DecodeValueFieldScalar(const char *field)
+{
+	int value = 0;
+	for (int i = 0; i < MSCR_VALUE_FIELD_LENGTH - 1; i++)
+	{
+		int digit = s_hexDigits[(unsigned char)field[i]];
+		if (digit < 0)
+			return NAN;
+		value = (value << 4) | digit;
+	}
+	unsigned char prefix = field[MSCR_VALUE_FIELD_LENGTH - 1];
+	return (double)(value - MSCR_PARAM_OFFSET_VALUE) * s_prefixMultipliers[prefix] / s_prefixDivisors[prefix];
+}
+
+
+//
+// Scalar implementation, used if no vector instructions are available
+//
+static void DecodeValueFieldsScalar(const char * const *fields, size_t count, double *values)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		values[i] = DecodeValueFieldScalar(fields[i]);
+	}
+}
+
+
+#if MSCR_VALUE_DECODER_X86
+
+//
+// SSE2 implementation, decodes 2 fields (one per 64 bit half) per iteration.
+//
+// The 7 digits of every field are converted to nibbles, the SI unit prefix byte is cleared so the
+// field is an 8 digit number that is 16 times too large. The nibbles are then combined into bytes,
+// 16 bit words and finally one 32 bit value per field using multiply-add instructions.
+//
+__attribute__((target("sse2")))
+static void DecodeValueFieldsSse2(const char * const *fields, size_t count, double *values)
+{
+	const __m128i digitMask  = _mm_set_epi8(0, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i nibbleMul  = _mm_set1_epi32(0x00010010); // Multiply the high nibble by 16 and add the low nibble
+	const __m128i byteMul    = _mm_set1_epi32(0x00010100); // Multiply the high byte by 256 and add the low byte
+	const __m128i paramOffset = _mm_set1_epi32(MSCR_PARAM_OFFSET_VALUE);
+	size_t i = 0;
+
+	for (; i + 2 <= count; i += 2)
+	{
+		uint64_t fieldA, fieldB;
+		memcpy(&fieldA, fields[i], sizeof(fieldA));
+		memcpy(&fieldB, fields[i + 1], sizeof(fieldB));
+		__m128i chars = _mm_set_epi64x((long long)fieldB, (long long)fieldA);
+
+		// Validate the digits: '0'-'9', 'A'-'F' or 'a'-'f'
+		__m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+		__m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+		__m128i isHexLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+		__m128i invalid = _mm_andnot_si128(_mm_or_si128(isDigit, isHexLetter), digitMask);
+		if (_mm_movemask_epi8(invalid) != 0)
+		{
+			values[i]     = DecodeValueFieldScalar(fields[i]);
+			values[i + 1] = DecodeValueFieldScalar(fields[i + 1]);
+			continue;
+		}
+
+		// Characters to nibbles: the low 4 bits, plus 9 for letters (bit 6 set)
+		__m128i isLetter = _mm_cmpeq_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x40)), _mm_set1_epi8(0x40));
+		__m128i nibbles = _mm_add_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x0F)), _mm_and_si128(isLetter, _mm_set1_epi8(9)));
+		nibbles = _mm_and_si128(nibbles, digitMask);
+
+		// Nibbles to bytes, bytes to 16 bit words and words to the 32 bit values in lane 0 and 2
+		__m128i bytesA = _mm_madd_epi16(_mm_unpacklo_epi8(nibbles, _mm_setzero_si128()), nibbleMul);
+		__m128i bytesB = _mm_madd_epi16(_mm_unpackhi_epi8(nibbles, _mm_setzero_si128()), nibbleMul);
+		__m128i words = _mm_madd_epi16(_mm_packs_epi32(bytesA, bytesB), byteMul);
+		__m128i raw = _mm_add_epi32(_mm_slli_epi32(words, 16), _mm_srli_epi64(words, 32));
+		raw = _mm_sub_epi32(_mm_srli_epi32(raw, 4), paramOffset);
+
+		__m128d scaled = _mm_cvtepi32_pd(_mm_shuffle_epi32(raw, _MM_SHUFFLE(3, 1, 2, 0)));
+		unsigned char prefixA = fields[i][MSCR_VALUE_FIELD_LENGTH - 1];
+		unsigned char prefixB = fields[i + 1][MSCR_VALUE_FIELD_LENGTH - 1];
+		__m128d multipliers = _mm_set_pd(s_prefixMultipliers[prefixB], s_prefixMultipliers[prefixA]);
+		__m128d divisors = _mm_set_pd(s_prefixDivisors[prefixB], s_prefixDivisors[prefixA]);
+		_mm_storeu_pd(&values[i], _mm_div_pd(_mm_mul_pd(scaled, multipliers), divisors));
+	}
+
+	DecodeValueFieldsScalar(&fields[i], count - i, &values[i]);
+}
+
+
+//
+// AVX2 implementation, decodes 4 fields per iteration.
+// This is the same algorithm as the SSE2 implementation, with 2 fields in each 128 bit lane.
+//
+__attribute__((target("avx2")))
+static void DecodeValueFieldsAvx2(const char * const *fields, size_t count, double *values)
+{
+	const __m256i digitMask  = _mm256_set1_epi64x(0x00FFFFFFFFFFFFFFLL);
+	const __m256i nibbleMul  = _mm256_set1_epi32(0x00010010);
+	const __m256i byteMul    = _mm256_set1_epi32(0x00010100);
+	const __m256i paramOffset = _mm256_set1_epi32(MSCR_PARAM_OFFSET_VALUE);
+	const __m256i laneSelect = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		uint64_t field[4];
+		for (int f = 0; f < 4; f++)
+			memcpy(&field[f], fields[i + f], sizeof(field[f]));
+		__m256i chars = _mm256_set_epi64x((long long)field[3], (long long)field[2], (long long)field[1], (long long)field[0]);
+
+		__m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+		__m256i isDigit = _mm256_andnot_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('9')), _mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)));
+		__m256i isHexLetter = _mm256_andnot_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('f')), _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)));
+		__m256i invalid = _mm256_andnot_si256(_mm256_or_si256(isDigit, isHexLetter), digitMask);
+		if (_mm256_movemask_epi8(invalid) != 0)
+		{
+			DecodeValueFieldsScalar(&fields[i], 4, &values[i]);
+			continue;
+		}
+
+		__m256i isLetter = _mm256_cmpeq_epi8(_mm256_and_si256(chars, _mm256_set1_epi8(0x40)), _mm256_set1_epi8(0x40));
+		__m256i nibbles = _mm256_add_epi8(_mm256_and_si256(chars, _mm256_set1_epi8(0x0F)), _mm256_and_si256(isLetter, _mm256_set1_epi8(9)));
+		nibbles = _mm256_and_si256(nibbles, digitMask);
+
+		__m256i bytesA = _mm256_madd_epi16(_mm256_unpacklo_epi8(nibbles, _mm256_setzero_si256()), nibbleMul);
+		__m256i bytesB = _mm256_madd_epi16(_mm256_unpackhi_epi8(nibbles, _mm256_setzero_si256()), nibbleMul);
+		__m256i words = _mm256_madd_epi16(_mm256_packs_epi32(bytesA, bytesB), byteMul);
+		__m256i raw = _mm256_add_epi32(_mm256_slli_epi32(words, 16), _mm256_srli_epi64(words, 32));
+		raw = _mm256_sub_epi32(_mm256_srli_epi32(raw, 4), paramOffset);
+
+		__m256d scaled = _mm256_cvtepi32_pd(_mm256_castsi256_si128(_mm256_permutevar8x32_epi32(raw, laneSelect)));
+		unsigned char prefix[4];
+		for (int f = 0; f < 4; f++)
+			prefix[f] = fields[i + f][MSCR_VALUE_FIELD_LENGTH - 1];
+		__m256d multipliers = _mm256_set_pd(s_prefixMultipliers[prefix[3]], s_prefixMultipliers[prefix[2]],
+		                                    s_prefixMultipliers[prefix[1]], s_prefixMultipliers[prefix[0]]);
+		__m256d divisors = _mm256_set_pd(s_prefixDivisors[prefix[3]], s_prefixDivisors[prefix[2]],
+		                                 s_prefixDivisors[prefix[1]], s_prefixDivisors[prefix[0]]);
+		_mm256_storeu_pd(&values[i], _mm256_div_pd(_mm256_mul_pd(scaled, multipliers), divisors));
+	}
+
+	// The remaining 1 to 3 fields, e.g. of a single package line
+	DecodeValueFieldsSse2(&fields[i], count - i, &values[i]);
+}
+
+#endif // MSCR_VALUE_DECODER_X86
+
+
+//
+// Fills the look up tables and selects the fastest implementation for this processor.
+// Must only be called through `pthread_once()` with `s_decoderOnce`, which also makes the tables
+// visible to every thread that decodes values.
+//
+static void InitValueDecoder()
+{
+	// The SI unit prefixes, the index of a prefix is its exponent (power of 1000) + 6
+	static const char prefixes[] = "afpnum kMGTPE";
+	static const double powersOf1000[7] = { 1, 1e3, 1e6, 1e9, 1e12, 1e15, 1e18 };
+
+	for (int c = 0; c < 256; c++)
+	{
+		s_prefixMultipliers[c] = NAN;
+		s_prefixDivisors[c] = 1;
+
+		if (c >= '0' && c <= '9')
+			s_hexDigits[c] = c - '0';
+		else if (c >= 'A' && c <= 'F')
+			s_hexDigits[c] = c - 'A' + 10;
+		else if (c >= 'a' && c <= 'f')
+			s_hexDigits[c] = c - 'a' + 10;
+		else
+			s_hexDigits[c] = -1;
+	}
+	for (int i = 0; prefixes[i] != '\0'; i++)
+	{
+		int exponent = i - 6;
+		unsigned char c = prefixes[i];
+		if (exponent >= 0)
+			s_prefixMultipliers[c] = powersOf1000[exponent];
+		else
+		{
+			s_prefixMultipliers[c] = 1;
+			s_prefixDivisors[c] = powersOf1000[-exponent];
+		}
+	}
+
+#if MSCR_VALUE_DECODER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		s_decoderName = "avx2";
+		s_decodeFunc = DecodeValueFieldsAvx2;
+		return;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		s_decoderName = "sse2";
+		s_decodeFunc = DecodeValueFieldsSse2;
+		return;
+	}
+#endif
+	s_decoderName = "scalar";
+	s_decodeFunc = DecodeValueFieldsScalar;
+}
+
+
+//
+// See documentation in MSValueDecoder.h
+//
+void DecodeValueFields(const char * const *fields, size_t count, double *values)
+{
+	pthread_once(&s_decoderOnce, InitValueDecoder);
+	s_decodeFunc(fields, count, values);
+}
+
+
+//
+// See documentation in MSValueDecoder.h
+//
+int FindValueFields(const char *line, size_t length, const char **fields, int maxFields)
+{
+	const char *p = line;
+	const char *end = line + length;
+	int nrOfFields = 0;
+
+	// Find the beginning of the package
+	while (p < end && *p != REPLY_MEASURE_DP)
+	{
+		if (*p == '\n' || *p == '\0')
+			return CODE_UNEXPECTED_DATA;
+		p++;
+	}
+	if (p == end)
+		return CODE_UNEXPECTED_DATA;
+	p++;
+
+	while (p < end && *p != '\n' && *p != '\0')
+	{
+		if (*p == ';')
+		{
+			p++;
+			continue;
+		}
+		// 2 characters variable type, 8 characters value
+		if (end - p < 10 || nrOfFields >= maxFields)
+			return CODE_UNEXPECTED_DATA;
+		fields[nrOfFields++] = p + 2;
+		p += 10;
+
+		// Skip the metadata
+		while (p < end && *p != ';' && *p != '\n' && *p != '\0')
+			p++;
+	}
+	return nrOfFields;
+}
+
+
+//
+// See documentation in MSValueDecoder.h
+//
+const char* GetValueDecoderName()
+{
+	pthread_once(&s_decoderOnce, InitValueDecoder);
+	return s_decoderName;
+}
@@ -0,0 +1,112 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : MSValueDecoder.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * MSValueDecoder decodes batches of MethodSCRIPT value fields.
+ *	Every subpackage in a MethodSCRIPT data package carries a value field of exactly 8 characters:
+ *	7 hexadecimal digits followed by one SI unit prefix character.
+ *	Where `ParsePackageLine()` decodes these one by one into the `float` values of a `MscrPackage`,
+ *	this module decodes many fields in one call into `double` values. This is intended for offline
+ *	processing of large amounts of recorded data; `MSDatasetAddEvent()` uses it for every package line
+ *	it gets. The values are rounded once, so they equal those of `ExactValueToDouble()`.
+ *
+ *	On x86 processors the fields are decoded with SSE2 or AVX2 instructions. The implementation is
+ *	selected at runtime based on the capabilities of the processor, on other platforms (or if no
+ *	vector instructions are available) a scalar implementation is used.
+ *
+ ============================================================================
+ */
+
+#ifndef MSVALUEDECODER_H
+#define MSVALUEDECODER_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include "MSComm.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and macros
+//////////////////////////////////////////////////////////////////////////////
+
+/// The number of characters in a MethodSCRIPT value field (7 hexadecimal digits and the SI unit prefix)
+#define MSCR_VALUE_FIELD_LENGTH	8
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Decodes a batch of MethodSCRIPT value fields into scaled values.
+/// The values are calculated in double precision, so they are more accurate than the `float` values
+/// stored in a `MscrSubPackage`. Fields containing invalid characters are decoded as NAN.
+/// This is thread safe; the look up tables are initialized once on the first call.
+///
+/// parameters:
+///   fields   - Array of `count` pointers to value fields. Each field must have at least 8 readable characters
+///   count    - The number of fields to decode
+///   values   - The array in which the `count` decoded values are stored
+///
+void DecodeValueFields(const char * const *fields, size_t count, double *values);
+
+
+///
+/// Finds the value fields of all subpackages in one MethodSCRIPT data package line.
+/// The returned pointers point into `line`, so they can be passed to `DecodeValueFields()` directly.
+/// This can be called for several lines first to decode all values of a batch of lines at once.
+///
+/// parameters:
+///   line        - The package line, starting with 'P' and ending at '\n', '\0' or `length`
+///   length      - The maximum number of characters to read from `line`
+///   fields      - The array in which the pointers to the value fields are stored
+///   maxFields   - The size of the `fields` array
+///
+/// Returns:
+///   The number of value fields found, or CODE_UNEXPECTED_DATA if the line is not a valid package
+///   or contains more than `maxFields` subpackages.
+///
+int FindValueFields(const char *line, size_t length, const char **fields, int maxFields);
+
+
+///
+/// Returns the name of the value decoder implementation that is used on this processor
+/// ("avx2", "sse2" or "scalar"). This is useful for logging and benchmarking.
+///
+const char* GetValueDecoderName();
+
+
+#endif //MSVALUEDECODER_H
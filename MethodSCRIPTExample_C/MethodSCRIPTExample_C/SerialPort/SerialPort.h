@@ -8,6 +8,77 @@
 #ifndef SERIALPORT_H_
 #define SERIALPORT_H_
 
+#include "MethodSCRIPTcomm/MSCommon.h"
+
+#ifdef __WIN32
+	#include <windows.h>
+#endif
+
+
+// Size of the receive ring buffer of a serial port, must be a power of 2
+#define SERIAL_RX_RING_SIZE 4096
+
+///
+/// One opened serial port. All state of a port is stored here, so any number of ports can be used
+/// at the same time, each with its own MSComm (see `SerialPortGetTransport`).
+///
+typedef struct _SerialPort
+{
+#ifdef __WIN32
+	HANDLE handle;						// Serial port handle
+#else
+	int fd;								// File descriptor of the serial port
+	// Receive ring buffer. Data is read from the serial port in blocks that are as large as possible and
+	// then handed out from here, so reading one character at a time does not need a system call per character.
+	// The indices run freely and are masked when accessing `rx_ring`.
+	unsigned int rx_head;				// Write index
+	unsigned int rx_tail;				// Read index
+	char rx_ring[SERIAL_RX_RING_SIZE];
+	int write_timeout_ms;				// Maximum time a write waits for room in the output buffer, < 0 to wait forever.
+										// Set to READ_TIMEOUT_MS by `SerialPortOpen`, so writes give up after as long as reads.
+#endif
+} SerialPort;
+
+
+/// Opens a serial port to which an EmStat Pico is connected.
+/// Returns: 1 on successful connection, 0 in case of failure.
+int SerialPortOpen(SerialPort *port, const char *name, int baudrate);
+
+/// Closes the serial port
+/// Returns: 1 if closed successfully, 0 in case of failure.
+int SerialPortClose(SerialPort *port);
+
+/// Fills in the communication functions for a MSComm that uses this serial port (see `MSCommInitTransport`)
+void SerialPortGetTransport(SerialPort *port, MSTransport *transport);
+
+/// Writes the input character to the device. `port` is the SerialPort.
+/// Returns: 1 if data is written successfully, 0 in case of failure.
+int SerialPortWriteChar(void *port, char c);
+
+/// Writes a list of data blocks to the device with as few system calls as possible. `port` is the SerialPort.
+/// On Linux this waits at most `write_timeout_ms` of the port for room in the output buffer.
+/// Returns: the number of bytes written, or -1 in case of failure or timeout.
+int SerialPortWriteBlocks(void *port, const MSWriteBlock *blocks, int count);
+
+/// Reads a character from the device. `port` is the SerialPort.
+/// Returns: -1 on failure or end-of-file (hang-up), 0 if no data was available or the value of the received byte on success
+int SerialPortReadChar(void *port);
+
+/// Reads up to `size` bytes that were received from the device into `buf`. `port` is the SerialPort.
+/// Returns: the number of bytes read, 0 if no data was available (also after an interrupted read) or -1 on failure
+///          or end-of-file (hang-up)
+int SerialPortReadBlock(void *port, char *buf, int size);
+
+/// Waits until data from the device can be read, or until `*timeout_ms` has passed (forever if < 0)
+/// `*timeout_ms` is decreased by the time spent waiting. `port` is the SerialPort.
+/// Returns: 1 if data is available, 0 on timeout or -1 on failure
+int SerialPortWait(void *port, int *timeout_ms);
+
+
+//
+// Functions for a single serial port, kept for existing code. These use one default SerialPort
+// that is opened with the settings from MethodSCRIPTExample.h.
+//
 
 /// Opens the serial port to which Emstat pico is connected.
 /// Returns: 1 on successful connection, 0 in case of failure.
@@ -17,10 +88,24 @@ int OpenSerialPort();
 /// Returns: 1 if data is written successfully, 0 in case of failure.
 int WriteToDevice(char c);
 
+/// Writes a list of data blocks to the device with as few system calls as possible
+/// Returns: the number of bytes written, or -1 in case of failure.
+int WriteBlocksToDevice(const MSWriteBlock *blocks, int count);
+
 /// Reads a character read from the EmStat Pico
 /// Returns: -1 on failure or the value of the received byte on success
 int ReadFromDevice();
 
+/// Reads up to `size` bytes that were received from the EmStat Pico into `buf`
+/// Returns: the number of bytes read, 0 if no data was available (also after an interrupted read) or -1 on failure
+///          or end-of-file (hang-up)
+int ReadBlockFromDevice(char *buf, int size);
+
+/// Waits until data from the EmStat Pico can be read, or until `*timeout_ms` has passed (forever if < 0)
+/// `*timeout_ms` is decreased by the time spent waiting.
+/// Returns: 1 if data is available, 0 on timeout or -1 on failure
+int WaitForDevice(int *timeout_ms);
+
 /// Closes the serial port
 /// Returns: 1 if closed successfully, 0 in case of failure.
 int CloseSerialPort();
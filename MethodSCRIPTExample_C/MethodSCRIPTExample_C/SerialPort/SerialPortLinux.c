@@ -1,7 +1,12 @@
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <termios.h> // Serial port interface on Linux
 
 // PalmSens includes
@@ -12,7 +17,8 @@
 #define FAILURE 0
 #define SUCCESS 1
 
-int fd; // File descriptor for serial port
+// The serial port used by the functions without a SerialPort argument
+static SerialPort default_port = { .fd = -1 };
 
 
 // Look up element for coversion between int and speed_t
@@ -86,12 +92,52 @@ speed_t baud_to_termios(int request_baud)
 
 
 //
+// Reads as much data as is available and fits into the receive ring buffer with a single system call.
+// Returns the number of bytes read, 0 if no data was available or -1 on failure.
 //
+static int FillRxRing(SerialPort *port)
+{
+	unsigned int free_space = SERIAL_RX_RING_SIZE - (port->rx_head - port->rx_tail);
+	unsigned int offset = port->rx_head & (SERIAL_RX_RING_SIZE - 1);
+	struct iovec iov[2];
+	int iovcnt = 1;
+
+	if (free_space == 0)
+		return 0;
+
+	// The free space wraps around the end of the ring if the write index is past the read index
+	iov[0].iov_base = &port->rx_ring[offset];
+	iov[0].iov_len = SERIAL_RX_RING_SIZE - offset;
+	if (iov[0].iov_len >= free_space)
+	{
+		iov[0].iov_len = free_space;
+	}
+	else
+	{
+		iov[1].iov_base = port->rx_ring;
+		iov[1].iov_len = free_space - iov[0].iov_len;
+		iovcnt = 2;
+	}
+
+	ssize_t bytes_read = readv(port->fd, iov, iovcnt);
+	if (bytes_read == 0)
+		return -1; // End-of-file, the device hung up
+	if (bytes_read < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	port->rx_head += bytes_read;
+	return bytes_read;
+}
+
+
 //
-int OpenSerialPort()
+//
+//
+int SerialPortOpen(SerialPort *port, const char *name, int baudrate)
 {
-	fd = open(SERIAL_PORT_NAME, O_RDWR | O_NOCTTY | O_NDELAY);
-	if (fd == -1)
+	port->rx_head = port->rx_tail = 0;
+	port->write_timeout_ms = READ_TIMEOUT_MS;
+	port->fd = open(name, O_RDWR | O_NOCTTY | O_NDELAY);
+	if (port->fd == -1)
 	{
 		printf("Unable to open serial port.\n");
 		return FAILURE;
@@ -102,16 +148,17 @@ int OpenSerialPort()
 	//
 	// Get the current configuration of the serial interface
 	//
-	if(tcgetattr(fd, &config) < 0)
+	if(tcgetattr(port->fd, &config) < 0)
 	{
 		printf("Unable to get initial serial port configuration\n");
+		SerialPortClose(port);
 		return FAILURE;
 	}
 
 	//
 	// Set baudrate for both input and output
 	//
-	speed_t baud_config = baud_to_termios(BAUD_RATE);
+	speed_t baud_config = baud_to_termios(baudrate);
 
 	cfsetispeed(&config, baud_config);
 	cfsetospeed(&config, baud_config);
@@ -140,9 +187,10 @@ int OpenSerialPort()
 	config.c_cflag |= CS8 |CREAD | CLOCAL;
 
 
-	if (tcsetattr(fd, TCSANOW, &config) != 0)
+	if (tcsetattr(port->fd, TCSANOW, &config) != 0)
 	{
 		printf("Unable to set serial port configuration\n");
+		SerialPortClose(port);
 		return FAILURE;
 	}
 
@@ -153,29 +201,249 @@ int OpenSerialPort()
 //
 //
 //
-int WriteToDevice(char tx_char)
+int SerialPortClose(SerialPort *port)
+{
+	if (port->fd >= 0)
+		close(port->fd);
+	port->fd = -1;
+	port->rx_head = port->rx_tail = 0;
+	return SUCCESS;
+}
+
+
+//
+//
+//
+void SerialPortGetTransport(SerialPort *port, MSTransport *transport)
+{
+	transport->context = port;
+	transport->write_char = SerialPortWriteChar;
+	transport->write_buf = SerialPortWriteBlocks;
+	transport->read_char = SerialPortReadChar;
+	transport->read_buf = SerialPortReadBlock;
+	transport->wait_read = SerialPortWait;
+}
+
+
+//
+//
+//
+int SerialPortWriteChar(void *port, char tx_char)
 {
-	int n = write(fd, &tx_char, 1);
+	int n = write(((SerialPort *)port)->fd, &tx_char, 1);
 	if (n < 0)
 	  return FAILURE;
 	return SUCCESS;
 }
 
 
+//
+//
+//
+int SerialPortWriteBlocks(void *port, const MSWriteBlock *blocks, int count)
+{
+	int fd = ((SerialPort *)port)->fd;
+	int timeout_ms = ((SerialPort *)port)->write_timeout_ms; // Shared by all waits of this call
+	struct iovec iov[64];
+	int total = 0;
+	int block = 0;
+	int offset = 0; // Number of bytes of `blocks[block]` that were already written
+
+	while (block < count)
+	{
+		// Gather as many blocks as possible into one writev call
+		int iovcnt = 0;
+		for (int i = block; i < count && iovcnt < 64; i++)
+		{
+			int skip = (i == block) ? offset : 0;
+			iov[iovcnt].iov_base = (void *)(blocks[i].data + skip);
+			iov[iovcnt].iov_len = blocks[i].length - skip;
+			iovcnt++;
+		}
+
+		ssize_t n = writev(fd, iov, iovcnt);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return -1;
+			// The output buffer of the port is full, wait until there is room again
+			struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+			struct timespec start, now;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			int ready = poll(&pfd, 1, timeout_ms);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (ready < 0 && errno != EINTR)
+				return -1;
+			if (ready == 0)
+			{
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			if (timeout_ms > 0)
+			{
+				long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+				timeout_ms = (elapsed_ms < timeout_ms) ? timeout_ms - elapsed_ms : 0;
+			}
+			continue;
+		}
+		total += n;
+
+		// Skip the blocks that were written completely
+		while (block < count && n >= blocks[block].length - offset)
+		{
+			n -= blocks[block].length - offset;
+			offset = 0;
+			block++;
+		}
+		offset += n;
+	}
+	return total;
+}
+
+
+//
+//
+//
+int SerialPortReadChar(void *port)
+{
+	SerialPort *serial_port = port;
+	if (serial_port->rx_head == serial_port->rx_tail)
+	{
+		int bytes_read = FillRxRing(serial_port);
+		if (bytes_read <= 0)
+			return bytes_read;
+	}
+	return (unsigned char)serial_port->rx_ring[serial_port->rx_tail++ & (SERIAL_RX_RING_SIZE - 1)];
+}
+
+
+//
+//
+//
+int SerialPortReadBlock(void *port, char *buf, int size)
+{
+	SerialPort *serial_port = port;
+	unsigned int available = serial_port->rx_head - serial_port->rx_tail;
+
+	// No buffered data, read straight into the buffer of the caller to avoid copying
+	if (available == 0)
+	{
+		int bytes_read = read(serial_port->fd, buf, size);
+		if (bytes_read > 0 || size == 0)
+			return bytes_read;
+		if (bytes_read == 0)
+			return -1; // End-of-file, the device hung up
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	}
+
+	// Hand out the buffered data (in at most 2 parts if it wraps around the end of the ring)
+	if ((unsigned int)size > available)
+		size = available;
+	for (int copied = 0; copied < size; )
+	{
+		unsigned int offset = serial_port->rx_tail & (SERIAL_RX_RING_SIZE - 1);
+		unsigned int part = SERIAL_RX_RING_SIZE - offset;
+		if (part > (unsigned int)(size - copied))
+			part = size - copied;
+		memcpy(buf + copied, &serial_port->rx_ring[offset], part);
+		serial_port->rx_tail += part;
+		copied += part;
+	}
+	return size;
+}
+
+
+//
+//
+//
+int SerialPortWait(void *port, int *timeout_ms)
+{
+	SerialPort *serial_port = port;
+	struct pollfd pfd = { .fd = serial_port->fd, .events = POLLIN };
+	struct timespec start, now;
+	int ready;
+
+	// Data that was already read from the port is available immediately
+	if (serial_port->rx_head != serial_port->rx_tail)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ready = poll(&pfd, 1, *timeout_ms); // Sleeps until data arrives instead of spinning on the non-blocking port
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (*timeout_ms > 0)
+	{
+		long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+		*timeout_ms = (elapsed_ms < *timeout_ms) ? *timeout_ms - elapsed_ms : 0;
+	}
+
+	if (ready < 0)
+		return (errno == EINTR) ? 1 : -1; // Interrupted by a signal, let the caller check again
+	if (ready > 0 && (pfd.revents & (POLLERR | POLLHUP)))
+	{
+		// Error or hang-up, e.g. the USB cable was disconnected. The port stays readable from then on,
+		// so only report the data that was received before it.
+		int pending = 0;
+		if (!(pfd.revents & POLLIN) || ioctl(serial_port->fd, FIONREAD, &pending) < 0 || pending == 0)
+			return -1;
+	}
+	return ready;
+}
+
+
+//
+//
+//
+int OpenSerialPort()
+{
+	return SerialPortOpen(&default_port, SERIAL_PORT_NAME, BAUD_RATE);
+}
+
+
+//
+//
+//
+int WriteToDevice(char tx_char)
+{
+	return SerialPortWriteChar(&default_port, tx_char);
+}
+
+
+//
+//
+//
+int WriteBlocksToDevice(const MSWriteBlock *blocks, int count)
+{
+	return SerialPortWriteBlocks(&default_port, blocks, count);
+}
+
+
 //
 //
 //
 int ReadFromDevice()
 {
-	char rx_char;
-	int bytes_read = read(fd, &rx_char, 1); /* Read the data */
+	return SerialPortReadChar(&default_port);
+}
 
-	if (bytes_read > 0)
-		return rx_char;
-	else if (bytes_read == 0)
-		return 0;
-	else
-		return -1;
+
+//
+//
+//
+int ReadBlockFromDevice(char *buf, int size)
+{
+	return SerialPortReadBlock(&default_port, buf, size);
+}
+
+
+//
+//
+//
+int WaitForDevice(int *timeout_ms)
+{
+	return SerialPortWait(&default_port, timeout_ms);
 }
 
 
@@ -184,7 +452,8 @@ int ReadFromDevice()
 //
 int CloseSerialPort()
 {
-	close(fd);
-	return SUCCESS;
+	return SerialPortClose(&default_port);
 }
 
+
+
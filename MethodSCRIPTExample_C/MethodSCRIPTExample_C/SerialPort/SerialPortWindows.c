@@ -7,17 +7,17 @@
 #include "SerialPort.h"
 
 
-HANDLE hCom;				// Serial port handle
-DWORD dwBytesWritten = 0;	// Number of bytes written variable for serial WriteFile function
+// The serial port used by the functions without a SerialPort argument
+static SerialPort default_port = { .handle = INVALID_HANDLE_VALUE };
 
 //
 //
 //
-int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
+int SerialPortOpen(SerialPort *port, const char *name, int baudrate)
 {
 	DCB dcb = { 0 };
 	BOOL fSuccess;
-	hCom = CreateFile(serial_port_name, GENERIC_READ | GENERIC_WRITE, 0,  		// must be opened with exclusive-access
+	HANDLE hCom = CreateFile(name, GENERIC_READ | GENERIC_WRITE, 0,  		// must be opened with exclusive-access
 									  NULL, 						    // no security attributes
 									  OPEN_EXISTING,					// must use OPEN_EXISTING
 									  0,								// not overlapped I/O
@@ -28,12 +28,14 @@ int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
 		printf("CreateFile failed with error %lu.\n", GetLastError());
 		return 0;
 	}
+	port->handle = hCom;
 
 	// Set up the port connection parameters using device control block (DCB)
 	fSuccess = GetCommState(hCom, &dcb);
 
 	if (!fSuccess) {
 		printf("GetCommState failed with error %lu.\n", GetLastError());
+		SerialPortClose(port);
 		return 0;
 	}
 
@@ -48,6 +50,7 @@ int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
 
 	if (!fSuccess) {
 		printf("SetCommState failed with error %lu.\n", GetLastError());
+		SerialPortClose(port);
 		return 0;
 	}
 
@@ -60,6 +63,7 @@ int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
 
 	if (!SetCommTimeouts(hCom, &timeouts)) {
 		printf("SetCommState failed with error %lu.\n", GetLastError());
+		SerialPortClose(port);
 		return 0;
 	}
 	fflush(stdout);
@@ -71,10 +75,36 @@ int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
 //
 //
 //
-int WriteToDevice(char c)
+int SerialPortClose(SerialPort *port)
 {
-	char writeChar[2] = {c,'\0'};
-	if (WriteFile(hCom, writeChar, 1, &dwBytesWritten, NULL))
+	if (port->handle != INVALID_HANDLE_VALUE)
+		CloseHandle(port->handle);
+	port->handle = INVALID_HANDLE_VALUE;
+	return 0;
+}
+
+
+//
+//
+//
+void SerialPortGetTransport(SerialPort *port, MSTransport *transport)
+{
+	transport->context = port;
+	transport->write_char = SerialPortWriteChar;
+	transport->write_buf = SerialPortWriteBlocks;
+	transport->read_char = SerialPortReadChar;
+	transport->read_buf = SerialPortReadBlock;
+	transport->wait_read = SerialPortWait;
+}
+
+
+//
+//
+//
+int SerialPortWriteChar(void *port, char c)
+{
+	DWORD dwBytesWritten;
+	if (WriteFile(((SerialPort *)port)->handle, &c, 1, &dwBytesWritten, NULL))
 	{
 		return 1;
 	}
@@ -85,11 +115,29 @@ int WriteToDevice(char c)
 //
 //
 //
-int ReadFromDevice()
+int SerialPortWriteBlocks(void *port, const MSWriteBlock *blocks, int count)
+{
+	HANDLE hCom = ((SerialPort *)port)->handle;
+	int total = 0;
+	for (int i = 0; i < count; i++)
+	{
+		DWORD written;
+		if (!WriteFile(hCom, blocks[i].data, blocks[i].length, &written, NULL))
+			return -1;
+		total += written;
+	}
+	return total;
+}
+
+
+//
+//
+//
+int SerialPortReadChar(void *port)
 {
 	char tempChar; 							// Temporary character used for reading
 	DWORD noBytesRead;
-	ReadFile(hCom, 							// Handle of the Serial port
+	ReadFile(((SerialPort *)port)->handle, 	// Handle of the Serial port
 			&tempChar, 						// Temporary character
 			sizeof(tempChar),				// Size of TempChar
 			&noBytesRead, 					// Number of bytes read
@@ -97,7 +145,117 @@ int ReadFromDevice()
 	//Check for timeout
 	if(noBytesRead != sizeof(tempChar))
 		return -1;							//Return -1 on timeout
-	return (int)tempChar;
+	return (unsigned char)tempChar;
+}
+
+
+//
+//
+//
+int SerialPortReadBlock(void *port, char *buf, int size)
+{
+	HANDLE hCom = ((SerialPort *)port)->handle;
+	COMSTAT comStat;
+	DWORD errors;
+	DWORD noBytesRead;
+	DWORD toRead = 1;						// Wait for at least one byte (until the read timeout) if nothing is queued
+
+	// Only request what is already queued, so the read does not wait for the rest of the buffer to fill up
+	if (ClearCommError(hCom, &errors, &comStat) && comStat.cbInQue > 0)
+		toRead = (comStat.cbInQue < (DWORD)size) ? comStat.cbInQue : (DWORD)size;
+
+	if (!ReadFile(hCom, buf, toRead, &noBytesRead, NULL))
+		return -1;
+	return (int)noBytesRead;
+}
+
+
+//
+//
+//
+int SerialPortWait(void *port, int *timeout_ms)
+{
+	HANDLE hCom = ((SerialPort *)port)->handle;
+	ULONGLONG start = GetTickCount64();
+	COMSTAT comStat;
+	DWORD errors;
+
+	for (;;)
+	{
+		if (!ClearCommError(hCom, &errors, &comStat))
+			return -1;
+		if (comStat.cbInQue > 0)
+			break;
+
+		ULONGLONG elapsed = GetTickCount64() - start;
+		if (*timeout_ms >= 0 && elapsed >= (ULONGLONG)*timeout_ms)
+		{
+			*timeout_ms = 0;
+			return 0;
+		}
+		Sleep(1); // Yield the processor until the next check
+	}
+
+	if (*timeout_ms > 0)
+	{
+		ULONGLONG elapsed = GetTickCount64() - start;
+		*timeout_ms = (elapsed < (ULONGLONG)*timeout_ms) ? *timeout_ms - (int)elapsed : 0;
+	}
+	return 1;
+}
+
+
+//
+//
+//
+int OpenSerialPort(char *serial_port_name, uint32_t baudrate)
+{
+	return SerialPortOpen(&default_port, serial_port_name, baudrate);
+}
+
+
+//
+//
+//
+int WriteToDevice(char c)
+{
+	return SerialPortWriteChar(&default_port, c);
+}
+
+
+//
+//
+//
+int WriteBlocksToDevice(const MSWriteBlock *blocks, int count)
+{
+	return SerialPortWriteBlocks(&default_port, blocks, count);
+}
+
+
+//
+//
+//
+int ReadFromDevice()
+{
+	return SerialPortReadChar(&default_port);
+}
+
+
+//
+//
+//
+int ReadBlockFromDevice(char *buf, int size)
+{
+	return SerialPortReadBlock(&default_port, buf, size);
+}
+
+
+//
+//
+//
+int WaitForDevice(int *timeout_ms)
+{
+	return SerialPortWait(&default_port, timeout_ms);
 }
 
 
@@ -106,7 +264,5 @@ int ReadFromDevice()
 //
 int CloseSerialPort()
 {
-	if (hCom != NULL)
-		CloseHandle(hCom);
-	return 0;
+	return SerialPortClose(&default_port);
 }
@@ -0,0 +1,231 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : SerialReactor.h
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * SerialReactor drives any number of EmStat Picos from a single thread on Linux.
+ *	The serial port of every device is registered with `epoll`. When data arrives it is read in blocks
+ *	and fed to a `MSParser` per device, which reports the received lines and packages to the event
+ *	function of that device. Devices are never blocked on, so one slow or silent device does not delay
+ *	the others.
+ *
+ *	Besides the events of `MSParser`, the event function of a device receives:
+ *	  CODE_TIMEOUT   No data was received from the device for longer than its timeout (line is NULL).
+ *	                 The timeout restarts, so this is reported again if the device stays silent.
+ *	  CODE_ERROR     The device was disconnected or reading failed (line is NULL). The device is
+ *	                 removed from the reactor, the serial port is left open for the caller to close.
+ *
+ *	Two backends are available, selected when the reactor is initialised:
+ *	  epoll      Waits for readiness with `epoll_wait` and then reads every ready port with `read`.
+ *	  io_uring   Keeps a read queued in the kernel for every port. All completed reads are collected
+ *	             and all new reads are queued with a single `io_uring_enter` call per iteration, so
+ *	             the number of system calls does not grow with the number of devices.
+ *	By default io_uring is used if the kernel supports it (Linux 5.7 or newer, not disabled by a
+ *	sysctl or seccomp filter), otherwise epoll.
+ *
+ *	Typical use:
+ *	  SerialReactorInit(&reactor);
+ *	  for every device: SerialPortOpen(&port[i], ...); SerialReactorAdd(&reactor, &device[i], &port[i], OnEvent, &state[i]);
+ *	  while (SerialReactorRun(&reactor, -1) > 0) {}
+ *	  SerialReactorClose(&reactor);
+ *
+ ============================================================================
+ */
+
+#ifndef SERIALREACTOR_H
+#define SERIALREACTOR_H
+
+//////////////////////////////////////////////////////////////////////////////
+// Includes
+//////////////////////////////////////////////////////////////////////////////
+
+#include "SerialPort.h"
+#include "MethodSCRIPTcomm/MSParser.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Constants and defines
+//////////////////////////////////////////////////////////////////////////////
+
+// Maximum number of ready devices handled per call of epoll_wait
+#define REACTOR_MAX_EVENTS		64
+
+// Number of bytes read from a device at once
+#define REACTOR_READ_SIZE		4096
+
+// Maximum number of devices of a reactor using the io_uring backend
+#define REACTOR_MAX_URING_DEVICES	256
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////////
+
+struct _SerialReactor;
+struct _ReactorUring;
+
+///
+/// The way a reactor waits for and reads data, see the description at the top of this file
+///
+typedef enum _ReactorBackend
+{
+	REACTOR_BACKEND_AUTO = 0,			// io_uring if supported by the kernel, otherwise epoll
+	REACTOR_BACKEND_EPOLL,
+	REACTOR_BACKEND_IO_URING,
+} ReactorBackend;
+
+///
+/// One EmStat Pico registered with a reactor. The memory is owned by the caller and must stay
+/// valid while the device is registered.
+///
+typedef struct _ReactorDevice
+{
+	struct _SerialReactor *reactor;		// The reactor this device is registered with, NULL if none
+	struct _ReactorDevice *next;		// Next device registered with the same reactor
+	SerialPort *port;					// The opened serial port of the device
+	MSParser parser;					// Parses the data received from the device
+	int timeoutMs;						// Maximum time without data before CODE_TIMEOUT is reported, -1 for none
+	long long deadline;					// Time (CLOCK_MONOTONIC, in ms) at which the timeout expires
+	int slot;							// Read buffer of the device in the io_uring backend, -1 if none
+} ReactorDevice;
+
+
+///
+/// Waits for data from a set of devices and dispatches it.
+///
+typedef struct _SerialReactor
+{
+	ReactorBackend backend;				// The backend in use, never REACTOR_BACKEND_AUTO
+	int epollFd;						// The epoll instance the serial ports are registered with
+	struct _ReactorUring *uring;		// State of the io_uring backend
+	int deviceCount;					// Number of registered devices
+	ReactorDevice *devices;				// List of registered devices
+	unsigned long removals;				// Number of devices removed, to notice removals by event functions
+} SerialReactor;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Functions
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Initialises a reactor without any devices, using io_uring if possible and epoll otherwise.
+///
+/// parameters:
+///   reactor  - The reactor to initialise
+///
+/// Returns:
+///   CODE_OK if successful, otherwise CODE_ERROR.
+///
+RetCode SerialReactorInit(SerialReactor *reactor);
+
+
+///
+/// Initialises a reactor without any devices, using the given backend.
+///
+/// parameters:
+///   reactor  - The reactor to initialise
+///   backend  - The backend to use. REACTOR_BACKEND_AUTO falls back to epoll if io_uring is not available.
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NOT_IMPLEMENTED if the requested backend is not available or CODE_ERROR.
+///
+RetCode SerialReactorInitBackend(SerialReactor *reactor, ReactorBackend backend);
+
+
+///
+/// Returns the name of the backend of a reactor, e.g. to log it.
+///
+const char* SerialReactorGetBackendName(const SerialReactor *reactor);
+
+
+///
+/// Removes all devices and releases the resources of the reactor.
+/// The serial ports of the devices are not closed.
+///
+/// parameters:
+///   reactor  - The reactor
+///
+void SerialReactorClose(SerialReactor *reactor);
+
+
+///
+/// Registers a device with the reactor.
+///
+/// parameters:
+///   reactor    - The reactor
+///   device     - The device to register, initialised by this function
+///   port       - The opened serial port the EmStat Pico is connected to
+///   eventFunc  - The function that is called for all events of this device
+///   context    - Pointer that is passed to `eventFunc`, e.g. to identify the device
+///
+/// Returns:
+///   CODE_OK if successful, CODE_NULL if `eventFunc` is NULL or CODE_ERROR if the port could not be registered
+///   (or the io_uring backend already has REACTOR_MAX_URING_DEVICES devices).
+///
+RetCode SerialReactorAdd(SerialReactor *reactor, ReactorDevice *device, SerialPort *port, MSParserEventFunc eventFunc, void *context);
+
+
+///
+/// Removes a device from its reactor. This may be called from the event function of any device, and the
+/// memory of the device may be freed right after, also from within an event function.
+///
+/// parameters:
+///   device  - The device to remove
+///
+void SerialReactorRemove(ReactorDevice *device);
+
+
+///
+/// Sets the maximum time a device may be silent before CODE_TIMEOUT is reported.
+///
+/// parameters:
+///   device      - A registered device
+///   timeout_ms  - The timeout in milliseconds or -1 to disable it (default)
+///
+void SerialReactorSetTimeout(ReactorDevice *device, int timeout_ms);
+
+
+///
+/// Waits until at least one device has data or a timeout has expired and handles all ready devices.
+/// The event functions are called from within this function.
+///
+/// parameters:
+///   reactor     - The reactor
+///   timeout_ms  - The maximum time to wait in milliseconds, -1 to wait until something happens
+///
+/// Returns:
+///   The number of devices that are still registered, or -1 if waiting failed.
+///
+int SerialReactorRun(SerialReactor *reactor, int timeout_ms);
+
+
+#endif //SERIALREACTOR_H
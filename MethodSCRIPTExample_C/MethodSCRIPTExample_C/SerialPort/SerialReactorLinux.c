@@ -0,0 +1,715 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ Name        : SerialReactorLinux.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// The io_uring backend is only built if the kernel headers support it. liburing is not needed.
+#if defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#include <linux/io_uring.h>
+		#ifdef __NR_io_uring_setup
+			#define REACTOR_HAS_IO_URING 1
+		#endif
+	#endif
+#endif
+
+#include "SerialReactor.h"
+
+
+//
+// Returns the current time of CLOCK_MONOTONIC in milliseconds
+//
+static long long NowMs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+//
+// Reports an event that is not a received line to the event function of a device
+//
+static void ReportEvent(ReactorDevice *device, RetCode event)
+{
+	device->parser.eventFunc(device->parser.context, event, NULL, 0, NULL);
+}
+
+
+//
+// Feeds data received from a device to its parser
+//
+static void FeedDevice(ReactorDevice *device, const char *data, int length)
+{
+	if (device->timeoutMs >= 0)
+		device->deadline = NowMs() + device->timeoutMs;
+	MSParserFeed(&device->parser, data, length);
+}
+
+
+//
+// Reads the available data of a device and feeds it to its parser.
+// The device is removed from the reactor if it was disconnected: if reading reports end-of-file or fails,
+// or if `hangup` is set (EPOLLHUP or EPOLLERR) and no data is left.
+//
+static void ReadDevice(ReactorDevice *device, int hangup)
+{
+	char buf[REACTOR_READ_SIZE];
+	int n = SerialPortReadBlock(device->port, buf, sizeof(buf));
+
+	if (n > 0)
+	{
+		FeedDevice(device, buf, n);
+		return;
+	}
+	// No data after a spurious wake-up or a signal, the device is still connected
+	if (n == 0 && !hangup)
+		return;
+	SerialReactorRemove(device);
+	ReportEvent(device, CODE_ERROR);
+}
+
+
+//
+// Checks if a device is registered with a reactor, without looking at the device itself,
+// which may have been freed after it was removed
+//
+static int IsRegistered(const SerialReactor *reactor, const ReactorDevice *device)
+{
+	for (const ReactorDevice *registered = reactor->devices; registered != NULL; registered = registered->next)
+	{
+		if (registered == device)
+			return 1;
+	}
+	return 0;
+}
+
+
+#ifdef REACTOR_HAS_IO_URING
+
+//
+// io_uring backend
+//
+// Every device gets a slot with a read buffer. While the device is registered a POLL_ADD request
+// for its port is queued, linked to a READ request into the buffer of the slot. The poll makes the
+// read wait for data, even though the port is opened non-blocking. When the read completes, the
+// data is fed to the parser and a new poll and read are queued. All queued requests are submitted
+// and all completions are collected with one io_uring_enter call per iteration of the reactor.
+//
+
+// Size of the submission queue. A device uses at most 3 entries (poll, read and cancel) per iteration
+// and an iteration uses 1 entry for its timeout.
+#define URING_ENTRIES		(4 * REACTOR_MAX_URING_DEVICES)
+
+// Type of a request, stored in the lowest 2 bits of its user data. The other bits store the slot.
+#define URING_POLL			0
+#define URING_READ			1
+#define URING_CANCEL		2
+#define URING_TIMEOUT		3
+#define URING_DATA(slot, type)	(((uint64_t)(slot) << 2) | (type))
+
+
+// The read buffer of a device
+typedef struct _UringSlot
+{
+	ReactorDevice *device;				// The device using this slot, NULL if none
+	int busy;							// Set while a read into `buf` is queued or its data is being parsed
+	char buf[REACTOR_READ_SIZE];
+} UringSlot;
+
+
+typedef struct _ReactorUring
+{
+	int fd;								// The io_uring instance
+	unsigned int sqEntries;
+	unsigned int sqMask;
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	struct io_uring_sqe *sqes;
+	unsigned int toSubmit;				// Number of queued requests that are not submitted yet
+	unsigned int cqMask;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	struct io_uring_cqe *cqes;
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	size_t sqesSize;
+	struct __kernel_timespec timeout;	// Timeout of the current iteration
+	int busyCount;						// Number of slots with a read queued
+	UringSlot slots[REACTOR_MAX_URING_DEVICES];
+} ReactorUring;
+
+
+//
+// Submits the queued requests and waits for at least `minComplete` completions
+// Returns 0 if successful or -1 on failure
+//
+static int UringEnter(ReactorUring *uring, unsigned int minComplete)
+{
+	int n = syscall(__NR_io_uring_enter, uring->fd, uring->toSubmit, minComplete,
+			minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (n < 0)
+		return (errno == EINTR || errno == EAGAIN || errno == EBUSY) ? 0 : -1;
+	uring->toSubmit -= n;
+	return 0;
+}
+
+
+//
+// Returns a cleared submission queue entry, after making sure `count` entries are free.
+// Submits the queued requests first if the queue is full.
+//
+static struct io_uring_sqe* UringGetSqe(ReactorUring *uring, unsigned int count)
+{
+	unsigned int tail = *uring->sqTail;
+
+	if (tail + count - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE) > uring->sqEntries)
+		UringEnter(uring, 0);
+
+	struct io_uring_sqe *sqe = &uring->sqes[tail & uring->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+
+//
+// Makes the last entry returned by `UringGetSqe` available to the kernel
+//
+static void UringQueue(ReactorUring *uring)
+{
+	__atomic_store_n(uring->sqTail, *uring->sqTail + 1, __ATOMIC_RELEASE);
+	uring->toSubmit++;
+}
+
+
+//
+// Queues a poll and a read for the port of the device in a slot
+//
+static void UringArmRead(ReactorUring *uring, int slot)
+{
+	int fd = uring->slots[slot].device->port->fd;
+	struct io_uring_sqe *sqe = UringGetSqe(uring, 2); // The linked requests must be submitted together
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = POLLIN;
+	sqe->flags = IOSQE_IO_LINK; // No IOSQE_CQE_SKIP_SUCCESS, a failing poll would then hide the read completion too
+	sqe->user_data = URING_DATA(slot, URING_POLL);
+	UringQueue(uring);
+
+	sqe = UringGetSqe(uring, 1);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)uring->slots[slot].buf;
+	sqe->len = REACTOR_READ_SIZE;
+	sqe->off = (uint64_t)-1; // Read at the current position, serial ports are not seekable
+	sqe->user_data = URING_DATA(slot, URING_READ);
+	UringQueue(uring);
+
+	uring->slots[slot].busy = 1;
+	uring->busyCount++;
+}
+
+
+//
+// Handles the completion of a read
+//
+static void UringReadDone(SerialReactor *reactor, int slot, int result)
+{
+	ReactorUring *uring = reactor->uring;
+	ReactorDevice *device = uring->slots[slot].device;
+
+	// The slot stays busy while its data is parsed, so it can not be given to a device that is
+	// added from within an event function.
+	if (device != NULL && result > 0)
+		FeedDevice(device, uring->slots[slot].buf, result);
+
+	uring->slots[slot].busy = 0;
+	uring->busyCount--;
+	if (device == NULL || uring->slots[slot].device != device)
+		return; // Removed from the reactor
+
+	if (result > 0 || result == -EAGAIN || result == -EINTR)
+	{
+		UringArmRead(uring, slot);
+	}
+	else
+	{
+		// End-of-file (hang-up), a read error, or the poll failed and cancelled the read
+		SerialReactorRemove(device);
+		ReportEvent(device, CODE_ERROR);
+	}
+}
+
+
+//
+// Handles all completed requests
+//
+static void UringReap(SerialReactor *reactor)
+{
+	ReactorUring *uring = reactor->uring;
+	unsigned int head = *uring->cqHead;
+	unsigned int tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++)
+	{
+		struct io_uring_cqe *cqe = &uring->cqes[head & uring->cqMask];
+
+		// Only the reads matter. A failed poll also fails its read, the timeout only ends the wait.
+		if ((cqe->user_data & 3) == URING_READ)
+			UringReadDone(reactor, cqe->user_data >> 2, cqe->res);
+	}
+	__atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+
+//
+// Releases the memory mappings and the io_uring instance
+//
+static void UringFree(ReactorUring *uring)
+{
+	if (uring->sqes != NULL && uring->sqes != MAP_FAILED)
+		munmap(uring->sqes, uring->sqesSize);
+	if (uring->cqRing != NULL && uring->cqRing != MAP_FAILED && uring->cqRing != uring->sqRing)
+		munmap(uring->cqRing, uring->cqRingSize);
+	if (uring->sqRing != NULL && uring->sqRing != MAP_FAILED)
+		munmap(uring->sqRing, uring->sqRingSize);
+	if (uring->fd >= 0)
+		close(uring->fd);
+	free(uring);
+}
+
+
+//
+// Sets up the io_uring backend
+//
+static RetCode UringInit(SerialReactor *reactor)
+{
+	struct io_uring_params params;
+	ReactorUring *uring = calloc(1, sizeof(ReactorUring));
+
+	if (uring == NULL)
+		return CODE_ERROR;
+	memset(&params, 0, sizeof(params));
+	uring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+
+	// IORING_OP_READ needs Linux 5.6, IORING_FEAT_FAST_POLL was added right after it in 5.7
+	if (uring->fd < 0 || !(params.features & IORING_FEAT_FAST_POLL))
+	{
+		UringFree(uring);
+		return CODE_NOT_IMPLEMENTED;
+	}
+
+	uring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	uring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (uring->cqRingSize > uring->sqRingSize)
+			uring->sqRingSize = uring->cqRingSize;
+		uring->cqRingSize = uring->sqRingSize;
+	}
+
+	uring->sqRing = mmap(NULL, uring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			uring->fd, IORING_OFF_SQ_RING);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		uring->cqRing = uring->sqRing;
+	else
+		uring->cqRing = mmap(NULL, uring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				uring->fd, IORING_OFF_CQ_RING);
+	uring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			uring->fd, IORING_OFF_SQES);
+	if (uring->sqRing == MAP_FAILED || uring->cqRing == MAP_FAILED || uring->sqes == MAP_FAILED)
+	{
+		UringFree(uring);
+		return CODE_ERROR;
+	}
+
+	char *sq = uring->sqRing;
+	char *cq = uring->cqRing;
+	unsigned int *sqArray = (unsigned int *)(sq + params.sq_off.array);
+	uring->sqEntries = params.sq_entries;
+	uring->sqMask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+	uring->sqHead = (unsigned int *)(sq + params.sq_off.head);
+	uring->sqTail = (unsigned int *)(sq + params.sq_off.tail);
+	uring->cqMask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+	uring->cqHead = (unsigned int *)(cq + params.cq_off.head);
+	uring->cqTail = (unsigned int *)(cq + params.cq_off.tail);
+	uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	// Entry i of the submission queue always uses sqe i
+	for (unsigned int i = 0; i < params.sq_entries; i++)
+		sqArray[i] = i;
+
+	reactor->uring = uring;
+	return CODE_OK;
+}
+
+
+//
+// Waits for all reads to finish after the devices were removed and releases the backend
+//
+static void UringClose(SerialReactor *reactor)
+{
+	ReactorUring *uring = reactor->uring;
+
+	while (uring->busyCount > 0)
+	{
+		if (UringEnter(uring, 1) < 0)
+			break;
+		UringReap(reactor);
+	}
+	UringFree(uring);
+	reactor->uring = NULL;
+}
+
+
+//
+// Gives a device a slot and queues its first read
+//
+static RetCode UringAdd(SerialReactor *reactor, ReactorDevice *device)
+{
+	ReactorUring *uring = reactor->uring;
+
+	for (int slot = 0; slot < REACTOR_MAX_URING_DEVICES; slot++)
+	{
+		if (uring->slots[slot].device == NULL && !uring->slots[slot].busy)
+		{
+			uring->slots[slot].device = device;
+			device->slot = slot;
+			UringArmRead(uring, slot);
+			return CODE_OK;
+		}
+	}
+	return CODE_ERROR;
+}
+
+
+//
+// Releases the slot of a device. A queued read is cancelled, the slot is reused once it completed.
+//
+static void UringRemove(SerialReactor *reactor, ReactorDevice *device)
+{
+	ReactorUring *uring = reactor->uring;
+	UringSlot *slot = &uring->slots[device->slot];
+
+	slot->device = NULL;
+	if (slot->busy)
+	{
+		struct io_uring_sqe *sqe = UringGetSqe(uring, 1);
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->addr = URING_DATA(device->slot, URING_POLL); // Cancelling the poll cancels the linked read too
+		sqe->user_data = URING_DATA(device->slot, URING_CANCEL);
+		UringQueue(uring);
+	}
+	device->slot = -1;
+}
+
+
+//
+// Submits all queued reads and handles the completed ones
+// Returns 0 if successful or -1 on failure
+//
+static int UringRun(SerialReactor *reactor, int timeout_ms)
+{
+	ReactorUring *uring = reactor->uring;
+
+	if (timeout_ms > 0)
+	{
+		// Completes when the time has passed or as soon as any other request completes
+		struct io_uring_sqe *sqe = UringGetSqe(uring, 1);
+		uring->timeout.tv_sec = timeout_ms / 1000;
+		uring->timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->addr = (uintptr_t)&uring->timeout;
+		sqe->len = 1;
+		sqe->off = 1;
+		sqe->user_data = URING_DATA(0, URING_TIMEOUT);
+		UringQueue(uring);
+	}
+
+	if (UringEnter(uring, timeout_ms != 0 ? 1 : 0) < 0)
+		return -1;
+	UringReap(reactor);
+	return 0;
+}
+
+#else
+
+//
+// io_uring is not supported by the kernel headers, only epoll can be used
+//
+static RetCode UringInit(SerialReactor *reactor) { return CODE_NOT_IMPLEMENTED; }
+static void UringClose(SerialReactor *reactor) { }
+static RetCode UringAdd(SerialReactor *reactor, ReactorDevice *device) { return CODE_ERROR; }
+static void UringRemove(SerialReactor *reactor, ReactorDevice *device) { }
+static int UringRun(SerialReactor *reactor, int timeout_ms) { return -1; }
+
+#endif // REACTOR_HAS_IO_URING
+
+
+//
+// Waits for readable ports with epoll and reads them
+// Returns 0 if successful or -1 on failure
+//
+static int EpollRun(SerialReactor *reactor, int timeout_ms)
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	int count = epoll_wait(reactor->epollFd, events, REACTOR_MAX_EVENTS, timeout_ms);
+
+	if (count < 0)
+		return (errno == EINTR) ? 0 : -1;
+
+	unsigned long removals = reactor->removals;
+	for (int i = 0; i < count; i++)
+	{
+		ReactorDevice *device = events[i].data.ptr;
+		// The device may have been removed, and freed, by an event function of a device handled before it
+		if (reactor->removals != removals && !IsRegistered(reactor, device))
+			continue;
+		ReadDevice(device, (events[i].events & (EPOLLHUP | EPOLLERR)) != 0);
+	}
+	return 0;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+RetCode SerialReactorInit(SerialReactor *reactor)
+{
+	return SerialReactorInitBackend(reactor, REACTOR_BACKEND_AUTO);
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+RetCode SerialReactorInitBackend(SerialReactor *reactor, ReactorBackend backend)
+{
+	reactor->deviceCount = 0;
+	reactor->devices = NULL;
+	reactor->removals = 0;
+	reactor->epollFd = -1;
+	reactor->uring = NULL;
+
+	if (backend != REACTOR_BACKEND_EPOLL)
+	{
+		RetCode code = UringInit(reactor);
+		if (code == CODE_OK)
+		{
+			reactor->backend = REACTOR_BACKEND_IO_URING;
+			return CODE_OK;
+		}
+		if (backend == REACTOR_BACKEND_IO_URING)
+			return code;
+	}
+
+	reactor->backend = REACTOR_BACKEND_EPOLL;
+	reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor->epollFd < 0)
+		return CODE_ERROR;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+const char* SerialReactorGetBackendName(const SerialReactor *reactor)
+{
+	return (reactor->backend == REACTOR_BACKEND_IO_URING) ? "io_uring" : "epoll";
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+void SerialReactorClose(SerialReactor *reactor)
+{
+	while (reactor->devices != NULL)
+		SerialReactorRemove(reactor->devices);
+	if (reactor->uring != NULL)
+		UringClose(reactor);
+	if (reactor->epollFd >= 0)
+		close(reactor->epollFd);
+	reactor->epollFd = -1;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+RetCode SerialReactorAdd(SerialReactor *reactor, ReactorDevice *device, SerialPort *port, MSParserEventFunc eventFunc, void *context)
+{
+	device->reactor = NULL;
+	device->port = port;
+	device->timeoutMs = -1;
+	device->deadline = 0;
+	device->slot = -1;
+	if (MSParserInit(&device->parser, eventFunc, context) != CODE_OK)
+		return CODE_NULL;
+
+	if (reactor->backend == REACTOR_BACKEND_IO_URING)
+	{
+		if (UringAdd(reactor, device) != CODE_OK)
+			return CODE_ERROR;
+	}
+	else
+	{
+		// EPOLLERR and EPOLLHUP are always reported, so a disconnect wakes up the reactor as well
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = device };
+		if (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, port->fd, &event) < 0)
+			return CODE_ERROR;
+	}
+
+	device->reactor = reactor;
+	device->next = reactor->devices;
+	reactor->devices = device;
+	reactor->deviceCount++;
+	return CODE_OK;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+void SerialReactorRemove(ReactorDevice *device)
+{
+	SerialReactor *reactor = device->reactor;
+	ReactorDevice **link;
+
+	if (reactor == NULL)
+		return;
+	for (link = &reactor->devices; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == device)
+		{
+			*link = device->next;
+			break;
+		}
+	}
+	if (reactor->backend == REACTOR_BACKEND_IO_URING)
+		UringRemove(reactor, device);
+	else
+		epoll_ctl(reactor->epollFd, EPOLL_CTL_DEL, device->port->fd, NULL);
+	reactor->deviceCount--;
+	reactor->removals++;
+	device->reactor = NULL;
+	device->next = NULL;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+void SerialReactorSetTimeout(ReactorDevice *device, int timeout_ms)
+{
+	device->timeoutMs = timeout_ms;
+	if (timeout_ms >= 0)
+		device->deadline = NowMs() + timeout_ms;
+}
+
+
+//
+// See documentation in SerialReactor.h
+//
+int SerialReactorRun(SerialReactor *reactor, int timeout_ms)
+{
+	long long now = NowMs();
+	ReactorDevice *device;
+	int result;
+
+	// Nothing to wait for
+	if (reactor->deviceCount == 0)
+		return 0;
+
+	// Wait no longer than until the first device timeout. Data that was already read from a port into its
+	// receive buffer does not make the port readable, so do not wait at all in that case.
+	for (device = reactor->devices; device != NULL; device = device->next)
+	{
+		long long remaining;
+
+		if (device->port->rx_head != device->port->rx_tail)
+			remaining = 0;
+		else if (device->timeoutMs >= 0)
+			remaining = (device->deadline > now) ? device->deadline - now : 0;
+		else
+			continue;
+
+		if (timeout_ms < 0 || remaining < timeout_ms)
+			timeout_ms = (int)remaining;
+	}
+
+	if (reactor->backend == REACTOR_BACKEND_IO_URING)
+		result = UringRun(reactor, timeout_ms);
+	else
+		result = EpollRun(reactor, timeout_ms);
+	if (result < 0)
+		return -1;
+
+	// Handle buffered data and expired timeouts. The next device is looked up before the event function
+	// is called, so the current device can be removed from within it.
+	now = NowMs();
+	for (device = reactor->devices; device != NULL; )
+	{
+		ReactorDevice *next = device->next;
+		unsigned long removals = reactor->removals;
+
+		if (device->port->rx_head != device->port->rx_tail)
+		{
+			ReadDevice(device, 0);
+		}
+		else if (device->timeoutMs >= 0 && device->deadline <= now)
+		{
+			device->deadline = now + device->timeoutMs;
+			ReportEvent(device, CODE_TIMEOUT);
+		}
+		// Stop if the event function removed the next device, which may have been freed.
+		// The rest is handled in the next call.
+		if (reactor->removals != removals && !IsRegistered(reactor, next))
+			break;
+		device = next;
+	}
+	return reactor->deviceCount;
+}
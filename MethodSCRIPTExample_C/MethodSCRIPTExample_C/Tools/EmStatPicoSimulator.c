@@ -0,0 +1,754 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : EmStatPicoSimulator.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Simulates an EmStat Pico on a pseudo-terminal (Linux only), so the MethodSCRIPT SDK and the
+ *	example can be tested and load-tested without hardware.
+ *	The simulator answers the version command `t` and runs MethodSCRIPT scripts like the ones in
+ *	`ScriptFiles/`. The measurement loops `meas_loop_lsv`, `meas_loop_swv`, `meas_loop_eis` and
+ *	`meas_loop_ca` produce packages with the variables added with `pck_add`, as measured on a
+ *	10 kOhm resistor, including the status and current range metadata. Other commands are accepted
+ *	and ignored, except for `set_pgstat_mode` (current range type) and `wait`. Everything after
+ *	`on_finished:` is ignored. A running script can be aborted with `Z`.
+ *
+ *	By default the packages are sent with the timing the script asks for. The rate can be changed to
+ *	a fixed number of packages per second or to as fast as the reader can take them, and the number
+ *	of points per measurement loop can be overridden to generate large amounts of data.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. Tools/EmStatPicoSimulator.c -o EmStatPicoSimulator -lm
+ *	Usage:
+ *	  ./EmStatPicoSimulator [-l link] [-r packages/s] [-b baudrate] [-n points] [-1]
+ *	    -l link   Also make the pseudo-terminal available as `link`, e.g. /tmp/ttyPico
+ *	    -r rate   Packages per second, 0 for as fast as possible (default: timing of the script)
+ *	    -b baud   Limit the data rate to that of a serial port with this baud rate
+ *	    -n points Number of points of every measurement loop (default: as set in the script).
+ *	              A scan keeps its potential range, only the step changes.
+ *	    -1        Exit after running one script
+ *	The name of the pseudo-terminal is printed on the first line of the output.
+ *
+ ============================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "MethodSCRIPTcomm/MSComm.h"
+#include "MethodSCRIPTcomm/MSValueDecoder.h"
+
+
+#define MAX_SCRIPT_LINES	1000
+#define MAX_VARIABLES		32
+#define MAX_ARGUMENTS		12
+#define INPUT_BUFFER_SIZE	4096
+#define OUTPUT_BUFFER_SIZE	4096
+
+// The simulated cell, a resistor with some parallel capacitance
+#define CELL_RESISTANCE		10e3
+#define CELL_CAPACITANCE	10e-12
+
+// Version response, the second line ends the response
+#define VERSION_RESPONSE	"tespico1.2\ntSimulator*\n"
+
+
+// Command line settings
+typedef struct _SimSettings
+{
+	const char *link;			// Symbolic link to the pseudo-terminal, or NULL
+	double rate;				// Packages per second, 0 for as fast as possible, < 0 for the timing of the script
+	double baudrate;			// Maximum data rate in baud, 0 for no limit
+	long points;				// Number of points of every measurement loop, 0 to use the script
+	int once;					// Exit after running one script
+} SimSettings;
+
+
+// A MethodSCRIPT variable
+typedef struct _SimVariable
+{
+	char name[32];
+	char type[3];				// Variable type sent in the packages, e.g. "ba"
+	double value;
+	int isCurrent;				// Measured currents get status and current range metadata
+} SimVariable;
+
+
+typedef struct _Simulator
+{
+	SimSettings settings;
+	int master;					// The simulator side of the pseudo-terminal
+	char input[INPUT_BUFFER_SIZE];
+	size_t inputLength;			// Received characters in `input` that are not handled yet
+	char *script[MAX_SCRIPT_LINES];
+	int scriptLines;
+	int receivingScript;		// Set between `e` and the empty line that ends a script
+	SimVariable variables[MAX_VARIABLES];
+	int variableCount;
+	int highSpeed;				// Set by `set_pgstat_mode 3`, selects the high speed current ranges
+	int aborted;
+	unsigned int noise;			// State of the noise generator
+	struct timespec next;		// Time at which the next package is due
+	char output[OUTPUT_BUFFER_SIZE];
+	size_t outputLength;
+	long packages;				// Number of packages sent by the current script
+} Simulator;
+
+
+// SI prefixes, from small to large
+static const char PREFIXES[] = "afpnum kMGTPE";
+
+// Maximum current of the ranges of the low speed and high speed mode
+static const double LOW_SPEED_RANGES[] = { 100e-9, 2e-6, 4e-6, 8e-6, 16e-6, 32e-6, 63e-6, 125e-6, 250e-6, 500e-6, 1e-3, 15e-3 };
+static const double HIGH_SPEED_RANGES[] = { 100e-9, 1e-6, 6e-6, 13e-6, 25e-6, 50e-6, 100e-6, 200e-6, 1e-3, 5e-3 };
+
+static const char *linkName;
+
+
+//
+// Writes all buffered output to the pseudo-terminal
+//
+static void Flush(Simulator *sim)
+{
+	size_t written = 0;
+
+	while (written < sim->outputLength)
+	{
+		ssize_t n = write(sim->master, sim->output + written, sim->outputLength - written);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			exit(1);
+		}
+		written += n;
+	}
+	sim->outputLength = 0;
+}
+
+
+//
+// Adds text to the output
+//
+static void Send(Simulator *sim, const char *text, size_t length)
+{
+	if (sim->outputLength + length > sizeof(sim->output))
+		Flush(sim);
+	memcpy(sim->output + sim->outputLength, text, length);
+	sim->outputLength += length;
+}
+
+
+//
+// Parses a number with an optional SI prefix, e.g. "-500m" or "200k"
+//
+static double ParseValue(const char *text)
+{
+	char *end;
+	double value = strtod(text, &end);
+	const char *prefix = (*end != '\0') ? strchr(PREFIXES, *end) : NULL;
+
+	if (prefix != NULL)
+		value *= pow(1000, (prefix - PREFIXES) - 6);
+	return value;
+}
+
+
+//
+// Encodes a value as a MethodSCRIPT value field: 7 hex digits and an SI prefix.
+// The smallest prefix that fits gives the best resolution.
+//
+static void EncodeValue(double value, char *field)
+{
+	long long mantissa = 0;
+	int i;
+
+	for (i = 0; PREFIXES[i] != '\0'; i++)
+	{
+		mantissa = llround(value / pow(1000, i - 6));
+		if (llabs(mantissa) < MSCR_PARAM_OFFSET_VALUE)
+			break;
+	}
+	if (PREFIXES[i] == '\0')
+	{
+		i--;
+		mantissa = (mantissa < 0) ? -(MSCR_PARAM_OFFSET_VALUE - 1) : MSCR_PARAM_OFFSET_VALUE - 1;
+	}
+	sprintf(field, "%07llX%c", mantissa + MSCR_PARAM_OFFSET_VALUE, PREFIXES[i]);
+}
+
+
+//
+// Returns the current range code for a current
+//
+static int CurrentRange(Simulator *sim, double current)
+{
+	const double *ranges = sim->highSpeed ? HIGH_SPEED_RANGES : LOW_SPEED_RANGES;
+	int count = sim->highSpeed ? sizeof(HIGH_SPEED_RANGES) / sizeof(double) : sizeof(LOW_SPEED_RANGES) / sizeof(double);
+	int range = 0;
+
+	while (range < count - 1 && fabs(current) > ranges[range])
+		range++;
+	return sim->highSpeed ? 128 + range : range;
+}
+
+
+//
+// Returns a relative measurement error of at most 0.1%
+//
+static double Noise(Simulator *sim)
+{
+	sim->noise = sim->noise * 1103515245 + 12345;
+	return ((sim->noise >> 16) / 32768.0 - 1) * 1e-3;
+}
+
+
+//
+// Returns the current through the cell at a potential
+//
+static double CellCurrent(Simulator *sim, double potential)
+{
+	return potential / CELL_RESISTANCE * (1 + Noise(sim));
+}
+
+
+//
+// Returns the time of CLOCK_MONOTONIC in seconds
+//
+static double Now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+//
+// Waits until the given time of CLOCK_MONOTONIC in seconds
+//
+static void WaitUntil(Simulator *sim, double time)
+{
+	struct timespec until = { (time_t)time, (long)((time - (time_t)time) * 1e9) };
+
+	Flush(sim);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+		;
+}
+
+
+//
+// Checks for an abort command `Z` without waiting. Other input received while a script runs is ignored.
+//
+static void CheckAbort(Simulator *sim)
+{
+	struct pollfd pfd = { .fd = sim->master, .events = POLLIN };
+	char buf[256];
+
+	while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+	{
+		ssize_t n = read(sim->master, buf, sizeof(buf));
+		if (n <= 0)
+			break;
+		if (memchr(buf, 'Z', n) != NULL)
+			sim->aborted = 1;
+	}
+}
+
+
+//
+// Finds a variable by name
+// Returns the variable or NULL if it was not declared
+//
+static SimVariable* FindVariable(Simulator *sim, const char *name)
+{
+	for (int i = 0; i < sim->variableCount; i++)
+	{
+		if (strcmp(sim->variables[i].name, name) == 0)
+			return &sim->variables[i];
+	}
+	return NULL;
+}
+
+
+//
+// Sets the variable type of a variable that is an output of a measurement loop
+// Returns the variable or NULL if it was not declared
+//
+static SimVariable* SetOutput(Simulator *sim, const char *name, const char *type)
+{
+	SimVariable *variable = FindVariable(sim, name);
+
+	if (variable == NULL)
+	{
+		fprintf(stderr, "Variable %s is not declared\n", name);
+		return NULL;
+	}
+	strcpy(variable->type, type);
+	variable->isCurrent = (type[0] == 'b');
+	variable->value = 0;
+	return variable;
+}
+
+
+//
+// Splits a script line into words
+// Returns the number of words
+//
+static int SplitLine(char *line, char **words, int maxWords)
+{
+	int count = 0;
+	char *save;
+
+	for (char *word = strtok_r(line, " \t\r", &save); word != NULL && count < maxWords; word = strtok_r(NULL, " \t\r", &save))
+		words[count++] = word;
+	return count;
+}
+
+
+//
+// Sends one data package with the variables added in the measurement loop
+//
+static void SendPackage(Simulator *sim, SimVariable **package, int count)
+{
+	char line[MS_MAX_LINECHARS * 4];
+	int length = 0;
+
+	line[length++] = REPLY_MEASURE_DP;
+	for (int i = 0; i < count; i++)
+	{
+		if (i > 0)
+			line[length++] = ';';
+		memcpy(&line[length], package[i]->type, 2);
+		EncodeValue(package[i]->value, &line[length + 2]);
+		length += 2 + MSCR_VALUE_FIELD_LENGTH;
+		if (package[i]->isCurrent)
+			length += sprintf(&line[length], ",10,2%02X", CurrentRange(sim, package[i]->value));
+	}
+	line[length++] = '\n';
+	Send(sim, line, length);
+	sim->packages++;
+
+	// Wait until the next package is due. The baud rate limit applies on top of the package rate.
+	double interval = (sim->settings.baudrate > 0) ? length * 10 / sim->settings.baudrate : 0;
+	if (sim->settings.rate > 0 && 1 / sim->settings.rate > interval)
+		interval = 1 / sim->settings.rate;
+
+	if (interval > 0)
+	{
+		double now = Now();
+		double due = sim->next.tv_sec + sim->next.tv_nsec * 1e-9 + interval;
+		if (due < now - 1)
+			due = now; // Fell behind more than a second (reader too slow), do not try to catch up
+		WaitUntil(sim, due);
+		sim->next.tv_sec = (time_t)due;
+		sim->next.tv_nsec = (long)((due - (time_t)due) * 1e9);
+		CheckAbort(sim);
+	}
+	else if ((sim->packages & 255) == 0)
+	{
+		CheckAbort(sim);
+	}
+}
+
+
+//
+// Runs a measurement loop, from the `meas_loop_...` line up to its `endloop`
+//
+static void RunLoop(Simulator *sim, char **words, int wordCount, int first, int end)
+{
+	SimVariable *package[MSCR_SUBPACKAGES_PER_LINE];
+	SimVariable *out[4] = { NULL };
+	int packageCount = 0;
+	double begin = 0, stop = 0, step = 1, interval = 0, amplitude = 0, fend = 0;
+	long points;
+	enum { LSV, SWV, EIS, CA } technique;
+
+	if (strcmp(words[0], "meas_loop_lsv") == 0 && wordCount >= 7)
+	{
+		technique = LSV;
+		out[0] = SetOutput(sim, words[1], "da");
+		out[1] = SetOutput(sim, words[2], "ba");
+		begin = ParseValue(words[3]);
+		stop = ParseValue(words[4]);
+		step = ParseValue(words[5]);
+		interval = step / ParseValue(words[6]);
+	}
+	else if (strcmp(words[0], "meas_loop_swv") == 0 && wordCount >= 10)
+	{
+		technique = SWV;
+		out[0] = SetOutput(sim, words[1], "da");
+		out[1] = SetOutput(sim, words[2], "ba");
+		out[2] = SetOutput(sim, words[3], "ba");
+		out[3] = SetOutput(sim, words[4], "ba");
+		begin = ParseValue(words[5]);
+		stop = ParseValue(words[6]);
+		step = ParseValue(words[7]);
+		amplitude = ParseValue(words[8]);
+		interval = 1 / ParseValue(words[9]);
+	}
+	else if (strcmp(words[0], "meas_loop_eis") == 0 && wordCount >= 8)
+	{
+		technique = EIS;
+		out[0] = SetOutput(sim, words[1], "dc");
+		out[1] = SetOutput(sim, words[2], "cc");
+		out[2] = SetOutput(sim, words[3], "cd");
+		begin = ParseValue(words[5]);
+		fend = ParseValue(words[6]);
+		stop = ParseValue(words[7]); // Number of frequencies
+	}
+	else if (strcmp(words[0], "meas_loop_ca") == 0 && wordCount >= 6)
+	{
+		technique = CA;
+		out[0] = SetOutput(sim, words[1], "da");
+		out[1] = SetOutput(sim, words[2], "ba");
+		begin = ParseValue(words[3]);
+		interval = ParseValue(words[4]);
+		stop = ParseValue(words[5]); // Run time
+	}
+	else
+	{
+		fprintf(stderr, "Measurement loop not supported: %s\n", words[0]);
+		return;
+	}
+
+	// Collect the variables of the package
+	for (int i = first; i < end; i++)
+	{
+		if (strncmp(sim->script[i], "pck_add ", 8) == 0 && packageCount < MSCR_SUBPACKAGES_PER_LINE)
+		{
+			SimVariable *variable = FindVariable(sim, sim->script[i] + 8);
+			if (variable != NULL && variable->type[0] != '\0')
+				package[packageCount++] = variable;
+		}
+	}
+
+	if (technique == EIS)
+		points = (long)stop;
+	else if (technique == CA)
+		points = (long)(stop / interval);
+	else
+		points = (long)(fabs(stop - begin) / step + 1.5);
+	if (sim->settings.points > 0)
+	{
+		// Spread the points over the same potential range
+		if ((technique == LSV || technique == SWV) && sim->settings.points > 1)
+			step = fabs(stop - begin) / (sim->settings.points - 1);
+		points = sim->settings.points;
+	}
+	if (sim->settings.rate < 0 && technique != EIS)
+		sim->settings.rate = (interval > 0) ? 1 / interval : 0;
+
+	Send(sim, "M0000\n", 6);
+	clock_gettime(CLOCK_MONOTONIC, &sim->next);
+	for (long i = 0; i < points && !sim->aborted; i++)
+	{
+		double potential = (stop >= begin) ? begin + i * step : begin - i * step;
+
+		switch (technique)
+		{
+			case LSV:
+			case CA:
+				if (technique == CA)
+					potential = begin;
+				if (out[0]) out[0]->value = potential;
+				if (out[1]) out[1]->value = CellCurrent(sim, potential);
+				break;
+			case SWV:
+				if (out[0]) out[0]->value = potential;
+				if (out[2]) out[2]->value = CellCurrent(sim, potential + amplitude);
+				if (out[3]) out[3]->value = CellCurrent(sim, potential - amplitude);
+				if (out[1]) out[1]->value = (out[2] && out[3]) ? out[2]->value - out[3]->value : CellCurrent(sim, 2 * amplitude);
+				break;
+			case EIS:
+			{
+				double frequency = (points > 1) ? begin * pow(fend / begin, (double)i / (points - 1)) : begin;
+				double wrc = 2 * M_PI * frequency * CELL_RESISTANCE * CELL_CAPACITANCE;
+				if (out[0]) out[0]->value = frequency;
+				if (out[1]) out[1]->value = CELL_RESISTANCE / (1 + wrc * wrc) * (1 + Noise(sim));
+				if (out[2]) out[2]->value = -CELL_RESISTANCE * wrc / (1 + wrc * wrc) * (1 + Noise(sim));
+				// A real EIS measurement takes a few periods of the frequency
+				if (sim->settings.rate < 0)
+					WaitUntil(sim, Now() + 3 / frequency);
+				break;
+			}
+		}
+		SendPackage(sim, package, packageCount);
+	}
+	Send(sim, "*\n", 2);
+}
+
+
+//
+// Runs the received script
+//
+static void RunScript(Simulator *sim)
+{
+	double rate = sim->settings.rate;
+	double start = Now();
+
+	sim->variableCount = 0;
+	sim->highSpeed = 0;
+	sim->aborted = 0;
+	sim->packages = 0;
+	Send(sim, "e\n", 2);
+
+	for (int i = 0; i < sim->scriptLines && !sim->aborted; i++)
+	{
+		char line[MS_MAX_LINECHARS];
+		char *words[MAX_ARGUMENTS];
+		int wordCount;
+
+		snprintf(line, sizeof(line), "%s", sim->script[i]);
+		wordCount = SplitLine(line, words, MAX_ARGUMENTS);
+		if (wordCount == 0)
+			continue;
+
+		if (strcmp(words[0], "var") == 0 && wordCount >= 2 && sim->variableCount < MAX_VARIABLES)
+		{
+			SimVariable *variable = &sim->variables[sim->variableCount++];
+			memset(variable, 0, sizeof(*variable));
+			snprintf(variable->name, sizeof(variable->name), "%s", words[1]);
+		}
+		else if (strcmp(words[0], "set_pgstat_mode") == 0 && wordCount >= 2)
+		{
+			sim->highSpeed = (atoi(words[1]) == 3);
+		}
+		else if (strcmp(words[0], "wait") == 0 && wordCount >= 2)
+		{
+			if (rate < 0)
+				WaitUntil(sim, Now() + ParseValue(words[1]));
+		}
+		else if (strncmp(words[0], "meas_loop_", 10) == 0)
+		{
+			int end = i + 1;
+			while (end < sim->scriptLines && strncmp(sim->script[end], "endloop", 7) != 0)
+				end++;
+			RunLoop(sim, words, wordCount, i + 1, end);
+			sim->settings.rate = rate;
+			i = end;
+		}
+		else if (strcmp(words[0], "on_finished:") == 0)
+		{
+			break;
+		}
+	}
+
+	Send(sim, "\n", 1);
+	Flush(sim);
+	fprintf(stderr, "Script %s: %ld packages in %.3f s\n", sim->aborted ? "aborted" : "done", sim->packages, Now() - start);
+}
+
+
+//
+// Handles one received line
+// Returns 1 if a script was run, otherwise 0
+//
+static int HandleLine(Simulator *sim, char *line)
+{
+	if (sim->receivingScript)
+	{
+		if (line[0] == '\0')
+		{
+			sim->receivingScript = 0;
+			RunScript(sim);
+			for (int i = 0; i < sim->scriptLines; i++)
+				free(sim->script[i]);
+			sim->scriptLines = 0;
+			return 1;
+		}
+		if (line[0] != '#' && sim->scriptLines < MAX_SCRIPT_LINES)
+			sim->script[sim->scriptLines++] = strdup(line);
+		return 0;
+	}
+
+	if (strcmp(line, "t") == 0)
+	{
+		Send(sim, VERSION_RESPONSE, sizeof(VERSION_RESPONSE) - 1);
+		Flush(sim);
+	}
+	else if (strcmp(line, "e") == 0)
+	{
+		sim->receivingScript = 1;
+		sim->scriptLines = 0;
+	}
+	return 0;
+}
+
+
+//
+// Waits until the program on the other side has read everything that was sent, at most `timeout` seconds.
+// Closing the pseudo-terminal would discard the data that was not read yet.
+// The kernel moves written data to the other side in the background, so the queue must stay empty for a while.
+//
+static void WaitUntilRead(int slave, double timeout)
+{
+	double end = Now() + timeout;
+	int pending;
+	int idle = 0;
+
+	while (idle < 10 && Now() < end && ioctl(slave, FIONREAD, &pending) == 0)
+	{
+		idle = (pending > 0) ? 0 : idle + 1;
+		usleep(10000);
+	}
+}
+
+
+//
+// Removes the symbolic link when the simulator is stopped
+//
+static void OnSignal(int signal)
+{
+	(void)signal;
+
+	if (linkName != NULL)
+		unlink(linkName);
+	_exit(0);
+}
+
+
+//
+// Creates the pseudo-terminal
+// Returns the name of the pseudo-terminal or NULL on failure
+//
+static const char* OpenPseudoTerminal(Simulator *sim, int *slave)
+{
+	struct termios config;
+	const char *name;
+
+	sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (sim->master < 0 || grantpt(sim->master) < 0 || unlockpt(sim->master) < 0 || (name = ptsname(sim->master)) == NULL)
+		return NULL;
+
+	// Keep the other side open, so a program can close and reopen it without the simulator seeing a hang-up.
+	// Until the program configures the port itself, it behaves like a raw serial port.
+	*slave = open(name, O_RDWR | O_NOCTTY);
+	if (*slave < 0 || tcgetattr(*slave, &config) < 0)
+		return NULL;
+	cfmakeraw(&config);
+	tcsetattr(*slave, TCSANOW, &config);
+	return name;
+}
+
+
+int main(int argc, char *argv[])
+{
+	static Simulator sim;
+	const char *name;
+	int slave;
+	int option;
+
+	sim.settings.rate = -1;
+	sim.noise = 1;
+	while ((option = getopt(argc, argv, "l:r:b:n:1")) != -1)
+	{
+		switch (option)
+		{
+			case 'l': sim.settings.link = optarg; break;
+			case 'r': sim.settings.rate = atof(optarg); break;
+			case 'b': sim.settings.baudrate = atof(optarg); break;
+			case 'n': sim.settings.points = atol(optarg); break;
+			case '1': sim.settings.once = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-l link] [-r packages/s] [-b baudrate] [-n points] [-1]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	name = OpenPseudoTerminal(&sim, &slave);
+	if (name == NULL)
+	{
+		perror("Could not create pseudo-terminal");
+		return 1;
+	}
+	if (sim.settings.link != NULL)
+	{
+		unlink(sim.settings.link);
+		if (symlink(name, sim.settings.link) < 0)
+		{
+			perror("Could not create link");
+			return 1;
+		}
+		linkName = sim.settings.link;
+	}
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	printf("%s\n", name);
+	fflush(stdout);
+
+	for (;;)
+	{
+		ssize_t n = read(sim.master, sim.input + sim.inputLength, sizeof(sim.input) - sim.inputLength);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		sim.inputLength += n;
+
+		// Handle all complete lines
+		char *start = sim.input;
+		char *newline;
+		while ((newline = memchr(start, '\n', sim.input + sim.inputLength - start)) != NULL)
+		{
+			*newline = '\0';
+			if (newline > start && newline[-1] == '\r')
+				newline[-1] = '\0';
+			if (HandleLine(&sim, start) && sim.settings.once)
+			{
+				WaitUntilRead(slave, 10);
+				OnSignal(0);
+			}
+			start = newline + 1;
+		}
+		sim.inputLength -= start - sim.input;
+		memmove(sim.input, start, sim.inputLength);
+		if (sim.inputLength == sizeof(sim.input))
+			sim.inputLength = 0; // Line too long, discard it
+	}
+
+	close(slave);
+	OnSignal(0);
+	return 0;
+}
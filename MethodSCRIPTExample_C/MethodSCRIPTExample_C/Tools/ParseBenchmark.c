@@ -0,0 +1,287 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : ParseBenchmark.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Benchmark of the ways a package line can be parsed, from the original `ParseResponse()` to
+ *	`ParsePackageLine()`, `MSParser`, `ReceivePackage()` and `ParsePackageLineWithSchema()`.
+ *	A number of package lines is generated in memory with the layouts of an LSV and an EIS measurement.
+ *	Every method parses all lines and the number of lines per second is printed, so the speed of a
+ *	change can be compared before and after by running this on both versions. Nothing is read from a
+ *	device, so only the time spent in the SDK is measured.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. Tools/ParseBenchmark.c MethodSCRIPTcomm/MSParser.c MethodSCRIPTcomm/MSComm.c -o ParseBenchmark -lm
+ *	Usage:
+ *	  ./ParseBenchmark [lines]
+ *
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MethodSCRIPTcomm/MSComm.h"
+#include "MethodSCRIPTcomm/MSParser.h"
+
+
+#define DEFAULT_LINES		1000000
+
+// Maximum length of a generated line, including the terminating zero
+#define LINE_LENGTH			64
+
+// Size of the blocks in which the lines are passed to a MSParser, like the reads of a serial port
+#define CHUNK_SIZE			4096
+
+// The layouts of the generated lines, with the values as arguments. The values are offset by 0x8000000.
+static const char LSV_FORMAT[] = "Pda%07Xu;ba%07Xp,10,2%02X\n";
+static const char EIS_FORMAT[] = "Pdc%07X ;cc%07Xm;cd%07Xm;cb%07Xm;ca%07Xm\n";
+
+// The names of the methods of `ParseLines()`
+static const char *METHODS[] = { "ParseResponse", "ParsePackageLine", "ReceivePackage", "MSParser",
+		"ParsePackageLineWithSchema" };
+
+
+// The generated lines
+typedef struct _BenchLines
+{
+	char *data;
+	size_t size;
+	long count;
+} BenchLines;
+
+// State of the in-memory transport of `ReceivePackage()`
+typedef struct _BenchTransport
+{
+	const BenchLines *lines;
+	size_t position;
+} BenchTransport;
+
+
+//
+// Returns the time of a monotonic clock in seconds
+//
+static double Now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+//
+// Generates `count` lines with the LSV or EIS layout and values that change from line to line
+// Returns 0 if successful
+//
+static int GenerateLines(BenchLines *lines, long count, int eis)
+{
+	lines->data = malloc(count * LINE_LENGTH);
+	lines->size = 0;
+	lines->count = count;
+	if (lines->data == NULL)
+		return -1;
+
+	for (long i = 0; i < count; i++)
+	{
+		unsigned int value = 0x8000000 + (unsigned int)(i * 7919 % 1000000);
+		char *line = lines->data + lines->size;
+		if (eis)
+			lines->size += sprintf(line, EIS_FORMAT, value, value ^ 0x5A5, value ^ 0x3C3, value + 17, value - 17);
+		else
+			lines->size += sprintf(line, LSV_FORMAT, value, value ^ 0x5A5, (unsigned int)(i % 8));
+	}
+	return 0;
+}
+
+
+//
+// Counts the packages and errors of a MSParser
+//
+static void OnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	long *errors = context;
+	(void)line;
+	(void)length;
+	(void)package;
+
+	if (event != CODE_OK)
+		(*errors)++;
+}
+
+
+//
+// Read function of the in-memory transport, hands out the lines in blocks like a serial port
+//
+static int BenchReadBuf(void *context, char *buf, int size)
+{
+	BenchTransport *transport = context;
+	size_t left = transport->lines->size - transport->position;
+	size_t n = (left < (size_t)size) ? left : (size_t)size;
+
+	memcpy(buf, transport->lines->data + transport->position, n);
+	transport->position += n;
+	return (int)n;
+}
+
+
+//
+// Write function of the in-memory transport, nothing is sent
+//
+static int BenchWriteChar(void *context, char c)
+{
+	(void)context;
+	(void)c;
+	return 1;
+}
+
+
+//
+// Parses every line with one of the methods
+// Returns the number of lines that could not be parsed
+//
+static long ParseLines(const BenchLines *lines, int method)
+{
+	static MscrPackage package;
+	long errors = 0;
+	const char *line = lines->data;
+	const char *end = lines->data + lines->size;
+
+	switch (method)
+	{
+		case 0:		// The original parser, which modifies the line so it works on a copy
+		{
+			char copy[LINE_LENGTH];
+			while (line < end)
+			{
+				const char *next = memchr(line, '\n', end - line) + 1;
+				memcpy(copy, line, next - line);
+				copy[next - line] = '\0';
+				ParseResponse(copy, &package);
+				line = next;
+			}
+			break;
+		}
+		case 1:
+			while (line < end)
+			{
+				const char *next = memchr(line, '\n', end - line) + 1;
+				if (ParsePackageLine(line, next - line, &package) != CODE_OK)
+					errors++;
+				line = next;
+			}
+			break;
+		case 2:
+		{
+			BenchTransport context = { lines, 0 };
+			MSTransport transport = { 0 };
+			MSComm msComm;
+			transport.context = &context;
+			transport.write_char = BenchWriteChar;
+			transport.read_buf = BenchReadBuf;
+			MSCommInitTransport(&msComm, &transport);
+			for (long i = 0; i < lines->count; i++)
+			{
+				if (ReceivePackage(&msComm, &package) != CODE_OK)
+					errors++;
+			}
+			break;
+		}
+		case 3:
+		{
+			MSParser parser;
+			MSParserInit(&parser, OnEvent, &errors);
+			for (size_t offset = 0; offset < lines->size; offset += CHUNK_SIZE)
+				MSParserFeed(&parser, lines->data + offset, (lines->size - offset < CHUNK_SIZE) ? lines->size - offset : CHUNK_SIZE);
+			break;
+		}
+		case 4:
+		{
+			MscrPackageSchema schema;
+			ResetPackageSchema(&schema);
+			while (line < end)
+			{
+				const char *next = memchr(line, '\n', end - line) + 1;
+				if (ParsePackageLineWithSchema(&schema, line, next - line, &package) != CODE_OK)
+					errors++;
+				line = next;
+			}
+			break;
+		}
+	}
+	return errors;
+}
+
+
+//
+// Runs every method on one set of lines
+//
+static void RunBenchmark(const char *name, const BenchLines *lines)
+{
+	printf("%s, %ld lines of %zu characters\n", name, lines->count, lines->size / lines->count);
+	for (int method = 0; method < (int)(sizeof(METHODS) / sizeof(METHODS[0])); method++)
+	{
+		double start = Now();
+		long errors = ParseLines(lines, method);
+		double seconds = Now() - start;
+		printf("  %-28s %8.2f M lines/s %8.1f ns/line", METHODS[method], lines->count / seconds * 1e-6, seconds * 1e9 / lines->count);
+		if (errors > 0)
+			printf(", %ld errors", errors);
+		printf("\n");
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	long count = (argc > 1) ? atol(argv[1]) : DEFAULT_LINES;
+	BenchLines lsv, eis;
+
+	if (count <= 0)
+	{
+		printf("Usage: %s [lines]\n", argv[0]);
+		return 1;
+	}
+	if (GenerateLines(&lsv, count, 0) != 0 || GenerateLines(&eis, count, 1) != 0)
+	{
+		printf("Out of memory\n");
+		return 1;
+	}
+
+	RunBenchmark("LSV", &lsv);
+	RunBenchmark("EIS", &eis);
+
+	free(lsv.data);
+	free(eis.data);
+	return 0;
+}
@@ -0,0 +1,252 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : ReactorBenchmark.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Benchmark of the SerialReactor backends using pseudo-terminals (Linux only).
+ *	A child process plays a number of EmStat Picos, each on its own pseudo-terminal, that all send
+ *	the same amount of measurement data. The reactor receives and parses everything, once with each
+ *	backend, and the throughput and CPU time of the receiving process are printed. A device is removed
+ *	from the reactor once all its packages are received, or when it did not receive anything for
+ *	TIMEOUT_MS.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. -ISerialPort -IMethodSCRIPTcomm Tools/ReactorBenchmark.c SerialPort/SerialReactorLinux.c
+ *	      SerialPort/SerialPortLinux.c MethodSCRIPTcomm/MSParser.c MethodSCRIPTcomm/MSComm.c
+ *	      -o ReactorBenchmark -lutil -lm
+ *	Usage:
+ *	  ./ReactorBenchmark [devices] [packages per device]
+ *
+ ============================================================================
+ */
+
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "SerialPort/SerialReactor.h"
+
+
+#define DEFAULT_DEVICES		64
+#define DEFAULT_PACKAGES	20000
+
+// Number of packages sent to a device at once
+#define PACKAGES_PER_WRITE	16
+
+// Time after which a device that stopped receiving data is given up
+#define TIMEOUT_MS			2000
+
+static const char PACKAGE_LINE[] = "Pda7F85F3Fu;ba48D4DA9p,10,288\n";
+
+
+// State of one simulated device
+typedef struct _BenchDevice
+{
+	int master;				// Pseudo-terminal side of the simulator
+	SerialPort port;		// Pseudo-terminal side of the reactor
+	ReactorDevice device;
+	long expected;			// Number of packages sent
+	long packages;			// Number of packages received
+	long errors;			// Number of unexpected lines received
+} BenchDevice;
+
+
+//
+// Counts the received packages of a device
+//
+static void OnEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	BenchDevice *bench = context;
+	(void)line;
+	(void)length;
+	(void)package;
+
+	if (event == CODE_OK)
+		bench->packages++;
+	else
+		bench->errors++;
+
+	if (bench->packages == bench->expected || event == CODE_TIMEOUT || event == CODE_ERROR)
+		SerialReactorRemove(&bench->device);
+}
+
+
+//
+// Sends `packages` packages to every device, spread in small writes over all devices
+//
+static void Simulate(BenchDevice *devices, int count, long packages)
+{
+	char block[sizeof(PACKAGE_LINE) * PACKAGES_PER_WRITE];
+	size_t lineLength = sizeof(PACKAGE_LINE) - 1;
+
+	for (int i = 0; i < PACKAGES_PER_WRITE; i++)
+		memcpy(block + i * lineLength, PACKAGE_LINE, lineLength);
+
+	for (long sent = 0; sent < packages; sent += PACKAGES_PER_WRITE)
+	{
+		long n = (packages - sent < PACKAGES_PER_WRITE) ? packages - sent : PACKAGES_PER_WRITE;
+		for (int i = 0; i < count; i++)
+		{
+			if (write(devices[i].master, block, n * lineLength) < 0)
+				_exit(1);
+		}
+	}
+	// Closing the pseudo-terminals would discard the data that was not read yet, so keep them
+	// open until the benchmark is done.
+	pause();
+	_exit(0);
+}
+
+
+//
+// Returns the CPU time used by this process in seconds
+//
+static double CpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+
+//
+// Returns the number of context switches of this process
+//
+static long ContextSwitches()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+
+//
+// Runs the benchmark with one backend
+// Returns 0 if successful
+//
+static int RunBenchmark(ReactorBackend backend, BenchDevice *devices, int count, long packages)
+{
+	SerialReactor reactor;
+	struct timespec start, end;
+	long received = 0;
+	long errors = 0;
+
+	if (SerialReactorInitBackend(&reactor, backend) != CODE_OK)
+	{
+		printf("%-10s not available\n", (backend == REACTOR_BACKEND_IO_URING) ? "io_uring" : "epoll");
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		char name[64];
+		int slave;
+
+		if (openpty(&devices[i].master, &slave, name, NULL, NULL) < 0 || !SerialPortOpen(&devices[i].port, name, 230400))
+		{
+			printf("Could not create pseudo-terminal %d\n", i);
+			return -1;
+		}
+		close(slave);
+		devices[i].expected = packages;
+		devices[i].packages = 0;
+		devices[i].errors = 0;
+		if (SerialReactorAdd(&reactor, &devices[i].device, &devices[i].port, OnEvent, &devices[i]) != CODE_OK)
+		{
+			printf("Could not add device %d\n", i);
+			return -1;
+		}
+		SerialReactorSetTimeout(&devices[i].device, TIMEOUT_MS);
+	}
+
+	double cpu = CpuTime();
+	long switches = ContextSwitches();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid_t child = fork();
+	if (child == 0)
+		Simulate(devices, count, packages);
+	for (int i = 0; i < count; i++)
+		close(devices[i].master);
+
+	long iterations = 0;
+	while (SerialReactorRun(&reactor, -1) > 0)
+		iterations++;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cpu = CpuTime() - cpu;
+	switches = ContextSwitches() - switches;
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+
+	for (int i = 0; i < count; i++)
+	{
+		received += devices[i].packages;
+		errors += devices[i].errors;
+		SerialPortClose(&devices[i].port);
+	}
+	SerialReactorClose(&reactor);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	printf("%-10s %10ld packages %6ld errors %8.3f s %10.0f packages/s %8.3f s CPU %8ld iterations %8ld context switches\n",
+			SerialReactorGetBackendName(&reactor), received, errors, seconds, received / seconds, cpu, iterations, switches);
+	return (received == packages * count && errors == 0) ? 0 : -1;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int count = (argc > 1) ? atoi(argv[1]) : DEFAULT_DEVICES;
+	long packages = (argc > 2) ? atol(argv[2]) : DEFAULT_PACKAGES;
+	BenchDevice *devices = calloc(count, sizeof(BenchDevice));
+	int result = 0;
+
+	if (devices == NULL || count <= 0 || count > REACTOR_MAX_URING_DEVICES)
+	{
+		printf("Usage: %s [devices (1-%d)] [packages per device]\n", argv[0], REACTOR_MAX_URING_DEVICES);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%d devices, %ld packages per device\n", count, packages);
+	result |= RunBenchmark(REACTOR_BACKEND_EPOLL, devices, count, packages);
+	result |= RunBenchmark(REACTOR_BACKEND_IO_URING, devices, count, packages);
+
+	free(devices);
+	return result ? 1 : 0;
+}
@@ -0,0 +1,670 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : ReplayCapture.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Replays capture files recorded with MSCapture (see MSCapture.h) through `ReceivePackage()`.
+ *	Every file is processed as if the measurement was received again, and the number of packages
+ *	and other responses is printed, followed by the total throughput. This can be used to process
+ *	archived measurements again after a change to the SDK, or to measure the processing speed on
+ *	real measurement data.
+ *	With -m the files are memory mapped and parsed with MSParser instead (see MSLogFile.h), which
+ *	is much faster and also accepts raw logs of the EmStat Pico output.
+ *	With -j the files are parsed on several threads with MSBatch (see MSBatch.h). A single file is
+ *	split into chunks, multiple files are divided over the threads. With -d, -c or -b as well, the
+ *	files are split into chunks one by one and the packages are passed on in the order of the file.
+ *	With -d the packages of every file are also collected in an MSDataset (see MSDataset.h) and a
+ *	summary of every measurement loop is printed.
+ *	With -c the packages of all files are written to one CSV file with MSCsvWriter (see MSCsvWriter.h),
+ *	in the same format as the example project.
+ *	With -b the packages of all files are written to one binary result file with MSResultWriter, and
+ *	with -r the given files are result files, which are read with MSResultFile (see MSResultFile.h)
+ *	and summarised like with -d.
+ *	With -a the CSV and result files are written on background threads with MSAsyncWriter (see
+ *	MSAsyncWriter.h), and the time that parsing had to wait for the disk is printed.
+ *	With -l the given files are record logs (see MSRecordLog.h), e.g. of a measurement that was
+ *	interrupted. Their valid records are converted like the packages of a capture, so with -c or -b
+ *	a record log is converted to a CSV or result file.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. Tools/ReplayCapture.c MethodSCRIPTcomm/MSCapture.c MethodSCRIPTcomm/MSLogFile.c
+ *	      MethodSCRIPTcomm/MSBatch.c MethodSCRIPTcomm/MSParser.c MethodSCRIPTcomm/MSComm.c
+ *	      MethodSCRIPTcomm/MSValueDecoder.c MethodSCRIPTcomm/MSDataset.c MethodSCRIPTcomm/MSArena.c
+ *	      MethodSCRIPTcomm/MSCsvWriter.c MethodSCRIPTcomm/MSResultFile.c MethodSCRIPTcomm/MSAsyncWriter.c
+ *	      MethodSCRIPTcomm/MSRecordLog.c -o ReplayCapture -lm -lpthread
+ *	Usage:
+ *	  ./ReplayCapture [-t | -m | -d | -c csvfile | -b resultfile] [-j threads] [-a] [-v] capture...
+ *	  ./ReplayCapture -l [-d | -c csvfile | -b resultfile] [-a] [-v] recordlog...
+ *	  ./ReplayCapture -r resultfile...
+ *	    -t  Replay with the original timing instead of as fast as possible
+ *	    -m  Parse the memory mapped files directly
+ *	    -d  Parse the memory mapped files into a dataset and print a summary of every measurement loop
+ *	    -c  Parse the memory mapped files and write all packages to this CSV file
+ *	    -b  Parse the memory mapped files and write all packages to this result file
+ *	    -r  Read result files and print a summary of every measurement loop
+ *	    -a  Write the CSV and result files on background threads
+ *	    -l  Read record logs instead of captures
+ *	    -j  Parse the memory mapped files on this number of threads, 0 for one per processor core
+ *	    -v  Print the values of every package. With -j, the packages are printed with their position
+ *	        (file, loop and package number) and in any order.
+ *
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "MethodSCRIPTcomm/MSCapture.h"
+#include "MethodSCRIPTcomm/MSLogFile.h"
+#include "MethodSCRIPTcomm/MSBatch.h"
+#include "MethodSCRIPTcomm/MSDataset.h"
+#include "MethodSCRIPTcomm/MSAsyncWriter.h"
+#include "MethodSCRIPTcomm/MSCsvWriter.h"
+#include "MethodSCRIPTcomm/MSRecordLog.h"
+#include "MethodSCRIPTcomm/MSResultFile.h"
+
+
+// Counters of one or more replayed captures
+typedef struct _ReplayStats
+{
+	long packages;			// Data packages
+	long responses;			// Other responses, e.g. begin and end of a measurement
+	long errors;			// Lines that could not be parsed
+	long bytes;				// Size of the capture files
+	int verbose;			// Print the values of every package
+	MSDataset *dataset;		// If not NULL, the lines are also added to this dataset
+	MSCsvWriter *csv;		// If not NULL, the packages are also written to this CSV file
+	int loopPackages;		// The number of packages in the current measurement loop
+	MSResultWriter *results;	// If not NULL, the packages are also written to this result file
+} ReplayStats;
+
+
+//
+// Returns the time of a monotonic clock in seconds
+//
+static double Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+//
+// Prints the values of a package on one line, after an optional prefix
+//
+static void PrintPackage(const char *prefix, const MscrPackage *package)
+{
+	char line[MSCR_SUBPACKAGES_PER_LINE * 16 + 64];
+	int length = snprintf(line, sizeof(line), "%s", prefix);
+
+	// Print the line at once, so lines of different threads are not mixed up
+	for (int i = 0; i < package->nr_of_subpackages && length < (int)sizeof(line); i++)
+		length += snprintf(&line[length], sizeof(line) - length, "%s%g", (i > 0) ? "\t" : "", GetSubpackageValue(&package->subpackages[i]));
+	printf("%s\n", line);
+}
+
+
+//
+// Counts a line of the given type
+//
+static void CountLine(ReplayStats *stats, RetCode event)
+{
+	if (event == CODE_OK)
+	{
+		stats->packages++;
+	}
+	else if (event > 0)
+	{
+		stats->responses++;
+	}
+	else
+	{
+		stats->errors++;
+	}
+}
+
+
+//
+// Writes a line to the CSV file like the example project: a header before the first package of
+// every measurement loop and an empty line after every loop
+//
+static void WriteCsv(ReplayStats *stats, RetCode event, const MscrPackage *package)
+{
+	switch (event)
+	{
+	case CODE_MEASURING:
+		stats->loopPackages = 0;
+		break;
+	case CODE_OK:
+		if (stats->loopPackages == 0)
+			MSCsvWriteHeader(stats->csv, package);
+		MSCsvWritePackage(stats->csv, package, ++stats->loopPackages);
+		break;
+	case CODE_MEASUREMENT_DONE:
+		MSCsvWriteText(stats->csv, "\n");
+		break;
+	default:
+		break;
+	}
+}
+
+
+//
+// Counts a line that was parsed by the MSParser, `context` is the ReplayStats
+//
+static void OnLine(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	ReplayStats *stats = context;
+
+	if (event == CODE_OK && stats->verbose)
+		PrintPackage("", package);
+	if (stats->dataset != NULL)
+		MSDatasetOnEvent(stats->dataset, event, line, length, package);
+	if (stats->csv != NULL)
+		WriteCsv(stats, event, package);
+	if (stats->results != NULL)
+		MSResultWriterOnEvent(stats->results, event, line, length, package);
+	CountLine(stats, event);
+}
+
+
+//
+// Prints the size of every measurement loop of a dataset and the range of every column
+//
+static void PrintDataset(const MSDataset *dataset)
+{
+	for (size_t i = 0; i < dataset->loopCount; i++)
+	{
+		const MSDatasetLoop *loop = &dataset->loops[i];
+		printf("  loop %zu: %zu packages, %zu scans%s\n", i + 1, loop->rowCount, loop->scanCount,
+				loop->complete ? "" : ", incomplete");
+
+		for (int c = 0; c < loop->columnCount; c++)
+		{
+			const MSDatasetColumn *column = &loop->columns[c];
+			double min = INFINITY, max = -INFINITY, sum = 0;
+			size_t count = 0;
+
+			for (size_t row = 0; row < loop->rowCount; row++)
+			{
+				double value = column->values[row];
+				if (isnan(value))
+					continue;
+				min = (value < min) ? value : min;
+				max = (value > max) ? value : max;
+				sum += value;
+				count++;
+			}
+			const MscrVarTypeInfo *info = GetVarTypeInfo(column->variableType);
+			printf("    %-24s %zu values from %g to %g, mean %g %s\n", info->name,
+					count, min, max, (count > 0) ? sum / count : NAN, info->unit);
+		}
+	}
+}
+
+
+//
+// Reads a result file and prints the size of every measurement loop and the range of every column.
+// Returns 0 if the file could be read, otherwise 1
+//
+static int ReadResultFile(const char *filename, ReplayStats *stats)
+{
+	MSResultFile file;
+
+	if (MSResultFileOpen(&file, filename) != CODE_OK)
+	{
+		printf("%s: not a result file\n", filename);
+		return 1;
+	}
+	printf("%s: %u loops%s\n", filename, file.loopCount, file.recovered ? ", not closed" : "");
+
+	for (uint32_t i = 0; i < file.loopCount; i++)
+	{
+		const MSResultLoop *loop = &file.loops[i];
+		printf("  loop %u: %llu packages in %u chunks%s\n", i + 1, (unsigned long long)loop->rowCount,
+				loop->chunkCount, loop->complete ? "" : ", incomplete");
+
+		for (uint32_t c = 0; c < loop->columnCount; c++)
+		{
+			double min = INFINITY, max = -INFINITY, sum = 0;
+			size_t count = 0;
+
+			for (uint32_t k = 0; k < loop->chunkCount; k++)
+			{
+				const double *values = MSResultGetValues(&file, loop, &loop->chunks[k], c);
+				for (uint32_t row = 0; row < loop->chunks[k].rowCount; row++)
+				{
+					double value = values[row];
+					if (isnan(value))
+						continue;
+					min = (value < min) ? value : min;
+					max = (value > max) ? value : max;
+					sum += value;
+					count++;
+				}
+			}
+			const MscrVarTypeInfo *info = GetVarTypeInfo(loop->columns[c].variableType);
+			printf("    %-24s %zu values from %g to %g, mean %g %s\n", info->name,
+					count, min, max, (count > 0) ? sum / count : NAN, info->unit);
+		}
+		stats->packages += loop->rowCount;
+	}
+	stats->bytes += file.log.size;
+	MSResultFileClose(&file);
+	return 0;
+}
+
+
+//
+// Reads the valid records of a record log and adds them to `stats` like the packages of a capture
+//
+static int ReadRecordLog(const char *filename, ReplayStats *stats)
+{
+	MSRecordLogInfo info;
+	ReplayStats file = { 0 };
+	RetCode code;
+
+	file.verbose = stats->verbose;
+	file.csv = stats->csv;
+	file.results = stats->results;
+	if (stats->dataset != NULL)
+	{
+		MSDatasetInit(stats->dataset, 0);
+		file.dataset = stats->dataset;
+	}
+	code = MSRecordLogRead(filename, OnLine, &file, &info);
+
+	if (code == CODE_ERROR)
+		printf("%s: could not open file\n", filename);
+	else if (info.validSize == 0)
+		printf("%s: not a record log of this subpackage layout\n", filename);
+	else
+		printf("%s: %ld packages, %ld other responses, %ld errors over %.1f s%s\n", filename, file.packages,
+				file.responses, file.errors, (info.lastTimeUs - info.firstTimeUs) / 1e6,
+				(code == CODE_OK) ? "" : ", damaged data after the last valid record was ignored");
+	if (file.dataset != NULL)
+	{
+		if (file.dataset->error != CODE_OK)
+			printf("  out of memory, the dataset is incomplete\n");
+		PrintDataset(file.dataset);
+		MSDatasetFree(file.dataset);
+	}
+	stats->packages += file.packages;
+	stats->responses += file.responses;
+	stats->errors += file.errors;
+	stats->bytes += (long)info.fileSize;
+	return (code == CODE_OK) ? 0 : 1;
+}
+
+
+//
+// Parses one memory mapped capture file or raw log and adds the results to `stats`.
+// With `threads` >= 0 the file is parsed with MSBatch on that number of threads, in the order of the file.
+// Returns 0 if the complete file was parsed, otherwise 1
+//
+static int ParseMapped(const char *filename, int threads, ReplayStats *stats)
+{
+	MSLogFile log;
+	MSParser parser;
+	ReplayStats file = { 0 };
+	RetCode code;
+
+	if (MSLogFileOpen(&log, filename) != CODE_OK)
+	{
+		printf("%s: could not open file\n", filename);
+		return 1;
+	}
+	file.verbose = stats->verbose;
+	file.csv = stats->csv;
+	file.results = stats->results;
+	if (stats->dataset != NULL)
+	{
+		MSDatasetInit(stats->dataset, 0);
+		file.dataset = stats->dataset;
+	}
+	if (threads >= 0)
+		code = MSBatchParseFileInOrder(filename, threads, OnLine, &file);
+	else
+	{
+		MSParserInit(&parser, OnLine, &file);
+		code = MSLogFileParse(&log, &parser);
+	}
+
+	printf("%s: %ld packages, %ld other responses, %ld errors%s\n", filename, file.packages, file.responses,
+			file.errors, (code == CODE_OK) ? "" : ", incomplete capture");
+	if (file.dataset != NULL)
+	{
+		if (file.dataset->error != CODE_OK)
+			printf("  out of memory, the dataset is incomplete\n");
+		PrintDataset(file.dataset);
+		MSDatasetFree(file.dataset);
+	}
+	stats->packages += file.packages;
+	stats->responses += file.responses;
+	stats->errors += file.errors;
+	stats->bytes += log.size;
+
+	MSLogFileClose(&log);
+	return (code == CODE_OK) ? 0 : 1;
+}
+
+
+//
+// Counts a line that was parsed by MSBatch, `context` is an array with ReplayStats per thread
+//
+static void OnBatchLine(void *context, int worker, const MSBatchPosition *position, RetCode event,
+		const char *line, size_t length, const MscrPackage *package)
+{
+	ReplayStats *stats = &((ReplayStats *)context)[worker];
+	(void)length;
+
+	if (line == NULL)
+	{
+		printf("file %d could not be parsed completely\n", position->file);
+		return;
+	}
+	if (event == CODE_OK && stats->verbose)
+	{
+		char prefix[64];
+		snprintf(prefix, sizeof(prefix), "%d\t%ld\t%ld\t", position->file, position->loop, position->index);
+		PrintPackage(prefix, package);
+	}
+	CountLine(stats, event);
+}
+
+
+//
+// Parses all files with MSBatch and adds the results to `stats`
+// Returns 0 if all files were parsed completely, otherwise 1
+//
+static int ParseBatch(char **filenames, int count, int threads, ReplayStats *stats)
+{
+	static ReplayStats workers[MSBATCH_MAX_THREADS];
+	RetCode code;
+
+	for (int i = 0; i < MSBATCH_MAX_THREADS; i++)
+		workers[i].verbose = stats->verbose;
+	if (count == 1)
+		code = MSBatchParseFile(filenames[0], threads, OnBatchLine, workers);
+	else
+		code = MSBatchParseFiles((const char *const *)filenames, count, threads, OnBatchLine, workers);
+
+	for (int i = 0; i < MSBATCH_MAX_THREADS; i++)
+	{
+		stats->packages += workers[i].packages;
+		stats->responses += workers[i].responses;
+		stats->errors += workers[i].errors;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		struct stat info;
+		if (stat(filenames[i], &info) == 0)
+			stats->bytes += info.st_size;
+	}
+	return (code == CODE_OK) ? 0 : 1;
+}
+
+
+//
+// Replays one capture file and adds the results to `stats`
+// Returns 0 if the complete capture was replayed, otherwise 1
+//
+static int Replay(const char *filename, MSReplaySpeed speed, ReplayStats *stats)
+{
+	MSReplay replay;
+	MSTransport transport;
+	MSComm msComm;
+	MscrPackage package;
+	ReplayStats file = { 0 };
+	RetCode code;
+
+	if (MSReplayOpen(&replay, filename, speed) != CODE_OK)
+	{
+		printf("%s: not a capture file\n", filename);
+		return 1;
+	}
+	fseek(replay.fp, 0, SEEK_END);
+	file.bytes = ftell(replay.fp);
+	fseek(replay.fp, MSCAPTURE_MAGIC_LENGTH, SEEK_SET);
+
+	MSReplayGetTransport(&replay, &transport);
+	MSCommInitTransport(&msComm, &transport);
+	// A response that takes longer than this while replaying with the original timing is an error
+	MSCommSetReadDeadline(&msComm, 60000);
+
+	while ((code = ReceivePackage(&msComm, &package)) != CODE_ERROR)
+	{
+		if (code == CODE_OK)
+		{
+			file.packages++;
+			if (stats->verbose)
+				PrintPackage("", &package);
+		}
+		else if (code > 0)
+		{
+			file.responses++;
+		}
+		else
+		{
+			file.errors++;
+		}
+	}
+
+	printf("%s: %ld packages, %ld other responses, %ld errors%s\n", filename, file.packages, file.responses,
+			file.errors, MSReplayAtEnd(&replay) ? "" : ", replay failed");
+	stats->packages += file.packages;
+	stats->responses += file.responses;
+	stats->errors += file.errors;
+	stats->bytes += file.bytes;
+
+	code = MSReplayAtEnd(&replay) ? CODE_OK : CODE_ERROR;
+	MSReplayClose(&replay);
+	return (code == CODE_OK) ? 0 : 1;
+}
+
+
+//
+// Closes an asynchronous writer and prints how long the parsing had to wait for it
+//
+static int CloseAsync(MSAsyncWriter *writer, const char *filename)
+{
+	MSAsyncWriterStats stats;
+
+	MSAsyncWriterGetStats(writer, &stats);
+	if (MSAsyncWriterClose(writer) != CODE_OK)
+	{
+		printf("%s: could not write file\n", filename);
+		return 1;
+	}
+	printf("%s: %llu buffers written, waited %llu times for %.3f s in total, longest write %.3f s\n", filename,
+			(unsigned long long)stats.buffersWritten, (unsigned long long)stats.waits,
+			stats.waitTimeUs / 1e6, stats.maxWriteUs / 1e6);
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	MSReplaySpeed speed = REPLAY_MAX_SPEED;
+	ReplayStats stats = { 0 };
+	MSDataset dataset;
+	MSCsvWriter csv;
+	const char *csvFilename = NULL;
+	FILE *csvFile = NULL;
+	MSResultWriter results;
+	const char *resultFilename = NULL;
+	MSAsyncWriter csvAsync, resultAsync;
+	int async = 0;
+	int recordLogs = 0;
+	int readResults = 0;
+	int mapped = 0;
+	int threads = -1;
+	int failed = 0;
+	int first = 1;
+	double start, seconds;
+
+	for (; first < argc && argv[first][0] == '-'; first++)
+	{
+		if (strcmp(argv[first], "-t") == 0)
+			speed = REPLAY_ORIGINAL_TIMING;
+		else if (strcmp(argv[first], "-m") == 0)
+			mapped = 1;
+		else if (strcmp(argv[first], "-d") == 0)
+		{
+			mapped = 1;
+			stats.dataset = &dataset;
+		}
+		else if (strcmp(argv[first], "-c") == 0 && first + 1 < argc)
+		{
+			mapped = 1;
+			csvFilename = argv[++first];
+		}
+		else if (strcmp(argv[first], "-b") == 0 && first + 1 < argc)
+		{
+			mapped = 1;
+			resultFilename = argv[++first];
+		}
+		else if (strcmp(argv[first], "-r") == 0)
+			readResults = 1;
+		else if (strcmp(argv[first], "-a") == 0)
+			async = 1;
+		else if (strcmp(argv[first], "-l") == 0)
+			recordLogs = 1;
+		else if (strcmp(argv[first], "-j") == 0 && first + 1 < argc)
+			threads = atoi(argv[++first]);
+		else if (strcmp(argv[first], "-v") == 0)
+			stats.verbose = 1;
+		else
+			break;
+	}
+	if (first >= argc)
+	{
+		printf("Usage: %s [-t | -m | -d | -c csvfile | -b resultfile] [-j threads] [-a] [-v] capture...\n", argv[0]);
+		printf("       %s -l [-d | -c csvfile | -b resultfile] [-a] [-v] recordlog...\n", argv[0]);
+		printf("       %s -r resultfile...\n", argv[0]);
+		return 1;
+	}
+	if (csvFilename != NULL)
+	{
+		RetCode code = CODE_NULL;
+		csvFile = fopen(csvFilename, "w");
+		if (csvFile != NULL && async)
+		{
+			code = MSAsyncWriterOpen(&csvAsync, csvFile, 0, 0);
+			if (code == CODE_OK)
+				code = MSCsvWriterInitAsync(&csv, &csvAsync);
+		}
+		else if (csvFile != NULL)
+			code = MSCsvWriterInit(&csv, csvFile, 0);
+		if (code != CODE_OK)
+		{
+			printf("%s: could not create CSV file\n", csvFilename);
+			return 1;
+		}
+		stats.csv = &csv;
+	}
+	if (resultFilename != NULL)
+	{
+		RetCode code;
+		if (async)
+		{
+			code = MSAsyncWriterOpen(&resultAsync, fopen(resultFilename, "wb"), 0, 0);
+			if (code == CODE_OK)
+				code = MSResultWriterOpenAsync(&results, &resultAsync, 0);
+		}
+		else
+			code = MSResultWriterOpen(&results, resultFilename, 0);
+		if (code != CODE_OK)
+		{
+			printf("%s: could not create result file\n", resultFilename);
+			return 1;
+		}
+		stats.results = &results;
+	}
+
+	start = Now();
+	if (readResults)
+	{
+		for (int i = first; i < argc; i++)
+			failed |= ReadResultFile(argv[i], &stats);
+	}
+	else if (recordLogs)
+	{
+		for (int i = first; i < argc; i++)
+			failed |= ReadRecordLog(argv[i], &stats);
+	}
+	else if (threads >= 0 && (stats.dataset != NULL || stats.csv != NULL || stats.results != NULL))
+	{
+		// These need the packages in order, so the files are parsed one by one
+		for (int i = first; i < argc; i++)
+			failed |= ParseMapped(argv[i], threads, &stats);
+	}
+	else if (threads >= 0)
+	{
+		failed = ParseBatch(&argv[first], argc - first, threads, &stats);
+	}
+	else
+	{
+		for (int i = first; i < argc; i++)
+			failed |= mapped ? ParseMapped(argv[i], -1, &stats) : Replay(argv[i], speed, &stats);
+	}
+	if (csvFile != NULL)
+	{
+		if (MSCsvWriterFree(&csv) != CODE_OK)
+		{
+			printf("%s: could not write CSV file\n", csvFilename);
+			failed = 1;
+		}
+		if (async)
+			failed |= CloseAsync(&csvAsync, csvFilename);
+		else
+			fclose(csvFile);
+	}
+	if (resultFilename != NULL && MSResultWriterClose(&results) != CODE_OK)
+	{
+		printf("%s: could not write result file\n", resultFilename);
+		failed = 1;
+	}
+	if (resultFilename != NULL && async)
+		failed |= CloseAsync(&resultAsync, resultFilename);
+	seconds = Now() - start;
+
+	printf("%d files, %ld packages, %ld other responses, %ld errors in %.3f s: %.0f packages/s, %.1f MB/s\n",
+			argc - first, stats.packages, stats.responses, stats.errors, seconds,
+			stats.packages / seconds, stats.bytes / seconds / 1e6);
+	return failed;
+}
@@ -0,0 +1,1119 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : SdkTest.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Tests of the MethodSCRIPT SDK modules that can run without an EmStat Pico.
+ *	The tests use the response in RESPONSE below, a recorded LSV measurement with nscans blocks and an
+ *	EIS measurement, and check that:
+ *	  - `ParsePackageLine()` gives the same packages as `ParseResponse()`, and stays within damaged lines
+ *	  - `DecodeValueFields()` gives the exact values of the value fields, and NAN for invalid fields
+ *	  - `MSParser` reports the same events wherever the data is split into chunks, and reports lines that
+ *	    are too long also when they arrive in one chunk
+ *	  - `MSRing` and `MSPackagePool` hand out entries and packages in order and count what they drop
+ *	  - the ring reader passes on everything `ReceivePackage()` returns, and skips damaged package lines
+ *	  - `MSDataset` keeps the loops, columns and nscans blocks of the response
+ *	  - `ParsePackageLineWithSchema()` gives the same result as `ParsePackageLine()`, also for damaged lines
+ *	  - `MSResultFileOpen()` only returns the complete chunks of a truncated result file
+ *	  - `MSRecordLogRecover()` keeps exactly the valid records of a truncated or corrupted record log
+ *	  - a record log converts to the same result file and dataset as the response it was recorded from
+ *	  - `MSCsvFormatFloat()` writes the shortest text that converts back to the same float
+ *	  - `MSBatchParseFileInOrder()` reports the same events in the same order as one MSParser
+ *	The files are written to a new directory in /tmp, which is removed if all tests pass.
+ *	Build with -fsanitize=address,undefined to also check the memory accesses.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. Tools/SdkTest.c MethodSCRIPTcomm/MSComm.c MethodSCRIPTcomm/MSParser.c
+ *	      MethodSCRIPTcomm/MSValueDecoder.c MethodSCRIPTcomm/MSRing.c MethodSCRIPTcomm/MSPackagePool.c
+ *	      MethodSCRIPTcomm/MSDataset.c MethodSCRIPTcomm/MSArena.c MethodSCRIPTcomm/MSLogFile.c
+ *	      MethodSCRIPTcomm/MSCapture.c MethodSCRIPTcomm/MSResultFile.c MethodSCRIPTcomm/MSAsyncWriter.c
+ *	      MethodSCRIPTcomm/MSRecordLog.c MethodSCRIPTcomm/MSCsvWriter.c MethodSCRIPTcomm/MSBatch.c
+ *	      -o SdkTest -lm -lpthread
+ *	Usage:
+ *	  ./SdkTest
+ *	The exit code is 0 if all tests passed.
+ *
+ ============================================================================
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "MethodSCRIPTcomm/MSBatch.h"
+#include "MethodSCRIPTcomm/MSComm.h"
+#include "MethodSCRIPTcomm/MSCsvWriter.h"
+#include "MethodSCRIPTcomm/MSDataset.h"
+#include "MethodSCRIPTcomm/MSPackagePool.h"
+#include "MethodSCRIPTcomm/MSParser.h"
+#include "MethodSCRIPTcomm/MSRecordLog.h"
+#include "MethodSCRIPTcomm/MSResultFile.h"
+#include "MethodSCRIPTcomm/MSRing.h"
+#include "MethodSCRIPTcomm/MSValueDecoder.h"
+
+
+// Maximum number of events of the response
+#define MAX_EVENTS			64
+
+// Maximum length of the text of one event, see `FormatEvent()`
+#define EVENT_TEXT_LENGTH	512
+
+// Maximum length of the path of a test file
+#define PATH_LENGTH			64
+
+// Rows per chunk of the result files, small so the files have many chunks
+#define CHUNK_ROWS			2
+
+// Checks a condition, counts and prints the failure
+#define CHECK(condition)	Check((condition), #condition, __FILE__, __LINE__)
+
+// The response of an EmStat Pico: an LSV loop, a loop with two nscans blocks and an EIS loop.
+// The packages have different layouts and metadata.
+static const char RESPONSE[] =
+	"e\n"
+	"M0000\n"
+	"Pda7F85F3Fu;ba48D4DA9p,10,288\n"
+	"Pda7F8A8B1u;ba48CF6A4p,10,288\n"
+	"Pda7F8F223u;ba48E1B36p,10,28B\n"
+	"Pda7F93B95u;ba48F5C1Bp,14,28B\n"
+	"Pda7F98507u;ba4905E23p,10,28B\n"
+	"*\n"
+	"M0000\n"
+	"C\n"
+	"Pda7FFFFFFm;ba8000000n,10,287\n"
+	"Pda8000064m;ba8001F40n,10,287\n"
+	"-\n"
+	"C\n"
+	"Pda8000000m;ba80003E8n,10,287\n"
+	"Pda80000C8m;ba8000FA0n,12,287\n"
+	"-\n"
+	"*\n"
+	"M0000\n"
+	"Pdc8030D40 ;cc8002710 ;cd7FFFC18 ;cb8002711 ;ca7FFF9C4m\n"
+	"Pdc80186A0 ;cc8002780 ;cd7FFFB00 ;cb8002800 ;ca7FFF000m\n"
+	"Pdc800C350 ;cc8002800 ;cd7FFFA00 ;cb8002900 ;ca7FFE000m,10\n"
+	"*\n"
+	"\n";
+
+// Number of copies of RESPONSE in the log of `TestBatchInOrder()`, enough for several chunks
+#define BATCH_RESPONSES		5000
+
+// Characters that replace a character of a package line in the tests of damaged lines
+static const char DAMAGE[] = "0F:G;, \nzm";
+
+
+// The events of a parser, ring or record log as text, see `FormatEvent()`
+typedef struct _EventList
+{
+	int count;
+	char text[MAX_EVENTS][EVENT_TEXT_LENGTH];
+} EventList;
+
+
+static int s_failures = 0;
+static char s_directory[] = "/tmp/SdkTestXXXXXX";
+
+
+//
+// Counts and prints a failed check
+//
+static void Check(int condition, const char *text, const char *file, int line)
+{
+	if (condition)
+		return;
+	if (s_failures < 20)
+		printf("  %s:%d: check failed: %s\n", file, line, text);
+	s_failures++;
+}
+
+
+//
+// Stores the full path of a file in the test directory in `path`, which has room for PATH_LENGTH characters
+//
+static const char* TestFile(char *path, const char *name)
+{
+	snprintf(path, PATH_LENGTH, "%s/%s", s_directory, name);
+	return path;
+}
+
+
+//
+// Reads a complete file into a new buffer
+// Returns the buffer, or NULL if the file could not be read
+//
+static char* ReadWholeFile(const char *filename, size_t *size)
+{
+	FILE *fp = fopen(filename, "rb");
+	char *data = NULL;
+
+	*size = 0;
+	if (fp == NULL)
+		return NULL;
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (length >= 0 && (data = malloc(length + 1)) != NULL)
+	{
+		*size = fread(data, 1, length, fp);
+		if (*size != (size_t)length)
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(fp);
+	return data;
+}
+
+
+//
+// Writes `size` bytes to a file, replacing it
+// Returns 0 if successful
+//
+static int WriteWholeFile(const char *filename, const char *data, size_t size)
+{
+	FILE *fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return -1;
+	size_t written = fwrite(data, 1, size, fp);
+	return (fclose(fp) == 0 && written == size) ? 0 : -1;
+}
+
+
+//
+// Checks that two packages have the same subpackages
+//
+static int SamePackage(const MscrPackage *a, const MscrPackage *b)
+{
+	if (a->nr_of_subpackages != b->nr_of_subpackages)
+		return 0;
+	for (int i = 0; i < a->nr_of_subpackages; i++)
+	{
+		float valueA = GetSubpackageValue(&a->subpackages[i]);
+		float valueB = GetSubpackageValue(&b->subpackages[i]);
+		if (memcmp(&valueA, &valueB, sizeof(valueA)) != 0
+				|| GetSubpackageVarType(&a->subpackages[i]) != GetSubpackageVarType(&b->subpackages[i])
+				|| GetSubpackageStatus(&a->subpackages[i]) != GetSubpackageStatus(&b->subpackages[i])
+				|| GetSubpackageCurrentRange(&a->subpackages[i]) != GetSubpackageCurrentRange(&b->subpackages[i]))
+			return 0;
+	}
+	return 1;
+}
+
+
+//
+// Formats an event as text: the code, the reply character and the subpackages of a package
+//
+static void FormatEvent(char *text, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	int n = snprintf(text, EVENT_TEXT_LENGTH, "%d %c", event, (line != NULL && length > 0) ? line[0] : '?');
+
+	if (event != CODE_OK || package == NULL)
+		return;
+	for (int i = 0; i < package->nr_of_subpackages && n < EVENT_TEXT_LENGTH; i++)
+	{
+		const MscrSubPackage *subpackage = &package->subpackages[i];
+		n += snprintf(text + n, EVENT_TEXT_LENGTH - n, " %d=%a,%d,%d", GetSubpackageVarType(subpackage),
+				GetSubpackageValue(subpackage), GetSubpackageStatus(subpackage), GetSubpackageCurrentRange(subpackage));
+	}
+}
+
+
+//
+// MSParserEventFunc that adds the events to an EventList
+//
+static void OnListEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	EventList *list = context;
+
+	if (list->count < MAX_EVENTS)
+		FormatEvent(list->text[list->count], event, line, length, package);
+	list->count++;
+}
+
+
+//
+// Checks that the first `count` events of two lists are the same
+//
+static int SameEvents(const EventList *a, const EventList *b, int count)
+{
+	if (count > a->count || count > b->count || count > MAX_EVENTS)
+		return 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(a->text[i], b->text[i]) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+
+//
+// Parses RESPONSE in the given chunk sizes. A size of 0 passes the rest of the response at once.
+//
+static void ParseResponseChunks(EventList *list, const size_t *sizes, int count)
+{
+	MSParser parser;
+	size_t offset = 0;
+	size_t total = sizeof(RESPONSE) - 1;
+
+	list->count = 0;
+	MSParserInit(&parser, OnListEvent, list);
+	for (int i = 0; offset < total; i++)
+	{
+		size_t size = (i < count && sizes[i] > 0) ? sizes[i] : total - offset;
+		if (size > total - offset)
+			size = total - offset;
+		MSParserFeed(&parser, RESPONSE + offset, size);
+		offset += size;
+	}
+}
+
+
+//
+// ParsePackageLine() must give the same packages as ParseResponse(). It may only read the given length of a
+// line, also when the line is cut short or has a character replaced.
+//
+static void TestParsePackageLine()
+{
+	static MscrPackage parsed, expected;
+	char line[sizeof(RESPONSE)];
+
+	for (const char *p = RESPONSE; *p != '\0'; p = strchr(p, '\n') + 1)
+	{
+		size_t length = strchr(p, '\n') + 1 - p;
+		if (*p != REPLY_MEASURE_DP)
+			continue;
+
+		memcpy(line, p, length);
+		line[length] = '\0';
+		ParseResponse(line, &expected);
+		CHECK(ParsePackageLine(p, length, &parsed) == CODE_OK);
+		CHECK(SamePackage(&parsed, &expected));
+
+		// A copy of exactly the given length, so the sanitizer reports any read past its end
+		for (size_t cut = 1; cut <= length; cut++)
+		{
+			char *copy = malloc(cut);
+			memcpy(copy, p, cut);
+			ParsePackageLine(copy, cut, &parsed);
+			CHECK(parsed.nr_of_subpackages <= MSCR_SUBPACKAGES_PER_LINE);
+			for (size_t i = 1; i < cut; i++)
+			{
+				for (const char *c = DAMAGE; *c != '\0'; c++)
+				{
+					char original = copy[i];
+					copy[i] = *c;
+					ParsePackageLine(copy, cut, &parsed);
+					CHECK(parsed.nr_of_subpackages <= MSCR_SUBPACKAGES_PER_LINE);
+					copy[i] = original;
+				}
+			}
+			free(copy);
+		}
+	}
+}
+
+
+//
+// The values of DecodeValueFields() must equal the exact values of the fields, rounded once. A field with
+// an invalid character is decoded as NAN.
+//
+static void TestValueDecoder()
+{
+	const char *fields[MSCR_SUBPACKAGES_PER_LINE];
+	double values[MSCR_SUBPACKAGES_PER_LINE];
+
+	for (const char *p = RESPONSE; *p != '\0'; p = strchr(p, '\n') + 1)
+	{
+		size_t length = strchr(p, '\n') + 1 - p;
+		if (*p != REPLY_MEASURE_DP)
+			continue;
+
+		int count = FindValueFields(p, length, fields, MSCR_SUBPACKAGES_PER_LINE);
+		CHECK(count > 0);
+		DecodeValueFields(fields, count, values);
+		for (int i = 0; i < count; i++)
+		{
+			char digits[8];
+			memcpy(digits, fields[i], 7);
+			digits[7] = '\0';
+			int mantissa = (int)strtol(digits, NULL, 16) - MSCR_PARAM_OFFSET_VALUE;
+			double factor = GetUnitPrefixValue(fields[i][7]);
+			double expected = (factor < 1) ? mantissa / (double)llround(1 / factor) : mantissa * factor;
+			CHECK(values[i] == expected);
+		}
+	}
+
+	const char *invalid[] = { "7F85F3Gu", "7F85F3Fx" };
+	DecodeValueFields(invalid, 2, values);
+	CHECK(isnan(values[0]) && isnan(values[1]));
+}
+
+
+//
+// MSParser must report the same events for every split of the response into chunks
+//
+static void TestParserChunks()
+{
+	static EventList reference, events;
+	size_t total = sizeof(RESPONSE) - 1;
+
+	ParseResponseChunks(&reference, NULL, 0);
+	CHECK(reference.count > 0 && reference.count <= MAX_EVENTS);
+	CHECK(strncmp(reference.text[reference.count - 1], "1 ", 2) == 0);		// CODE_RESPONSE_END
+
+	// Every split into two chunks
+	for (size_t split = 1; split < total; split++)
+	{
+		size_t sizes[1] = { split };
+		ParseResponseChunks(&events, sizes, 1);
+		CHECK(events.count == reference.count && SameEvents(&events, &reference, reference.count));
+	}
+
+	// Chunks of the same size, down to single characters
+	for (size_t size = 1; size <= 64; size++)
+	{
+		size_t sizes[sizeof(RESPONSE)];
+		for (size_t i = 0; i < total; i++)
+			sizes[i] = size;
+		ParseResponseChunks(&events, sizes, (int)total);
+		CHECK(events.count == reference.count && SameEvents(&events, &reference, reference.count));
+	}
+}
+
+
+//
+// A line longer than READ_BUFFER_LENGTH is reported as CODE_OUT_OF_RANGE, also when it arrives in one chunk,
+// and the next line is parsed normally
+//
+static void TestParserLongLine()
+{
+	static const char next[] = "Pda7F85F3Fu;ba48D4DA9p,10,288\n";
+	static char data[READ_BUFFER_LENGTH + sizeof(next) + 1];
+	static EventList events;
+	MSParser parser;
+
+	for (size_t length = READ_BUFFER_LENGTH; length <= READ_BUFFER_LENGTH + 1; length++)
+	{
+		// A package line of `length` characters, including the newline
+		memset(data, '0', length);
+		memcpy(data, "Pda", 3);
+		data[length - 1] = '\n';
+		memcpy(data + length, next, sizeof(next));
+		size_t total = length + sizeof(next) - 1;
+
+		for (size_t split = 0; split < length; split += 37)
+		{
+			events.count = 0;
+			MSParserInit(&parser, OnListEvent, &events);
+			MSParserFeed(&parser, data, split);
+			MSParserFeed(&parser, data + split, total - split);
+			CHECK(events.count == 2 && strncmp(events.text[1], "0 P", 3) == 0);
+			if (length > READ_BUFFER_LENGTH)
+				CHECK(strncmp(events.text[0], "-3 P", 4) == 0);
+			else
+				CHECK(strncmp(events.text[0], "-3 P", 4) != 0);
+		}
+	}
+}
+
+
+//
+// A ring hands out the entries in order, and drops and counts what does not fit.
+// A pool hands out each package once until it is released by all references.
+//
+static void TestRingAndPool()
+{
+	MSRing ring;
+	MSPackagePool pool;
+	MscrPackage *packages[4];
+
+	CHECK(MSRingInit(&ring, 6) == CODE_OUT_OF_RANGE);
+	CHECK(MSRingInit(&ring, 4) == CODE_OK);
+	CHECK(MSPackagePoolInit(&pool, 4) == CODE_OK);
+
+	for (int round = 0; round < 3; round++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			MSRingEntry *entry = MSRingBeginWrite(&ring);
+			CHECK(entry != NULL);
+			if (entry == NULL)
+				return;
+			entry->code = CODE_OK;
+			entry->package = packages[i] = MSPackageAcquire(&pool);
+			entry->reply = 'a' + i;
+			CHECK(entry->package != NULL);
+			MSRingCommitWrite(&ring);
+		}
+		CHECK(MSPackageAcquire(&pool) == NULL);
+		CHECK(MSRingBeginWrite(&ring) == NULL);
+		CHECK(MSRingGetOverflows(&ring) == (unsigned long)round + 1);
+
+		MSPackageRetain(packages[0]);
+		for (int i = 0; i < 4; i++)
+		{
+			const MSRingEntry *entry = MSRingBeginRead(&ring);
+			CHECK(entry != NULL && entry->reply == 'a' + i && entry->package == packages[i]);
+			MSRingEndRead(&ring);
+		}
+		CHECK(MSRingBeginRead(&ring) == NULL);
+
+		// Only the package with the extra reference is still in use
+		MscrPackage *package = MSPackageAcquire(&pool);
+		CHECK(package != NULL && package != packages[0]);
+		MSPackageRelease(package);
+		MSPackageRelease(packages[0]);
+	}
+	CHECK(MSRingGetHighWaterMark(&ring) == 4);
+	MSRingFree(&ring);
+	MSPackagePoolFree(&pool);
+}
+
+
+// State of the in-memory transport of `TestRingReader()`
+typedef struct _TestTransport
+{
+	const char *data;
+	size_t size;
+	size_t position;
+} TestTransport;
+
+
+//
+// Read function of the in-memory transport, hands out the data in small blocks like a serial port
+//
+static int TestReadBuf(void *context, char *buf, int size)
+{
+	TestTransport *transport = context;
+	size_t n = transport->size - transport->position;
+
+	if (n > 7)
+		n = 7;
+	if (n > (size_t)size)
+		n = size;
+	memcpy(buf, transport->data + transport->position, n);
+	transport->position += n;
+	return (int)n;
+}
+
+
+//
+// Write function of the in-memory transport, nothing is sent
+//
+static int TestWriteChar(void *context, char c)
+{
+	(void)context;
+	(void)c;
+	return 1;
+}
+
+
+//
+// Receives `data` with ReceivePackage() until the end of the response or an error, like the ring reader
+//
+static void ReceiveResponse(EventList *list, const char *data)
+{
+	static MscrPackage package;
+	TestTransport context = { data, strlen(data), 0 };
+	MSTransport transport = { 0 };
+	MSComm msComm;
+	RetCode code;
+
+	transport.context = &context;
+	transport.write_char = TestWriteChar;
+	transport.read_buf = TestReadBuf;
+	MSCommInitTransport(&msComm, &transport);
+	list->count = 0;
+	do
+	{
+		code = ReceivePackage(&msComm, &package);
+		OnListEvent(list, code, &msComm.lastReply, 1, &package);
+	} while (code != CODE_RESPONSE_END && code >= 0);
+}
+
+
+//
+// The ring reader passes on everything ReceivePackage() returns, skips and counts damaged package lines,
+// and closes the ring at the end of the response
+//
+static void TestRingReader()
+{
+	static const char damaged[] = "Pda7F85F3Fu;ba48D4DZ9p,10,288\n";
+	static EventList reference, events;
+	static char data[sizeof(RESPONSE) + sizeof(damaged)];
+	TestTransport context = { data, 0, 0 };
+	MSTransport transport = { 0 };
+	MSComm msComm;
+	MSRing ring;
+	MSPackagePool pool;
+	MSRingReader reader;
+	const MSRingEntry *entry;
+
+	// The response with a damaged line after the first package
+	const char *second = strstr(RESPONSE, "Pda7F8A8B1u");
+	memcpy(data, RESPONSE, second - RESPONSE);
+	memcpy(data + (second - RESPONSE), damaged, sizeof(damaged) - 1);
+	strcpy(data + (second - RESPONSE) + sizeof(damaged) - 1, second);
+	context.size = strlen(data);
+
+	ReceiveResponse(&reference, RESPONSE);
+	CHECK(reference.count > 0 && strncmp(reference.text[reference.count - 1], "1 ", 2) == 0);		// CODE_RESPONSE_END
+	transport.context = &context;
+	transport.write_char = TestWriteChar;
+	transport.read_buf = TestReadBuf;
+	CHECK(MSCommInitTransport(&msComm, &transport) == CODE_OK);
+	CHECK(MSRingInit(&ring, 64) == CODE_OK && MSPackagePoolInit(&pool, 64) == CODE_OK);
+	CHECK(MSRingStartReader(&reader, &msComm, &ring, &pool) == CODE_OK);
+
+	events.count = 0;
+	while ((entry = MSRingWaitRead(&ring)) != NULL)
+	{
+		OnListEvent(&events, entry->code, &entry->reply, 1, entry->package);
+		MSRingEndRead(&ring);
+	}
+	CHECK(MSRingJoinReader(&reader) == CODE_RESPONSE_END);
+	CHECK(MSRingGetBadLines(&ring) == 1);
+	CHECK(MSRingGetOverflows(&ring) == 0);
+	CHECK(events.count == reference.count && SameEvents(&events, &reference, reference.count));
+	MSRingFree(&ring);
+	MSPackagePoolFree(&pool);
+}
+
+
+//
+// A dataset has a loop per measurement loop of the response, with a column per variable and the nscans
+// blocks as scans. Only the columns with metadata get metadata arrays.
+//
+static void TestDataset()
+{
+	static const size_t ROWS[] = { 5, 4, 3 };
+	static const int COLUMNS[] = { 2, 2, 5 };
+	static const size_t SCANS[] = { 0, 2, 0 };
+	MSDataset dataset;
+	MSParser parser;
+
+	MSDatasetInit(&dataset, 0);
+	MSParserInit(&parser, MSDatasetOnEvent, &dataset);
+	MSParserFeed(&parser, RESPONSE, sizeof(RESPONSE) - 1);
+	CHECK(dataset.error == CODE_OK && dataset.loopCount == 3);
+
+	for (size_t i = 0; i < dataset.loopCount && i < 3; i++)
+	{
+		const MSDatasetLoop *loop = &dataset.loops[i];
+		CHECK(loop->complete && loop->rowCount == ROWS[i] && loop->columnCount == COLUMNS[i]
+				&& loop->scanCount == SCANS[i]);
+		for (int c = 0; c < loop->columnCount && loop->rowCount == ROWS[i]; c++)
+		{
+			for (size_t row = 0; row < loop->rowCount; row++)
+				CHECK(!isnan(loop->columns[c].values[row]));
+		}
+	}
+	// The values are decoded from the line, not converted from the float of the package
+	if (dataset.loopCount == 3 && dataset.loops[0].rowCount == 5)
+		CHECK(dataset.loops[0].columns[0].values[0] == -499905 / 1e6);
+	if (dataset.loopCount == 3 && dataset.loops[1].scanCount == 2)
+	{
+		const MSDatasetScan *scans = dataset.loops[1].scans;
+		CHECK(scans[0].firstRow == 0 && scans[0].rowCount == 2 && scans[1].firstRow == 2 && scans[1].rowCount == 2);
+	}
+	if (dataset.loopCount == 3 && dataset.loops[2].columnCount == 5 && dataset.loops[2].rowCount == 3)
+	{
+		const MSDatasetColumn *columns = dataset.loops[2].columns;
+		CHECK(columns[0].status == NULL && columns[3].status == NULL && columns[4].status != NULL);
+		if (columns[4].status != NULL)
+			CHECK(columns[4].status[0] == -1 && columns[4].status[1] == -1 && columns[4].status[2] == 0);
+	}
+	MSDatasetFree(&dataset);
+}
+
+
+//
+// Parses a line with and without schema and compares the results
+//
+static void CheckParseParity(MscrPackageSchema *schema, const char *line, size_t length)
+{
+	static MscrPackage plain, withSchema;
+
+	RetCode plainCode = ParsePackageLine(line, length, &plain);
+	RetCode schemaCode = ParsePackageLineWithSchema(schema, line, length, &withSchema);
+	CHECK(plainCode == schemaCode);
+	if (plainCode == CODE_OK && schemaCode == CODE_OK)
+		CHECK(SamePackage(&plain, &withSchema));
+}
+
+
+//
+// ParsePackageLineWithSchema() must return the same as ParsePackageLine() for every line, so also for lines
+// that look like the learned layout but are damaged: cut short or with one character replaced.
+//
+static void TestParseParity()
+{
+	MscrPackageSchema schema;
+	char line[READ_BUFFER_LENGTH];
+
+	ResetPackageSchema(&schema);
+	for (const char *p = RESPONSE; *p != '\0'; p = strchr(p, '\n') + 1)
+	{
+		size_t length = strchr(p, '\n') + 1 - p;
+		if (*p != REPLY_MEASURE_DP)
+			continue;
+
+		CheckParseParity(&schema, p, length);
+		for (size_t cut = 1; cut < length; cut++)
+		{
+			memcpy(line, p, cut);
+			line[cut] = '\n';
+			CheckParseParity(&schema, line, cut + 1);
+			CheckParseParity(&schema, p, length);		// Learns the layout again
+		}
+		for (size_t i = 1; i < length - 1; i++)
+		{
+			for (const char *c = DAMAGE; *c != '\0'; c++)
+			{
+				memcpy(line, p, length);
+				line[i] = *c;
+				CheckParseParity(&schema, line, length);
+				CheckParseParity(&schema, p, length);
+			}
+		}
+	}
+}
+
+
+//
+// Writes RESPONSE as result file, directly or through a record log
+// Returns 0 if successful
+//
+static int WriteResultFile(const char *filename, const char *recordLog)
+{
+	MSResultWriter writer;
+	MSParser parser;
+	MSRecordLogInfo info;
+
+	if (MSResultWriterOpen(&writer, filename, CHUNK_ROWS) != CODE_OK)
+		return -1;
+	if (recordLog != NULL)
+		MSRecordLogRead(recordLog, MSResultWriterOnEvent, &writer, &info);
+	else
+	{
+		MSParserInit(&parser, MSResultWriterOnEvent, &writer);
+		MSParserFeed(&parser, RESPONSE, sizeof(RESPONSE) - 1);
+	}
+	return (MSResultWriterClose(&writer) == CODE_OK) ? 0 : -1;
+}
+
+
+//
+// Checks that the loops of a result file opened from a truncated copy are a part of the complete file
+//
+static void CheckTruncatedResults(const MSResultFile *complete, const MSResultFile *file)
+{
+	CHECK(file->loopCount <= complete->loopCount);
+	for (uint32_t i = 0; i < file->loopCount && i < complete->loopCount; i++)
+	{
+		const MSResultLoop *loop = &file->loops[i];
+		const MSResultLoop *full = &complete->loops[i];
+		CHECK(loop->columnCount == full->columnCount && loop->rowCount <= full->rowCount);
+		if (loop->columnCount != full->columnCount)
+			continue;
+
+		for (uint32_t c = 0; c < loop->chunkCount; c++)
+		{
+			const MSResultChunk *chunk = &loop->chunks[c];
+			CHECK(c < full->chunkCount && chunk->firstRow == full->chunks[c].firstRow && chunk->rowCount == full->chunks[c].rowCount);
+			if (c >= full->chunkCount || chunk->rowCount != full->chunks[c].rowCount)
+				continue;
+			for (uint32_t column = 0; column < loop->columnCount; column++)
+			{
+				const double *values = MSResultGetValues(file, loop, chunk, column);
+				const double *fullValues = MSResultGetValues(complete, full, &full->chunks[c], column);
+				CHECK(memcmp(values, fullValues, chunk->rowCount * sizeof(double)) == 0);
+			}
+		}
+	}
+}
+
+
+//
+// MSResultFileOpen() must open every truncated copy of a result file, or reject it, without reading outside
+// the file, and may only return complete chunks
+//
+static void TestResultFileTruncated()
+{
+	char filename[PATH_LENGTH], truncated[PATH_LENGTH];
+	TestFile(filename, "response.msres");
+	TestFile(truncated, "truncated.msres");
+	MSResultFile complete, file;
+	size_t size;
+
+	CHECK(WriteResultFile(filename, NULL) == 0);
+	CHECK(MSResultFileOpen(&complete, filename) == CODE_OK);
+	CHECK(complete.loopCount == 3 && !complete.recovered);
+
+	char *data = ReadWholeFile(filename, &size);
+	CHECK(data != NULL);
+	if (data == NULL)
+		return;
+
+	for (size_t length = 0; length < size; length++)
+	{
+		CHECK(WriteWholeFile(truncated, data, length) == 0);
+		RetCode code = MSResultFileOpen(&file, truncated);
+		CHECK(code == CODE_OK || code == CODE_UNEXPECTED_DATA || code == CODE_ERROR);
+		if (code != CODE_OK)
+			continue;
+		CHECK(file.recovered);
+		CheckTruncatedResults(&complete, &file);
+		MSResultFileClose(&file);
+	}
+	MSResultFileClose(&complete);
+	free(data);
+}
+
+
+//
+// Writes RESPONSE as record log
+// Returns 0 if successful
+//
+static int WriteRecordLog(const char *filename)
+{
+	MSRecordLog log;
+	MSParser parser;
+
+	remove(filename);
+	if (MSRecordLogOpen(&log, filename, 10, 0) != CODE_OK)
+		return -1;
+	MSParserInit(&parser, MSRecordLogOnEvent, &log);
+	MSParserFeed(&parser, RESPONSE, sizeof(RESPONSE) - 1);
+	return (MSRecordLogClose(&log) == CODE_OK) ? 0 : -1;
+}
+
+
+//
+// Recovers a damaged copy of a record log and checks that exactly the records before the damage are kept
+//
+static void CheckRecoveredLog(const char *data, size_t size, size_t damageOffset, const EventList *reference,
+		size_t headerSize)
+{
+	static EventList events;
+	char filename[PATH_LENGTH];
+	TestFile(filename, "damaged.mslog");
+	MSRecordLogInfo info;
+
+	CHECK(WriteWholeFile(filename, data, size) == 0);
+	RetCode code = MSRecordLogRecover(filename, &info);
+	if (damageOffset < headerSize)
+	{
+		// A damaged header can not be recovered
+		CHECK(code == CODE_UNEXPECTED_DATA || code == CODE_ERROR || (code == CODE_OK && info.records == 0));
+		return;
+	}
+	CHECK(code == CODE_OK);
+	CHECK(info.validSize <= damageOffset);
+
+	events.count = 0;
+	CHECK(MSRecordLogRead(filename, OnListEvent, &events, &info) == CODE_OK);
+	CHECK((uint64_t)events.count == info.records);
+	CHECK(SameEvents(&events, reference, events.count));
+}
+
+
+//
+// MSRecordLogRecover() must keep all records before the end of a truncated log, and all records before
+// the damaged record of a log with one flipped bit
+//
+static void TestRecordLogRecover()
+{
+	static EventList reference, events;
+	char filename[PATH_LENGTH];
+	TestFile(filename, "response.mslog");
+	MSRecordLogInfo info;
+	size_t size, headerSize;
+
+	// The size of the header is the size of a log without records
+	MSRecordLog log;
+	remove(filename);
+	CHECK(MSRecordLogOpen(&log, filename, 10, 0) == CODE_OK && MSRecordLogClose(&log) == CODE_OK);
+	free(ReadWholeFile(filename, &headerSize));
+	CHECK(headerSize > 0);
+
+	ParseResponseChunks(&reference, NULL, 0);
+	CHECK(WriteRecordLog(filename) == 0);
+	CHECK(MSRecordLogRead(filename, OnListEvent, &events, &info) == CODE_OK);
+	CHECK(events.count == reference.count && SameEvents(&events, &reference, reference.count));
+
+	char *data = ReadWholeFile(filename, &size);
+	CHECK(data != NULL && size == info.validSize);
+	if (data == NULL)
+		return;
+
+	for (size_t length = 0; length < size; length++)
+		CheckRecoveredLog(data, length, length, &reference, headerSize);
+
+	for (size_t offset = 0; offset < size; offset++)
+	{
+		if (offset == offsetof(MSRecordFileHeader, reserved))
+			continue;		// Not checked by the reader
+		for (int bit = 0; bit < 8; bit += 3)
+		{
+			data[offset] ^= 1 << bit;
+			CheckRecoveredLog(data, size, offset, &reference, headerSize);
+			data[offset] ^= 1 << bit;
+		}
+	}
+	free(data);
+}
+
+
+//
+// A record log stores the reply character, so it converts to the same result file and dataset as the
+// response itself, with the nscans blocks as scans
+//
+static void TestRecordLogConversion()
+{
+	char recordLog[PATH_LENGTH], direct[PATH_LENGTH], converted[PATH_LENGTH];
+	TestFile(recordLog, "response.mslog");
+	TestFile(direct, "direct.msres");
+	TestFile(converted, "converted.msres");
+	MSDataset fromResponse, fromLog;
+	MSParser parser;
+	MSRecordLogInfo info;
+	size_t directSize, convertedSize;
+
+	CHECK(WriteRecordLog(recordLog) == 0);
+	CHECK(WriteResultFile(direct, NULL) == 0);
+	CHECK(WriteResultFile(converted, recordLog) == 0);
+
+	char *directData = ReadWholeFile(direct, &directSize);
+	char *convertedData = ReadWholeFile(converted, &convertedSize);
+	CHECK(directData != NULL && convertedData != NULL && directSize == convertedSize
+			&& memcmp(directData, convertedData, directSize) == 0);
+	free(directData);
+	free(convertedData);
+
+	MSDatasetInit(&fromResponse, 0);
+	MSDatasetInit(&fromLog, 0);
+	MSParserInit(&parser, MSDatasetOnEvent, &fromResponse);
+	MSParserFeed(&parser, RESPONSE, sizeof(RESPONSE) - 1);
+	CHECK(MSRecordLogRead(recordLog, MSDatasetOnEvent, &fromLog, &info) == CODE_OK);
+
+	CHECK(fromResponse.error == CODE_OK && fromLog.error == CODE_OK);
+	CHECK(fromResponse.loopCount == 3 && fromLog.loopCount == 3);
+	for (size_t i = 0; i < fromResponse.loopCount && i < fromLog.loopCount; i++)
+	{
+		const MSDatasetLoop *a = &fromResponse.loops[i];
+		const MSDatasetLoop *b = &fromLog.loops[i];
+		CHECK(a->rowCount == b->rowCount && a->scanCount == b->scanCount && a->columnCount == b->columnCount
+				&& a->complete && b->complete);
+		for (size_t s = 0; s < a->scanCount && s < b->scanCount; s++)
+			CHECK(a->scans[s].firstRow == b->scans[s].firstRow && a->scans[s].rowCount == b->scans[s].rowCount);
+	}
+	CHECK(fromResponse.loopCount == 3 && fromResponse.loops[1].scanCount == 2);
+	MSDatasetFree(&fromResponse);
+	MSDatasetFree(&fromLog);
+}
+
+
+//
+// Returns the number of significant digits of a text written by `MSCsvFormatFloat()`
+//
+static int CountDigits(const char *text)
+{
+	int count = 0, significant = 0;
+
+	for (const char *p = text; *p != '\0' && *p != 'E'; p++)
+	{
+		if (*p >= '1' && *p <= '9')
+			significant = count = count + 1;
+		else if (*p == '0' && count > 0)
+			count++;
+	}
+	return significant;
+}
+
+
+//
+// MSCsvFormatFloat() must write a text that converts back to the same float, with no more digits than
+// the shortest "%.*g" text that does. Near the midpoint to a neighbouring float the digits have to be exact.
+//
+static void TestCsvFormatFloat()
+{
+	static const struct { float value; const char *text; } EXPECTED[] = {
+		{ -0x1.89537ap-34f, "-8.9432E-11" },
+		{ -0x1.29e0b8p-13f, "-0.0001420392" },
+		{ 0x1p-96f, "1.2621775E-29" },		// Shorter than "%.9g", the float below a power of 2 is closer
+		{ 0.495f, "0.495" },
+		{ -1e-9f, "-1E-09" },
+	};
+	char text[MSCSV_MAX_VALUE_LENGTH + 1], shortest[32];
+	uint32_t bits = 1;
+
+	for (size_t i = 0; i < sizeof(EXPECTED) / sizeof(EXPECTED[0]); i++)
+	{
+		text[MSCsvFormatFloat(text, EXPECTED[i].value)] = '\0';
+		CHECK(strcmp(text, EXPECTED[i].text) == 0);
+	}
+	for (int i = 0; i < 200000; i++)
+	{
+		float value;
+		bits = bits * 1664525 + 1013904223;
+		memcpy(&value, &bits, sizeof(value));
+		if (!isfinite(value))
+			continue;
+
+		text[MSCsvFormatFloat(text, value)] = '\0';
+		CHECK(strtof(text, NULL) == value);
+		int digits = 1;
+		while (snprintf(shortest, sizeof(shortest), "%.*g", digits, value) > 0 && strtof(shortest, NULL) != value)
+			digits++;
+		CHECK(value == 0 || CountDigits(text) <= digits);
+	}
+}
+
+
+// The events of a parser as a count and a hash of their text, see `FormatEvent()`
+typedef struct _EventHash
+{
+	long count;
+	uint64_t hash;
+} EventHash;
+
+
+//
+// MSParserEventFunc that adds the events to an EventHash
+//
+static void OnHashEvent(void *context, RetCode event, const char *line, size_t length, const MscrPackage *package)
+{
+	EventHash *events = context;
+	char text[EVENT_TEXT_LENGTH];
+
+	FormatEvent(text, event, line, length, package);
+	for (const char *p = text; *p != '\0'; p++)
+		events->hash = (events->hash ^ (unsigned char)*p) * 0x100000001B3;		// FNV-1a
+	events->hash = (events->hash ^ '\n') * 0x100000001B3;
+	events->count++;
+}
+
+
+//
+// MSBatchParseFileInOrder() must report the same events in the same order as one MSParser, for any
+// number of threads, so an event function like `MSDatasetOnEvent()` can be passed to it
+//
+static void TestBatchInOrder()
+{
+	char filename[PATH_LENGTH];
+	TestFile(filename, "batch.log");
+	EventHash reference = { 0, 0 };
+	MSParser parser;
+	size_t size = sizeof(RESPONSE) - 1;
+	char *data = malloc(size * BATCH_RESPONSES);
+
+	CHECK(data != NULL);
+	if (data == NULL)
+		return;
+	for (int i = 0; i < BATCH_RESPONSES; i++)
+		memcpy(data + i * size, RESPONSE, size);
+	CHECK(WriteWholeFile(filename, data, size * BATCH_RESPONSES) == 0);
+	MSParserInit(&parser, OnHashEvent, &reference);
+	MSParserFeed(&parser, data, size * BATCH_RESPONSES);
+	free(data);
+	CHECK(size * BATCH_RESPONSES > 2 * MSBATCH_MIN_CHUNK_SIZE);
+
+	for (int threads = 1; threads <= 4; threads++)
+	{
+		EventHash events = { 0, 0 };
+		CHECK(MSBatchParseFileInOrder(filename, threads, OnHashEvent, &events) == CODE_OK);
+		CHECK(events.count == reference.count && events.hash == reference.hash);
+	}
+
+	MSDataset dataset;
+	MSDatasetInit(&dataset, 0);
+	CHECK(MSBatchParseFileInOrder(filename, 3, MSDatasetOnEvent, &dataset) == CODE_OK);
+	CHECK(dataset.error == CODE_OK && dataset.loopCount == 3 * BATCH_RESPONSES);
+	MSDatasetFree(&dataset);
+}
+
+
+//
+// Runs one test and prints its result
+//
+static void RunTest(const char *name, void (*test)())
+{
+	int failures = s_failures;
+	test();
+	printf("%-24s %s\n", name, (s_failures == failures) ? "ok" : "FAILED");
+}
+
+
+int main()
+{
+	if (mkdtemp(s_directory) == NULL)
+	{
+		printf("Could not create a directory in /tmp\n");
+		return 1;
+	}
+
+	RunTest("ParsePackageLine", TestParsePackageLine);
+	RunTest("ValueDecoder", TestValueDecoder);
+	RunTest("ParserChunks", TestParserChunks);
+	RunTest("ParserLongLine", TestParserLongLine);
+	RunTest("RingAndPool", TestRingAndPool);
+	RunTest("RingReader", TestRingReader);
+	RunTest("Dataset", TestDataset);
+	RunTest("ParseParity", TestParseParity);
+	RunTest("ResultFileTruncated", TestResultFileTruncated);
+	RunTest("RecordLogRecover", TestRecordLogRecover);
+	RunTest("RecordLogConversion", TestRecordLogConversion);
+	RunTest("CsvFormatFloat", TestCsvFormatFloat);
+	RunTest("BatchInOrder", TestBatchInOrder);
+
+	if (s_failures > 0)
+	{
+		printf("%d checks failed, the files are in %s\n", s_failures, s_directory);
+		return 1;
+	}
+	const char *files[] = { "response.msres", "truncated.msres", "response.mslog", "damaged.mslog",
+			"direct.msres", "converted.msres", "batch.log" };
+	for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+	{
+		char path[PATH_LENGTH];
+		remove(TestFile(path, files[i]));
+	}
+	rmdir(s_directory);
+	printf("All tests passed\n");
+	return 0;
+}
@@ -0,0 +1,256 @@
+/* ----------------------------------------------------------------------------
+ *         PalmSens MethodSCRIPT SDK
+ * ----------------------------------------------------------------------------
+ ============================================================================
+ Name        : SerialLoadTest.c
+ Copyright   :
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2019-2020, PalmSens BV
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the disclaimer below.
+ *
+ * PalmSens's name may not be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * DISCLAIMER: THIS SOFTWARE IS PROVIDED BY PALMSENS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * DISCLAIMED. IN NO EVENT SHALL PALMSENS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * ----------------------------------------------------------------------------
+ Description :
+ * ----------------------------------------------------------------------------
+ * Load test of the ways MSComm can read from a serial port, using a pseudo-terminal (Linux only).
+ *	A child process plays an EmStat Pico that sends a number of packages as fast as possible. They
+ *	are received with `ReceivePackage()` once with every way of reading:
+ *	  - read() per byte: a ReadCharFunc that calls read() for every character, like `ReadFromDevice()`
+ *	    of the original SDK
+ *	  - ring: `SerialPortReadChar()`, which hands out characters from the receive ring of the port
+ *	  - block: `SerialPortReadBlock()` as ReadBufFunc, which reads into the receive buffer of MSComm
+ *	  - block + poll(): the transport of `SerialPortGetTransport()`, which also waits for data with poll()
+ *	The first three poll the port when no data is available, like the original SDK. For every way the
+ *	number of read system calls (`syscr` of /proc/self/io), the CPU time and the context switches of the
+ *	receiving process are printed.
+ *
+ *	This is a separate program, it is not part of the example project. Build it from the project
+ *	directory with:
+ *	  gcc -O2 -I. -ISerialPort -IMethodSCRIPTcomm Tools/SerialLoadTest.c SerialPort/SerialPortLinux.c
+ *	      MethodSCRIPTcomm/MSComm.c -o SerialLoadTest -lutil -lm
+ *	Usage:
+ *	  ./SerialLoadTest [packages]
+ *
+ ============================================================================
+ */
+
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "MethodSCRIPTcomm/MSComm.h"
+#include "SerialPort/SerialPort.h"
+
+
+#define DEFAULT_PACKAGES	20000
+
+// Number of packages sent at once
+#define PACKAGES_PER_WRITE	16
+
+static const char PACKAGE_LINE[] = "Pda7F85F3Fu;ba48D4DA9p,10,288\n";
+
+// The ways of reading that are compared
+typedef enum _ReadMethod
+{
+	READ_PER_BYTE,
+	READ_RING,
+	READ_BLOCK,
+	READ_BLOCK_POLL,
+	READ_METHODS
+} ReadMethod;
+
+static const char *METHOD_NAMES[READ_METHODS] = { "read() per byte", "ring", "block", "block + poll()" };
+
+
+//
+// Reads one character with one read() call, like `ReadFromDevice()` of the original SDK.
+// Returns the character, 0 if no character was read or -1 if none was available.
+//
+static int ReadPerByte(void *port)
+{
+	char c;
+	int n = (int)read(((SerialPort *)port)->fd, &c, 1);
+
+	if (n > 0)
+		return c;
+	return (n == 0) ? 0 : -1;
+}
+
+
+//
+// Sends `packages` packages to the pseudo-terminal in small writes
+//
+static void Simulate(int master, long packages)
+{
+	char block[sizeof(PACKAGE_LINE) * PACKAGES_PER_WRITE];
+	size_t lineLength = sizeof(PACKAGE_LINE) - 1;
+
+	for (int i = 0; i < PACKAGES_PER_WRITE; i++)
+		memcpy(block + i * lineLength, PACKAGE_LINE, lineLength);
+
+	for (long sent = 0; sent < packages; sent += PACKAGES_PER_WRITE)
+	{
+		long n = (packages - sent < PACKAGES_PER_WRITE) ? packages - sent : PACKAGES_PER_WRITE;
+		if (write(master, block, n * lineLength) < 0)
+			_exit(1);
+	}
+	// Closing the pseudo-terminal would discard the data that was not read yet, so keep it
+	// open until the test is done.
+	pause();
+	_exit(0);
+}
+
+
+//
+// Returns the CPU time used by this process in seconds
+//
+static double CpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+
+//
+// Returns the number of context switches of this process
+//
+static long ContextSwitches()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+
+//
+// Returns the number of read system calls of this process, or -1 if it is not available
+//
+static long ReadCalls()
+{
+	FILE *fp = fopen("/proc/self/io", "r");
+	char line[64];
+	long calls = -1;
+
+	if (fp == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (sscanf(line, "syscr: %ld", &calls) == 1)
+			break;
+	}
+	fclose(fp);
+	return calls;
+}
+
+
+//
+// Receives the packages with one way of reading
+// Returns 0 if all packages were received
+//
+static int RunTest(ReadMethod method, long packages)
+{
+	SerialPort port;
+	MSTransport transport;
+	MSComm msComm;
+	MscrPackage package;
+	struct timespec start, end;
+	char name[64];
+	int master, slave;
+	long received = 0;
+	long errors = 0;
+
+	if (openpty(&master, &slave, name, NULL, NULL) < 0 || !SerialPortOpen(&port, name, 230400))
+	{
+		printf("Could not create pseudo-terminal\n");
+		return -1;
+	}
+	close(slave);
+
+	SerialPortGetTransport(&port, &transport);
+	if (method != READ_BLOCK_POLL)
+		transport.wait_read = NULL;
+	if (method != READ_BLOCK && method != READ_BLOCK_POLL)
+		transport.read_buf = NULL;
+	if (method == READ_PER_BYTE)
+		transport.read_char = ReadPerByte;
+	MSCommInitTransport(&msComm, &transport);
+
+	double cpu = CpuTime();
+	long switches = ContextSwitches();
+	long calls = ReadCalls();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid_t child = fork();
+	if (child == 0)
+		Simulate(master, packages);
+	close(master);
+
+	while (received + errors < packages)
+	{
+		RetCode code = ReceivePackage(&msComm, &package);
+		if (code == CODE_OK)
+			received++;
+		else if (code == CODE_TIMEOUT || code == CODE_ERROR)
+			break;
+		else
+			errors++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	calls = ReadCalls() - calls;
+	cpu = CpuTime() - cpu;
+	switches = ContextSwitches() - switches;
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+	SerialPortClose(&port);
+
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	printf("%-16s %8ld packages %6ld errors %8.3f s %10ld read calls %8.3f s CPU %8ld context switches\n",
+			METHOD_NAMES[method], received, errors, seconds, calls, cpu, switches);
+	return (received == packages && errors == 0) ? 0 : -1;
+}
+
+
+int main(int argc, char *argv[])
+{
+	long packages = (argc > 1) ? atol(argv[1]) : DEFAULT_PACKAGES;
+	int result = 0;
+
+	if (packages <= 0)
+	{
+		printf("Usage: %s [packages]\n", argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%ld packages of %zu characters\n", packages, sizeof(PACKAGE_LINE) - 1);
+	for (int method = 0; method < READ_METHODS; method++)
+		result |= RunTest(method, packages);
+	return result ? 1 : 0;
+}